@@ -0,0 +1,61 @@
+/**
+ * @file asset_index.h
+ * @brief Index of the files in assets/to_send, built once at startup and kept
+ *        current with inotify. It holds the resolved assets root, each file's size,
+ *        modification time and content hash (computed on first use), and up to
+ *        ASSET_FD_CACHE open descriptors, so a send resolves its file with one hash
+ *        lookup instead of walking the path from the working directory.
+ *        Only regular files below to_send are indexed (no hidden entries, no
+ *        symlinks); anything else, and every platform without inotify, falls
+ *        back to resolve_asset_path().
+ * @author Oussama Amara
+ * @version 1.0
+ * @date 2026-10-17
+ */
+
+#ifndef ASSET_INDEX_H
+#define ASSET_INDEX_H
+
+#include "content_store.h"
+#include <stdio.h>
+
+#define ASSET_FD_CACHE 32        ///< Descriptors kept open (least recently used closed first)
+#define ASSET_INDEX_BUCKETS 1024 ///< Hash buckets of file names
+#define ASSET_INDEX_MAX_DEPTH 8  ///< Deepest directory below to_send that is indexed
+
+/**
+ * @brief What the index knows of one file.
+ */
+typedef struct {
+    long long size;   ///< Bytes
+    long long mtime;  ///< Modification time (seconds)
+} AssetInfo;
+
+/**
+ * @brief Resolves the assets root, indexes assets/to_send and starts watching it.
+ *        Call once at startup, before any other thread resolves asset paths.
+ */
+void asset_index_init(void);
+
+/**
+ * @brief Opens an indexed file of assets/to_send without resolving its path.
+ * @param name Path below to_send ("docs/a.txt").
+ * @param positional 1 if the caller only reads at explicit offsets (pread(),
+ *        sendfile()): it gets a duplicate of the cached descriptor, sharing its
+ *        file position. 0 for sequential readers, which get a descriptor of their own.
+ * @param[out] info Size and modification time from the index.
+ * @return The file (close with fclose()), or NULL if it is not indexed.
+ */
+FILE* asset_index_open(const char* name, int positional, AssetInfo* info);
+
+/**
+ * @brief Content hash of a file of assets/to_send, remembered until inotify
+ *        reports a change. Files the index does not hold are hashed through
+ *        content_hash_cached(). Safe to call from several threads.
+ * @param name Path below to_send.
+ * @param[out] hash Receives CONTENT_HASH_LEN hex digits and a NUL.
+ * @return 0 on success, -1 if the file cannot be read.
+ */
+int asset_index_hash(const char* name, char* hash);
+
+#endif // ASSET_INDEX_H
@@ -48,9 +48,10 @@ void init_chat_buffers();
 
 /**
  * @brief Buffers a chunked chat message for later reassembly.
- * @param[in] cmd ParsedCommand containing chunk data.
+ *        The chunk payload is copied out of the view.
+ * @param[in] view Frame view containing chunk data.
  */
-void buffer_chat_chunk(const ParsedCommand* cmd);
+void buffer_chat_chunk(const FrameView* view);
 
 /**
  * @brief Reassembles a full chat message from buffered chunks.
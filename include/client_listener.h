@@ -3,18 +3,45 @@
  * @brief Declares listener thread for incoming frame handling.
  *        Used by client_main.c to enable real-time message reception.
  * @author Oussama Amara
- * @version 1.0
- * @date 2025-09-21
+ * @version 1.6
+ * @date 2026-10-17
  */
 
 #ifndef CLIENT_LISTENER_H
 #define CLIENT_LISTENER_H
 
 #include "platform_thread.h"
+#include "framing.h"
+#include "file_transfer.h"
+
+/**
+ * @brief State handed to the listener thread.
+ *        The receive buffer may already hold frames read during the handshake.
+ */
+typedef struct {
+    int sockfd;          ///< Connected socket
+    RecvBuffer* rbuf;    ///< Receive buffer shared with the handshake
+    int want_binary;     ///< 1 to accept the server's binary v2 offer
+    int want_crc32c;     ///< 1 to accept the server's CRC32C offer
+    int want_raw;        ///< 1 to accept raw data phases for file bodies
+    int want_lz4;        ///< 1 to accept LZ4 payload compression (binary frames only)
+    int chunk_size;      ///< File chunk size asked for in READY (0 = server default)
+    const char* host;    ///< Server address, for the extra connections of split files
+    int port;            ///< Server port, for the extra connections of split files
+    int streams;         ///< Connections a large chunked file is split across
+    int is_stream;       ///< 1 on an extra connection that carries one range of a file
+    int stream_done;     ///< Set when the range's DONE arrives; the stream then closes
+    char request[MAX_MESSAGE_LENGTH]; ///< RESUME payload a stream sends after CAPS ("" = none)
+    int request_chunk;   ///< Chunk size carried in the stream's RESUME
+    int request_dest;    ///< Whom the stream's RESUME goes to (0 = the server, else the relaying client)
+    RawReceive raw;      ///< Raw data phase in progress (raw.remaining > 0)
+} ListenerContext;
 
 /**
  * @brief Background thread that listens for incoming frames and displays them.
- * @param arg Pointer to socket descriptor (int*).
+ *        The main listener also registers the opener of extra file streams;
+ *        stream listeners (is_stream) stop after their range is done.
+ * @param arg Pointer to ListenerContext.
  * @return THREAD_FUNC return value.
  */
 THREAD_FUNC client_listener(void* arg);
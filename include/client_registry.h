@@ -1,11 +1,13 @@
 /**
  * @file client_registry.h
- * @brief Manages client registrations, IDs, and activity tracking.
- *      Supports up to MAX_CLIENTS simultaneous clients.
- *     Tracks last activity for timeout handling.
- *   @date 2025-09-14
+ * @brief Manages client registrations and IDs.
+ *      Supports up to REGISTRY_MAX_CLIENTS simultaneous clients in slab-allocated slots.
+ *     Lookups by ID or socket are O(1) and lock-free; only register/unregister lock.
+ *     IDs carry a slot generation, so a stale ID never resolves to a reused slot.
+ *     Inactivity timeouts are per-connection timers in the reactor.
+ *   @date 2026-10-17
  *  @author Oussama Amara
- * @version 0.1
+ * @version 0.3
  */
 #ifndef CLIENT_REGISTRY_H
 #define CLIENT_REGISTRY_H
@@ -22,21 +24,43 @@
 #include <stdio.h>
 
 
+/**
+ * @brief Client ID layout: (generation << REGISTRY_SLOT_BITS) | (slot + 1).
+ *        IDs are always > 0 (0 is the server) and fit in a positive int.
+ */
+#define REGISTRY_SLOT_BITS 17
+#define REGISTRY_SLOT_MASK ((1 << REGISTRY_SLOT_BITS) - 1)
+#define REGISTRY_GEN_MASK  ((1 << (31 - REGISTRY_SLOT_BITS)) - 1)
+
 /**
  * @brief Maximum number of simultaneous clients.
  */
-#define MAX_CLIENTS 64
+#define REGISTRY_MAX_CLIENTS REGISTRY_SLOT_MASK
+
 /**
- * @brief Inactivity timeout in seconds.
+ * @brief Slots per slab; slabs are allocated as the registry grows and never freed.
+ */
+#define REGISTRY_SLAB_SIZE 4096
+
+/**
+ * @brief One registry slot. Readers access id/socket atomically.
  */
 typedef struct {
-    int id;
-    int socket;
-    struct sockaddr_in addr;
-    time_t last_activity;
-    int active;
+    int id;                   ///< Current client ID, 0 while the slot is free
+    int socket;               ///< Client socket descriptor
+    struct sockaddr_in addr;  ///< Peer address
+    int generation;           ///< Bumped every time the slot is released (0 on first use)
+    int next_free;            ///< Free-list link (slot index, -1 = end)
     char name[32]; // Optional: for future name-based routing
 } ClientInfo;
+
+/**
+ * @brief Callback for registry_foreach().
+ * @param id Client ID.
+ * @param socket Client socket descriptor.
+ * @param ctx Caller context.
+ */
+typedef void (*RegistryVisitor)(int id, int socket, void* ctx);
 /** 
  * @brief Initializes the client registry.
  * @param void
@@ -62,30 +86,26 @@ int get_socket_by_id(int id);
  * @return Client ID, or -1 if not found.
  */
 int get_id_by_socket(int socket);
-/**
- * @brief Updates the last activity timestamp for a client.
- * @param id Client ID.
- * @return void
- * 
- */
-void update_activity(int id);
 /**
  * @brief Unregisters a client by ID.
+ *        The socket is left open; closing it is up to the connection owner.
  * @param id Client ID.
  * @return void
  */
 void unregister_client(int id);
-/**
- * @brief Checks for clients that have timed out and unregisters them.
- * @param timeout_seconds Inactivity timeout in seconds.
- * @return void
- */
-void check_timeouts(int timeout_seconds);
 /**
  * @brief Returns the number of currently active clients.
  * @param void
  * @return Number of active clients.
  */
 int has_active_clients();
+/**
+ * @brief Calls visit for every registered client (lock-free snapshot walk;
+ *        clients joining or leaving meanwhile may or may not be seen).
+ * @param visit Callback.
+ * @param ctx Context forwarded to visit.
+ * @return void
+ */
+void registry_foreach(RegistryVisitor visit, void* ctx);
 
 #endif
@@ -3,8 +3,8 @@
  * @brief Configuration structure for client and server applications.
  *        Server uses multi-port routing; client uses single-port feature selection.
  * @author Oussama Amara
- * @version 0.9
- * @date 2025-09-07
+ * @version 1.7
+ * @date 2026-10-17
  */
 
 #ifndef CONFIG_H
@@ -19,6 +19,21 @@ typedef struct {
     int port_chat;       ///< Server port for chat service
     int port_file;       ///< Server port for file service
     int port_game;       ///< Server port for game service
+    int reactors;        ///< Server event-loop threads (0 = one per CPU)
+    int pin_cpus;        ///< 1 to pin reactor i to CPU i
+    int binary_protocol; ///< Client: 1 to accept binary v2 frames when offered
+    int crc32c;          ///< Client: 1 to accept CRC32C checksums when offered
+    int raw_transfer;    ///< Client: 1 to receive file bodies as raw data phases when offered
+    int compression;     ///< Client: 1 to accept LZ4 payload compression when offered
+    int chunk_size;      ///< Client: file chunk size to ask for (bytes, 0 = server default)
+    int file_window;     ///< Server: file chunks a transfer may have in flight
+    int max_transfers;   ///< Server: chunked transfers sending at once (0 = unlimited)
+    long long transfer_rate;   ///< Server: bytes per second of one transfer (0 = unlimited)
+    long long total_rate;      ///< Server: bytes per second of all transfers (0 = unlimited)
+    long long background_size; ///< Server: transfers of at least this many bytes use idle bandwidth only (0 = off)
+    long long hot_cache_size;  ///< Server: bytes of encoded chunk frames kept for popular files (0 = off)
+    int streams;         ///< Client: connections a large chunked file is split across
+    int relay;           ///< Client: 1 to send its own files, relayed by the server
 } Config;
 
 int load_config(const char* path, Config* cfg);
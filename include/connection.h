@@ -40,6 +40,24 @@ void create_socket(int* sockfd);
  */
 void socket_bind(struct sockaddr_in* servaddr, int* sockfd);
 
+/**
+ * @brief Allows several sockets to bind the same address and port.
+ *        The kernel then spreads incoming connections across them (SO_REUSEPORT).
+ * @param[in] sockfd Pointer to socket descriptor (must not be bound yet).
+ * @return 0 on success, -1 if the platform does not support port sharing.
+ */
+int socket_reuseport(int* sockfd);
+
+/**
+ * @brief Creates, binds and starts a listening socket on host:port.
+ *        Exits on failure, like the primitives it is built from.
+ * @param[in] host IPv4 address to bind.
+ * @param[in] port Port to bind.
+ * @param[in] reuseport Non-zero to share the port with other listeners.
+ * @return Listening socket descriptor.
+ */
+int open_listener(const char* host, int port, int reuseport);
+
 /**
  * @brief Starts listening on a bound socket.
  * @param[in] sockfd Pointer to socket descriptor.
@@ -55,4 +73,23 @@ void socket_listening(int* sockfd);
  */
 void socket_accept(int* connfd, int* sockfd, struct sockaddr_in* cli, int* len);
 
+/**
+ * @brief Switches a socket to non-blocking mode.
+ * @param[in] sockfd Socket descriptor.
+ * @return 0 on success, -1 on failure.
+ */
+int socket_set_nonblocking(int sockfd);
+
+/**
+ * @brief Reports whether the last socket call failed only because it would block.
+ * @return 1 if the operation should be retried on readiness, 0 otherwise.
+ */
+int socket_would_block(void);
+
+/**
+ * @brief Closes a socket descriptor (closesocket on Windows, close elsewhere).
+ * @param[in] sockfd Socket descriptor.
+ */
+void socket_close(int sockfd);
+
 #endif // CONNECTION_H
@@ -0,0 +1,96 @@
+/**
+ * @file content_store.h
+ * @brief Content-addressed store of received files, used to skip redundant transfers.
+ *        The server announces a file's content hash in INCOMING; a receiver that
+ *        already stored a blob with that hash (assets/received/.store/<hash>)
+ *        links or copies it into place and answers HAVE instead of READY.
+ * @author Oussama Amara
+ * @version 1.1
+ * @date 2026-10-17
+ */
+
+#ifndef CONTENT_STORE_H
+#define CONTENT_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CONTENT_HASH_LEN 24 ///< Hex digits of a content hash: 64-bit FNV-1a, then CRC32C
+
+/**
+ * @brief Running content hash of bytes seen so far.
+ */
+typedef struct {
+    uint64_t fnv;  ///< 64-bit FNV-1a
+    uint32_t crc;  ///< CRC32C
+} ContentHasher;
+
+/**
+ * @brief Prepares the hash cache. Call once before any transfer.
+ */
+void content_store_init(void);
+
+/**
+ * @brief Starts a content hash.
+ */
+void content_hash_begin(ContentHasher* h);
+
+/**
+ * @brief Adds bytes to a content hash.
+ */
+void content_hash_update(ContentHasher* h, const void* data, size_t len);
+
+/**
+ * @brief Formats a content hash.
+ * @param[out] hash Receives CONTENT_HASH_LEN hex digits and a NUL.
+ */
+void content_hash_end(const ContentHasher* h, char* hash);
+
+/**
+ * @brief Hashes a file's content.
+ * @param path File to hash.
+ * @param[out] hash Receives CONTENT_HASH_LEN hex digits and a NUL.
+ * @return 0 on success, -1 if the file cannot be read.
+ */
+int content_hash_file(const char* path, char* hash);
+
+/**
+ * @brief Hash of a file to send, remembered while its size and modification
+ *        time stay the same so a file offered again is not read again.
+ *        Safe to call from several threads.
+ * @param path File to hash.
+ * @param[out] hash Receives CONTENT_HASH_LEN hex digits and a NUL.
+ * @return 0 on success, -1 if the file cannot be read.
+ */
+int content_hash_cached(const char* path, char* hash);
+
+/**
+ * @brief Splits an INCOMING payload ("<hash>,<filename>", or a bare filename).
+ * @param payload INCOMING payload.
+ * @param[out] hash Receives the hash, or "" if none is announced.
+ * @return The filename part of payload.
+ */
+const char* content_parse_offer(const char* payload, char* hash);
+
+/**
+ * @brief Adds a received file to the store (hard link, or copy where links fail).
+ * @param filename Name under assets/received.
+ */
+void content_store_add(const char* filename);
+
+/**
+ * @brief Adds a received file whose hash is already known (hashed while written).
+ * @param filename Name under assets/received.
+ * @param hash Content hash of the file.
+ */
+void content_store_add_hashed(const char* filename, const char* hash);
+
+/**
+ * @brief Materializes a stored blob as assets/received/<filename>.
+ * @param hash Content hash announced by the sender.
+ * @param filename Name under assets/received.
+ * @return 0 if the file is now in place, -1 if the blob is not stored.
+ */
+int content_store_materialize(const char* hash, const char* filename);
+
+#endif // CONTENT_STORE_H
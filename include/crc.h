@@ -2,14 +2,19 @@
  * @file crc.h
  * @brief Provides CRC generation and validation utilities for protocol integrity.
  *        Used to generate and verify checksums for client-server messages.
+ *        generate_crc() is the legacy one-byte XOR; crc32c() is the negotiated
+ *        whole-frame checksum; xxh64() is the chunk hash behind end-to-end file digests.
  * @author Oussama Amara
- * @version 0.1
- * @date 2025-09-07
+ * @version 0.4
+ * @date 2026-10-17
  */
 
 #ifndef CRC_H
 #define CRC_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 /**
  * @brief Computes a simple CRC checksum from input string.
  *        Uses XOR-based checksum for demonstration.
@@ -26,4 +31,77 @@ void generate_crc(const char* input, char* out_crc);
  */
 int validate_crc(const char* received_crc, const char* payload);
 
+/**
+ * @brief Validates a CRC field against a payload, neither being NUL-terminated.
+ * @param received_crc CRC field as received.
+ * @param crc_len CRC field length.
+ * @param payload Payload to verify.
+ * @param len Payload length.
+ * @return 1 if valid, 0 if mismatch.
+ */
+int validate_crc_n(const char* received_crc, size_t crc_len, const char* payload, size_t len);
+
+/**
+ * @brief Computes a 32-bit checksum over a binary buffer.
+ *        Rotate-and-XOR per byte; unlike generate_crc() it covers '|' and NUL bytes.
+ * @param data Buffer to hash.
+ * @param len Buffer length.
+ * @return Checksum value.
+ */
+uint32_t checksum32(const void* data, size_t len);
+
+/**
+ * @brief Computes CRC32C (Castagnoli), hardware-accelerated with SSE4.2 when available.
+ *        Calls chain: crc32c(crc32c(0, a, n), b, m) equals the CRC of a followed by b.
+ * @param crc Running CRC (0 to start).
+ * @param data Bytes to add.
+ * @param len Number of bytes.
+ * @return Updated CRC.
+ */
+uint32_t crc32c(uint32_t crc, const void* data, size_t len);
+
+/**
+ * @brief Computes XXH64 (64-bit xxHash) of a buffer. Four independent lanes of
+ *        32 bytes per step; several GB/s on one core without intrinsics.
+ * @param data Bytes to hash.
+ * @param len Number of bytes.
+ * @param seed Seed mixed into the state (a chunk's index for file digests).
+ * @return Hash value.
+ */
+uint64_t xxh64(const void* data, size_t len, uint64_t seed);
+
+/**
+ * @brief XXH64 of bytes that arrive in pieces; the digest equals one xxh64()
+ *        call over all of them.
+ */
+typedef struct {
+    uint64_t v[4];          ///< Lane accumulators
+    uint64_t seed;          ///< Seed given to xxh64_reset()
+    uint64_t total;         ///< Bytes hashed so far
+    unsigned char mem[32];  ///< Bytes short of a whole 32-byte stripe
+    size_t mem_len;         ///< Bytes in mem
+} Xxh64State;
+
+/**
+ * @brief Starts a new hash.
+ * @param s State to reset.
+ * @param seed Seed, as for xxh64().
+ */
+void xxh64_reset(Xxh64State* s, uint64_t seed);
+
+/**
+ * @brief Hashes the next len bytes.
+ * @param s State from xxh64_reset().
+ * @param data Bytes to hash.
+ * @param len Number of bytes.
+ */
+void xxh64_update(Xxh64State* s, const void* data, size_t len);
+
+/**
+ * @brief Hash of every byte given since the reset; the state stays usable.
+ * @param s State.
+ * @return Hash value.
+ */
+uint64_t xxh64_digest(const Xxh64State* s);
+
 #endif // CRC_H
@@ -0,0 +1,130 @@
+/**
+ * @file delta_sync.h
+ * @brief Delta transfers of files the receiver already holds an older copy of.
+ *        The receiver signs its copy in assets/received (SIGS frames): per block
+ *        a rolling checksum and a strong hash. The sender scans the new version
+ *        with the rolling checksum and encodes it as block references and
+ *        literal ranges; only that delta crosses the wire. The receiver rebuilds
+ *        the file from its copy and the delta, and checks the result against the
+ *        content hash announced in INCOMING.
+ * @author Oussama Amara
+ * @version 1.0
+ * @date 2026-10-17
+ */
+
+#ifndef DELTA_SYNC_H
+#define DELTA_SYNC_H
+
+#include "content_store.h"
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DELTA_MIN_SIZE (64 * 1024)     ///< Smallest copy worth signing
+#define DELTA_BLOCK_MIN 2048           ///< Smallest signed block
+#define DELTA_BLOCK_MAX (1024 * 1024)  ///< Largest signed block
+#define DELTA_TARGET_BLOCKS 16384      ///< Blocks a copy is cut into, unless DELTA_BLOCK_MAX is reached first
+#define DELTA_MAX_BLOCKS (1 << 22)     ///< Most signatures a sender accepts
+#define DELTA_SIG_SIZE 12              ///< Wire bytes per block: rolling checksum (4), strong hash (8)
+#define DELTA_FRAME_BYTES 65536        ///< Largest SIGS payload
+
+/**
+ * @brief Receiver side: the copy being signed, then patched.
+ */
+typedef struct DeltaBasis {
+    char filename[128];              ///< Name under assets/received
+    char hash[CONTENT_HASH_LEN + 1]; ///< Content hash the rebuilt file must have
+    int block_size;                  ///< Bytes per signed block
+    int blocks;                      ///< Full blocks in the copy (a short tail is not signed)
+    int next;                        ///< Next block to sign
+    FILE* fp;                        ///< Copy, open while signing
+    unsigned char* block;            ///< Read buffer of block_size bytes
+} DeltaBasis;
+
+/**
+ * @brief Sender side: signatures of the receiver's copy, indexed by rolling checksum.
+ */
+typedef struct DeltaSigs {
+    char filename[128];              ///< File the receiver holds a copy of
+    int block_size;                  ///< Bytes per signed block
+    int blocks;                      ///< Signatures announced
+    int count;                       ///< Signatures received so far
+    uint32_t* weak;                  ///< Rolling checksum per block
+    uint64_t* strong;                ///< Strong hash per block
+    uint64_t digest;                 ///< Hash of every signature, to tell deltas apart
+    int* heads;                      ///< Hash table of weak checksums: first block per bucket
+    int* chain;                      ///< Next block in the same bucket
+    unsigned mask;                   ///< Buckets - 1
+} DeltaSigs;
+
+/**
+ * @brief Counters of one encoded delta.
+ */
+typedef struct {
+    long long reused_blocks;         ///< Blocks referenced from the receiver's copy
+    long long literal_bytes;         ///< Bytes sent verbatim
+} DeltaStats;
+
+/**
+ * @brief Opens the receiver's copy of a file for signing.
+ * @param filename Name under assets/received.
+ * @param hash Content hash of the new version (from INCOMING).
+ * @return The basis (free with delta_basis_free()), or NULL if there is no copy
+ *         of at least DELTA_MIN_SIZE bytes.
+ */
+DeltaBasis* delta_basis_open(const char* filename, const char* hash);
+
+/**
+ * @brief Writes the next SIGS payload: "<first_block>\n", then in the first
+ *        frame "<block_size>,<blocks>,<filename>\n", then DELTA_SIG_SIZE bytes
+ *        per block (big-endian rolling checksum and strong hash).
+ * @param basis Copy being signed; basis->next advances.
+ * @param out Payload buffer.
+ * @param cap Capacity of out.
+ * @return Payload length, 0 if the copy cannot be read.
+ */
+size_t delta_sign_next(DeltaBasis* basis, unsigned char* out, size_t cap);
+
+/**
+ * @brief Rebuilds the file from the copy and a completed delta, then replaces
+ *        the copy and adds the result to the content store. The delta is removed.
+ * @param basis Copy the delta refers to.
+ * @param staged Name of the delta under assets/received.
+ * @return 0 on success, -1 if the delta does not apply or the result does not
+ *         match the announced hash (the copy is left untouched).
+ */
+int delta_apply(DeltaBasis* basis, const char* staged);
+
+/**
+ * @brief Frees a basis and closes its copy.
+ */
+void delta_basis_free(DeltaBasis* basis);
+
+/**
+ * @brief Adds a SIGS frame to the sender's signatures.
+ * @param[in,out] sigs Signatures; a frame whose first block is 0 starts new ones.
+ * @param data Frame payload.
+ * @param len Payload length.
+ * @return 0 on success, -1 on a malformed frame.
+ */
+int delta_sigs_decode(DeltaSigs** sigs, const void* data, size_t len);
+
+/**
+ * @brief Encodes a file against the receiver's signatures: a header
+ *        ("DLT1", block size, target size), then 'C' <first block> <count>
+ *        references and 'L' <length> <bytes> literals (big-endian 32-bit fields).
+ * @param sigs Complete signatures.
+ * @param src New version of the file, read from its start.
+ * @param target_size Size of src in bytes.
+ * @param out Destination of the delta.
+ * @param[out] stats Receives what the delta reuses.
+ * @return Size of the delta in bytes, or -1 on a read or write error.
+ */
+long long delta_encode(DeltaSigs* sigs, FILE* src, long long target_size, FILE* out, DeltaStats* stats);
+
+/**
+ * @brief Frees signatures.
+ */
+void delta_sigs_free(DeltaSigs* sigs);
+
+#endif // DELTA_SYNC_H
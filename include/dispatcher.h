@@ -4,8 +4,8 @@
  *        Supports modular dispatching for chat, file, and game features.
  *        Used by the server to route parsed commands based on port or protocol.
  * @author Oussama Amara
- * @version 0.6
- * @date 2025-09-07
+ * @version 0.8
+ * @date 2026-10-17
  */
 
 #ifndef DISPATCHER_H
@@ -23,10 +23,15 @@
 #endif
 
 /**
- * @brief Dispatches a parsed command to the appropriate feature handler.
- * @param cmd Pointer to parsed command.
+ * @brief Registers the server's frame handlers. Call once before any reactor starts.
+ */
+void dispatcher_init(void);
+
+/**
+ * @brief Dispatches a decoded frame to the appropriate feature handler.
+ * @param view Frame view borrowed from the connection's receive buffer.
  * @return void
  */
-void dispatch_command(const ParsedCommand* cmd);
+void dispatch_command(const FrameView* view);
 
 #endif // DISPATCHER_H
@@ -0,0 +1,146 @@
+/**
+ * @file file_batch.h
+ * @brief Manifest of a batched transfer: many files, or whole directories, sent
+ *        as one stream. The sender lists every file with its size and content
+ *        hash (BATCH frames); the receiver answers once with the files it needs
+ *        (WANT frames). The needed files are then sent back-to-back as a single
+ *        chunked transfer, staged in one partial file, and unpacked into their
+ *        places when the stream is complete.
+ * @author Oussama Amara
+ * @version 1.0
+ * @date 2026-10-17
+ */
+
+#ifndef FILE_BATCH_H
+#define FILE_BATCH_H
+
+#include "content_store.h"
+#include "partial_file.h"
+#include <stdio.h>
+#include <stddef.h>
+
+#define BATCH_MAX_FILES 65536   ///< Files one batch may list
+#define BATCH_PATH_MAX 256      ///< Longest relative path of a batched file
+#define BATCH_MAX_DEPTH 16      ///< Directory levels walked below a requested directory
+#define BATCH_FRAME_BYTES 65536 ///< Largest BATCH or WANT payload on binary frames
+
+/**
+ * @brief One file of a batch.
+ */
+typedef struct {
+    char path[BATCH_PATH_MAX];          ///< Path under assets/to_send (sender) or assets/received (receiver)
+    long long size;                     ///< File size in bytes
+    char hash[CONTENT_HASH_LEN + 1];    ///< Content hash
+    int wanted;                         ///< 1 if the receiver needs the file
+    long long offset;                   ///< Offset in the data stream (wanted files only)
+} BatchEntry;
+
+/**
+ * @brief Manifest and data layout of one batch.
+ */
+typedef struct FileBatch {
+    char id[TRANSFER_ID_LEN + 1];          ///< Hash of the manifest
+    char transfer_id[TRANSFER_ID_LEN + 1]; ///< Hash of the manifest and the wanted set
+    char name[128];                        ///< What was requested (for logs and the final ACK)
+    BatchEntry* entries;                   ///< Files in manifest order
+    int count;                             ///< Files listed so far
+    int cap;                               ///< Capacity of entries
+    int expected;                          ///< Files announced by the header (receiver)
+    long long total_bytes;                 ///< Size of every listed file
+    int* stream;                           ///< Indices of the wanted files, in stream order
+    int wanted;                            ///< Number of wanted files
+    long long stream_bytes;                ///< Size of the data stream
+    FILE* fp;                              ///< Wanted file open for reading (sender)
+    int open_index;                        ///< Entry fp belongs to, -1 if none
+    long long fp_pos;                      ///< Read position of fp
+} FileBatch;
+
+/**
+ * @brief Tells whether a REQUEST names a batch: several files separated by ';',
+ *        or a directory of assets/to_send.
+ */
+int file_batch_requested(const char* names);
+
+/**
+ * @brief Builds the manifest of a batch on the sender. Directories are walked
+ *        (hidden entries and blocked file types are left out) and every file is hashed.
+ * @param names Files and directories under assets/to_send, separated by ';'.
+ * @return The batch (free with file_batch_free()), or NULL if nothing can be sent.
+ */
+FileBatch* file_batch_build(const char* names);
+
+/**
+ * @brief Writes the next BATCH frame payload: entry lines "<size>,<hash>,<path>\n",
+ *        preceded in the first frame by the header "<id>,<count>,<total_bytes>,<name>\n".
+ * @param batch Batch being announced.
+ * @param[in,out] next Index of the first entry of the frame; advanced past the entries written.
+ * @param out Payload buffer.
+ * @param cap Capacity of out.
+ * @return Payload length.
+ */
+size_t file_batch_encode(const FileBatch* batch, int* next, char* out, size_t cap);
+
+/**
+ * @brief Adds a BATCH frame to the receiver's manifest.
+ * @param[in,out] batch Manifest; a frame with seq 0 starts a new one.
+ * @param data Frame payload.
+ * @param len Payload length.
+ * @param seq Index of the frame's first entry.
+ * @return 0 on success, -1 on a malformed frame or an unsafe path.
+ */
+int file_batch_decode(FileBatch** batch, const char* data, size_t len, int seq);
+
+/**
+ * @brief Marks on the receiver the files it needs: those whose content the store
+ *        cannot materialize. Creates the directories the files go into.
+ * @return Number of wanted files.
+ */
+int file_batch_select(FileBatch* batch);
+
+/**
+ * @brief Writes the next WANT frame payload: "<first>,<hex>", one bit per entry
+ *        from first on (most significant bit of each digit first).
+ * @param batch Batch being answered.
+ * @param[in,out] next Index of the first entry of the frame; advanced past the entries written.
+ * @param out Payload buffer.
+ * @param cap Capacity of out.
+ * @return Payload length.
+ */
+size_t file_batch_encode_want(const FileBatch* batch, int* next, char* out, size_t cap);
+
+/**
+ * @brief Applies a WANT frame on the sender.
+ * @return 0 on success, -1 on a malformed frame.
+ */
+int file_batch_decode_want(FileBatch* batch, const char* data, size_t len);
+
+/**
+ * @brief Lays the wanted files out back-to-back and derives the transfer ID.
+ *        Both ends call it once the wanted set is known.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int file_batch_layout(FileBatch* batch);
+
+/**
+ * @brief Reads len bytes of the data stream at offset, across file boundaries.
+ * @return Bytes read (short if a file shrank since the manifest was built).
+ */
+size_t file_batch_read(FileBatch* batch, void* data, size_t len, long long offset);
+
+/**
+ * @brief Unpacks the completed staging file into the wanted files, checking each
+ *        against its manifest hash and adding it to the content store. The
+ *        staging file is removed.
+ * @param batch Batch received.
+ * @param staged Name of the staging file under assets/received.
+ * @return Number of files that could not be written or failed their hash, -1 if
+ *         the staging file cannot be read.
+ */
+int file_batch_unpack(FileBatch* batch, const char* staged);
+
+/**
+ * @brief Frees a batch and closes its open file.
+ */
+void file_batch_free(FileBatch* batch);
+
+#endif // FILE_BATCH_H
@@ -3,15 +3,42 @@
  * @brief Unified file transfer interface for client and server.
  *        Supports chunked delivery, reassembly, retry logic, timeout detection,
  *        and progress tracking. Used by dispatcher and listener threads.
+ *        Receiver-side retries and deadlines are timers on the listener's wheel.
+ *        Peers that negotiate CAP_RAW receive the file body as a raw data phase
+ *        and hash it as it passes, sender and receiver alike.
+ *        Chunked transfers are binary-safe and unbounded: a START frame announces
+ *        the size and the negotiated chunk size, and each chunk is written at its
+ *        offset as it arrives. The sender keeps a window of chunks in flight and
+ *        the receiver answers with cumulative ACKs plus SACK bitmaps.
+ *        Chunked transfers carry a transfer ID and a chunk range: an interrupted
+ *        file resumes from its checkpoint, and a large one can be split across
+ *        several connections that fill the same partial file.
+ *        Received files enter a content-addressed store, so a file offered
+ *        again with the same content hash is answered with HAVE.
+ *        A client can send its own file: it runs the chunk sender on its server
+ *        socket and the server relays the frames to the receiver (relay.h).
+ *        One REQUEST can name many recipients: the server then reads and encodes
+ *        each chunk once and queues the same shared frame to all of them.
+ *        A REQUEST naming a directory or several files is a batch: one manifest,
+ *        one answer, and every needed file in a single chunked stream (file_batch.h).
+ *        A receiver holding an older copy of an offered file answers with its
+ *        block signatures instead of READY and gets only a delta (delta_sync.h).
+ *        Chunked transfers end with an end-to-end digest in DONE: the sender
+ *        sums chunk hashes as it reads, the receiver as it writes, and a file
+ *        takes its final name only once they agree.
  * @author Oussama Amara
- * @version 1.5
- * @date 2025-10-05
+ * @version 3.2
+ * @date 2026-10-17
  */
 
 #ifndef FILE_TRANSFER_H
 #define FILE_TRANSFER_H
 
 #include "protocol.h"
+#include "timer_wheel.h"
+#include "partial_file.h"
+#include "crc.h"
+#include <stdio.h>
 #ifdef _WIN32
   #include <winsock2.h>
   #pragma comment(lib, "ws2_32.lib")
@@ -20,57 +47,393 @@
   #include <netinet/in.h>
   #include <arpa/inet.h>
 #endif
-#define MAX_CHUNK_SIZE 256
-#define MAX_CHUNKS 64
-#define MAX_CLIENTS 64
-#define MAX_MESSAGE_SIZE 4096
+#define FILE_CHUNK_DEFAULT (64 * 1024)  ///< Chunk size when the receiver asks for none
+#define FILE_CHUNK_MIN 4096              ///< Smallest chunk size granted on binary frames
+#define FILE_CHUNK_MAX (1024 * 1024)     ///< Largest chunk size granted on binary frames
+#define FILE_TEXT_CHUNK_SIZE ((MAX_MESSAGE_LENGTH - 1) / 4 * 3) ///< Chunk size whose base64 fits a text frame
 #define MAX_RETRIES 5
 #define RETRY_INTERVAL 3 // seconds
+#define SACK_BITS 64        // Chunks after the cumulative ACK covered by a SACK bitmap
+#define TRANSFER_TIMEOUT 10 // seconds without a chunk before the transfer is abandoned
+#define DIGEST_SEGMENTS 16  // Digests per stream range in DONE, so a mismatch re-fetches only its part
+#define DIGEST_MAX_REFETCH 3 // Re-fetches after digest mismatches before a file is given up
 
 /**
  * @struct FileBuffer
- * @brief Represents the state and data of a file being transferred.
- *        Used for client-side reassembly and retry tracking.
+ * @brief Receiver state of one stream of a chunked transfer.
+ *        Chunks are written to their file offset (seq * chunk_size) in the
+ *        PartialFile shared by every stream of the file; a stream covers the
+ *        chunk range [first, end).
  */
-typedef struct {
+typedef struct FileBuffer {
     int active;                        ///< 1 if transfer is active
     int src_id;                        ///< Sender ID
     char filename[128];               ///< Name of file being transferred
-    char chunks[MAX_CHUNKS][MAX_CHUNK_SIZE + 1]; ///< Chunk data
-    int received[MAX_CHUNKS];         ///< Flags for received chunks
-    int final_seq;                    ///< Final chunk sequence number
-    time_t last_received;             ///< Timestamp of last received chunk
-    int retry_count[MAX_CHUNKS];      ///< Retry attempts per chunk
-    time_t last_retry[MAX_CHUNKS];    ///< Last retry timestamp per chunk
+    PartialFile* file;                 ///< Destination, NULL until START
+    int chunk_size;                    ///< Bytes per chunk (the last one may be shorter)
+    int first;                         ///< First chunk of this stream's range
+    int end;                           ///< One past the last chunk of this stream's range
+    int received_count;               ///< Chunks this stream stored
+    int cum_ack;                       ///< First chunk of the range not yet stored (cumulative ACK)
+    int ack_every;                     ///< Chunks between routine SACKs (a quarter of the window)
+    int unacked;                       ///< Chunks received since the last SACK
+    int self_id;                       ///< Our client ID, as addressed by the sender
+    int progress;                      ///< Last logged progress, in tenths
+    int sockfd;                       ///< Socket RETRY/TIMEOUT frames go out on
+    long long started_ms;              ///< When START arrived
+    long long last_received_ms;       ///< Cached clock of the last chunk
+    Timer deadline;                   ///< Abandons the transfer after TRANSFER_TIMEOUT of silence
+    Timer retry;                       ///< Asks again for missing chunks while gaps exist
+    int retry_rounds;                  ///< Retry rounds without progress
+    int retry_mark;                    ///< received_count at the last retry round
+    int awaiting_done;                 ///< Range stored; waiting for the sender's DONE and digest
+    int refetches;                     ///< Ranges asked for again since the offer, after digest mismatches
+    struct FileBatch* batch;           ///< Manifest of the batch this stream carries, NULL for one file
+    struct DeltaBasis* delta;          ///< Copy a delta stream rebuilds the file from, NULL for whole files
 } FileBuffer;
 
-extern FileBuffer buffers[MAX_CLIENTS]; ///< Global buffer array for client-side reassembly
+/**
+ * @brief Receiver state of one raw data phase.
+ *        Between the RAW header frame and the last body byte the stream carries
+ *        file bytes, not frames. They go to "<name>.part", which the DONE after
+ *        the body moves into place.
+ */
+typedef struct {
+    FILE* fp;                 ///< Destination "<name>.part" (NULL: bytes are discarded)
+    long long remaining;      ///< Body bytes still expected (0 = no raw phase)
+    long long total;          ///< Announced body length
+    long long written;        ///< Body bytes stored in the file
+    long long hashed;         ///< Stored bytes already hashed
+    Xxh64State chunk_hash;    ///< Hash of the FILE_DIGEST_CHUNK being stored
+    uint64_t digest;          ///< Digest of the completed chunks (see FILE_DIGEST_CHUNK)
+    int refetches;            ///< Times this body was asked for again after a mismatch
+    int awaiting_done;        ///< Body stored; DONE checks its digest and moves it into place
+    int src_id;               ///< Sender ID from the header frame
+    int dest_id;              ///< Receiver ID from the header frame
+    int sockfd;               ///< Socket the body arrives on
+    long long started_ms;     ///< When the header arrived
+    char filename[128];       ///< Name of the file being received
+} RawReceive;
 
 /**
- * @brief Sends a file to a client in chunked frames.
- *        Tracks progress and sends DONE frame on completion.
+ * @brief Sends a file to a client, raw or in windowed chunked frames.
+ *        The chunked path returns once the first window is queued; SACKs drive
+ *        the rest (file_transfer_on_sack()). A client (src_id != 0) relaying its
+ *        file through the server always sends chunked frames.
  * @param connfd Pointer to socket descriptor.
  * @param filename Name of file to send (from assets/to_send/).
+ * @param src_id Sender ID (0 = the server).
+ * @param dest_id Receiver ID.
+ * @param chunk_size Receiver's preferred chunk size (0 = FILE_CHUNK_DEFAULT).
+ */
+void send_file_to_client(int* connfd, const char* filename, int src_id, int dest_id, int chunk_size);
+
+/**
+ * @brief Handles a receiver's RESUME ("<transfer_id>,<first>,<end>,<filename>"):
+ *        sends chunks [first, end) of the file (end 0 = to the last chunk),
+ *        always as chunked frames. A file changed since the receiver's checkpoint
+ *        is sent whole. If the same transfer is already running on connfd from
+ *        first, only its end is moved (the receiver is splitting it).
+ * @param connfd Receiver socket.
+ * @param filename Name of file to send (from assets/to_send/).
  * @param src_id Sender ID.
  * @param dest_id Receiver ID.
+ * @param chunk_size Chunk size of the receiver's checkpoint.
+ * @param transfer_id Transfer ID of the receiver's checkpoint.
+ * @param first First chunk wanted.
+ * @param end One past the last chunk wanted (0 = to the end of the file).
+ */
+void resume_file_to_client(int connfd, const char* filename, int src_id, int dest_id, int chunk_size,
+                           const char* transfer_id, int first, int end);
+
+/**
+ * @brief Tells whether a file may not be sent (executables and scripts).
+ * @param filename Name or path of the file.
+ * @return 1 if blocked, 0 otherwise.
+ */
+int file_type_blocked(const char* filename);
+
+/**
+ * @brief Offers a batch to a client: walks the named files and directories of
+ *        assets/to_send and sends their manifest in BATCH frames, the rest of a
+ *        large one as the receiver's queue drains. The receiver's
+ *        WANT (file_batch_on_want()) starts the data stream. An unanswered
+ *        manifest is dropped after BATCH_ANSWER_TIMEOUT.
+ * @param connfd Receiver socket.
+ * @param names Files and directories, separated by ';'.
+ * @param dest_id Receiver ID.
+ * @return 0 on success, -1 if nothing can be sent.
+ */
+int file_batch_offer(int connfd, const char* names, int dest_id);
+
+/**
+ * @brief Handles a receiver's WANT frame ("<first>,<hex bitmap>"; seq asks for a
+ *        chunk size). After the last one the wanted files are sent back-to-back
+ *        as one chunked transfer named "<transfer_id>.batch".
+ * @param view WANT frame.
+ * @param connfd Receiver socket.
+ */
+void file_batch_on_want(const FrameView* view, int connfd);
+
+/**
+ * @brief Handles a receiver's SIGS frame (signatures of its copy; seq asks for a
+ *        chunk size). After the last one the file is encoded against them and
+ *        the delta sent as a chunked transfer named "<filename>.delta"; when the
+ *        delta would not be smaller, or the signatures are unusable, the whole
+ *        file is sent instead.
+ * @param view SIGS frame.
+ * @param connfd Receiver socket.
+ */
+void file_delta_on_sigs(const FrameView* view, int connfd);
+
+/**
+ * @brief Opens a multicast of a file from assets/to_send. The caller then sends
+ *        INCOMING to every recipient; their READY and RESUME reach
+ *        send_file_to_client() / resume_file_to_client() as usual and join the
+ *        group there. Each recipient keeps its own window, so a slow one lags
+ *        without holding back the others. Recipients on text frames are sent
+ *        the file on their own. The group ends once every recipient has the
+ *        file, answered HAVE, left, or let MULTICAST_ANSWER_TIMEOUT pass.
+ * @param filename Name of file to send (from assets/to_send/).
+ * @param src_id Client that asked for the multicast.
+ * @param recipients Client IDs (duplicates are ignored).
+ * @param count Number of recipients.
+ * @return 0 on success, -1 if the file cannot be read or too many multicasts run.
  */
-void send_file_to_client(int* connfd, const char* filename, int src_id, int dest_id);
+int file_multicast_open(const char* filename, int src_id, const int* recipients, int count);
+
+/**
+ * @brief Records a recipient's HAVE for a multicast it was invited to.
+ * @param recipient_id Client that answered HAVE.
+ * @param filename Name of the file.
+ * @return 0 if a multicast was waiting for the answer, -1 otherwise.
+ */
+int file_multicast_have(int recipient_id, const char* filename);
+
+/**
+ * @brief Gives up on the multicasts a departed client was invited to.
+ *        Recipients already receiving are released with their socket (file_transfer_release()).
+ * @param client_id Client that left.
+ */
+void file_multicast_drop_client(int client_id);
+
+/**
+ * @brief Splits a RESUME payload ("<transfer_id>,<first>,<end>,<filename>").
+ * @param request RESUME payload (NUL-terminated).
+ * @param[out] transfer_id Receives the transfer ID (TRANSFER_ID_LEN + 1 bytes).
+ * @param[out] first Receives the first chunk wanted.
+ * @param[out] end Receives one past the last chunk wanted (0 = to the end).
+ * @return The filename part of request, or NULL if it is malformed.
+ */
+const char* file_parse_resume(const char* request, char* transfer_id, int* first, int* end);
+
+/**
+ * @brief Chunk size granted to the receiver on connfd. Text frames carry
+ *        base64, so their chunks are fixed by the frame size; binary frames
+ *        honour the request within [FILE_CHUNK_MIN, FILE_CHUNK_MAX].
+ * @param connfd Socket the chunks go out on.
+ * @param requested Size asked for (0 = FILE_CHUNK_DEFAULT).
+ * @param relayed 1 if requested was already granted for the far end of a relay:
+ *        it is then only capped, never raised, by this hop's frame format.
+ * @return Chunk size in bytes.
+ */
+int file_chunk_grant(int connfd, int requested, int relayed);
+
+/**
+ * @brief Forwards a relayed CHUNK to its receiver, converting the payload
+ *        between base64 (text frames) and bytes (binary frames) when the two
+ *        hops use different formats.
+ * @param view Chunk from the sending client.
+ * @param dest_fd Receiver socket.
+ * @return 0 on success, -1 if the chunk cannot be forwarded.
+ */
+int file_relay_chunk(const FrameView* view, int dest_fd);
+
+/**
+ * @brief Prepares the sender table (the server's, or a relaying client's).
+ * @param window Chunks a transfer may have in flight (<= 0 keeps the default of 32).
+ */
+void file_transfer_init(int window);
+
+/**
+ * @brief Handles a receiver's SACK (file ACK) or RETRY frame: seq is the
+ *        cumulative ACK, the payload a hex bitmap of the SACK_BITS chunks after it.
+ *        Slides the window, retransmits reported gaps once (every unacknowledged
+ *        chunk in flight for RETRY) and sends DONE when everything is confirmed.
+ * @param view SACK frame.
+ * @param sockfd Receiver socket the transfer runs on.
+ * @param resend_all 1 for RETRY.
+ */
+void file_transfer_on_sack(const FrameView* view, int sockfd, int resend_all);
+
+/**
+ * @brief Abandons chunked transfers whose receiver is gone.
+ * @param sockfd Socket the transfers run on.
+ * @param dest_id Receiver that left, or -1 for every transfer on the socket.
+ */
+void file_transfer_release(int sockfd, int dest_id);
+
+/**
+ * @brief Sets the timer wheel that drives receiver-side retries and deadlines,
+ *        and paces scheduled senders. The wheel must be advanced by the thread
+ *        that handles file frames.
+ * @param wheel Listener's timer wheel (client) or reactor's (server).
+ */
+void file_transfer_set_timers(TimerWheel* wheel);
+
+/**
+ * @brief Senders parked on one thread's wheel that another thread woke, such as
+ *        multicast recipients a slower recipient stopped holding back.
+ */
+typedef struct FileWaker FileWaker;
+
+/**
+ * @brief Creates a waker for an event-loop thread.
+ * @param notify Called from any thread when the first sender is woken; must
+ *        make the loop call file_waker_run() soon (e.g. by writing to an eventfd).
+ * @param ctx Argument passed to notify.
+ * @return Waker, NULL on failure.
+ */
+FileWaker* file_waker_create(void (*notify)(void* ctx), void* ctx);
+
+/**
+ * @brief Frees a waker once no transfer driven by its thread remains.
+ */
+void file_waker_destroy(FileWaker* waker);
+
+/**
+ * @brief Sets the calling thread's waker (NULL = none: parked senders poll).
+ */
+void file_transfer_set_waker(FileWaker* waker);
+
+/**
+ * @brief Resumes the senders woken since the last call, on the next advance of
+ *        their wheel. Called by the thread that owns the waker.
+ */
+void file_waker_run(FileWaker* waker);
+
+/**
+ * @brief Opens one extra connection that asks for a range of a file.
+ * @param request RESUME payload to send once connected ("<transfer_id>,<first>,<end>,<filename>").
+ * @param chunk_size Chunk size, carried in RESUME's seq field.
+ * @param sender_id Whom RESUME is addressed to (0 = the server, else the relaying client).
+ * @return 0 on success, -1 on failure.
+ */
+typedef int (*FileStreamOpener)(const char* request, int chunk_size, int sender_id);
+
+/**
+ * @brief Lets a large chunked file be split across several connections.
+ * @param streams Connections per file, counting the one the offer came on (1 = no splitting).
+ * @param opener Opens the extra connections.
+ */
+void file_transfer_set_streams(int streams, FileStreamOpener opener);
+
+/**
+ * @brief Ends every transfer of the calling listener thread, saving checkpoints
+ *        of incomplete files, and frees its receive state. Call when the listener stops.
+ */
+void file_transfer_abandon(void);
 
 /**
  * @brief Handles INCOMING frame and prepares client buffer.
- *        Sends READY frame to sender.
- * @param cmd Parsed command containing file metadata.
+ *        Sends READY frame to sender; its seq field asks for a chunk size.
+ *        Sends RESUME instead when a checkpoint of the file exists, and HAVE
+ *        (no transfer at all) when the content store holds the announced hash.
+ *        On binary frames, a server file whose older copy is in assets/received
+ *        is answered with SIGS frames so only a delta is sent.
+ * @param view Frame view containing file metadata.
  * @param sockfd Socket descriptor to respond.
+ * @param chunk_size Preferred chunk size in bytes (0 = sender's default).
  */
-void handle_file_incoming(const ParsedCommand* cmd, int sockfd);
+void handle_file_incoming(const FrameView* view, int sockfd, int chunk_size);
 
 /**
- * @brief Buffers incoming file chunks, tracks progress, and reassembles when complete.
- *        Sends ACK or ERR frame based on save success.
+ * @brief Handles a BATCH frame. After the last one, materializes the files the
+ *        content store holds and answers with WANT for the others (ACK at once
+ *        if none is needed). The stream that follows is unpacked when complete
+ *        and confirmed with a single ACK.
+ * @param view Manifest frame.
+ * @param sockfd Socket descriptor to respond.
+ * @param chunk_size Preferred chunk size, carried in WANT's seq field.
+ */
+void handle_file_batch(const FrameView* view, int sockfd, int chunk_size);
+
+/**
+ * @brief Handles a START frame ("<size>,<chunk_size>,<transfer_id>,<first>,<end>,<filename>"):
+ *        opens (or joins) the partial file and tracks the range [first, end).
+ * @param view Frame view containing the transfer header.
+ * @param sockfd Socket descriptor to respond.
+ * @param may_split 1 to split the range across the configured streams.
+ */
+void handle_file_start(const FrameView* view, int sockfd, int may_split);
+
+/**
+ * @brief Writes an incoming chunk at its file offset and tracks progress.
+ *        Once every chunk of the range is stored, waits for DONE to verify
+ *        and confirm it (handle_file_done()).
  *        Implements retry logic for missing chunks.
- * @param cmd Parsed command containing chunk data.
+ * @param view Frame view containing chunk data (base64 on text frames).
  * @param sockfd Socket descriptor to respond.
  */
-void handle_file_chunk(const ParsedCommand* cmd, int sockfd);
+void handle_file_chunk(const FrameView* view, int sockfd);
+
+/**
+ * @brief Handles an ERR frame: the sender could not start the transfer, so the
+ *        receiver stops waiting for it (a partial file keeps its checkpoint).
+ *        An ERR naming another file (a refused request) is ignored.
+ * @param view ERR frame (payload: filename).
+ */
+void handle_file_error(const FrameView* view);
+
+/**
+ * @brief Handles a WAIT frame: the sender is queued or throttled by its
+ *        scheduler. Counts as activity, so the deadline and retry timers wait too.
+ * @param view WAIT frame (payload: filename).
+ */
+void handle_file_wait(const FrameView* view);
+
+/**
+ * @brief Handles DONE ("<first>,<end>,<digest>,<segment digests>,<filename>").
+ *        Compares the sender's digests of the range with the digests recorded as
+ *        its chunks were written; the file is then moved into place and ACKed.
+ *        Segments that differ are forgotten and asked for again with RESUME.
+ *        After a raw data phase it ends that phase instead: DONE is then
+ *        "<size>,<digest>,<filename>", and a body stored whole whose digest matches
+ *        is moved into place and ACKed, while one that differs is asked for again.
+ * @param view DONE frame.
+ * @param sockfd Socket the transfer runs on.
+ * @param rx Raw phase state of the connection.
+ * @return 1 if chunks were asked for again (the stream stays open), 0 otherwise.
+ */
+int handle_file_done(const FrameView* view, int sockfd, RawReceive* rx);
+
+/**
+ * @brief Handles a RAW header frame ("<size>,<filename>") and opens the destination.
+ *        The caller must route the next rx->remaining stream bytes to
+ *        file_raw_write() / file_raw_from_socket() instead of the frame parser.
+ * @param view Header frame.
+ * @param sockfd Socket the body arrives on.
+ * @param[out] rx Receiver state.
+ * @return 0 if a raw phase started (possibly empty and already finished), -1 on a bad header.
+ */
+int handle_file_raw(const FrameView* view, int sockfd, RawReceive* rx);
+
+/**
+ * @brief Stores body bytes that were already read into the receive buffer.
+ *        After the last byte the phase waits for DONE (or sends ERR).
+ * @param rx Receiver state.
+ * @param data Body bytes.
+ * @param len Number of bytes, at most rx->remaining.
+ */
+void file_raw_write(RawReceive* rx, const void* data, size_t len);
+
+/**
+ * @brief Reads body bytes from the socket and stores them with
+ *        file_raw_write(). Blocks until some bytes arrive.
+ *        After the last byte the phase waits for DONE.
+ * @param rx Receiver state.
+ * @return Bytes moved, 0 if the peer closed, -1 on error.
+ */
+long file_raw_from_socket(RawReceive* rx);
 
 #endif // FILE_TRANSFER_H
@@ -0,0 +1,198 @@
+/**
+ * @file file_transfer_internal.h
+ * @brief Pieces of the file transfer feature shared between its modules: the
+ *        windowed chunk sender (file_transfer.c), the multicast groups that
+ *        feed it (file_multicast.c), batch offers (file_batch.c) and delta
+ *        jobs (delta_sync.c). Callers outside the feature use file_transfer.h.
+ * @author Oussama Amara
+ * @version 1.4
+ * @date 2026-10-17
+ */
+
+#ifndef FILE_TRANSFER_INTERNAL_H
+#define FILE_TRANSFER_INTERNAL_H
+
+#include "asset_index.h"
+#include "file_batch.h"
+#include "timer_wheel.h"
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_OUTGOING 64            ///< Batch and delta offers waiting for an answer at once
+#define FILE_WAIT_INTERVAL_MS 1000 ///< Longest a held-back sender stays silent before a WAIT
+
+// ─────────────────────────────────────────────────────────────
+// Chunk sender (file_transfer.c)
+// ─────────────────────────────────────────────────────────────
+
+typedef struct MulticastGroup MulticastGroup;
+typedef struct OutgoingFile OutgoingFile;
+
+/**
+ * @brief Starts the windowed chunk sender for chunks [first, end) of a file.
+ *        A START frame ("<size>,<chunk_size>,<transfer_id>,<first>,<end>,<filename>")
+ *        precedes the chunks; its seq carries the window. When the receiver
+ *        resumes (resume_id set) but the file changed since its checkpoint, or the
+ *        chunk size differs, the whole file is sent again.
+ *        A multicast recipient (group set, fp NULL) takes the group's chunk size
+ *        and transfer ID and is fed from the group's chunk cache; its START waits
+ *        for the rest of the group (multicast_gathered()). A batch (batch
+ *        set, fp NULL) streams its wanted files back-to-back under its own transfer ID.
+ *        Any other file is identified by file_id (file_transfer_id_of()).
+ *        With scheduler limits set, START waits for admission and chunks for tokens.
+ * @return 0 once the transfer is claimed (it may already have ended), -1 if it
+ *         could not start (the receiver is sent ERR); fp is closed (and batch
+ *         freed) either way.
+ */
+int file_start_chunked(int connfd, FILE* fp, MulticastGroup* group, FileBatch* batch, const char* file_id,
+                       long long file_size, const char* filename, int src_id, int dest_id, int chunk_size,
+                       const char* resume_id, int first, int end);
+
+/**
+ * @brief Opens a file of assets/to_send for sending, refusing executables.
+ *        Indexed files need no path resolution; positional readers (pread(),
+ *        sendfile()) share the index's cached descriptor.
+ */
+FILE* file_open_outgoing(const char* filename, int positional, AssetInfo* info);
+
+/**
+ * @brief Derives the transfer ID of a file: FNV-1a of its name, size and
+ *        modification time, so an edited file never resumes into an old checkpoint.
+ */
+void file_transfer_id_of(const char* filename, const AssetInfo* info, char* out);
+
+/**
+ * @brief Reads len bytes at offset without depending on the stream position.
+ */
+size_t file_read_at(FILE* fp, void* data, size_t len, long long offset);
+
+/**
+ * @brief Digest of one chunk. Seeding with the index binds the bytes to their
+ *        place, so a range digest (the wrapping sum) catches misplaced chunks
+ *        while still adding up in any order.
+ */
+uint64_t file_chunk_digest(const void* data, size_t len, int seq);
+
+/**
+ * @brief Chunks a transfer may have in flight (file_window of the server config).
+ */
+int file_transfer_window(void);
+
+/**
+ * @brief Wheel of the calling thread (file_transfer_set_timers()), NULL if none.
+ */
+TimerWheel* file_transfer_timers(void);
+
+/**
+ * @brief Resumes a sender parked on its group, from any thread: it is queued on
+ *        its thread's waker (file_waker_run()). Without a waker its poll timer
+ *        finds out.
+ */
+void file_transfer_wake(OutgoingFile* sender);
+
+// ─────────────────────────────────────────────────────────────
+// Multicast groups (file_multicast.c)
+// ─────────────────────────────────────────────────────────────
+
+/**
+ * @brief Where one recipient of a multicast stands.
+ */
+enum {
+    MC_INVITED,   ///< INCOMING sent, no answer yet
+    MC_SENDING,   ///< Chunks flowing from the group's cache
+    MC_DELIVERED, ///< Every chunk acknowledged
+    MC_SKIPPED,   ///< Answered HAVE
+    MC_UNICAST,   ///< Text frames: handed to a transfer of its own
+    MC_FAILED     ///< Left, stalled, or never answered
+};
+
+void multicast_init(void);
+
+/**
+ * @brief A recipient answered READY or RESUME: starts its own sender fed from the
+ *        group. Recipients on text frames, or asking for another chunk size, get a
+ *        transfer of their own instead, since a shared chunk cannot be both bytes
+ *        and base64.
+ * @return 0 if the group serves the recipient, -1 if the caller sends the file.
+ */
+int multicast_join(int connfd, const char* filename, int dest_id, int chunk_size,
+                   const char* resume_id, int first, int end);
+
+/**
+ * @brief A recipient answered with signatures: it gets a transfer of its own.
+ */
+void multicast_unicast(int recipient_id, const char* filename);
+
+/**
+ * @brief Chunk size of the group, fixed (and the cache sized) by its first
+ *        sending recipient. The cache holds a full window for every recipient,
+ *        between 8 and 64 MiB.
+ */
+int multicast_chunk_size(MulticastGroup* g, int connfd, int requested);
+
+void multicast_transfer_id(MulticastGroup* g, char* out);
+
+/**
+ * @brief Whether a recipient's START may go out: every recipient answered, or
+ *        the join window passed since the first one did. If not, sender is
+ *        parked until the last answer (file_transfer_wake()).
+ * @return 0 if it may, else milliseconds until the join window closes.
+ */
+long long multicast_gather_wait(MulticastGroup* g, int recipient_id, OutgoingFile* sender, long long now);
+
+/**
+ * @brief Whether new chunk seq for recipient_id would evict a chunk another
+ *        recipient still needs; its sender then waits instead of running a
+ *        whole cache ahead, parked until those recipients are sent the chunk
+ *        or leave (file_transfer_wake()).
+ * @return 0 if seq may go out, else milliseconds until those recipients count as lagging.
+ */
+long long multicast_ahead(MulticastGroup* g, int recipient_id, int seq, OutgoingFile* sender, long long now);
+
+/**
+ * @brief Queues chunk seq to one recipient: the cached frame for its wire
+ *        variant when another recipient already had it, else read and encoded here.
+ *        A slot only moves on to a newer chunk no one still needs; an older chunk
+ *        (a retry, a recipient that fell behind) is read without taking the slot.
+ * @param[out] digest Digest of the chunk.
+ * @return 0 once queued, -1 on failure.
+ */
+int multicast_send(MulticastGroup* g, int sockfd, int recipient_id, int seq, uint64_t* digest);
+
+/**
+ * @brief Moves an invited or sending recipient to its final state (MC_*); the
+ *        group is freed after the last one.
+ */
+void multicast_settle(MulticastGroup* g, int recipient_id, int state);
+
+// ─────────────────────────────────────────────────────────────
+// Batch offers (file_batch.c)
+// ─────────────────────────────────────────────────────────────
+
+void file_batch_init(void);
+
+/**
+ * @brief Drops the manifests offered on sockfd to dest_id (-1 = any) that
+ *        still wait for a WANT.
+ */
+void file_batch_drop_pending(int sockfd, int dest_id);
+
+/**
+ * @brief Largest BATCH or WANT payload the peer on fd accepts in one frame.
+ */
+size_t file_batch_frame_cap(int fd);
+
+// ─────────────────────────────────────────────────────────────
+// Delta jobs (delta_sync.c)
+// ─────────────────────────────────────────────────────────────
+
+void file_delta_init(void);
+
+/**
+ * @brief Drops the signatures collected on sockfd from dest_id (-1 = any) and
+ *        cancels their running encodes.
+ */
+void file_delta_drop_pending(int sockfd, int dest_id);
+
+#endif // FILE_TRANSFER_INTERNAL_H
@@ -0,0 +1,342 @@
+/**
+ * @file framing.h
+ * @brief Stream framing for protocol frames over TCP.
+ *        Every frame on the wire is preceded by a 4-byte big-endian body length,
+ *        so coalesced or split TCP segments are reassembled correctly.
+ *        Each connection keeps a RecvBuffer that holds partial frames between reads
+ *        and yields every complete frame contained in a read.
+ *        Binary v2 frames carry their own length in the header and go on the wire
+ *        without the prefix; their first byte (FRAME_V2_MAGIC) tells them apart,
+ *        since a text prefix always starts with 0x00.
+ *        Sockets owned by the server reactor get an outbound queue: frames are
+ *        appended to it and flushed with writev() when the socket is writable,
+ *        so a slow receiver never blocks the thread that produced the frame.
+ *        A raw data phase (frame_queue_file) streams file bytes unframed after a
+ *        header frame; the file body is a queue entry that is written whenever
+ *        the socket accepts more, and frames queued behind it follow its last byte.
+ *        With WIRE_LZ4 binary payloads are compressed when that makes them smaller.
+ *        A frame sent to many sockets can be encoded once as a SharedFrame that
+ *        every queue references instead of copying.
+ * @author Oussama Amara
+ * @version 1.9
+ * @date 2026-10-17
+ */
+
+#ifndef FRAMING_H
+#define FRAMING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Size of the length prefix in bytes.
+ */
+#define FRAME_PREFIX_SIZE 4
+
+/**
+ * @brief Largest frame body accepted from the wire: a FILE_CHUNK_MAX (1 MiB)
+ *        file chunk plus its binary header.
+ */
+#define FRAME_MAX_SIZE (1024 * 1024 + 64)
+
+/**
+ * @brief Initial receive buffer capacity; grows up to FRAME_MAX_SIZE + prefix.
+ */
+#define RECVBUF_INITIAL_SIZE 16384
+
+/**
+ * @brief Per-connection receive buffer.
+ *        Bytes in [head, tail) are received but not yet consumed. When the write
+ *        position reaches the end, the unread remainder (at most one partial frame)
+ *        is moved back to the start so frames always stay contiguous.
+ */
+typedef struct {
+    char* data;       ///< Backing storage
+    size_t capacity;  ///< Size of data
+    size_t head;      ///< First unconsumed byte
+    size_t tail;      ///< One past the last received byte
+} RecvBuffer;
+
+/**
+ * @brief Allocates a receive buffer.
+ * @param rb Buffer to initialize.
+ * @param capacity Initial capacity in bytes.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int recvbuf_init(RecvBuffer* rb, size_t capacity);
+
+/**
+ * @brief Releases a receive buffer.
+ * @param rb Buffer to release.
+ */
+void recvbuf_free(RecvBuffer* rb);
+
+/**
+ * @brief Performs one recv() into the free space of the buffer.
+ *        Frames previously returned by recvbuf_next_frame() become invalid.
+ *        Fails with errno set to EMSGSIZE if a pending frame cannot fit.
+ * @param rb Receive buffer.
+ * @param fd Socket descriptor.
+ * @return Bytes received, 0 on orderly shutdown, -1 on error or would-block
+ *         (use socket_would_block()/errno to tell them apart).
+ */
+int recvbuf_fill(RecvBuffer* rb, int fd);
+
+/**
+ * @brief Extracts the next complete frame from the buffer.
+ *        The returned body points into the buffer and is not NUL-terminated;
+ *        it stays valid until the next recvbuf_next_frame() or recvbuf_fill().
+ * @param rb Receive buffer.
+ * @param[out] frame Start of the frame body.
+ * @param[out] len Length of the frame body.
+ * @return 1 if a frame was extracted, 0 if more data is needed,
+ *         -1 if the peer announced a frame larger than FRAME_MAX_SIZE.
+ */
+int recvbuf_next_frame(RecvBuffer* rb, const char** frame, size_t* len);
+
+/**
+ * @brief Consumes up to max unframed bytes, e.g. the start of a raw data phase
+ *        that arrived in the same read as its header frame.
+ *        The returned bytes stay valid until the next recvbuf_fill().
+ * @param rb Receive buffer.
+ * @param max Largest number of bytes to consume.
+ * @param[out] data Start of the consumed bytes.
+ * @return Number of bytes consumed (0 if the buffer is empty).
+ */
+size_t recvbuf_take(RecvBuffer* rb, size_t max, const char** data);
+
+/**
+ * @brief Sends one length-prefixed frame.
+ *        On a socket with an outbound queue the frame is queued whole and written
+ *        as far as the socket allows; the rest is flushed later. Otherwise partial
+ *        sends are retried, waiting briefly for writability, so a frame is never
+ *        left half-written on the stream.
+ * @param fd Socket descriptor.
+ * @param frame Frame body.
+ * @param len Body length in bytes.
+ * @return 0 on success, -1 on failure.
+ */
+int send_frame(int fd, const char* frame, size_t len);
+
+/**
+ * @brief Outbound queue limits, in queued bytes per socket.
+ *        Above the high watermark a socket is congested and bulk producers wait
+ *        in frame_wait_drain() until it falls to the low watermark. A peer whose
+ *        backlog passes the hard limit has stopped reading and is disconnected.
+ */
+#define OUTQ_LOW_WATERMARK  (64 * 1024)
+#define OUTQ_HIGH_WATERMARK (256 * 1024)
+#define OUTQ_HARD_LIMIT     (4 * 1024 * 1024)
+
+/**
+ * @brief Gives a socket an outbound queue.
+ *        Until this is called (and after frame_queue_close()) sends on the
+ *        socket are written synchronously, as the client does.
+ * @param fd Non-blocking socket descriptor.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int frame_queue_open(int fd);
+
+/**
+ * @brief Drops whatever is still queued for a socket and detaches its queue.
+ * @param fd Socket descriptor.
+ */
+void frame_queue_close(int fd);
+
+/**
+ * @brief Writes as much of the socket's queue as the kernel accepts.
+ *        Called by the reactor when the socket becomes writable.
+ * @param fd Socket descriptor.
+ * @return Bytes still queued, or -1 on a socket error.
+ */
+long frame_flush(int fd);
+
+/**
+ * @brief Returns the number of bytes queued for a socket.
+ * @param fd Socket descriptor.
+ * @return Queued bytes, unsent file bodies included (0 if the socket has no queue).
+ */
+size_t frame_pending(int fd);
+
+/**
+ * @brief Applies backpressure for bulk senders.
+ *        Returns at once unless the socket is above OUTQ_HIGH_WATERMARK; otherwise
+ *        flushes and waits for writability until it is down to OUTQ_LOW_WATERMARK.
+ * @param fd Socket descriptor.
+ * @return 0 when the caller may keep sending, -1 if the peer stalled and was dropped.
+ */
+int frame_wait_drain(int fd);
+
+/**
+ * @brief Defers flushing of queued sockets on this thread until frame_uncork().
+ *        Frames sent while corked accumulate and go out in one writev() per socket.
+ *        Calls nest.
+ */
+void frame_cork(void);
+
+/**
+ * @brief Ends a frame_cork() section and flushes every socket written meanwhile.
+ */
+void frame_uncork(void);
+
+/**
+ * @brief Chunk size of a file body's digest: chunk i of the body is hashed with
+ *        xxh64() seeded with i, and the digest is the wrapping sum of those hashes.
+ */
+#define FILE_DIGEST_CHUNK 65536
+
+/**
+ * @brief Called once when a queued file body has been written (ok = 1) or
+ *        dropped with its socket or a failed read (ok = 0).
+ *        Runs under the socket's queue lock, so it must not send on that socket;
+ *        instead it may encode one frame into trailer (cap bytes, see
+ *        frame_encode_command()) to go out right after the last file byte.
+ * @param arg Argument given to frame_queue_file().
+ * @param ok 1 if every byte was written.
+ * @param digest Digest of the bytes sent (see FILE_DIGEST_CHUNK).
+ * @param trailer Buffer for the trailing frame (NULL when ok is 0).
+ * @param cap Size of trailer.
+ * @return Length of the trailing frame, 0 for none.
+ */
+typedef size_t (*FileSentFn)(void* arg, int ok, uint64_t digest, char* trailer, size_t cap);
+
+/**
+ * @brief Streams part of an open file to a socket as a raw data phase.
+ *        On a socket with an outbound queue the body is queued behind the frames
+ *        already there (the phase's header) and written until the socket would
+ *        block; the reactor resumes it when the socket is writable. Each slice
+ *        of the file is read once, hashed for the digest handed to done while in
+ *        cache, and sent from the same buffer. File bytes do not count towards
+ *        OUTQ_HARD_LIMIT. Sockets without a queue are written synchronously.
+ * @param fd Socket descriptor.
+ * @param file_fd File descriptor to read from; must stay open until done runs.
+ * @param offset File offset of the first byte to send.
+ * @param len Number of bytes to send.
+ * @param done Completion callback, called exactly once (possibly before this returns).
+ * @param arg Argument for done.
+ * @return 0 on success so far, -1 on failure (the stream is then unusable).
+ */
+int frame_queue_file(int fd, int file_fd, long long offset, long long len, FileSentFn done, void* arg);
+
+/**
+ * @brief Wire options, negotiated per socket through CAPS.
+ */
+#define WIRE_BINARY 0x1   ///< Send binary v2 frames instead of text frames
+#define WIRE_CRC32C 0x2   ///< Protect frames with CRC32C instead of the legacy checksum
+#define WIRE_RAW    0x4   ///< Receive file bodies as raw data phases
+#define WIRE_LZ4    0x8   ///< Compress binary frame payloads when they shrink
+
+/**
+ * @brief Records the wire options negotiated for a socket.
+ *        Safe to call while other threads send on the socket.
+ * @param fd Socket descriptor.
+ * @param flags WIRE_* bits (0 = text frames).
+ */
+void frame_set_wire(int fd, unsigned flags);
+
+/**
+ * @brief Returns the wire options negotiated for a socket (0 if never set).
+ * @param fd Socket descriptor.
+ * @return WIRE_* bits.
+ */
+unsigned frame_wire(int fd);
+
+/**
+ * @brief Builds and sends one frame in the wire format negotiated for fd.
+ * @param fd Socket descriptor.
+ * @param channel Feature type: chat, file, game, system
+ * @param src_id Sender ID (0 = server)
+ * @param dest_id Receiver ID
+ * @param message Message content (NUL-terminated)
+ * @param status Frame status
+ * @return 0 on success, -1 on failure.
+ */
+int send_command(int fd, const char* channel, int src_id, int dest_id,
+                 const char* message, const char* status);
+
+/**
+ * @brief Encodes the frame send_command() would send, without sending it.
+ * @param fd Socket descriptor (selects the wire format).
+ * @param channel Feature type.
+ * @param src_id Sender ID.
+ * @param dest_id Receiver ID.
+ * @param message Message content (NUL-terminated).
+ * @param status Frame status.
+ * @param[out] out Encoded frame, ready for the wire.
+ * @param cap Size of out.
+ * @return Encoded size, 0 if it does not fit.
+ */
+size_t frame_encode_command(int fd, const char* channel, int src_id, int dest_id,
+                            const char* message, const char* status, char* out, size_t cap);
+
+/**
+ * @brief Builds and sends one chunk of a multi-frame message.
+ *        Text frames carry seq/final as trailing |SEQ|END fields and stop at
+ *        the first NUL; binary frames carry the payload verbatim.
+ * @param fd Socket descriptor.
+ * @param channel Feature type.
+ * @param src_id Sender ID.
+ * @param dest_id Receiver ID.
+ * @param data Chunk payload.
+ * @param len Payload length.
+ * @param status Frame status.
+ * @param seq Chunk sequence number.
+ * @param is_final 1 if this is the last chunk.
+ * @return 0 on success, -1 on failure.
+ */
+int send_chunk(int fd, const char* channel, int src_id, int dest_id,
+               const void* data, size_t len, const char* status, int seq, int is_final);
+
+/**
+ * @brief Encoded frame that several outbound queues reference without copying.
+ *        Reference counts are atomic; the frame is freed with its last reference.
+ */
+typedef struct SharedFrame SharedFrame;
+
+/**
+ * @brief Encodes one chunk frame for every socket whose wire options are wire.
+ *        Binary frames cover WIRE_CRC32C and WIRE_LZ4; text frames get the
+ *        length prefix. The caller owns the one reference returned.
+ * @param wire WIRE_* options of the receiving sockets.
+ * @param channel Feature type.
+ * @param src_id Sender ID.
+ * @param dest_id Receiver ID (the same for every socket the frame goes to).
+ * @param data Chunk payload.
+ * @param len Payload length.
+ * @param status Frame status.
+ * @param seq Chunk sequence number.
+ * @param is_final 1 if this is the last chunk.
+ * @return The frame, or NULL on allocation failure or an oversized payload.
+ */
+SharedFrame* frame_share_chunk(unsigned wire, const char* channel, int src_id, int dest_id,
+                               const void* data, size_t len, const char* status, int seq, int is_final);
+
+/**
+ * @brief Takes one more reference to a shared frame.
+ * @param frame Shared frame.
+ */
+void frame_share_retain(SharedFrame* frame);
+
+/**
+ * @brief Drops one reference; the last one frees the frame. NULL is ignored.
+ * @param frame Shared frame.
+ */
+void frame_share_release(SharedFrame* frame);
+
+/**
+ * @brief Returns the encoded size of a shared frame in bytes.
+ * @param frame Shared frame.
+ * @return Bytes on the wire.
+ */
+size_t frame_shared_size(const SharedFrame* frame);
+
+/**
+ * @brief Sends a shared frame like send_frame(). Whatever the socket does not
+ *        take at once is queued as a reference to the frame, not a copy.
+ * @param fd Socket descriptor.
+ * @param frame Shared frame (the caller keeps its reference).
+ * @return 0 on success, -1 on failure.
+ */
+int frame_send_shared(int fd, SharedFrame* frame);
+
+#endif // FRAMING_H
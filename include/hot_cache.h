@@ -0,0 +1,78 @@
+/**
+ * @file hot_cache.h
+ * @brief Size-bounded LRU cache of the server's popular files, held as
+ *        ready-to-send chunk frames. A file requested again is sent from the
+ *        encoded frames (header, CRC32C and LZ4 already applied), with no disk
+ *        read, checksum or formatting; each frame is queued by reference.
+ *        Frames are filled in as chunks are first sent, one variant per set of
+ *        binary wire options, and addressed from server 0 to 0 like multicast
+ *        frames so any receiver takes them. Text receivers, batches, deltas and
+ *        relayed files bypass the cache.
+ * @author Oussama Amara
+ * @version 1.1
+ * @date 2026-10-17
+ */
+
+#ifndef HOT_CACHE_H
+#define HOT_CACHE_H
+
+#include "framing.h"
+#include <stdint.h>
+
+#define HOT_CACHE_BUCKETS 256     ///< Hash buckets of transfer IDs
+#define HOT_CACHE_FILE_SHARE 4    ///< A file is cached only if it fits a quarter of the cache
+#define HOT_CACHE_VARIANTS 4      ///< Binary encodings: CRC32C or not, LZ4 or not
+
+/**
+ * @brief Counters since startup.
+ */
+typedef struct {
+    long long hits;       ///< Chunks sent from a cached frame
+    long long misses;     ///< Chunks of a cached file read and encoded
+    long long evictions;  ///< Files dropped to make room
+    long long files;      ///< Files cached now
+    long long bytes;      ///< Bytes held now (frames and tables)
+    long long capacity;   ///< Configured size
+} HotCacheStats;
+
+/**
+ * @brief Sets the cache size. 0 disables the cache.
+ * @param max_bytes Bytes of frames and tables kept at most.
+ */
+void hot_cache_init(long long max_bytes);
+
+/**
+ * @brief Notes a request for one of the server's files and caches it if it fits.
+ *        The file becomes the most recently used.
+ * @param file_id Transfer ID of the file's current version (name, size, mtime).
+ * @param file_size Size of the file in bytes.
+ */
+void hot_cache_admit(const char* file_id, long long file_size);
+
+/**
+ * @brief Looks up the encoded frame of a chunk.
+ * @param file_id Transfer ID of the file.
+ * @param chunk_size Chunk size of the transfer; a file is cached for the first size asked.
+ * @param seq Chunk index.
+ * @param wire WIRE_* options of the receiving socket (binary only).
+ * @param[out] cacheable Set to 1 on a miss the caller should fill with hot_cache_put().
+ * @param[out] digest Receives the chunk's digest on a hit.
+ * @return The frame with a reference for the caller, or NULL.
+ */
+SharedFrame* hot_cache_get(const char* file_id, int chunk_size, int seq, unsigned wire, int* cacheable,
+                           uint64_t* digest);
+
+/**
+ * @brief Stores the frame of a chunk after a miss. Files are evicted, least
+ *        recently used first, while the cache is over its size.
+ * @param frame Frame to keep (the cache takes its own reference).
+ * @param digest Digest of the chunk's bytes, returned with later hits.
+ */
+void hot_cache_put(const char* file_id, int chunk_size, int seq, unsigned wire, SharedFrame* frame, uint64_t digest);
+
+/**
+ * @brief Reads the counters.
+ */
+void hot_cache_stats(HotCacheStats* stats);
+
+#endif // HOT_CACHE_H
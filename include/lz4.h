@@ -0,0 +1,55 @@
+/**
+ * @file lz4.h
+ * @brief LZ4 block compression (the standard block format, no frame header).
+ *        Used for negotiated payload compression of binary v2 frames. The
+ *        *_dict variants prime the match window with a dictionary shared by both
+ *        peers, which lets short messages compress.
+ * @author Oussama Amara
+ * @version 1.0
+ * @date 2026-10-17
+ */
+
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stddef.h>
+
+/**
+ * @brief Compresses a block.
+ * @param src Bytes to compress.
+ * @param len Number of bytes.
+ * @param dst Output buffer.
+ * @param cap Output capacity; compression stops as soon as it would exceed it.
+ * @return Compressed size, or 0 if the result does not fit in cap.
+ */
+size_t lz4_compress(const void* src, size_t len, void* dst, size_t cap);
+
+/**
+ * @brief Compresses a block whose matches may also refer into a dictionary.
+ * @param dict Dictionary (at most 64 KiB are used).
+ * @param dict_len Dictionary length.
+ * @param src Bytes to compress.
+ * @param len Number of bytes.
+ * @param dst Output buffer.
+ * @param cap Output capacity.
+ * @return Compressed size, or 0 if the result does not fit in cap.
+ */
+size_t lz4_compress_dict(const void* dict, size_t dict_len, const void* src, size_t len, void* dst, size_t cap);
+
+/**
+ * @brief Decompresses a block.
+ * @param src Compressed block.
+ * @param len Block length.
+ * @param dst Output buffer.
+ * @param cap Output capacity.
+ * @return Decompressed size, or -1 if the block is malformed or does not fit.
+ */
+long lz4_decompress(const void* src, size_t len, void* dst, size_t cap);
+
+/**
+ * @brief Decompresses a block made by lz4_compress_dict() with the same dictionary.
+ * @return Decompressed size, or -1 if the block is malformed or does not fit.
+ */
+long lz4_decompress_dict(const void* dict, size_t dict_len, const void* src, size_t len, void* dst, size_t cap);
+
+#endif // LZ4_H
@@ -0,0 +1,144 @@
+/**
+ * @file partial_file.h
+ * @brief Destination of a chunked transfer that survives dropped connections.
+ *        Chunks go to "<name>.part" under assets/received; a checkpoint
+ *        ("<name>.ckpt": transfer ID, sizes, a bitmap of stored chunks and their
+ *        digests) is saved next to it, so a reconnecting client resumes where it
+ *        stopped. Parallel streams of one transfer share a single PartialFile.
+ *        The file takes its final name only once the sender's digest is checked
+ *        (partial_finish()). Raw data phases write the same "<name>.part" and
+ *        move it into place with partial_place().
+ * @author Oussama Amara
+ * @version 1.2
+ * @date 2026-10-17
+ */
+
+#ifndef PARTIAL_FILE_H
+#define PARTIAL_FILE_H
+
+#include "platform_thread.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define TRANSFER_ID_LEN 16           ///< Hex digits of a transfer ID
+#define CHECKPOINT_INTERVAL_MS 1000  ///< Oldest a saved checkpoint gets while chunks arrive
+
+/**
+ * @brief Shared receive state of one transfer.
+ *        The bitmap and counters are guarded by lock; chunk bytes are written
+ *        with positioned writes outside it.
+ */
+typedef struct PartialFile {
+    char transfer_id[TRANSFER_ID_LEN + 1]; ///< Sender's ID of this version of the file
+    char filename[128];                    ///< Final name under assets/received
+    int fd;                                ///< "<name>.part", -1 once complete
+    long long file_size;                   ///< File size in bytes
+    int chunk_size;                        ///< Bytes per chunk
+    int total_chunks;                      ///< Chunks in the file
+    unsigned char* received;               ///< Bitmap of stored chunks
+    uint64_t* digests;                     ///< xxh64() of each stored chunk, seeded with its index
+    int received_count;                    ///< Number of bits set in received
+    int resumed;                           ///< Chunks already stored when opened
+    int complete;                          ///< 1 once renamed to its final name
+    int refs;                              ///< Streams using this file
+    int writers;                           ///< Chunk writes in progress; the file closes after the last
+    long long started_ms;                  ///< When the file was opened
+    long long checkpoint_ms;               ///< When the checkpoint was last saved
+    mutex_t lock;                          ///< Guards bitmap, counters and checkpoint
+} PartialFile;
+
+/**
+ * @brief Prepares the table of open partial files. Call once before any transfer.
+ */
+void partial_init(void);
+
+/**
+ * @brief Reads the checkpoint of a file without opening it.
+ *        Used to ask for a resume instead of a fresh transfer.
+ * @param filename Name under assets/received.
+ * @param[out] transfer_id Receives the checkpoint's transfer ID (TRANSFER_ID_LEN + 1 bytes).
+ * @param[out] chunk_size Receives the checkpoint's chunk size.
+ * @param[out] first_missing Receives the first chunk not yet stored.
+ * @return 0 if a usable checkpoint exists, -1 otherwise.
+ */
+int partial_probe(const char* filename, char* transfer_id, int* chunk_size, int* first_missing);
+
+/**
+ * @brief Opens the destination of a transfer, shared by all its streams.
+ *        Joins a PartialFile already open for the same transfer ID, else resumes
+ *        from a matching checkpoint, else starts an empty "<name>.part"
+ *        (discarding a checkpoint of another version of the file).
+ * @param transfer_id Sender's transfer ID.
+ * @param filename Name under assets/received.
+ * @param file_size File size in bytes.
+ * @param chunk_size Bytes per chunk.
+ * @return The shared file (release with partial_release()), or NULL on failure.
+ */
+PartialFile* partial_open(const char* transfer_id, const char* filename, long long file_size, int chunk_size);
+
+/**
+ * @brief Tells whether a chunk is already stored.
+ */
+int partial_has(PartialFile* pf, int seq);
+
+/**
+ * @brief First chunk in [from, end) that is not stored yet.
+ * @return The chunk, or end if all are stored.
+ */
+int partial_first_missing(PartialFile* pf, int from, int end);
+
+/**
+ * @brief Writes a chunk at its offset and records it with its digest.
+ *        Saves the checkpoint when it is older than CHECKPOINT_INTERVAL_MS.
+ * @param pf Shared file.
+ * @param seq Chunk number.
+ * @param data Chunk bytes (chunk_size, or the remainder for the last chunk).
+ * @param len Number of bytes.
+ * @param digest xxh64() of the bytes, seeded with seq.
+ * @return 2 if this chunk completed the file, 1 if stored, 0 if already stored, -1 on error.
+ */
+int partial_store(PartialFile* pf, int seq, const void* data, size_t len, uint64_t digest);
+
+/**
+ * @brief Digest of chunks [first, end): the wrapping sum of their chunk digests,
+ *        so it does not depend on the order they arrived in.
+ * @param[out] digest Receives the sum.
+ * @return Number of chunks of the range not stored yet (the sum is only
+ *         meaningful at 0).
+ */
+int partial_digest(PartialFile* pf, int first, int end, uint64_t* digest);
+
+/**
+ * @brief Forgets chunks [first, end) so they are received again, and saves the
+ *        checkpoint. Used when they fail verification.
+ */
+void partial_forget(PartialFile* pf, int first, int end);
+
+/**
+ * @brief Moves a file whose every chunk is stored and verified to its final
+ *        name, unless other streams still use it (the last one does it).
+ * @return 1 if the file is in place, 0 if chunks are missing or other streams
+ *         remain, -1 if it could not be moved.
+ */
+int partial_finish(PartialFile* pf);
+
+/**
+ * @brief Builds "<assets>/received/<name><suffix>", e.g. the ".part" or ".ckpt" of a file.
+ * @return 0 on success, -1 if the path does not fit.
+ */
+int partial_path(const char* filename, const char* suffix, char* out, size_t cap);
+
+/**
+ * @brief Renames "<name>.part" to its final name, replacing an older copy.
+ * @return 0 on success, -1 on failure.
+ */
+int partial_place(const char* filename);
+
+/**
+ * @brief Drops one stream's reference. The last one saves the checkpoint of an
+ *        incomplete file and frees it.
+ * @param pf Shared file.
+ */
+void partial_release(PartialFile* pf);
+
+#endif // PARTIAL_FILE_H
@@ -2,8 +2,8 @@
  * @file platform.h
  * @brief Platform abstraction layer for OS-specific operations (e.g., path handling, socket setup, etc.). Ensures cross-platform compatibility across Linux, Windows, macOS.
  * @author Oussama Amara
- * @version 1.0
- * @date 2025-09-04
+ * @version 1.2
+ * @date 2026-10-17
  */
 
 #ifndef PLATFORM_H
@@ -21,6 +21,13 @@
  */
 
 void sleep_ms(int milliseconds);
+
+/**
+ * @brief Returns a monotonic timestamp in milliseconds.
+ *        Unaffected by wall-clock changes; only differences are meaningful.
+ * @return Milliseconds since an unspecified starting point.
+ */
+long long monotonic_ms(void);
 /**
  * @brief Returns the platform-specific temporary directory path.
  * @return Path string.
@@ -41,11 +48,18 @@ void print_working_directory();
 const char* get_working_directory_path() ;
 
 /**
- * @brief Resolves the absolute path to a file inside the assets folder,
- *        searching upward from the current directory.
+ * @brief Returns the absolute path of the assets folder, searching upward from
+ *        the current directory on the first call and remembering the result.
+ * @return Pointer to a static buffer, or NULL if no assets folder is found.
+ */
+const char* resolve_assets_root(void);
+
+/**
+ * @brief Resolves the absolute path to a file inside the assets folder
+ *        (see resolve_assets_root()).
  * @param subfolder Subdirectory inside assets (e.g., "to_send")
  * @param filename Name of the file to resolve
- * @return Pointer to static buffer containing the full path, or NULL on failure
+ * @return Pointer to a per-thread static buffer containing the full path, or NULL on failure
  */
 const char* resolve_asset_path(const char* subfolder, const char* filename) ;
 #endif // PLATFORM_H
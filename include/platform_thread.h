@@ -13,13 +13,17 @@
 #ifdef _WIN32
 #include <windows.h>
 typedef HANDLE thread_t;
+typedef CRITICAL_SECTION mutex_t;
 #define THREAD_FUNC DWORD WINAPI
 #define THREAD_RETURN return 0
+#define THREAD_LOCAL __declspec(thread)
 #else
 #include <pthread.h>
 typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
 #define THREAD_FUNC void*
 #define THREAD_RETURN return NULL
+#define THREAD_LOCAL __thread
 #endif
 
 /**
@@ -36,5 +40,43 @@ int create_thread(thread_t* thread, THREAD_FUNC (*func)(void*), void* arg);
  * @return void
  */
 void detach_thread(thread_t thread);
+/**
+ * @brief Waits for a thread to finish and releases its handle.
+ * @param thread The thread to join.
+ * @return void
+ */
+void join_thread(thread_t thread);
+/**
+ * @brief Pins the calling thread to a single CPU.
+ * @param cpu Zero-based CPU index.
+ * @return 0 on success, -1 if unsupported or the CPU does not exist.
+ */
+int pin_current_thread(int cpu);
+/**
+ * @brief Returns the number of online CPUs (at least 1).
+ * @return CPU count.
+ */
+int cpu_count(void);
+
+/**
+ * @brief Initializes a mutex.
+ * @param m Mutex to initialize.
+ */
+void mutex_init(mutex_t* m);
+/**
+ * @brief Locks a mutex.
+ * @param m Mutex to lock.
+ */
+void mutex_lock(mutex_t* m);
+/**
+ * @brief Unlocks a mutex.
+ * @param m Mutex to unlock.
+ */
+void mutex_unlock(mutex_t* m);
+/**
+ * @brief Destroys a mutex.
+ * @param m Mutex to destroy.
+ */
+void mutex_destroy(mutex_t* m);
 
 #endif
@@ -0,0 +1,36 @@
+/**
+ * @file presence.h
+ * @brief Event-driven presence: who is online and whether interaction may start.
+ *        The server keeps a versioned membership set. A joining client receives
+ *        one snapshot of its peers (LIST frames); everyone else receives a JOIN or
+ *        LEAVE delta. START/WAIT is sent only when readiness changes. Every
+ *        presence frame carries the membership version in its sequence field.
+ *        Nothing is sent while the roster is idle.
+ * @author Oussama Amara
+ * @version 1.0
+ * @date 2026-10-17
+ */
+
+#ifndef PRESENCE_H
+#define PRESENCE_H
+
+/**
+ * @brief Initializes the membership set. Call once before any reactor starts.
+ */
+void presence_init(void);
+
+/**
+ * @brief Adds a registered client: sends it the snapshot and its readiness,
+ *        and announces it to every other member.
+ * @param id Client ID from the registry.
+ */
+void presence_join(int id);
+
+/**
+ * @brief Removes a client and announces its departure to the remaining members.
+ *        Call before the client is unregistered. Unknown IDs are ignored.
+ * @param id Client ID.
+ */
+void presence_leave(int id);
+
+#endif // PRESENCE_H
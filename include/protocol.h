@@ -6,28 +6,156 @@
  *      Example: 1A2B3C4D|chat|1|2|Hello there!|READY
  *      Frame status can be WAIT, READY, DONE, ACK, ERR, etc.
  *     Ensures message integrity and proper routing between clients and server.
- * @date 2025-09-14
+ *     Protocol v2 adds a fixed binary header, opted into through CAPS after ID_ASSIGN.
+ * @date 2026-10-17
  * @author Oussama Amara
- * @version 1.0
+ * @version 2.6
  */
 
 #ifndef PROTOCOL_H
 #define PROTOCOL_H
 #include <stdlib.h>
+#include <stdint.h>
 #define MAX_COMMAND_LENGTH 1024
 #define MAX_MESSAGE_LENGTH 512
 
+/**
+ * @brief Feature channels as carried in binary frames.
+ */
+typedef enum {
+    CH_UNKNOWN = 0,
+    CH_SYSTEM,
+    CH_CHAT,
+    CH_FILE,
+    CH_GAME,
+    CH_COUNT
+} ChannelCode;
+
+/**
+ * @brief Frame statuses as carried in binary frames.
+ */
+typedef enum {
+    ST_UNKNOWN = 0,
+    ST_WAIT,
+    ST_READY,
+    ST_DONE,
+    ST_ACK,
+    ST_LIST,
+    ST_ID_ASSIGN,
+    ST_ERR,
+    ST_CHUNK,
+    ST_REQUEST,
+    ST_INCOMING,
+    ST_RETRY,
+    ST_TIMEOUT,
+    ST_ALERT,
+    ST_START,
+    ST_CAPS,
+    ST_JOIN,
+    ST_LEAVE,
+    ST_RAW,
+    ST_RESUME,
+    ST_HAVE,
+    ST_OFFER,
+    ST_BATCH,
+    ST_WANT,
+    ST_SIGS,
+    ST_COUNT
+} StatusCode;
+
+/**
+ * @brief First byte of every binary frame. Text frames never start with it
+ *        because their length prefix starts with 0x00.
+ */
+#define FRAME_V2_MAGIC 0xC2
+#define FRAME_V2_VERSION 2
+#define FRAME_V2_HEADER_SIZE 28
+
+#define FRAME_FLAG_FINAL  0x0001 ///< Last chunk of a multi-frame message
+#define FRAME_FLAG_CRC32C 0x0002 ///< checksum is CRC32C of header (minus checksum) + payload
+#define FRAME_FLAG_LZ4    0x0004 ///< payload is the original length (4 bytes) + an LZ4 block
+#define FRAME_FLAG_DICT   0x0008 ///< the LZ4 block is primed with the chat dictionary
+
+#define FRAME_COMPRESS_MIN 128      ///< Smaller payloads are sent as they are
+#define FRAME_COMPRESS_MIN_CHAT 16  ///< Same for chat, which has a dictionary to match against
+
+/**
+ * @brief Hex digits of a text CRC32C field. Legacy XOR fields have 2.
+ */
+#define FRAME_CRC32C_DIGITS 8
+
+/**
+ * @brief Capability tokens offered by the server and echoed by clients that opt in.
+ */
+#define CAP_BINARY_V2 "bin2"
+#define CAP_CRC32C "crc32c"
+#define CAP_RAW "raw"       ///< File bodies arrive as raw data phases after a RAW header frame
+#define CAP_LZ4 "lz4"       ///< Binary frame payloads may be LZ4-compressed
+
+/**
+ * @brief Binary frame header (all fields big-endian on the wire).
+ *
+ *  0      1        2        3        4         8          12     16      18       20            24
+ *  +------+--------+--------+--------+---------+----------+------+-------+--------+-------------+----------+
+ *  |magic |version |channel |status  | src_id  | dest_id  | seq  | flags | rsvd   | payload_len | checksum |
+ *  +------+--------+--------+--------+---------+----------+------+-------+--------+-------------+----------+
+ */
+typedef struct {
+    uint8_t channel;       ///< ChannelCode
+    uint8_t status;        ///< StatusCode
+    uint16_t flags;        ///< FRAME_FLAG_*
+    int32_t src_id;        ///< Sender ID (0 = server)
+    int32_t dest_id;       ///< Receiver ID
+    int32_t seq;           ///< Chunk sequence number
+    uint32_t payload_len;  ///< Bytes following the header
+    uint32_t checksum;     ///< checksum32 of the payload, or CRC32C with FRAME_FLAG_CRC32C
+} FrameHeaderV2;
+
 typedef struct {
     char crc[9];           ///< CRC checksum for message integrity
     char channel[16];      ///< Feature type: chat, file, game, system
     int src_id;            ///< Sender ID (0 = server)
     int dest_id;           ///< Receiver ID
     char message[MAX_MESSAGE_LENGTH]; ///< Message content
+    size_t message_len;    ///< Bytes in message (binary payloads may hold '|' or NUL)
     char status[16];       ///< Frame status: WAIT, READY, DONE, ACK, ERR, etc.
     int seq_num;     ///< Sequence number of chunk
     int is_final;    ///< 1 if last chunk, 0 otherwise
 } ParsedCommand;
 
+/**
+ * @brief Byte range inside a frame body.
+ */
+typedef struct {
+    uint32_t off;          ///< Offset from FrameView.base
+    uint32_t len;          ///< Length in bytes
+} FrameSpan;
+
+/**
+ * @brief Decoded frame that borrows its bytes from the receive buffer.
+ *        Channel and status are interned to codes while decoding; the payload
+ *        stays where it was received. A view is valid until the next
+ *        recvbuf_next_frame()/recvbuf_fill() on its buffer, so handlers that
+ *        keep data must copy it (frame_view_copy()).
+ */
+typedef struct {
+    const char* base;      ///< Start of the frame body (not owned, not NUL-terminated)
+    uint8_t channel;       ///< ChannelCode
+    uint8_t status;        ///< StatusCode
+    uint8_t is_final;      ///< 1 if last chunk, 0 otherwise
+    uint8_t binary;        ///< 1 if decoded from a binary v2 frame
+    int32_t src_id;        ///< Sender ID (0 = server)
+    int32_t dest_id;       ///< Receiver ID
+    int32_t seq_num;       ///< Sequence number of chunk
+    FrameSpan crc;         ///< Text CRC field (empty for binary frames)
+    FrameSpan payload;     ///< Message bytes
+} FrameView;
+
+/**
+ * @brief Pointer to the first byte of a span of a view.
+ */
+#define FRAME_VIEW_PTR(view, span) ((view)->base + (span).off)
+
 /**
  * @brief Builds a protocol frame from components.
  * @param channel Feature type: chat, file, game, system
@@ -41,6 +169,22 @@ typedef struct {
 void build_frame(const char* channel, int src_id, int dest_id,
                  const char* message, const char* status, char* out_frame);
 
+/**
+ * @brief Builds a text frame with optional SEQ/END trailer and checksum choice.
+ * @param channel Feature type: chat, file, game, system
+ * @param src_id Sender ID (0 = server)
+ * @param dest_id Receiver ID
+ * @param message Message content
+ * @param status Frame status
+ * @param seq Chunk sequence number, or -1 to omit the |SEQ|END trailer
+ * @param is_final 1 if last chunk (only written with a trailer)
+ * @param use_crc32c 1 for an 8-digit CRC32C over the whole frame, 0 for the legacy XOR
+ * @param out_frame Output buffer of MAX_COMMAND_LENGTH bytes
+ * @return Frame length in bytes.
+ */
+size_t build_frame_ex(const char* channel, int src_id, int dest_id, const char* message,
+                      const char* status, int seq, int is_final, int use_crc32c, char* out_frame);
+
 /**
  * @brief Decodes a raw frame into ParsedCommand structure.
  * @param input Raw input string.
@@ -58,6 +202,145 @@ int decode_frame(const char* input, ParsedCommand* cmd);
  */
 int parse_command(const char* input, ParsedCommand* cmd);
 
+/**
+ * @brief Decodes a text frame body into a view without copying or validating it.
+ * @param frame Frame body (not NUL-terminated).
+ * @param len Body length.
+ * @param view Output view over frame.
+ * @return 0 on success, -1 if fewer than six fields are present.
+ */
+int decode_frame_view(const char* frame, size_t len, FrameView* view);
+
+/**
+ * @brief Decodes a binary v2 frame into a view, validating its checksum.
+ *        A compressed payload is inflated into a per-thread buffer the view then
+ *        points to; it stays valid until the thread decodes the next frame.
+ * @param frame Encoded frame.
+ * @param len Encoded length.
+ * @param view Output view over frame.
+ * @return 0 on success, -1 on malformed frame or checksum mismatch.
+ */
+int decode_frame_v2_view(const unsigned char* frame, size_t len, FrameView* view);
+
+/**
+ * @brief Decodes and validates a frame body of either wire format into a view.
+ *        This is the dispatch hot path: nothing is copied.
+ * @param frame Frame body as returned by the framing layer.
+ * @param len Body length.
+ * @param view Output view over frame.
+ * @return 0 on success, -1 on failure.
+ */
+int parse_frame_view(const char* frame, size_t len, FrameView* view);
+
+/**
+ * @brief Copies a span of a view into a NUL-terminated buffer, truncating if needed.
+ * @param view Source view.
+ * @param span Span to copy (e.g. view->payload).
+ * @param dst Destination buffer.
+ * @param cap Destination capacity (> 0).
+ * @return Number of bytes copied, excluding the terminator.
+ */
+size_t frame_view_copy(const FrameView* view, FrameSpan span, char* dst, size_t cap);
+
+/**
+ * @brief Materializes a view into an owning ParsedCommand.
+ * @param view Source view.
+ * @param cmd Output command structure.
+ */
+void frame_view_to_command(const FrameView* view, ParsedCommand* cmd);
+
+/**
+ * @brief Parses and validates a frame body of either wire format.
+ *        Binary frames are recognized by FRAME_V2_MAGIC; anything else is decoded as text.
+ * @param frame Frame body as returned by the framing layer (not NUL-terminated).
+ * @param len Body length.
+ * @param cmd Output command structure.
+ * @return 0 on success, -1 on failure.
+ */
+int parse_frame(const char* frame, size_t len, ParsedCommand* cmd);
+
+/**
+ * @brief Encodes a binary v2 frame (header + payload).
+ * @param hdr Header fields; payload_len and checksum are filled in.
+ * @param payload Payload bytes (may contain '|' and NUL).
+ * @param payload_len Payload length.
+ * @param out Output buffer of at least FRAME_V2_HEADER_SIZE + payload_len bytes.
+ * @return Total encoded size.
+ */
+size_t encode_frame_v2(FrameHeaderV2* hdr, const void* payload, size_t payload_len, unsigned char* out);
+
+/**
+ * @brief Compresses a payload for a binary v2 frame: chat with the chat
+ *        dictionary, everything else as a plain LZ4 block.
+ * @param channel ChannelCode of the frame.
+ * @param payload Payload bytes.
+ * @param len Payload length.
+ * @param out Output buffer of len bytes.
+ * @param[out] flags FRAME_FLAG_LZ4 (and FRAME_FLAG_DICT) are added on success.
+ * @return Compressed payload length, or 0 if the payload is small or does not
+ *         shrink and must be sent as it is.
+ */
+size_t frame_v2_compress(int channel, const void* payload, size_t len, unsigned char* out, uint16_t* flags);
+
+/**
+ * @brief Frees the calling thread's decompression buffer. Views of compressed
+ *        frames point into it, so call only when the thread stops decoding.
+ */
+void frame_v2_release(void);
+
+/**
+ * @brief Decodes a binary v2 frame into ParsedCommand, validating its checksum.
+ * @param frame Encoded frame.
+ * @param len Encoded length.
+ * @param cmd Output command structure.
+ * @return 0 on success, -1 on malformed frame or checksum mismatch.
+ */
+int decode_frame_v2(const unsigned char* frame, size_t len, ParsedCommand* cmd);
+
+/**
+ * @brief Returns the protocol name of a channel code ("chat", "file", ...).
+ * @param code ChannelCode.
+ * @return Name, or "unknown".
+ */
+const char* channel_name(int code);
+
+/**
+ * @brief Maps a channel name to its code.
+ * @param name Channel name.
+ * @return ChannelCode, CH_UNKNOWN if unrecognized.
+ */
+int channel_code(const char* name);
+
+/**
+ * @brief Maps a channel name that is not NUL-terminated to its code.
+ * @param name Channel name.
+ * @param len Name length.
+ * @return ChannelCode, CH_UNKNOWN if unrecognized.
+ */
+int channel_code_n(const char* name, size_t len);
+
+/**
+ * @brief Returns the protocol name of a status code ("READY", "ACK", ...).
+ * @param code StatusCode.
+ * @return Name, or "UNKNOWN".
+ */
+const char* status_name(int code);
+
+/**
+ * @brief Maps a status name to its code.
+ * @param name Status name.
+ * @return StatusCode, ST_UNKNOWN if unrecognized.
+ */
+int status_code(const char* name);
+
+/**
+ * @brief Maps a status name that is not NUL-terminated to its code.
+ * @param name Status name.
+ * @param len Name length.
+ * @return StatusCode, ST_UNKNOWN if unrecognized.
+ */
+int status_code_n(const char* name, size_t len);
+
 /**
  * @brief Frees memory allocated for a ParsedCommand.
  *        Currently a placeholder for future dynamic fields.
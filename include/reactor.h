@@ -0,0 +1,149 @@
+/**
+ * @file reactor.h
+ * @brief Event loop that owns the listening sockets and every client connection.
+ *        Uses edge-triggered epoll on Linux and a poll() backend elsewhere.
+ *        Accepts, reads, parses and dispatches frames from readiness events
+ *        instead of spawning one thread per client. Several reactors can run
+ *        side by side, each with its own SO_REUSEPORT listeners and connections.
+ *        Each reactor owns a timer wheel; client inactivity is a per-connection timer.
+ *        Other threads wake a reactor's parked file senders through its wake descriptor.
+ * @author Oussama Amara
+ * @version 1.3
+ * @date 2026-10-17
+ */
+
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#ifdef _WIN32
+  #include <winsock2.h>
+#else
+  #include <netinet/in.h>
+#endif
+#include <signal.h>
+#include "config.h"
+#include "framing.h"
+#include "timer_wheel.h"
+
+/**
+ * @brief Maximum number of listening sockets a reactor can own.
+ */
+#define REACTOR_MAX_LISTENERS 8
+
+/**
+ * @brief Upper bound on event-loop threads in a reactor pool.
+ */
+#define REACTOR_MAX_THREADS 64
+
+/**
+ * @brief Maximum number of readiness events handled per wait call.
+ */
+#define REACTOR_MAX_EVENTS 256
+
+/**
+ * @brief Longest the event loop sleeps without an event, so it notices shutdown.
+ */
+#define REACTOR_MAX_WAIT_MS 1000
+
+/**
+ * Time of inactive client after which we kill the client
+ */
+#define CLIENT_TIME_OUT 300 // seconds
+
+/**
+ * @brief Kind tag stored at the start of every object registered with the poller.
+ */
+typedef enum {
+    EV_LISTENER,
+    EV_CONNECTION,
+    EV_WAKE
+} EventKind;
+
+/**
+ * @brief Listening socket owned by a reactor.
+ */
+typedef struct {
+    EventKind kind;              ///< Always EV_LISTENER
+    int fd;                      ///< Listening socket descriptor
+    int port;                    ///< Feature port it is bound to
+} Listener;
+
+typedef struct Poller Poller;
+struct Reactor;
+
+/**
+ * @brief Per-client connection state owned by a reactor.
+ */
+typedef struct Connection {
+    EventKind kind;              ///< Always EV_CONNECTION
+    int fd;                      ///< Client socket descriptor
+    int port;                    ///< Feature port the client connected to
+    int client_id;               ///< ID assigned by the registry
+    struct sockaddr_in addr;     ///< Peer address
+    RecvBuffer rbuf;             ///< Bytes received but not yet framed
+    struct Reactor* owner;       ///< Reactor whose loop serves this connection
+    Timer idle_timer;            ///< Fires CLIENT_TIME_OUT after the last read
+    long long last_read_ms;      ///< Cached clock of the last read
+    struct Connection* prev;     ///< Previous connection owned by the same reactor
+    struct Connection* next;     ///< Next connection owned by the same reactor
+} Connection;
+
+
+/**
+ * @brief Event loop state.
+ */
+typedef struct Reactor {
+    int index;                                     ///< Position in the reactor pool
+    Poller* poller;                                ///< Backend (epoll or poll)
+    Listener listeners[REACTOR_MAX_LISTENERS];     ///< Owned listening sockets
+    int listener_count;                            ///< Number of listeners in use
+    Connection* connections;                       ///< Live client connections
+    int connection_count;                          ///< Length of the connection list
+    TimerWheel timers;                             ///< Timeouts of owned connections
+    EventKind wake_kind;                           ///< Always EV_WAKE; registered for wake_fds[0]
+    int wake_fds[2];                               ///< Read and write ends of the wake descriptor (-1 = none)
+    struct FileWaker* waker;                       ///< File senders other threads woke (NULL = they poll)
+} Reactor;
+
+/**
+ * @brief Creates the poller backing a reactor.
+ * @param[out] r Reactor to initialize.
+ * @return 0 on success, -1 on failure.
+ */
+int reactor_init(Reactor* r);
+
+/**
+ * @brief Hands a bound, listening socket to the reactor.
+ *        The socket is switched to non-blocking mode.
+ * @param r Reactor.
+ * @param fd Listening socket descriptor.
+ * @param port Feature port the socket is bound to.
+ * @return 0 on success, -1 on failure.
+ */
+int reactor_add_listener(Reactor* r, int fd, int port);
+
+/**
+ * @brief Runs the event loop until *running becomes 0.
+ * @param r Reactor.
+ * @param running Flag cleared by the signal handler on shutdown.
+ */
+void reactor_run(Reactor* r, volatile sig_atomic_t* running);
+
+/**
+ * @brief Closes every connection and listener and releases the poller.
+ * @param r Reactor.
+ */
+void reactor_destroy(Reactor* r);
+
+/**
+ * @brief Starts cfg->reactors event loops and blocks until *running becomes 0.
+ *        Each reactor binds its own chat/file/game listeners (SO_REUSEPORT when
+ *        more than one runs), owns the connections it accepts for their whole life,
+ *        and is optionally pinned to a CPU. The calling thread runs reactor 0.
+ * @param cfg Server configuration (host, ports, reactors, pin_cpus).
+ * @param running Flag cleared by the signal handler on shutdown.
+ * @return 0 on clean shutdown, -1 if the pool could not start.
+ */
+int reactor_pool_run(const Config* cfg, volatile sig_atomic_t* running);
+
+#endif // REACTOR_H
@@ -0,0 +1,79 @@
+/**
+ * @file relay.h
+ * @brief Cut-through relay of files that clients send to each other.
+ *        A client OFFERs one of its own files to another client; the server
+ *        announces it to the receiver (INCOMING) and from then on forwards frames
+ *        between the two as they arrive: READY, RESUME, HAVE and SACKs to the
+ *        sender, START, CHUNK and DONE to the receiver. Nothing is staged on disk,
+ *        and the sender's window bounds what waits in the receiver's queue.
+ *        The relay ends with the receiver's ACK or ERR, not with DONE: a digest
+ *        mismatch sends RESUME back through it.
+ * @author Oussama Amara
+ * @version 1.1
+ * @date 2026-10-17
+ */
+
+#ifndef RELAY_H
+#define RELAY_H
+
+#include "protocol.h"
+
+/**
+ * @brief Prepares the relay table. Call once before any reactor starts.
+ */
+void relay_init(void);
+
+/**
+ * @brief Registers a file offered by sender_id to receiver_id.
+ *        A relay between the same two clients is replaced.
+ * @param sender_id Client that owns the file.
+ * @param receiver_id Client the file is offered to.
+ * @param filename Name of the file.
+ * @return 0 on success, -1 if the relay table is full.
+ */
+int relay_open(int sender_id, int receiver_id, const char* filename);
+
+/**
+ * @brief Admits an extra stream of the receiver that asks the sender for a
+ *        range of a file already relayed by that sender.
+ * @param sender_id Client that owns the file.
+ * @param receiver_id Stream connection asking for the range.
+ * @param filename Name of the file.
+ * @return 0 if admitted, -1 if the sender relays no such file.
+ */
+int relay_join(int sender_id, int receiver_id, const char* filename);
+
+/**
+ * @brief Forwards a frame of a registered relay to its destination (dest_id),
+ *        re-encoded for the destination's wire format. Chunks are converted
+ *        between base64 and bytes when the hops differ (file_relay_chunk()).
+ * @param view Frame from either end of the relay.
+ * @param seq Sequence field to forward (lets the caller adjust READY's chunk size).
+ * @return 0 on success, -1 if no relay joins the two clients or the send failed.
+ */
+int relay_forward(const FrameView* view, int seq);
+
+/**
+ * @brief The sender's DONE went through: the relay waits for the receiver's
+ *        verdict (ACK, ERR, or RESUME for chunks that failed the digest) and
+ *        expires if none comes within the transfer timeout.
+ * @param sender_id Client that owns the file.
+ * @param receiver_id Receiving client.
+ */
+void relay_done(int sender_id, int receiver_id);
+
+/**
+ * @brief Ends the relay from sender_id to receiver_id (the receiver's ACK, ERR
+ *        or HAVE went through).
+ * @param sender_id Client that owns the file.
+ * @param receiver_id Receiving client.
+ */
+void relay_close(int sender_id, int receiver_id);
+
+/**
+ * @brief Ends every relay a disconnecting client takes part in.
+ * @param client_id Client that left.
+ */
+void relay_drop_client(int client_id);
+
+#endif // RELAY_H
@@ -0,0 +1,64 @@
+/**
+ * @file router.h
+ * @brief Table-driven routing of decoded frames to feature handlers.
+ *        Handlers are registered per [channel][status] pair, so dispatching a frame
+ *        is one indexed call on the interned codes of its FrameView. Used by the
+ *        server dispatcher and the client listener.
+ * @author Oussama Amara
+ * @version 1.0
+ * @date 2026-10-17
+ */
+
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include "protocol.h"
+
+/**
+ * @brief Wildcard status for router_register(): fills every status of a channel
+ *        that has no specific handler.
+ */
+#define ROUTE_ANY_STATUS (-1)
+
+/**
+ * @brief Frame handler.
+ * @param view Decoded frame (borrowed from the receive buffer).
+ * @param ctx Caller context passed to router_dispatch().
+ */
+typedef void (*FrameHandler)(const FrameView* view, void* ctx);
+
+/**
+ * @brief Jump table indexed by ChannelCode and StatusCode.
+ */
+typedef struct {
+    FrameHandler routes[CH_COUNT][ST_COUNT];
+} FrameRouter;
+
+/**
+ * @brief Clears every route.
+ * @param router Router to initialize.
+ */
+void router_init(FrameRouter* router);
+
+/**
+ * @brief Registers a handler for a channel/status pair.
+ *        A specific status always wins over ROUTE_ANY_STATUS, whatever the order
+ *        of registration.
+ * @param router Router.
+ * @param channel ChannelCode.
+ * @param status StatusCode, or ROUTE_ANY_STATUS.
+ * @param handler Handler to call.
+ * @return 0 on success, -1 if the codes are out of range.
+ */
+int router_register(FrameRouter* router, int channel, int status, FrameHandler handler);
+
+/**
+ * @brief Calls the handler registered for the view's channel and status.
+ * @param router Router.
+ * @param view Decoded frame.
+ * @param ctx Context forwarded to the handler.
+ * @return 1 if a handler ran, 0 if the frame has no route.
+ */
+int router_dispatch(const FrameRouter* router, const FrameView* view, void* ctx);
+
+#endif // ROUTER_H
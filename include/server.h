@@ -17,15 +17,6 @@
   #include <arpa/inet.h>
 #endif
 
-#include "platform_thread.h"
-/**
- * @brief Struct to pass client connection data to thread.
- */
-typedef struct {
-    int connfd;
-    int port;
-    struct sockaddr_in cli;
-} ClientArgs;
 
 /**
  * @brief Signal handler for graceful shutdown.
@@ -0,0 +1,109 @@
+/**
+ * @file timer_wheel.h
+ * @brief Hierarchical timer wheel for timeouts, retries and deadlines.
+ *        Timers are intrusive and caller-owned, so scheduling and cancelling are
+ *        O(1) with no allocation. Four levels of 64 slots at a 10 ms tick cover
+ *        about 46 hours; far timers cascade down a level as their slot comes up.
+ *        The wheel caches the monotonic clock it was last advanced to.
+ *        A wheel belongs to one thread and is not locked.
+ * @author Oussama Amara
+ * @version 1.0
+ * @date 2026-10-17
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TIMER_WHEEL_TICK_MS 10  ///< Resolution; timers never fire early
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+
+/**
+ * @brief Called when a timer expires. The timer is no longer pending and may be
+ *        rescheduled, or its owner freed, from inside the callback.
+ */
+typedef void (*TimerCallback)(void* arg);
+
+/**
+ * @brief One timer. Embed it in the object it times and set it up with timer_init().
+ */
+typedef struct Timer {
+    struct Timer* next;
+    struct Timer** pprev;     ///< Link pointing at this timer; NULL when not pending
+    uint64_t expires;         ///< Tick at which it fires
+    uint8_t level;            ///< Wheel level it is linked into
+    uint8_t slot;             ///< Slot within that level
+    TimerCallback callback;
+    void* arg;
+} Timer;
+
+/**
+ * @brief Wheel state.
+ */
+typedef struct {
+    Timer* slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    uint64_t occupied[TIMER_WHEEL_LEVELS];  ///< Bit per non-empty slot
+    uint64_t tick;                          ///< Next tick to process
+    long long origin_ms;                    ///< Clock value of tick 0
+    long long now_ms;                       ///< Cached clock from the last advance
+    size_t count;                           ///< Pending timers
+} TimerWheel;
+
+/**
+ * @brief Initializes an empty wheel.
+ * @param w Wheel.
+ * @param now_ms Current monotonic time (see monotonic_ms()).
+ */
+void timer_wheel_init(TimerWheel* w, long long now_ms);
+
+/**
+ * @brief Prepares a timer. Must be called once before the timer is scheduled.
+ * @param t Timer.
+ * @param callback Function run on expiry.
+ * @param arg Argument passed to callback.
+ */
+void timer_init(Timer* t, TimerCallback callback, void* arg);
+
+/**
+ * @brief Arms a timer to fire delay_ms after the wheel's cached clock.
+ *        A pending timer is moved to the new expiry.
+ * @param w Wheel.
+ * @param t Timer set up with timer_init().
+ * @param delay_ms Delay in milliseconds (0 = on the next advance).
+ */
+void timer_schedule(TimerWheel* w, Timer* t, long long delay_ms);
+
+/**
+ * @brief Disarms a timer. Does nothing if it is not pending.
+ * @param w Wheel.
+ * @param t Timer.
+ */
+void timer_cancel(TimerWheel* w, Timer* t);
+
+/**
+ * @brief Reports whether a timer is armed.
+ * @param t Timer.
+ * @return 1 if pending, 0 otherwise.
+ */
+int timer_pending(const Timer* t);
+
+/**
+ * @brief Moves the wheel's clock to now_ms and runs every timer that expired.
+ * @param w Wheel.
+ * @param now_ms Current monotonic time.
+ */
+void timer_wheel_advance(TimerWheel* w, long long now_ms);
+
+/**
+ * @brief Returns how long the owner may sleep before calling timer_wheel_advance().
+ *        Exact for timers within the next 640 ms, a lower bound beyond that.
+ * @param w Wheel.
+ * @return Milliseconds, or -1 if no timer is pending.
+ */
+int timer_wheel_timeout(const TimerWheel* w);
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,105 @@
+/**
+ * @file transfer_scheduler.h
+ * @brief Global scheduler of outgoing chunked transfers.
+ *        Admits at most max_transfers at once (the rest wait in FIFO order) and
+ *        paces chunks with token buckets: one per transfer and one shared by all.
+ *        Transfers of at least background_size bytes run in the background class:
+ *        they are admitted only when no foreground transfer waits, and send only
+ *        from bandwidth the foreground leaves idle, pausing while chat traffic flows.
+ *        Buckets may run into debt by one chunk, so a chunk larger than the bucket
+ *        still goes out and the next one waits longer.
+ * @author Oussama Amara
+ * @version 1.0
+ * @date 2026-10-17
+ */
+
+#ifndef TRANSFER_SCHEDULER_H
+#define TRANSFER_SCHEDULER_H
+
+#include <stddef.h>
+
+#define SCHED_BURST_MS 250  ///< Bucket depth, in time at the capped rate
+#define SCHED_IDLE_MS 200   ///< Quiet time the background class waits for after interactive or foreground traffic
+#define SCHED_POLL_MS 50    ///< How often a queued or idle-starved transfer asks again
+
+/**
+ * @brief Scheduling class of a transfer.
+ */
+typedef enum {
+    SCHED_FOREGROUND, ///< Requested files: full share of the caps
+    SCHED_BACKGROUND  ///< Bulk syncs: idle bandwidth only
+} SchedClass;
+
+/**
+ * @brief Scheduler state of one transfer. Embedded in the sender's transfer slot;
+ *        only the thread driving the transfer touches it outside the scheduler lock.
+ */
+typedef struct SchedFlow {
+    SchedClass cls;            ///< Class chosen at admission
+    int state;                 ///< FLOW_IDLE, FLOW_QUEUED or FLOW_ACTIVE
+    double tokens;             ///< Per-transfer bucket (bytes; negative = debt)
+    long long stamp_ms;        ///< Last refill of the per-transfer bucket
+    struct SchedFlow* prev;    ///< Neighbours in the wait queue of its class
+    struct SchedFlow* next;
+} SchedFlow;
+
+enum {
+    FLOW_IDLE,   ///< Not admitted and not waiting
+    FLOW_QUEUED, ///< Waiting for a free slot
+    FLOW_ACTIVE  ///< Admitted: counts toward max_transfers
+};
+
+/**
+ * @brief Sets the limits. 0 disables a limit.
+ * @param max_transfers Chunked transfers sending at once.
+ * @param transfer_rate Bytes per second of one transfer.
+ * @param total_rate Bytes per second of all transfers together.
+ * @param background_size Transfers of at least this many bytes run in the background class.
+ */
+void sched_init(int max_transfers, long long transfer_rate, long long total_rate, long long background_size);
+
+/**
+ * @brief Tells whether any limit is set. Raw data phases are not paced, so
+ *        senders use chunked frames while it is.
+ */
+int sched_enabled(void);
+
+/**
+ * @brief Class of a transfer of the given size.
+ */
+SchedClass sched_class_of(long long bytes);
+
+/**
+ * @brief Admits a transfer, or queues it behind those already waiting.
+ *        Call again (after SCHED_POLL_MS) while it returns 0.
+ * @return 1 once admitted, 0 while queued.
+ */
+int sched_admit(SchedFlow* flow, SchedClass cls, long long now_ms);
+
+/**
+ * @brief Charges bytes about to be sent to the transfer's and the shared bucket.
+ * @return 0 if the bytes may go now (they are charged), else milliseconds to wait.
+ */
+long long sched_grant(SchedFlow* flow, size_t bytes, long long now_ms);
+
+/**
+ * @brief Charges bytes that cannot wait (retransmissions); the buckets go into debt.
+ */
+void sched_charge(SchedFlow* flow, size_t bytes, long long now_ms);
+
+/**
+ * @brief Frees the transfer's slot, or takes it out of the wait queue.
+ */
+void sched_release(SchedFlow* flow);
+
+/**
+ * @brief Records interactive traffic (chat): background transfers pause for SCHED_IDLE_MS.
+ */
+void sched_note_interactive(long long now_ms);
+
+/**
+ * @brief Counters for logs: transfers sending and waiting.
+ */
+void sched_counts(int* active, int* queued);
+
+#endif // TRANSFER_SCHEDULER_H
@@ -0,0 +1,85 @@
+#!/bin/bash
+# Multicast check: one file to several co-paced recipients should be read from
+# disk about once per chunk, not once per recipient. Without arguments it runs
+# a small group, then one larger than the old 64-transfer table.
+# Usage: ./test_multicast.sh [recipients] [size_mb]   (run from scripts/, after a build)
+
+CHUNK=65536
+cd ..
+ROOT=$(pwd)
+WORK=
+# Clients quit when their input ends, once the test is over
+cleanup() {
+    [ -n "$WORK" ] || return
+    touch "$WORK/done"; sleep 0.5; kill $(jobs -p) 2>/dev/null; wait 2>/dev/null
+    [ -n "$KEEP" ] || rm -rf "$WORK"
+    WORK=
+}
+trap cleanup EXIT
+
+# run_case <recipients> <size_mb>: one multicast to that many clients, 0 if every copy is identical
+run_case() {
+    local RECIPIENTS=$1 SIZE_MB=$2
+    WORK=$(mktemp -d)
+    mkdir -p "$WORK/srv/assets/to_send" "$WORK/srv/assets/received"
+    cp assets/server.cfg "$WORK/srv/assets/"
+    head -c $((SIZE_MB * 1024 * 1024)) /dev/urandom > "$WORK/srv/assets/to_send/mc.bin"
+    local TOTAL=$(( (SIZE_MB * 1024 * 1024 + CHUNK - 1) / CHUNK ))
+
+    (cd "$WORK/srv" && CONFIG_REACTORS=2 exec "$ROOT/build/bin/server" assets/server.cfg > server.log 2>&1) &
+    sleep 0.5
+    if ! kill -0 $! 2>/dev/null; then
+        echo "[✗] Server did not start (is another one using the ports?)."
+        return 1
+    fi
+
+    # Clients 1..N only receive; the last one to connect asks for the multicast
+    local PAUSE=0.2
+    [ "$RECIPIENTS" -le 16 ] || PAUSE=0.05
+    for i in $(seq 1 $((RECIPIENTS + 1))); do
+        mkdir -p "$WORK/c$i/assets/to_send" "$WORK/c$i/assets/received"
+        sed "s/^chunk_size .*/chunk_size $CHUNK/" assets/client_file.cfg > "$WORK/c$i/assets/client_file.cfg"
+        if [ "$i" -gt "$RECIPIENTS" ]; then input="0\nmc.bin\n*\n"; sleep 1; else input=""; fi
+        (cd "$WORK/c$i" && (sleep 1; printf "$input"; until [ -e "$WORK/done" ]; do sleep 0.2; done) | "$ROOT/build/bin/client" assets/client_file.cfg > client.log 2>&1) &
+        sleep $PAUSE
+    done
+
+    for _ in $(seq 1 600); do
+        grep -q "Multicast of 'mc.bin' ended" "$WORK/srv/server.log" && break
+        sleep 0.1
+    done
+    local RESULT=$(grep "Multicast of 'mc.bin' ended" "$WORK/srv/server.log")
+    if [ -z "$RESULT" ]; then
+        echo "[✗] Multicast to $RECIPIENTS recipient(s) did not end."
+        return 1
+    fi
+    echo "[*] ${RESULT#*\] }"
+
+    local FAILED=0
+    for i in $(seq 1 $RECIPIENTS); do
+        if ! cmp -s "$WORK/c$i/assets/received/mc.bin" "$WORK/srv/assets/to_send/mc.bin"; then
+            echo "[✗] Client $i did not receive an identical copy."
+            FAILED=1
+        fi
+    done
+
+    # Retries may re-read a few chunks; a start or cache miss per recipient would not fit in 5 %
+    local READS=$(echo "$RESULT" | sed -n 's/.* \([0-9]*\) chunk(s) read.*/\1/p')
+    if [ -z "$READS" ] || [ "$READS" -gt $((TOTAL + TOTAL / 20)) ]; then
+        echo "[✗] ${READS:-?} chunk(s) read for $TOTAL chunk(s)."
+        FAILED=1
+    else
+        echo "[✓] $READS chunk(s) read for $TOTAL chunk(s) and $RECIPIENTS recipient(s)."
+    fi
+    cleanup
+    return $FAILED
+}
+
+if [ $# -gt 0 ]; then
+    run_case "$1" "${2:-24}"
+    exit $?
+fi
+FAILED=0
+run_case 3 24 || FAILED=1
+run_case 80 8 || FAILED=1
+exit $FAILED
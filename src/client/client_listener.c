@@ -4,110 +4,446 @@
  *        Handles chat and file chunk buffering, reassembly, and moderation.
  *        Supports chat, file, game (stub), and system frames in real time.
  *        Delegates file logic to features/file_transfer.c.
+ *        Reads through a framing buffer so coalesced or split frames are handled.
+ *        Answers the server's CAPS offer and switches to binary v2 frames when enabled.
+ *        Frames are routed through a [channel][status] jump table.
+ *        Presence arrives as one LIST snapshot followed by JOIN/LEAVE deltas.
+ *        RAW headers switch the stream to a raw data phase until the body is consumed.
+ *        File retries and deadlines fire from a timer wheel that bounds each wait.
+ *        Large chunked files may be split across extra connections, each served
+ *        by a stream listener thread of its own.
+ *        Accepts LZ4 payload compression when offered on binary frames.
+ *        Files this client offers are sent from here once the receiver's READY
+ *        or RESUME comes back through the server's relay.
+ *        File WAIT frames from a queued or throttled sender keep transfers alive.
+ *        File DONE frames are checked against the received chunks' digests.
  * @author Oussama Amara
- * @version 1.4
- * @date 2025-10-04
+ * @version 3.2
+ * @date 2026-10-17
  */
 
 #include "client_listener.h"
 #include "protocol.h"
+#include "framing.h"
 #include "logger.h"
 #include "chat.h"
 #include "file_transfer.h"
+#include "router.h"
+#include "platform.h"
+#include "timer_wheel.h"
 
 #include <string.h>
 #include <stdio.h>
-#include <time.h>
+#include <stdlib.h>
+#include <errno.h>
+#ifndef _WIN32
+#include <poll.h>
+#include <unistd.h>
+#endif
 
 extern volatile int client_running;
-extern FileBuffer buffers[MAX_CLIENTS];
-#define TIMEOUT_SECONDS 10
+
+static const ListenerContext* main_ctx; ///< Main connection's settings, copied into streams
+
+/**
+ * @brief Waits until the socket is readable or timeout_ms passes (-1 = no limit).
+ * @return 1 if readable, 0 on timeout, -1 on error.
+ */
+static int wait_readable(int sockfd, int timeout_ms) {
+#ifdef _WIN32
+    fd_set rfds;
+    FD_ZERO(&rfds);
+    FD_SET(sockfd, &rfds);
+    struct timeval tv = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+    int rc = select(sockfd + 1, &rfds, NULL, NULL, timeout_ms < 0 ? NULL : &tv);
+#else
+    struct pollfd pfd = { .fd = sockfd, .events = POLLIN, .revents = 0 };
+    int rc = poll(&pfd, 1, timeout_ms);
+    if (rc < 0 && errno == EINTR) return 0;
+#endif
+    return rc > 0 ? 1 : rc;
+}
+
+// ─────────────────────────────────────────────────────────────
+// Frame handlers (ctx is the ListenerContext)
+// ─────────────────────────────────────────────────────────────
+
+/**
+ * @brief Capability offer: replies with what we accept, then switches our own frames.
+ */
+static void on_caps(const FrameView* view, void* arg) {
+    ListenerContext* ctx = arg;
+    char caps[MAX_MESSAGE_LENGTH];
+    frame_view_copy(view, view->payload, caps, sizeof(caps));
+    unsigned wire = ((ctx->want_binary && strstr(caps, CAP_BINARY_V2)) ? WIRE_BINARY : 0) |
+                    ((ctx->want_crc32c && strstr(caps, CAP_CRC32C)) ? WIRE_CRC32C : 0) |
+                    ((ctx->want_raw && strstr(caps, CAP_RAW)) ? WIRE_RAW : 0);
+    if ((wire & WIRE_BINARY) && ctx->want_lz4 && strstr(caps, CAP_LZ4)) wire |= WIRE_LZ4;
+    if (wire) {
+        char reply[64] = "";
+        if (wire & WIRE_BINARY) strcat(reply, "," CAP_BINARY_V2);
+        if (wire & WIRE_CRC32C) strcat(reply, "," CAP_CRC32C);
+        if (wire & WIRE_RAW) strcat(reply, "," CAP_RAW);
+        if (wire & WIRE_LZ4) strcat(reply, "," CAP_LZ4);
+        memmove(reply, reply + 1, strlen(reply));  // Drop the leading comma
+        send_command(ctx->sockfd, "system", view->dest_id, 0, reply, "CAPS");
+        frame_set_wire(ctx->sockfd, wire);
+        log_message(LOG_INFO, "Negotiated capabilities: %s", reply);
+    }
+
+    // A stream asks for its range once the wire format is settled
+    if (ctx->request[0]) {
+        send_chunk(ctx->sockfd, "file", view->dest_id, ctx->request_dest, ctx->request, strlen(ctx->request), "RESUME",
+                   ctx->request_chunk, 1);
+        ctx->request[0] = '\0';
+    }
+}
+
+/**
+ * @brief Buffers a chat chunk and prints the message once it is complete.
+ */
+static void on_chat_chunk(const FrameView* view, void* arg) {
+    (void)arg;
+    buffer_chat_chunk(view);
+    const char* full = assemble_chat_message(view->src_id, view->dest_id);
+    if (!full) return;
+
+    if (moderate_chat_message(full)) {
+        log_message(LOG_WARN, "Blocked message from %d due to banned content.", view->src_id);
+        return;
+    }
+    printf("\n[CHAT] From %d → %s\n> ", view->src_id, full);
+    fflush(stdout);
+}
+
+static void on_file_incoming(const FrameView* view, void* arg) {
+    ListenerContext* ctx = arg;
+    handle_file_incoming(view, ctx->sockfd, ctx->chunk_size);  // Wake-up logic
+}
+
+static void on_file_batch(const FrameView* view, void* arg) {
+    ListenerContext* ctx = arg;
+    handle_file_batch(view, ctx->sockfd, ctx->chunk_size);  // Manifest; answered with WANT
+}
+
+static void on_file_start(const FrameView* view, void* arg) {
+    ListenerContext* ctx = arg;
+    handle_file_start(view, ctx->sockfd, !ctx->is_stream);  // Open destination; only the main connection splits
+}
+
+static void on_file_done(const FrameView* view, void* arg) {
+    ListenerContext* ctx = arg;
+    int refetching = handle_file_done(view, ctx->sockfd, &ctx->raw);  // Verify the digest, then save
+    if (ctx->is_stream && !refetching) ctx->stream_done = 1;  // The stream's range is delivered
+}
+
+static void on_file_raw(const FrameView* view, void* arg) {
+    ListenerContext* ctx = arg;
+    handle_file_raw(view, ctx->sockfd, &ctx->raw);
+}
+
+static void on_file_chunk(const FrameView* view, void* arg) {
+    handle_file_chunk(view, ((ListenerContext*)arg)->sockfd);  // Buffer + reassemble
+}
+
+static void on_file_wait(const FrameView* view, void* arg) {
+    (void)arg;
+    handle_file_wait(view);  // Sender is queued or throttled: keep waiting
+}
+
+static void on_file_err(const FrameView* view, void* arg) {
+    (void)arg;
+    handle_file_error(view);  // Sender gave up before the first chunk
+}
+
+// Sending side of a relayed file: the receiver's answers arrive through the server
+
+static void on_file_ready(const FrameView* view, void* arg) {
+    ListenerContext* ctx = arg;
+    char filename[MAX_MESSAGE_LENGTH];
+    frame_view_copy(view, view->payload, filename, sizeof(filename));
+    send_file_to_client(&ctx->sockfd, filename, view->dest_id, view->src_id, view->seq_num);  // seq: granted chunk size
+}
+
+static void on_file_resume(const FrameView* view, void* arg) {
+    ListenerContext* ctx = arg;
+    char request[MAX_MESSAGE_LENGTH], transfer_id[TRANSFER_ID_LEN + 1];
+    int first, end;
+    frame_view_copy(view, view->payload, request, sizeof(request));
+    const char* filename = file_parse_resume(request, transfer_id, &first, &end);
+    if (filename)
+        resume_file_to_client(ctx->sockfd, filename, view->dest_id, view->src_id, view->seq_num, transfer_id, first, end);
+}
+
+static void on_file_have(const FrameView* view, void* arg) {
+    (void)arg;
+    log_message(LOG_INFO, "Client %d already has %.*s; nothing to send.", view->src_id,
+                (int)view->payload.len, FRAME_VIEW_PTR(view, view->payload));
+}
+
+static void on_file_sack(const FrameView* view, void* arg) {
+    file_transfer_on_sack(view, ((ListenerContext*)arg)->sockfd, view->status == ST_RETRY);
+}
+
+static void on_list(const FrameView* view, void* arg) {
+    (void)arg;
+    // Snapshot entries are "id,name" separated by ';'
+    const char* p = FRAME_VIEW_PTR(view, view->payload);
+    const char* end = p + view->payload.len;
+    while (p < end) {
+        const char* sep = memchr(p, ';', (size_t)(end - p));
+        if (!sep) sep = end;
+        log_message(LOG_INFO, "Active client: %.*s", (int)(sep - p), p);
+        p = sep + 1;
+    }
+}
+
+static void on_join(const FrameView* view, void* arg) {
+    (void)arg;
+    log_message(LOG_INFO, "Client joined: %.*s", (int)view->payload.len, FRAME_VIEW_PTR(view, view->payload));
+}
+
+static void on_leave(const FrameView* view, void* arg) {
+    ListenerContext* ctx = arg;
+    log_message(LOG_INFO, "Client %.*s left.", (int)view->payload.len, FRAME_VIEW_PTR(view, view->payload));
+    file_transfer_release(ctx->sockfd, atoi(FRAME_VIEW_PTR(view, view->payload)));  // Files we were sending it
+}
+
+static void on_start(const FrameView* view, void* arg) {
+    (void)view;
+    (void)arg;
+    log_message(LOG_INFO, "Interaction enabled.");
+}
+
+static void on_wait(const FrameView* view, void* arg) {
+    (void)view;
+    (void)arg;
+    log_message(LOG_INFO, "Waiting for another client...");
+}
+
+/**
+ * @brief Builds the listener's jump table.
+ */
+static void register_routes(FrameRouter* router) {
+    router_init(router);
+    router_register(router, CH_SYSTEM, ST_CAPS, on_caps);
+    router_register(router, CH_SYSTEM, ST_LIST, on_list);
+    router_register(router, CH_SYSTEM, ST_JOIN, on_join);
+    router_register(router, CH_SYSTEM, ST_LEAVE, on_leave);
+    router_register(router, CH_SYSTEM, ST_START, on_start);
+    router_register(router, CH_SYSTEM, ST_WAIT, on_wait);
+    router_register(router, CH_CHAT, ST_CHUNK, on_chat_chunk);
+    router_register(router, CH_FILE, ST_INCOMING, on_file_incoming);
+    router_register(router, CH_FILE, ST_BATCH, on_file_batch);
+    router_register(router, CH_FILE, ST_START, on_file_start);
+    router_register(router, CH_FILE, ST_CHUNK, on_file_chunk);
+    router_register(router, CH_FILE, ST_WAIT, on_file_wait);
+    router_register(router, CH_FILE, ST_ERR, on_file_err);
+    router_register(router, CH_FILE, ST_RAW, on_file_raw);
+    router_register(router, CH_FILE, ST_DONE, on_file_done);
+    router_register(router, CH_FILE, ST_READY, on_file_ready);
+    router_register(router, CH_FILE, ST_RESUME, on_file_resume);
+    router_register(router, CH_FILE, ST_HAVE, on_file_have);
+    router_register(router, CH_FILE, ST_ACK, on_file_sack);
+    router_register(router, CH_FILE, ST_RETRY, on_file_sack);
+}
+
+/**
+ * @brief Handles one frame body of either wire format.
+ * @param router Listener routes.
+ * @param ctx Listener state (socket to reply on, negotiated options).
+ * @param frame Frame body from the receive buffer.
+ * @param len Body length.
+ */
+static void handle_frame(const FrameRouter* router, ListenerContext* ctx, const char* frame, size_t len) {
+    FrameView view;
+    if (parse_frame_view(frame, len, &view) != 0) return;
+    // Only chat payloads are text worth printing; file payloads may be chunk bytes
+    if (view.channel == CH_CHAT)
+        log_message(LOG_DEBUG, "Received frame: %s|%d|%d|%.*s|%s",
+                    channel_name(view.channel), view.src_id, view.dest_id,
+                    (int)view.payload.len, FRAME_VIEW_PTR(&view, view.payload), status_name(view.status));
+    else
+        log_message(LOG_DEBUG, "Received frame: %s|%d|%d|<%u bytes>|%s",
+                    channel_name(view.channel), view.src_id, view.dest_id,
+                    (unsigned)view.payload.len, status_name(view.status));
+
+    router_dispatch(router, &view, ctx);
+}
+
 /**
- * @brief Checks for stalled file transfers and aborts if timeout exceeded.
- * @param sockfd Socket descriptor to send TIMEOUT frames.
+ * @brief Reads and handles frames until the connection closes (or, on a
+ *        stream, until its range is done). Every complete frame contained in a
+ *        read is handled; partial frames wait in the receive buffer.
  */
-static void check_file_transfer_timeouts(int sockfd) {
-    time_t now = time(NULL);
-    for (int i = 0; i < MAX_CLIENTS; ++i) {
-        FileBuffer* buf = &buffers[i];
-        if (buf->active && buf->final_seq >= 0 && now - buf->last_received > TIMEOUT_SECONDS) {
-            log_message(LOG_WARN, "[FILE] Timeout waiting for chunk from client %d. Aborting transfer of '%s'.", buf->src_id, buf->filename);
-
-            char err[MAX_COMMAND_LENGTH];
-            build_frame("system", 0, buf->src_id, buf->filename, "TIMEOUT", err);
-            send(sockfd, err, strlen(err), 0);
-
-            buf->active = 0;
+static void listen_loop(ListenerContext* ctx) {
+    int sockfd = ctx->sockfd;
+    RecvBuffer* rbuf = ctx->rbuf;
+
+    FrameRouter router;
+    register_routes(&router);
+
+    // Retries and transfer deadlines run here, between reads
+    TimerWheel timers;
+    timer_wheel_init(&timers, monotonic_ms());
+    file_transfer_set_timers(&timers);
+
+    while (client_running && !ctx->stream_done) {
+        const char* frame;
+        size_t len;
+        int rc;
+        while (ctx->raw.remaining == 0 && (rc = recvbuf_next_frame(rbuf, &frame, &len)) == 1) {
+            handle_frame(&router, ctx, frame, len);
         }
-        for (int i = 0; i <= buf->final_seq; ++i) {
-            if (!buf->received[i]) {
-                char retry[MAX_COMMAND_LENGTH];
-                snprintf(retry, sizeof(retry), "RETRY|%d", i);
-                build_frame("file", 0, buf->src_id, retry, "RETRY", retry);
-                send(sockfd, retry, strlen(retry), 0);
-                log_message(LOG_INFO, "[FILE] Requested retry for missing chunk #%d from client %d", i, buf->src_id);
+        if (ctx->raw.remaining == 0 && rc < 0) break;
+
+        // Raw data phase: the next raw.remaining bytes are file body, not frames
+        if (ctx->raw.remaining > 0) {
+            const char* data;
+            size_t taken = recvbuf_take(rbuf, (size_t)ctx->raw.remaining, &data);
+            if (taken > 0) {
+                file_raw_write(&ctx->raw, data, taken);
+                continue;
             }
+            if (file_raw_from_socket(&ctx->raw) <= 0) break;
+            continue;
+        }
+
+        timer_wheel_advance(&timers, monotonic_ms());
+        int ready = wait_readable(sockfd, timer_wheel_timeout(&timers));
+        timer_wheel_advance(&timers, monotonic_ms());
+        if (ready < 0) break;
+        if (ready == 0) continue;
+
+        if (recvbuf_fill(rbuf, sockfd) <= 0) break;
+    }
+
+    // Incomplete files keep their checkpoint for the next offer
+    file_transfer_abandon();
+    file_transfer_set_timers(NULL);
+    frame_v2_release();
+}
+
+// ─────────────────────────────────────────────────────────────
+// Extra connections of split files
+// ─────────────────────────────────────────────────────────────
+
+/**
+ * @brief State of one stream thread; freed when the stream ends.
+ */
+typedef struct {
+    ListenerContext ctx;
+    RecvBuffer rbuf;
+} FileStream;
+
+static void close_socket(int sockfd) {
+#ifdef _WIN32
+    closesocket(sockfd);
+#else
+    close(sockfd);
+#endif
+}
+
+/**
+ * @brief Connects to the server and waits for ID_ASSIGN.
+ *        Frames after it stay in rbuf for the listener.
+ * @return The socket, or -1 on failure.
+ */
+static int connect_stream(const char* host, int port, RecvBuffer* rbuf) {
+    int sockfd = (int)socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd < 0) return -1;
+
+    struct sockaddr_in servaddr;
+    memset(&servaddr, 0, sizeof(servaddr));
+    servaddr.sin_family = AF_INET;
+    servaddr.sin_port = htons((unsigned short)port);
+    servaddr.sin_addr.s_addr = inet_addr(host);
+    if (connect(sockfd, (struct sockaddr*)&servaddr, sizeof(servaddr)) != 0) {
+        close_socket(sockfd);
+        return -1;
+    }
+
+    int assigned = 0;
+    while (!assigned && recvbuf_fill(rbuf, sockfd) > 0) {
+        const char* frame;
+        size_t len;
+        while (!assigned && recvbuf_next_frame(rbuf, &frame, &len) == 1) {
+            FrameView view;
+            assigned = parse_frame_view(frame, len, &view) == 0 && view.status == ST_READY &&
+                       view.payload.len == 9 && memcmp(FRAME_VIEW_PTR(&view, view.payload), "ID_ASSIGN", 9) == 0;
         }
     }
+    if (!assigned) {
+        close_socket(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+static THREAD_FUNC stream_listener(void* arg) {
+    FileStream* stream = arg;
+    ListenerContext* ctx = &stream->ctx;
 
+    ctx->sockfd = connect_stream(ctx->host, ctx->port, &stream->rbuf);
+    if (ctx->sockfd < 0) {
+        log_message(LOG_ERROR, "[FILE] Stream could not connect to %s:%d", ctx->host, ctx->port);
+    } else {
+        log_message(LOG_INFO, "[FILE] Stream connected for '%s'", ctx->request);
+        listen_loop(ctx);
+        close_socket(ctx->sockfd);
+    }
+    recvbuf_free(&stream->rbuf);
+    free(stream);
+    THREAD_RETURN;
+}
+
+/**
+ * @brief FileStreamOpener: starts a stream thread that asks for one range.
+ *        Connecting happens on the new thread so the main listener never waits.
+ */
+static int open_file_stream(const char* request, int chunk_size, int sender_id) {
+    FileStream* stream = calloc(1, sizeof(*stream));
+    if (!stream) return -1;
+    if (recvbuf_init(&stream->rbuf, RECVBUF_INITIAL_SIZE) != 0) {
+        free(stream);
+        return -1;
+    }
+
+    ListenerContext* ctx = &stream->ctx;
+    ctx->rbuf = &stream->rbuf;
+    ctx->want_binary = main_ctx->want_binary;
+    ctx->want_crc32c = main_ctx->want_crc32c;
+    ctx->want_lz4 = main_ctx->want_lz4;
+    ctx->chunk_size = chunk_size;
+    ctx->host = main_ctx->host;
+    ctx->port = main_ctx->port;
+    ctx->is_stream = 1;
+    ctx->request_chunk = chunk_size;
+    ctx->request_dest = sender_id;
+    snprintf(ctx->request, sizeof(ctx->request), "%s", request);
+
+    thread_t thread;
+    if (create_thread(&thread, stream_listener, stream) != 0) {
+        recvbuf_free(&stream->rbuf);
+        free(stream);
+        return -1;
+    }
+    detach_thread(thread);
+    return 0;
 }
 
 /**
  * @brief Thread function that continuously listens for incoming frames.
- *        Handles chat and file chunk buffering and reassembly, logs system frames,
- *        and prints messages to console in real time.
- * @param arg Pointer to socket descriptor (int*).
+ * @param arg Pointer to ListenerContext.
  * @return THREAD_FUNC return value.
  */
 THREAD_FUNC client_listener(void* arg) {
-    int sockfd = *((int*)arg);
-    char buffer[MAX_COMMAND_LENGTH];
-
-    while (client_running) {
-        int received = recv(sockfd, buffer, sizeof(buffer) - 1, 0);
-        if (received <= 0) break;
-
-        buffer[received] = '\0';
-        log_message(LOG_INFO, "Received frame: %s", buffer);
-
-        ParsedCommand cmd;
-        if (parse_command(buffer, &cmd) != 0) continue;
-
-        // Handle incoming chat chunks
-        if (strcmp(cmd.channel, "chat") == 0 && strcmp(cmd.status, "CHUNK") == 0) {
-            buffer_chat_chunk(&cmd);
-            const char* full = assemble_chat_message(cmd.src_id, cmd.dest_id);
-            if (full) {
-                if (moderate_chat_message(full)) {
-                    log_message(LOG_WARN, "Blocked message from %d due to banned content.", cmd.src_id);
-                    continue;
-                }
-                printf("\n[CHAT] From %d → %s\n> ", cmd.src_id, full);
-                fflush(stdout);
-            }
-        }
+    ListenerContext* ctx = (ListenerContext*)arg;
 
-        // Handle incoming file transfer
-        else if (strcmp(cmd.channel, "file") == 0) {
-            if (strcmp(cmd.status, "INCOMING") == 0) {
-                handle_file_incoming(&cmd, sockfd);  // Wake-up logic
-            } else if (strcmp(cmd.status, "CHUNK") == 0) {
-                check_file_transfer_timeouts(sockfd); // ⏱️ Timeout check
-                handle_file_chunk(&cmd, sockfd);      // Buffer + reassemble
-            }
-        }
+    main_ctx = ctx;
+    file_transfer_set_streams(ctx->streams, open_file_stream);
 
-        // Handle system frames
-        else if (strcmp(cmd.status, "LIST") == 0) {
-            log_message(LOG_INFO, "Active client: %s", cmd.message);
-        }
-        else if (strcmp(cmd.status, "START") == 0) {
-            log_message(LOG_INFO, "Interaction enabled.");
-        }
-        else if (strcmp(cmd.status, "WAIT") == 0) {
-            log_message(LOG_INFO, "Waiting for another client...");
-        }
-    }
+    listen_loop(ctx);
 
     log_message(LOG_WARN, "Listener thread exiting.");
     THREAD_RETURN;
@@ -5,18 +5,27 @@
  *        Uses custom protocol format: <CRC>|<CHANNEL>|<SRC_ID>|<DEST_ID>|<MESSAGE>|<STATUS>
  *        Supports chat, file, and game features based on port configuration.
  *        Real-time reception is handled by a background listener thread.
+ *        Interrupted file transfers resume from checkpoints in assets/received.
+ *        With `relay on`, files are offered from this client's own assets/to_send
+ *        and relayed by the server instead of requested from the server's copy.
  * @author Oussama Amara
- * @version 1.5
- * @date 2025-09-28
+ * @version 2.3
+ * @date 2026-10-17
  */
 
 #include "client.h"
 #include "config.h"
 #include "logger.h"
 #include "protocol.h"
+#include "framing.h"
 #include "chat.h"
 #include "client_listener.h"
 #include "platform_thread.h"
+#include "partial_file.h"
+#include "content_store.h"
+#include "file_transfer.h"
+#include "platform.h"
+#include "asset_index.h"
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -97,21 +106,26 @@ int run_client(int argc, char** argv) {
 
     log_message(LOG_INFO, "[ok] Connected to server");
 
-    char buffer[MAX_COMMAND_LENGTH];
     int my_id = -1;
 
-    // Handshake: wait for ID_ASSIGN
-    while (1) {
-        int received = recv(sockfd, buffer, sizeof(buffer) - 1, 0);
-        if (received <= 0) break;
-
-        buffer[received] = '\0';
-        ParsedCommand cmd;
-        if (parse_command(buffer, &cmd) == 0) {
-            if (strcmp(cmd.status, "READY") == 0 && strcmp(cmd.message, "ID_ASSIGN") == 0) {
-                my_id = cmd.dest_id;
-                log_message(LOG_INFO, "Assigned client ID: %d", my_id);
-                break;
+    RecvBuffer rbuf;
+    if (recvbuf_init(&rbuf, RECVBUF_INITIAL_SIZE) != 0) {
+        log_message(LOG_ERROR, "Failed to allocate receive buffer.");
+        return 1;
+    }
+
+    // Handshake: wait for ID_ASSIGN; later frames stay buffered for the listener
+    while (my_id < 0 && recvbuf_fill(&rbuf, sockfd) > 0) {
+        const char* frame;
+        size_t len;
+        while (my_id < 0 && recvbuf_next_frame(&rbuf, &frame, &len) == 1) {
+            FrameView view;
+            if (parse_frame_view(frame, len, &view) == 0) {
+                if (view.status == ST_READY && view.payload.len == 9 &&
+                    memcmp(FRAME_VIEW_PTR(&view, view.payload), "ID_ASSIGN", 9) == 0) {
+                    my_id = view.dest_id;
+                    log_message(LOG_INFO, "Assigned client ID: %d", my_id);
+                }
             }
         }
     }
@@ -122,10 +136,19 @@ int run_client(int argc, char** argv) {
     }
 
     init_chat_buffers();  // Initialize chunk reassembly buffers
+    partial_init();       // Shared destinations of resumable and split file transfers
+    content_store_init(); // Received files are kept by content hash to skip repeats
+    file_transfer_init(cfg.file_window);  // Senders of the files this client relays
+    asset_index_init();   // Files this client offers, watched for changes
 
     // Launch listener thread
+    ListenerContext listener_ctx = { .sockfd = sockfd, .rbuf = &rbuf, .want_binary = cfg.binary_protocol,
+                                     .want_crc32c = cfg.crc32c, .want_raw = cfg.raw_transfer,
+                                     .want_lz4 = cfg.compression,
+                                     .chunk_size = cfg.chunk_size, .host = cfg.host, .port = cfg.port,
+                                     .streams = cfg.streams };
     thread_t listener_thread;
-    create_thread(&listener_thread, client_listener, &sockfd);
+    create_thread(&listener_thread, client_listener, &listener_ctx);
     detach_thread(listener_thread);
 
     // Main loop: user input
@@ -152,15 +175,42 @@ int run_client(int argc, char** argv) {
             send_chat(sockfd, my_id, target_id, message);
 
         } else if (strcmp(channel, "file") == 0) {
-            printf("[FILE] Enter filename to send (from assets/to_send/): ");
+            printf("[FILE] Enter filename, directory or a;b;c to send (from assets/to_send/): ");
             fflush(stdout);
             fgets(message, sizeof(message), stdin);
             message[strcspn(message, "\n")] = '\0';
 
             if (strlen(message) == 0) continue;
 
-            build_frame("file", my_id, target_id, message, "REQUEST", buffer);
-            send(sockfd, buffer, strlen(buffer), 0);
+            if (cfg.relay) {
+                // Announce our own copy; the receiver's READY comes back through the server
+                char hash[CONTENT_HASH_LEN + 1], offer[MAX_MESSAGE_LENGTH];
+                if (asset_index_hash(message, hash) != 0) {
+                    log_message(LOG_ERROR, "Cannot read '%s' from assets/to_send", message);
+                    continue;
+                }
+                snprintf(offer, sizeof(offer), "%s,%.*s", hash, (int)(sizeof(offer) - sizeof(hash) - 1), message);
+                send_command(sockfd, "file", my_id, target_id, offer, "OFFER");
+                log_message(LOG_INFO, "File '%s' offered to client %d", message, target_id);
+                continue;
+            }
+
+            if (target_id == 0) {
+                // Target 0 is the server: one read of the file fans out to many clients
+                char recipients[MAX_MESSAGE_LENGTH], request[2 * MAX_MESSAGE_LENGTH];
+                printf("[FILE] Enter recipient IDs (comma separated, * for everyone): ");
+                fflush(stdout);
+                if (!fgets(recipients, sizeof(recipients), stdin)) break;
+                recipients[strcspn(recipients, "\n")] = '\0';
+                if (strlen(recipients) == 0) continue;
+
+                snprintf(request, sizeof(request), "%s;%s", recipients, message);
+                send_command(sockfd, "file", my_id, 0, request, "REQUEST");
+                log_message(LOG_INFO, "Multicast of '%s' requested for %s", message, recipients);
+                continue;
+            }
+
+            send_command(sockfd, "file", my_id, target_id, message, "REQUEST");
             log_message(LOG_INFO, "File request sent to client %d for '%s'", target_id, message);
 
         } else if (strcmp(channel, "game") == 0) {
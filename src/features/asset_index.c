@@ -0,0 +1,426 @@
+/**
+ * @file asset_index.c
+ * @brief Index of assets/to_send: names hashed into buckets, an LRU set of open
+ *        descriptors, and a watcher thread that applies inotify events.
+ *        Everything is guarded by one lock; hashing a file runs outside it.
+ * @author Oussama Amara
+ * @version 1.0
+ * @date 2026-10-17
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE // O_CLOEXEC, F_DUPFD_CLOEXEC
+#endif
+
+#include "asset_index.h"
+#include "logger.h"
+#include "platform.h"
+#include "platform_thread.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ASSET_WATCH_EVENTS (IN_CREATE | IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_DELETE | IN_MOVED_FROM | \
+                            IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+/**
+ * @brief One indexed file.
+ */
+typedef struct AssetEntry {
+    struct AssetEntry* next;    ///< Next in the same bucket
+    unsigned bucket;            ///< Bucket it hangs in
+    AssetInfo info;
+    char hash[CONTENT_HASH_LEN + 1];
+    int hashed;                 ///< 1 once hash holds the current content's hash
+    unsigned generation;        ///< Bumped on every change, so a hash of older content is dropped
+    int fd;                     ///< Cached descriptor, -1 if none
+    int slot;                   ///< Index in fds[] while fd is open
+    unsigned long long used;    ///< Last open, for LRU eviction
+    char name[];                ///< Path below to_send
+} AssetEntry;
+
+/**
+ * @brief One watched directory.
+ */
+typedef struct {
+    int wd;                     ///< inotify watch, -1 = free
+    char* rel;                  ///< Path below to_send ("" for to_send itself)
+} AssetWatch;
+
+static struct {
+    int enabled;                ///< 1 once to_send is indexed and watched
+    mutex_t lock;
+    char to_send[PATH_MAX];     ///< Absolute path of assets/to_send
+    int dir_fd;                 ///< to_send, for openat()
+    int inotify_fd;
+    AssetEntry* buckets[ASSET_INDEX_BUCKETS];
+    int files;
+    AssetEntry* fds[ASSET_FD_CACHE];
+    int open_fds;
+    unsigned long long clock;   ///< LRU clock
+    AssetWatch* watches;
+    int watch_count;
+    int watch_cap;
+} assets;
+
+// ─────────────────────────────────────────────────────────────
+// Entries and descriptors (lock held)
+// ─────────────────────────────────────────────────────────────
+
+static unsigned name_bucket(const char* name) {
+    unsigned long long hash = 1469598103934665603ULL;
+    for (const char* p = name; *p; ++p) hash = (hash ^ (unsigned char)*p) * 1099511628211ULL;
+    return (unsigned)(hash % ASSET_INDEX_BUCKETS);
+}
+
+static AssetEntry* entry_find(const char* name) {
+    for (AssetEntry* e = assets.buckets[name_bucket(name)]; e; e = e->next)
+        if (strcmp(e->name, name) == 0) return e;
+    return NULL;
+}
+
+static void fd_close(AssetEntry* e) {
+    if (e->fd < 0) return;
+    close(e->fd);
+    e->fd = -1;
+    assets.fds[e->slot] = assets.fds[--assets.open_fds];
+    assets.fds[e->slot]->slot = e->slot;
+}
+
+/**
+ * @brief Opens an entry's descriptor, closing the least recently used one if
+ *        the cache is full.
+ */
+static int fd_open(AssetEntry* e) {
+    if (e->fd >= 0) return 0;
+    int fd = openat(assets.dir_fd, e->name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    if (assets.open_fds == ASSET_FD_CACHE) {
+        AssetEntry* oldest = assets.fds[0];
+        for (int i = 1; i < assets.open_fds; ++i)
+            if (assets.fds[i]->used < oldest->used) oldest = assets.fds[i];
+        fd_close(oldest);
+    }
+    e->fd = fd;
+    e->slot = assets.open_fds;
+    assets.fds[assets.open_fds++] = e;
+    return 0;
+}
+
+static void entry_remove(const char* name) {
+    unsigned b = name_bucket(name);
+    for (AssetEntry** link = &assets.buckets[b]; *link; link = &(*link)->next) {
+        AssetEntry* e = *link;
+        if (strcmp(e->name, name) != 0) continue;
+        fd_close(e);
+        *link = e->next;
+        free(e);
+        assets.files--;
+        return;
+    }
+}
+
+/**
+ * @brief Brings an entry in line with the file on disk: added, updated (cached
+ *        descriptor and hash dropped) or removed.
+ */
+static void entry_refresh(const char* name) {
+    struct stat st;
+    if (fstatat(assets.dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode)) {
+        entry_remove(name);
+        return;
+    }
+
+    AssetEntry* e = entry_find(name);
+    if (!e) {
+        size_t len = strlen(name);
+        e = calloc(1, sizeof(*e) + len + 1);
+        if (!e) return;
+        memcpy(e->name, name, len + 1);
+        e->fd = -1;
+        e->bucket = name_bucket(name);
+        e->next = assets.buckets[e->bucket];
+        assets.buckets[e->bucket] = e;
+        assets.files++;
+    } else {
+        fd_close(e);  // A replaced file keeps the old inode open
+    }
+    e->info.size = (long long)st.st_size;
+    e->info.mtime = (long long)st.st_mtime;
+    e->hashed = 0;
+    e->generation++;
+}
+
+// ─────────────────────────────────────────────────────────────
+// Directory scan and watches (lock held)
+// ─────────────────────────────────────────────────────────────
+
+static int hidden(const char* name) {
+    return name[0] == '.';
+}
+
+static void watch_add(int wd, const char* rel) {
+    for (int i = 0; i < assets.watch_count; ++i) {
+        if (assets.watches[i].wd != wd) continue;
+        free(assets.watches[i].rel);
+        assets.watches[i].rel = strdup(rel);
+        return;
+    }
+    if (assets.watch_count == assets.watch_cap) {
+        int cap = assets.watch_cap ? assets.watch_cap * 2 : 16;
+        AssetWatch* grown = realloc(assets.watches, (size_t)cap * sizeof(*grown));
+        if (!grown) return;
+        assets.watches = grown;
+        assets.watch_cap = cap;
+    }
+    assets.watches[assets.watch_count].wd = wd;
+    assets.watches[assets.watch_count].rel = strdup(rel);
+    assets.watch_count++;
+}
+
+static const char* watch_rel(int wd) {
+    for (int i = 0; i < assets.watch_count; ++i)
+        if (assets.watches[i].wd == wd) return assets.watches[i].rel;
+    return NULL;
+}
+
+static void watch_forget(int wd) {
+    for (int i = 0; i < assets.watch_count; ++i) {
+        if (assets.watches[i].wd != wd) continue;
+        free(assets.watches[i].rel);
+        assets.watches[i] = assets.watches[--assets.watch_count];
+        return;
+    }
+}
+
+/**
+ * @brief Watches a directory below to_send and indexes the files in it.
+ *        The watch comes first, so nothing written during the scan is missed.
+ */
+static void scan_dir(const char* rel, int depth) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s%s%s", assets.to_send, rel[0] ? "/" : "", rel);
+    int wd = inotify_add_watch(assets.inotify_fd, path, ASSET_WATCH_EVENTS | IN_ONLYDIR | IN_DONT_FOLLOW);
+    if (wd < 0) {
+        log_message(LOG_WARN, "[ASSETS] Cannot watch '%s': %s", path, strerror(errno));
+    } else {
+        watch_add(wd, rel);
+    }
+
+    DIR* d = opendir(path);
+    if (!d) return;
+    struct dirent* ent;
+    while ((ent = readdir(d)) != NULL) {
+        if (hidden(ent->d_name)) continue;
+        char child[PATH_MAX];
+        snprintf(child, sizeof(child), "%s%s%s", rel, rel[0] ? "/" : "", ent->d_name);
+
+        struct stat st;
+        if (fstatat(assets.dir_fd, child, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            if (depth < ASSET_INDEX_MAX_DEPTH) scan_dir(child, depth + 1);
+        } else if (S_ISREG(st.st_mode)) {
+            entry_refresh(child);
+        }
+    }
+    closedir(d);
+}
+
+static int depth_of(const char* rel) {
+    int depth = rel[0] ? 1 : 0;
+    for (const char* p = rel; *p; ++p) depth += *p == '/';
+    return depth;
+}
+
+/**
+ * @brief Drops every entry and watch and indexes to_send again: after a lost
+ *        event (queue overflow) or a directory renamed or removed under us.
+ */
+static void rebuild(void) {
+    for (int b = 0; b < ASSET_INDEX_BUCKETS; ++b) {
+        while (assets.buckets[b]) {
+            AssetEntry* e = assets.buckets[b];
+            fd_close(e);
+            assets.buckets[b] = e->next;
+            free(e);
+        }
+    }
+    assets.files = 0;
+    for (int i = 0; i < assets.watch_count; ++i) {
+        inotify_rm_watch(assets.inotify_fd, assets.watches[i].wd);
+        free(assets.watches[i].rel);
+    }
+    assets.watch_count = 0;
+    scan_dir("", 0);
+}
+
+// ─────────────────────────────────────────────────────────────
+// Watcher thread
+// ─────────────────────────────────────────────────────────────
+
+static void apply_event(const struct inotify_event* ev) {
+    if (ev->mask & IN_Q_OVERFLOW) {
+        log_message(LOG_WARN, "[ASSETS] inotify queue overflowed; indexing assets/to_send again");
+        rebuild();
+        return;
+    }
+    if (ev->mask & IN_IGNORED) {
+        watch_forget(ev->wd);
+        return;
+    }
+
+    const char* dir = watch_rel(ev->wd);
+    if (!dir) return;
+    if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+        if (dir[0]) rebuild();  // A subdirectory left: its files go with it
+        return;
+    }
+    if (ev->len == 0 || hidden(ev->name)) return;
+
+    char rel[PATH_MAX];
+    snprintf(rel, sizeof(rel), "%s%s%s", dir, dir[0] ? "/" : "", ev->name);
+    if (ev->mask & IN_ISDIR) {
+        if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+            if (depth_of(rel) <= ASSET_INDEX_MAX_DEPTH) scan_dir(rel, depth_of(rel));
+        } else if (ev->mask & IN_MOVED_FROM) {
+            rebuild();  // Its watches still name the old path
+        }
+        return;
+    }
+    entry_refresh(rel);
+}
+
+static THREAD_FUNC asset_watcher(void* arg) {
+    (void)arg;
+    char buf[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        ssize_t n = read(assets.inotify_fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+
+        mutex_lock(&assets.lock);
+        for (char* p = buf; p < buf + n;) {
+            const struct inotify_event* ev = (const struct inotify_event*)p;
+            apply_event(ev);
+            p += sizeof(*ev) + ev->len;
+        }
+        mutex_unlock(&assets.lock);
+    }
+    log_message(LOG_WARN, "[ASSETS] Stopped watching assets/to_send; paths are resolved again");
+    assets.enabled = 0;
+    THREAD_RETURN;
+}
+#endif
+
+// ─────────────────────────────────────────────────────────────
+// API
+// ─────────────────────────────────────────────────────────────
+
+void asset_index_init(void) {
+    const char* root = resolve_assets_root();
+    if (!root) return;
+#ifdef __linux__
+    mutex_init(&assets.lock);
+    snprintf(assets.to_send, sizeof(assets.to_send), "%s/to_send", root);
+    assets.dir_fd = open(assets.to_send, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    assets.inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (assets.dir_fd < 0 || assets.inotify_fd < 0) {
+        log_message(LOG_WARN, "[ASSETS] Cannot watch '%s'; paths are resolved per request", assets.to_send);
+        if (assets.dir_fd >= 0) close(assets.dir_fd);
+        if (assets.inotify_fd >= 0) close(assets.inotify_fd);
+        return;
+    }
+
+    mutex_lock(&assets.lock);
+    scan_dir("", 0);
+    mutex_unlock(&assets.lock);
+
+    thread_t watcher;
+    if (create_thread(&watcher, asset_watcher, NULL) != 0) {
+        log_message(LOG_WARN, "[ASSETS] Cannot start the watcher thread; paths are resolved per request");
+        return;
+    }
+    detach_thread(watcher);
+    assets.enabled = 1;
+    log_message(LOG_INFO, "[ASSETS] Indexed %d file(s) in %d director(ies) under %s", assets.files, assets.watch_count, root);
+#else
+    log_message(LOG_INFO, "[ASSETS] Assets folder: %s", root);
+#endif
+}
+
+FILE* asset_index_open(const char* name, int positional, AssetInfo* info) {
+#ifdef __linux__
+    if (!assets.enabled) return NULL;
+
+    int fd = -1;
+    mutex_lock(&assets.lock);
+    AssetEntry* e = entry_find(name);
+    if (e) {
+        if (positional) {
+            if (fd_open(e) == 0) {
+                e->used = ++assets.clock;
+                fd = fcntl(e->fd, F_DUPFD_CLOEXEC, 0);
+            }
+        } else {
+            fd = openat(assets.dir_fd, e->name, O_RDONLY | O_CLOEXEC);
+        }
+        *info = e->info;
+    }
+    mutex_unlock(&assets.lock);
+
+    if (fd < 0) return NULL;
+    FILE* fp = fdopen(fd, "rb");
+    if (!fp) close(fd);
+    return fp;
+#else
+    (void)name;
+    (void)positional;
+    (void)info;
+    return NULL;
+#endif
+}
+
+int asset_index_hash(const char* name, char* hash) {
+#ifdef __linux__
+    if (assets.enabled) {
+        mutex_lock(&assets.lock);
+        AssetEntry* e = entry_find(name);
+        if (e && e->hashed) {
+            memcpy(hash, e->hash, sizeof(e->hash));
+            mutex_unlock(&assets.lock);
+            return 0;
+        }
+        unsigned generation = e ? e->generation : 0;
+        mutex_unlock(&assets.lock);
+
+        if (e) {
+            // Hash outside the lock; a change meanwhile bumps the generation and the result is not kept
+            char path[PATH_MAX];
+            if (snprintf(path, sizeof(path), "%s/%s", assets.to_send, name) >= (int)sizeof(path) ||
+                content_hash_file(path, hash) != 0)
+                return -1;
+
+            mutex_lock(&assets.lock);
+            e = entry_find(name);
+            if (e && e->generation == generation) {
+                memcpy(e->hash, hash, sizeof(e->hash));
+                e->hashed = 1;
+            }
+            mutex_unlock(&assets.lock);
+            return 0;
+        }
+    }
+#endif
+    const char* path = resolve_asset_path("to_send", name);
+    return path ? content_hash_cached(path, hash) : -1;
+}
@@ -5,12 +5,15 @@
  *        Only exposes send_chat() and receive_chat() to client logic.
  * @date 2025-09-20
  * @author Oussama Amara
- * @version 1.1
+ * @version 1.2
  */
 
 #include "chat.h"
 #include "protocol.h"
+#include "framing.h"
 #include "logger.h"
+#include "platform_thread.h"
+#include "client_registry.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -20,7 +23,6 @@
  */
 #define MAX_CHUNK_SIZE 256
 #define MAX_CHUNKS 64
-#define MAX_CLIENTS 64
 #define MAX_MESSAGE_SIZE 4096
 
 /**
@@ -35,10 +37,20 @@ typedef struct {
     int final_seq;
 } ChatBuffer;
 
-static ChatBuffer buffers[MAX_CLIENTS];  ///< Internal buffer array
+/**
+ * @brief Internal buffers, one table per thread, indexed by the sender's
+ *        registry slot. A sender's chunks are always handled by the reactor
+ *        that owns its connection, so per-thread buffers need no locking.
+ *        A buffer exists only while a message is being reassembled.
+ */
+static THREAD_LOCAL ChatBuffer** buffers;
+static THREAD_LOCAL int buffer_count;
 
 void init_chat_buffers() {
-    memset(buffers, 0, sizeof(buffers));
+    for (int i = 0; i < buffer_count; ++i) free(buffers[i]);
+    free(buffers);
+    buffers = NULL;
+    buffer_count = 0;
 }
 
 /**
@@ -53,42 +65,58 @@ void send_chat(int connfd, int src_id, int dest_id, const char* message){
         strncpy(chunk, message + i * MAX_CHUNK_SIZE, MAX_CHUNK_SIZE);
         chunk[MAX_CHUNK_SIZE] = '\0';
 
-        char frame[MAX_COMMAND_LENGTH];
         int is_final = (i == total_chunks - 1);
-        //build_frame("chat", 0, 0, chunk, "CHUNK", frame);  // src/dest filled by dispatcher
-        build_frame("chat", src_id, dest_id, chunk, "CHUNK", frame);
-        char extended[MAX_COMMAND_LENGTH];
-        snprintf(extended, sizeof(extended), "%s|%d|%d", frame, i, is_final);
-        send(connfd, extended, strlen(extended), 0);
+        send_chunk(connfd, "chat", src_id, dest_id, chunk, strlen(chunk), "CHUNK", i, is_final);
     }
 
     log_message(LOG_INFO, "Chat message sent in %d chunk(s).", total_chunks);
 }
 
+/**
+ * @brief Receive buffer used by receive_chat(); keeps frames that arrived
+ *        after the last complete message for the next call.
+ */
+static THREAD_LOCAL RecvBuffer chat_rbuf;
+
+/**
+ * @brief Blocks until the next valid frame (text or binary) has been decoded.
+ *        The view stays valid until the next call.
+ * @return 0 on success, -1 if the connection closed or failed.
+ */
+static int read_view(int connfd, FrameView* view) {
+    if (!chat_rbuf.data && recvbuf_init(&chat_rbuf, RECVBUF_INITIAL_SIZE) != 0) return -1;
+
+    while (1) {
+        const char* frame;
+        size_t len;
+        int rc = recvbuf_next_frame(&chat_rbuf, &frame, &len);
+        if (rc < 0) return -1;
+        if (rc == 1) {
+            if (parse_frame_view(frame, len, view) != 0) continue;
+            return 0;
+        }
+        if (recvbuf_fill(&chat_rbuf, connfd) <= 0) return -1;
+    }
+}
+
 /**
  * @brief Receives and reassembles a chat message from the server.
  */
 int receive_chat(int connfd, char* buffer, int size) {
-    char temp[MAX_COMMAND_LENGTH];
     char chunks[MAX_CHUNKS][MAX_CHUNK_SIZE + 1];
     int received[MAX_CHUNKS] = {0};
     int final_seq = -1;
 
     while (1) {
-        int len = recv(connfd, temp, sizeof(temp) - 1, 0);
-        if (len <= 0) return -1;
-
-        temp[len] = '\0';
-
-        ParsedCommand cmd;
-        if (decode_frame(temp, &cmd) != 0) continue;
-        if (strcmp(cmd.channel, "chat") != 0 || strcmp(cmd.status, "CHUNK") != 0) continue;
+        FrameView view;
+        if (read_view(connfd, &view) != 0) return -1;
+        if (view.channel != CH_CHAT || view.status != ST_CHUNK) continue;
 
-        int seq = cmd.seq_num;
-        int is_final = cmd.is_final;
+        int seq = view.seq_num;
+        int is_final = view.is_final;
 
         if (seq < 0 || seq >= MAX_CHUNKS) continue;
-        strncpy(chunks[seq], cmd.message, MAX_CHUNK_SIZE);
+        frame_view_copy(&view, view.payload, chunks[seq], MAX_CHUNK_SIZE + 1);
         received[seq] = 1;
         if (is_final) final_seq = seq;
 
@@ -118,35 +146,50 @@ int receive_chat(int connfd, char* buffer, int size) {
     }
 }
 
-void buffer_chat_chunk(const ParsedCommand* cmd) {
-    for (int i = 0; i < MAX_CLIENTS; ++i) {
-        if (!buffers[i].active || (buffers[i].src_id == cmd->src_id && buffers[i].dest_id == cmd->dest_id)) {
-            buffers[i].active = 1;
-            buffers[i].src_id = cmd->src_id;
-            buffers[i].dest_id = cmd->dest_id;
-            strncpy(buffers[i].chunks[cmd->seq_num], cmd->message, MAX_CHUNK_SIZE);
-            buffers[i].chunks[cmd->seq_num][MAX_CHUNK_SIZE] = '\0';
-            buffers[i].received[cmd->seq_num] = 1;
-            if (cmd->is_final) buffers[i].final_seq = cmd->seq_num;
-            return;
-        }
+void buffer_chat_chunk(const FrameView* view) {
+    if (view->seq_num < 0 || view->seq_num >= MAX_CHUNKS || view->src_id < 0) return;
+
+    int slot = view->src_id & REGISTRY_SLOT_MASK;
+    if (slot >= buffer_count) {
+        int count = buffer_count ? buffer_count : 16;
+        while (count <= slot) count *= 2;
+        ChatBuffer** grown = realloc(buffers, (size_t)count * sizeof(*grown));
+        if (!grown) return;
+        memset(grown + buffer_count, 0, (size_t)(count - buffer_count) * sizeof(*grown));
+        buffers = grown;
+        buffer_count = count;
+    }
+
+    ChatBuffer* buf = buffers[slot];
+    if (!buf && !(buf = buffers[slot] = calloc(1, sizeof(ChatBuffer)))) return;
+    // A message from an earlier client of the slot, or to another peer, is dropped
+    if (!buf->active || buf->src_id != view->src_id || buf->dest_id != view->dest_id) {
+        memset(buf, 0, sizeof(*buf));
+        buf->active = 1;
+        buf->src_id = view->src_id;
+        buf->dest_id = view->dest_id;
+        buf->final_seq = -1;
     }
+    frame_view_copy(view, view->payload, buf->chunks[view->seq_num], MAX_CHUNK_SIZE + 1);
+    buf->received[view->seq_num] = 1;
+    if (view->is_final) buf->final_seq = view->seq_num;
 }
 
 const char* assemble_chat_message(int src_id, int dest_id) {
-    for (int i = 0; i < MAX_CLIENTS; ++i) {
-        if (buffers[i].active && buffers[i].src_id == src_id && buffers[i].dest_id == dest_id) {
-            static char full[MAX_MESSAGE_SIZE];
-            full[0] = '\0';
-            for (int j = 0; j <= buffers[i].final_seq; ++j) {
-                if (!buffers[i].received[j]) return NULL;
-                strncat(full, buffers[i].chunks[j], sizeof(full) - strlen(full) - 1);
-            }
-            buffers[i].active = 0;
-            return full;
-        }
+    int slot = src_id & REGISTRY_SLOT_MASK;
+    if (src_id < 0 || slot >= buffer_count) return NULL;
+    ChatBuffer* buf = buffers[slot];
+    if (!buf || !buf->active || buf->src_id != src_id || buf->dest_id != dest_id || buf->final_seq < 0) return NULL;
+
+    static THREAD_LOCAL char full[MAX_MESSAGE_SIZE];
+    full[0] = '\0';
+    for (int j = 0; j <= buf->final_seq; ++j) {
+        if (!buf->received[j]) return NULL;
+        strncat(full, buf->chunks[j], sizeof(full) - strlen(full) - 1);
     }
-    return NULL;
+    free(buf);
+    buffers[slot] = NULL;
+    return full;
 }
 
 int moderate_chat_message(const char* msg) {
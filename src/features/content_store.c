@@ -0,0 +1,227 @@
+/**
+ * @file content_store.c
+ * @brief Content hashes and the receiver's content-addressed store.
+ *        Blobs live in assets/received/.store, named by hash. A completed file
+ *        is hard-linked there (copied where links are unavailable), so storing
+ *        it costs no extra disk space; a blob is materialized the same way.
+ * @author Oussama Amara
+ * @version 1.1
+ * @date 2026-10-17
+ */
+
+#include "content_store.h"
+#include "crc.h"
+#include "logger.h"
+#include "platform.h"
+#include "platform_thread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#else
+#include <unistd.h>
+#endif
+
+#define HASH_CACHE_SIZE 64      ///< Files to send whose hash is remembered
+#define HASH_READ_SIZE 65536    ///< Bytes read per call while hashing
+
+/**
+ * @brief Remembered hash of one file to send.
+ */
+typedef struct {
+    char path[512];             ///< Resolved path ("" = free)
+    long long size;             ///< Size when hashed
+    long long mtime;            ///< Modification time when hashed
+    char hash[CONTENT_HASH_LEN + 1];
+} HashCacheEntry;
+
+static HashCacheEntry hash_cache[HASH_CACHE_SIZE];
+static int hash_cache_next;     ///< Entry replaced next (round robin)
+static mutex_t hash_cache_lock;
+
+void content_store_init(void) {
+    mutex_init(&hash_cache_lock);
+}
+
+// ─────────────────────────────────────────────────────────────
+// Hashing
+// ─────────────────────────────────────────────────────────────
+
+void content_hash_begin(ContentHasher* h) {
+    h->fnv = 1469598103934665603ULL;
+    h->crc = 0;
+}
+
+void content_hash_update(ContentHasher* h, const void* data, size_t len) {
+    const unsigned char* p = data;
+    uint64_t fnv = h->fnv;
+    for (size_t i = 0; i < len; ++i) fnv = (fnv ^ p[i]) * 1099511628211ULL;
+    h->fnv = fnv;
+    h->crc = crc32c(h->crc, p, len);
+}
+
+void content_hash_end(const ContentHasher* h, char* hash) {
+    snprintf(hash, CONTENT_HASH_LEN + 1, "%016llx%08x", (unsigned long long)h->fnv, (unsigned)h->crc);
+}
+
+int content_hash_file(const char* path, char* hash) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return -1;
+
+    unsigned char* block = malloc(HASH_READ_SIZE);
+    if (!block) {
+        fclose(fp);
+        return -1;
+    }
+
+    ContentHasher h;
+    content_hash_begin(&h);
+    size_t n;
+    while ((n = fread(block, 1, HASH_READ_SIZE, fp)) > 0) content_hash_update(&h, block, n);
+    int ok = !ferror(fp);
+    fclose(fp);
+    free(block);
+    if (!ok) return -1;
+
+    content_hash_end(&h, hash);
+    return 0;
+}
+
+int content_hash_cached(const char* path, char* hash) {
+    struct stat st;
+    if (stat(path, &st) != 0) return -1;
+
+    mutex_lock(&hash_cache_lock);
+    for (int i = 0; i < HASH_CACHE_SIZE; ++i) {
+        HashCacheEntry* e = &hash_cache[i];
+        if (strcmp(e->path, path) == 0 && e->size == (long long)st.st_size && e->mtime == (long long)st.st_mtime) {
+            memcpy(hash, e->hash, sizeof(e->hash));
+            mutex_unlock(&hash_cache_lock);
+            return 0;
+        }
+    }
+    mutex_unlock(&hash_cache_lock);
+
+    // Hash outside the lock; two threads racing on one file store the same result
+    if (content_hash_file(path, hash) != 0) return -1;
+
+    mutex_lock(&hash_cache_lock);
+    HashCacheEntry* e = &hash_cache[hash_cache_next];
+    hash_cache_next = (hash_cache_next + 1) % HASH_CACHE_SIZE;
+    snprintf(e->path, sizeof(e->path), "%s", path);
+    e->size = (long long)st.st_size;
+    e->mtime = (long long)st.st_mtime;
+    memcpy(e->hash, hash, sizeof(e->hash));
+    mutex_unlock(&hash_cache_lock);
+    return 0;
+}
+
+const char* content_parse_offer(const char* payload, char* hash) {
+    hash[0] = '\0';
+    for (int i = 0; i < CONTENT_HASH_LEN; ++i) {
+        char c = payload[i];
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) return payload;
+    }
+    if (payload[CONTENT_HASH_LEN] != ',') return payload;
+
+    memcpy(hash, payload, CONTENT_HASH_LEN);
+    hash[CONTENT_HASH_LEN] = '\0';
+    return payload + CONTENT_HASH_LEN + 1;
+}
+
+// ─────────────────────────────────────────────────────────────
+// Store
+// ─────────────────────────────────────────────────────────────
+
+/**
+ * @brief Path of a blob; creates the store directory on first use.
+ */
+static int blob_path(const char* hash, char* out, size_t cap) {
+    const char* dir = resolve_asset_path("received", ".store");
+    if (!dir) return -1;
+#ifdef _WIN32
+    _mkdir(dir);
+#else
+    mkdir(dir, 0755);
+#endif
+    return (size_t)snprintf(out, cap, "%s/%s", dir, hash) < cap ? 0 : -1;
+}
+
+static int copy_file(const char* from, const char* to) {
+    FILE* in = fopen(from, "rb");
+    if (!in) return -1;
+    FILE* out = fopen(to, "wb");
+    if (!out) {
+        fclose(in);
+        return -1;
+    }
+
+    char block[8192];
+    size_t n;
+    int ok = 1;
+    while (ok && (n = fread(block, 1, sizeof(block), in)) > 0) ok = fwrite(block, 1, n, out) == n;
+    ok = !ferror(in) && ok;
+    fclose(in);
+    ok = (fclose(out) == 0) && ok;
+    if (!ok) remove(to);
+    return ok ? 0 : -1;
+}
+
+/**
+ * @brief Hard-links from to to, copying where the link fails (other file
+ *        system, or no hard links).
+ */
+static int link_or_copy(const char* from, const char* to) {
+#ifdef _WIN32
+    if (CreateHardLinkA(to, from, NULL)) return 0;
+#else
+    if (link(from, to) == 0) return 0;
+#endif
+    return copy_file(from, to);
+}
+
+void content_store_add(const char* filename) {
+    const char* resolved = resolve_asset_path("received", filename);
+    char hash[CONTENT_HASH_LEN + 1];
+    if (resolved && content_hash_file(resolved, hash) == 0) content_store_add_hashed(filename, hash);
+}
+
+void content_store_add_hashed(const char* filename, const char* hash) {
+    const char* resolved = resolve_asset_path("received", filename);
+    if (!resolved) return;
+    char path[1024], blob[1024];
+    snprintf(path, sizeof(path), "%s", resolved);
+    if (blob_path(hash, blob, sizeof(blob)) != 0) return;
+
+    struct stat st;
+    if (stat(blob, &st) == 0) return;  // Already stored
+    if (link_or_copy(path, blob) == 0)
+        log_message(LOG_INFO, "[FILE] Stored '%s' as %s", filename, hash);
+}
+
+int content_store_materialize(const char* hash, const char* filename) {
+    char blob[1024], path[1024];
+    struct stat st;
+    if (blob_path(hash, blob, sizeof(blob)) != 0 || stat(blob, &st) != 0) return -1;
+
+    const char* resolved = resolve_asset_path("received", filename);
+    if (!resolved) return -1;
+    snprintf(path, sizeof(path), "%s", resolved);
+
+    // Already the same file (a previous materialization): nothing to do
+    struct stat dest;
+    if (stat(path, &dest) == 0 && dest.st_ino == st.st_ino && dest.st_dev == st.st_dev && dest.st_ino != 0) return 0;
+
+    remove(path);
+    if (link_or_copy(blob, path) != 0) {
+        log_message(LOG_WARN, "[FILE] Could not materialize '%s' from the store", filename);
+        return -1;
+    }
+    return 0;
+}
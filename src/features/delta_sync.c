@@ -0,0 +1,715 @@
+/**
+ * @file delta_sync.c
+ * @brief Block signatures, rolling-checksum delta encoding and delta application.
+ *        The rolling checksum is the rsync one (two 16-bit running sums, updated
+ *        in O(1) as the window slides by a byte); the strong hash is FNV-1a 64
+ *        and is only computed on the sender when the rolling checksum matches.
+ *        The server collects a receiver's SIGS frames, encodes the delta on a
+ *        worker thread and hands it to the chunk sender (file_transfer.c).
+ * @author Oussama Amara
+ * @version 1.1
+ * @date 2026-10-17
+ */
+
+#ifndef _WIN32
+#define _FILE_OFFSET_BITS 64 // fseeko() on large files
+#endif
+
+#include "delta_sync.h"
+#include "file_transfer.h"
+#include "file_transfer_internal.h"
+#include "framing.h"
+#include "logger.h"
+#include "platform.h"
+#include "platform_thread.h"
+#include "timer_wheel.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define fseek64 _fseeki64
+#else
+#define fseek64 fseeko
+#endif
+
+#define DELTA_WINDOW (1024 * 1024) ///< Bytes of the new version scanned per refill
+#define DELTA_COPY_SIZE 65536      ///< Bytes copied per call while rebuilding
+
+// ─────────────────────────────────────────────────────────────
+// Checksums
+// ─────────────────────────────────────────────────────────────
+
+/**
+ * @brief Rolling checksum state of a window of n bytes.
+ *        s1 is the byte sum, s2 the sum of the running s1 values.
+ */
+typedef struct {
+    uint32_t s1;
+    uint32_t s2;
+} Rolling;
+
+static void rolling_init(Rolling* r, const unsigned char* p, size_t n) {
+    r->s1 = r->s2 = 0;
+    for (size_t i = 0; i < n; ++i) {
+        r->s1 += p[i];
+        r->s2 += r->s1;
+    }
+}
+
+/**
+ * @brief Slides the window by one byte: out leaves, in enters.
+ */
+static void rolling_roll(Rolling* r, unsigned char out, unsigned char in, size_t n) {
+    r->s1 += (uint32_t)in - out;
+    r->s2 += r->s1 - (uint32_t)n * out;
+}
+
+static uint32_t rolling_value(const Rolling* r) {
+    return (r->s1 & 0xFFFFu) | (r->s2 << 16);
+}
+
+static uint64_t strong_hash(const unsigned char* p, size_t n) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < n; ++i) hash = (hash ^ p[i]) * 1099511628211ULL;
+    return hash;
+}
+
+static void put_u32(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static uint32_t get_u32(const unsigned char* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put_u64(unsigned char* p, uint64_t v) {
+    put_u32(p, (uint32_t)(v >> 32));
+    put_u32(p + 4, (uint32_t)v);
+}
+
+static uint64_t get_u64(const unsigned char* p) {
+    return ((uint64_t)get_u32(p) << 32) | get_u32(p + 4);
+}
+
+// ─────────────────────────────────────────────────────────────
+// RECEIVER: Sign the copy
+// ─────────────────────────────────────────────────────────────
+
+DeltaBasis* delta_basis_open(const char* filename, const char* hash) {
+    const char* path = resolve_asset_path("received", filename);
+    struct stat st;
+    if (!path || stat(path, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < DELTA_MIN_SIZE) return NULL;
+
+    long long size = (long long)st.st_size;
+    int block = DELTA_BLOCK_MIN;
+    while ((size + block - 1) / block > DELTA_TARGET_BLOCKS && block < DELTA_BLOCK_MAX) block *= 2;
+    if (size / block > DELTA_MAX_BLOCKS) return NULL;
+
+    DeltaBasis* basis = calloc(1, sizeof(*basis));
+    if (!basis) return NULL;
+    snprintf(basis->filename, sizeof(basis->filename), "%s", filename);
+    snprintf(basis->hash, sizeof(basis->hash), "%s", hash);
+    basis->block_size = block;
+    basis->blocks = (int)(size / block);
+    basis->fp = fopen(path, "rb");
+    basis->block = malloc((size_t)block);
+    if (!basis->fp || !basis->block) {
+        delta_basis_free(basis);
+        return NULL;
+    }
+    return basis;
+}
+
+size_t delta_sign_next(DeltaBasis* basis, unsigned char* out, size_t cap) {
+    size_t len = (size_t)snprintf((char*)out, cap, "%d\n", basis->next);
+    if (basis->next == 0)
+        len += (size_t)snprintf((char*)out + len, cap - len, "%d,%d,%s\n", basis->block_size, basis->blocks, basis->filename);
+
+    while (basis->next < basis->blocks && len + DELTA_SIG_SIZE <= cap) {
+        if (fread(basis->block, 1, (size_t)basis->block_size, basis->fp) != (size_t)basis->block_size) return 0;
+        Rolling r;
+        rolling_init(&r, basis->block, (size_t)basis->block_size);
+        put_u32(out + len, rolling_value(&r));
+        put_u64(out + len + 4, strong_hash(basis->block, (size_t)basis->block_size));
+        len += DELTA_SIG_SIZE;
+        basis->next++;
+    }
+    if (basis->next == basis->blocks && basis->fp) {
+        fclose(basis->fp);  // Signed: the copy is opened again to rebuild from it
+        basis->fp = NULL;
+    }
+    return len;
+}
+
+void delta_basis_free(DeltaBasis* basis) {
+    if (!basis) return;
+    if (basis->fp) fclose(basis->fp);
+    free(basis->block);
+    free(basis);
+}
+
+// ─────────────────────────────────────────────────────────────
+// RECEIVER: Rebuild from the copy and the delta
+// ─────────────────────────────────────────────────────────────
+
+/**
+ * @brief Copies len bytes from in to out, hashing them.
+ */
+static int copy_hashed(FILE* in, FILE* out, long long len, unsigned char* buf, ContentHasher* h) {
+    while (len > 0) {
+        size_t want = len < DELTA_COPY_SIZE ? (size_t)len : DELTA_COPY_SIZE;
+        if (fread(buf, 1, want, in) != want || fwrite(buf, 1, want, out) != want) return -1;
+        content_hash_update(h, buf, want);
+        len -= (long long)want;
+    }
+    return 0;
+}
+
+int delta_apply(DeltaBasis* basis, const char* staged) {
+    char staged_path[1024], basis_path[1024], rebuilt_path[1040];
+    const char* resolved = resolve_asset_path("received", staged);
+    if (!resolved) return -1;
+    snprintf(staged_path, sizeof(staged_path), "%s", resolved);
+    resolved = resolve_asset_path("received", basis->filename);
+    if (!resolved) return -1;
+    snprintf(basis_path, sizeof(basis_path), "%s", resolved);
+    snprintf(rebuilt_path, sizeof(rebuilt_path), "%s.rebuild", basis_path);
+
+    FILE* delta = fopen(staged_path, "rb");
+    FILE* copy = fopen(basis_path, "rb");
+    FILE* out = fopen(rebuilt_path, "wb");
+    unsigned char* buf = malloc(DELTA_COPY_SIZE);
+    ContentHasher h;
+    content_hash_begin(&h);
+
+    unsigned char header[16], op[9];
+    long long target = -1, written = 0;
+    int ok = delta && copy && out && buf && fread(header, 1, sizeof(header), delta) == sizeof(header) &&
+             memcmp(header, "DLT1", 4) == 0 && get_u32(header + 4) == (uint32_t)basis->block_size;
+    if (ok) target = (long long)get_u64(header + 8);
+
+    while (ok && fread(op, 1, 1, delta) == 1) {
+        if (op[0] == 'C' && fread(op + 1, 1, 8, delta) == 8) {
+            long long first = get_u32(op + 1), count = get_u32(op + 5);
+            long long len = count * basis->block_size;
+            ok = first + count <= basis->blocks && fseek64(copy, first * basis->block_size, SEEK_SET) == 0 &&
+                 copy_hashed(copy, out, len, buf, &h) == 0;
+            written += len;
+        } else if (op[0] == 'L' && fread(op + 1, 1, 4, delta) == 4) {
+            long long len = get_u32(op + 1);
+            ok = copy_hashed(delta, out, len, buf, &h) == 0;
+            written += len;
+        } else {
+            ok = 0;
+        }
+    }
+    ok = ok && !ferror(delta) && written == target;
+    if (out) ok = fclose(out) == 0 && ok;
+    if (copy) fclose(copy);
+    if (delta) fclose(delta);
+    free(buf);
+    remove(staged_path);
+
+    char hash[CONTENT_HASH_LEN + 1];
+    content_hash_end(&h, hash);
+    if (!ok || strcmp(hash, basis->hash) != 0) {
+        log_message(LOG_WARN, "[FILE] Delta of '%s' %s", basis->filename,
+                    ok ? "rebuilt a file that does not match its hash" : "could not be applied");
+        remove(rebuilt_path);
+        return -1;
+    }
+
+    // Renaming replaces the copy's directory entry, never a store blob it may be linked to
+#ifdef _WIN32
+    remove(basis_path);
+#endif
+    if (rename(rebuilt_path, basis_path) != 0) {
+        remove(rebuilt_path);
+        return -1;
+    }
+    content_store_add_hashed(basis->filename, basis->hash);
+    return 0;
+}
+
+// ─────────────────────────────────────────────────────────────
+// SENDER: Collect the signatures
+// ─────────────────────────────────────────────────────────────
+
+int delta_sigs_decode(DeltaSigs** sigs, const void* data, size_t len) {
+    const unsigned char* p = data;
+    const unsigned char* end = p + len;
+    char line[256];
+
+    const unsigned char* nl = memchr(p, '\n', len);
+    if (!nl || (size_t)(nl - p) >= sizeof(line)) return -1;
+    memcpy(line, p, (size_t)(nl - p));
+    line[nl - p] = '\0';
+    int first = atoi(line);
+    p = nl + 1;
+
+    if (first == 0) {
+        delta_sigs_free(*sigs);
+        *sigs = calloc(1, sizeof(**sigs));
+        if (!*sigs) return -1;
+        DeltaSigs* s = *sigs;
+
+        nl = memchr(p, '\n', (size_t)(end - p));
+        if (!nl || (size_t)(nl - p) >= sizeof(line)) return -1;
+        memcpy(line, p, (size_t)(nl - p));
+        line[nl - p] = '\0';
+        p = nl + 1;
+        int name_at = 0;
+        if (sscanf(line, "%d,%d,%n", &s->block_size, &s->blocks, &name_at) != 2 || name_at == 0 ||
+            s->block_size < DELTA_BLOCK_MIN || s->block_size > DELTA_BLOCK_MAX || s->blocks <= 0 ||
+            s->blocks > DELTA_MAX_BLOCKS || line[name_at] == '\0')
+            return -1;
+        snprintf(s->filename, sizeof(s->filename), "%s", line + name_at);
+        s->weak = malloc((size_t)s->blocks * sizeof(*s->weak));
+        s->strong = malloc((size_t)s->blocks * sizeof(*s->strong));
+        s->digest = 1469598103934665603ULL;
+        if (!s->weak || !s->strong) return -1;
+    }
+
+    DeltaSigs* s = *sigs;
+    size_t n = (size_t)(end - p) / DELTA_SIG_SIZE;
+    if (!s || first != s->count || (size_t)(end - p) % DELTA_SIG_SIZE != 0 || s->count + (long long)n > s->blocks)
+        return -1;
+    for (size_t i = 0; i < n; ++i, p += DELTA_SIG_SIZE) {
+        s->weak[s->count] = get_u32(p);
+        s->strong[s->count] = get_u64(p + 4);
+        for (int b = 0; b < DELTA_SIG_SIZE; ++b) s->digest = (s->digest ^ p[b]) * 1099511628211ULL;
+        s->count++;
+    }
+    return 0;
+}
+
+void delta_sigs_free(DeltaSigs* sigs) {
+    if (!sigs) return;
+    free(sigs->weak);
+    free(sigs->strong);
+    free(sigs->heads);
+    free(sigs->chain);
+    free(sigs);
+}
+
+/**
+ * @brief Buckets the blocks by rolling checksum. Blocks are chained in
+ *        ascending order, so the first match is the lowest block.
+ */
+static int sigs_index(DeltaSigs* sigs) {
+    unsigned buckets = 1;
+    while (buckets < (unsigned)sigs->blocks * 2) buckets <<= 1;
+    sigs->mask = buckets - 1;
+    sigs->heads = malloc(buckets * sizeof(*sigs->heads));
+    sigs->chain = malloc((size_t)sigs->blocks * sizeof(*sigs->chain));
+    if (!sigs->heads || !sigs->chain) return -1;
+    for (unsigned i = 0; i < buckets; ++i) sigs->heads[i] = -1;
+    for (int i = sigs->blocks - 1; i >= 0; --i) {
+        unsigned bucket = (sigs->weak[i] ^ (sigs->weak[i] >> 16)) & sigs->mask;
+        sigs->chain[i] = sigs->heads[bucket];
+        sigs->heads[bucket] = i;
+    }
+    return 0;
+}
+
+// ─────────────────────────────────────────────────────────────
+// SENDER: Encode the delta
+// ─────────────────────────────────────────────────────────────
+
+/**
+ * @brief Delta being written: the pending run of consecutive block references
+ *        is merged into one 'C' op.
+ */
+typedef struct {
+    FILE* out;
+    long long size;
+    int run_first;
+    int run_count;
+    int failed;
+} DeltaWriter;
+
+static void delta_write(DeltaWriter* w, const void* data, size_t len) {
+    if (len && fwrite(data, 1, len, w->out) != len) w->failed = 1;
+    w->size += (long long)len;
+}
+
+static void flush_run(DeltaWriter* w) {
+    if (w->run_count == 0) return;
+    unsigned char op[9] = { 'C' };
+    put_u32(op + 1, (uint32_t)w->run_first);
+    put_u32(op + 5, (uint32_t)w->run_count);
+    delta_write(w, op, sizeof(op));
+    w->run_count = 0;
+}
+
+static void emit_literal(DeltaWriter* w, const unsigned char* data, size_t len, DeltaStats* stats) {
+    if (len == 0) return;
+    flush_run(w);
+    unsigned char op[5] = { 'L' };
+    put_u32(op + 1, (uint32_t)len);
+    delta_write(w, op, sizeof(op));
+    delta_write(w, data, len);
+    stats->literal_bytes += (long long)len;
+}
+
+static void emit_copy(DeltaWriter* w, int block, DeltaStats* stats) {
+    if (w->run_count > 0 && block != w->run_first + w->run_count) flush_run(w);
+    if (w->run_count == 0) w->run_first = block;
+    w->run_count++;
+    stats->reused_blocks++;
+}
+
+/**
+ * @brief Block of the receiver's copy equal to the window, or -1. The block
+ *        following the last match is tried first: unchanged regions match in order.
+ */
+static int find_block(const DeltaSigs* sigs, uint32_t weak, const unsigned char* window, int expected) {
+    uint64_t strong = 0;
+    int hashed = 0;
+    if (expected >= 0 && expected < sigs->blocks && sigs->weak[expected] == weak) {
+        strong = strong_hash(window, (size_t)sigs->block_size);
+        hashed = 1;
+        if (sigs->strong[expected] == strong) return expected;
+    }
+    for (int i = sigs->heads[(weak ^ (weak >> 16)) & sigs->mask]; i >= 0; i = sigs->chain[i]) {
+        if (sigs->weak[i] != weak) continue;
+        if (!hashed) {
+            strong = strong_hash(window, (size_t)sigs->block_size);
+            hashed = 1;
+        }
+        if (sigs->strong[i] == strong) return i;
+    }
+    return -1;
+}
+
+long long delta_encode(DeltaSigs* sigs, FILE* src, long long target_size, FILE* out, DeltaStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (sigs->count != sigs->blocks || (!sigs->heads && sigs_index(sigs) != 0)) return -1;
+
+    size_t block = (size_t)sigs->block_size;
+    size_t cap = 2 * block + DELTA_WINDOW;
+    unsigned char* buf = malloc(cap);
+    if (!buf) return -1;
+
+    DeltaWriter w = { out, 0, 0, 0, 0 };
+    unsigned char header[16];
+    memcpy(header, "DLT1", 4);
+    put_u32(header + 4, (uint32_t)block);
+    put_u64(header + 8, (uint64_t)target_size);
+    delta_write(&w, header, sizeof(header));
+
+    // buf[lit, pos) is pending literal data; the window is buf[pos, pos + block)
+    size_t end = fread(buf, 1, cap, src), pos = 0, lit = 0;
+    int eof = end < cap;
+    Rolling r;
+    int valid = 0;
+    while (!w.failed) {
+        if (end - pos < block && !eof) {
+            emit_literal(&w, buf + lit, pos - lit, stats);
+            memmove(buf, buf + pos, end - pos);
+            end -= pos;
+            pos = lit = 0;
+            size_t n = fread(buf + end, 1, cap - end, src);
+            end += n;
+            eof = end < cap;
+            valid = 0;
+            continue;
+        }
+        if (end - pos < block) break;
+
+        if (!valid) {
+            rolling_init(&r, buf + pos, block);
+            valid = 1;
+        }
+        int expected = w.run_count > 0 ? w.run_first + w.run_count : -1;
+        int match = find_block(sigs, rolling_value(&r), buf + pos, expected);
+        if (match >= 0) {
+            emit_literal(&w, buf + lit, pos - lit, stats);
+            emit_copy(&w, match, stats);
+            pos += block;
+            lit = pos;
+            valid = 0;
+        } else if (pos + block < end) {
+            rolling_roll(&r, buf[pos], buf[pos + block], block);
+            pos++;
+        } else {
+            pos++;  // Window needs more data: refilled, or the tail is literal
+            valid = 0;
+        }
+    }
+    emit_literal(&w, buf + lit, end - lit, stats);
+    flush_run(&w);
+    free(buf);
+
+    if (w.failed || ferror(src) || fflush(out) != 0) return -1;
+    return w.size;
+}
+
+// ─────────────────────────────────────────────────────────────
+// SENDER: Encode on a worker and start the transfer
+// ─────────────────────────────────────────────────────────────
+
+/**
+ * @brief Signatures arriving from a receiver, until its last SIGS frame.
+ */
+typedef struct {
+    int sockfd;           ///< Receiver socket (-1 = free slot)
+    int dest_id;          ///< Receiver ID
+    DeltaSigs* sigs;      ///< Signatures so far; NULL once a frame was malformed
+    char filename[128];   ///< File signed, from the first frame
+} PendingSigs;
+
+#define DELTA_POLL_MS 10 ///< How often a reactor checks on a delta being encoded
+
+/**
+ * @brief A delta encoded on a worker thread for one receiver. The reactor that
+ *        got the signatures polls it with a timer and starts the transfer.
+ */
+typedef struct {
+    Timer poll;               ///< On the reactor's wheel until the worker is done
+    TimerWheel* wheel;        ///< Wheel of the reactor that got the signatures
+    int sockfd;
+    int dest_id;
+    int chunk_size;           ///< Chunk size the receiver asked for
+    DeltaSigs* sigs;
+    char filename[128];
+    int done;                 ///< Set by the worker once delta is built (atomic)
+    int cancelled;            ///< Receiver left meanwhile (sigs_lock)
+    FILE* delta;              ///< Result, NULL to send the file whole
+    long long delta_size;
+    char file_id[TRANSFER_ID_LEN + 1];
+    long long last_wait_ms;   ///< When the receiver last heard from us
+} DeltaJob;
+
+static PendingSigs pending_sigs[MAX_OUTGOING];
+static DeltaJob* delta_jobs[MAX_OUTGOING];
+static mutex_t sigs_lock;  ///< Guards pending_sigs and delta_jobs
+
+void file_delta_init(void) {
+    mutex_init(&sigs_lock);
+    for (int i = 0; i < MAX_OUTGOING; ++i) pending_sigs[i].sockfd = -1;
+}
+
+void file_delta_drop_pending(int sockfd, int dest_id) {
+    mutex_lock(&sigs_lock);
+    for (int i = 0; i < MAX_OUTGOING; ++i) {
+        PendingSigs* p = &pending_sigs[i];
+        if (p->sockfd != sockfd || (dest_id >= 0 && p->dest_id != dest_id)) continue;
+        delta_sigs_free(p->sigs);
+        p->sigs = NULL;
+        p->sockfd = -1;
+    }
+    // Running encodes finish on their worker; their reactor then drops the result
+    for (int i = 0; i < MAX_OUTGOING; ++i) {
+        DeltaJob* job = delta_jobs[i];
+        if (job && job->sockfd == sockfd && (dest_id < 0 || job->dest_id == dest_id)) job->cancelled = 1;
+    }
+    mutex_unlock(&sigs_lock);
+}
+
+/**
+ * @brief Encodes a file of assets/to_send against the receiver's signatures
+ *        into a temporary file.
+ * @param[out] delta_size Size of the delta.
+ * @param[out] file_id Transfer ID of the file's current version.
+ * @return The delta, rewound, or NULL when it cannot be built or would not be
+ *         smaller than the file.
+ */
+static FILE* delta_build(DeltaSigs* sigs, const char* filename, int dest_id, long long* delta_size, char* file_id) {
+    AssetInfo info;
+    FILE* src = file_open_outgoing(filename, 0, &info);  // Read front to back
+    if (!src) return NULL;
+    long long file_size = info.size;
+    file_transfer_id_of(filename, &info, file_id);
+
+    long long started = monotonic_ms();
+    DeltaStats stats;
+    FILE* delta = tmpfile();
+    *delta_size = delta ? delta_encode(sigs, src, file_size, delta, &stats) : -1;
+    fclose(src);
+    if (*delta_size < 0 || *delta_size >= file_size) {
+        if (*delta_size >= 0)
+            log_message(LOG_INFO, "[FILE] Delta of '%s' for client %d is no smaller than the file; sending it whole", filename, dest_id);
+        if (delta) fclose(delta);
+        return NULL;
+    }
+    rewind(delta);
+    log_message(LOG_INFO, "[FILE] Delta of '%s' for client %d: %lld of %lld bytes (%lld block(s) of %d reused, %lld literal bytes) in %lld ms",
+                filename, dest_id, *delta_size, file_size, stats.reused_blocks, sigs->block_size, stats.literal_bytes,
+                monotonic_ms() - started);
+    return delta;
+}
+
+/**
+ * @brief Builds the delta of a job (on its worker, or inline without one).
+ */
+static void delta_job_run(DeltaJob* job) {
+    job->delta = delta_build(job->sigs, job->filename, job->dest_id, &job->delta_size, job->file_id);
+    __atomic_store_n(&job->done, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Starts the transfer a finished job built (on the reactor): the delta,
+ *        or the whole file when no delta was worth sending. Frees the job.
+ */
+static void delta_job_finish(DeltaJob* job) {
+    int connfd = job->sockfd;
+    if (!job->delta) {
+        send_file_to_client(&connfd, job->filename, 0, job->dest_id, job->chunk_size);
+    } else {
+        // A checkpoint of a delta against another copy must never resume into this one
+        char delta_id[TRANSFER_ID_LEN + 1];
+        snprintf(delta_id, sizeof(delta_id), "%016llx",
+                 strtoull(job->file_id, NULL, 16) ^ (unsigned long long)job->sigs->digest);
+
+        // Always chunked: a raw phase writes straight to the file the delta is applied to
+        char staged[sizeof(job->filename) + 8];
+        snprintf(staged, sizeof(staged), "%s.delta", job->filename);
+        file_start_chunked(connfd, job->delta, NULL, NULL, delta_id, job->delta_size, staged, 0, job->dest_id,
+                      job->chunk_size, NULL, 0, 0);
+    }
+    delta_sigs_free(job->sigs);
+    free(job);
+}
+
+/**
+ * @brief Poll timer of a job: waits for its worker, keeping the receiver's
+ *        deadline alive with WAIT, then starts the transfer unless the receiver left.
+ */
+static void on_delta_poll(void* arg) {
+    DeltaJob* job = arg;
+    long long now = job->wheel->now_ms;
+    if (!__atomic_load_n(&job->done, __ATOMIC_ACQUIRE)) {
+        mutex_lock(&sigs_lock);
+        int cancelled = job->cancelled;
+        mutex_unlock(&sigs_lock);
+        if (!cancelled && now - job->last_wait_ms >= FILE_WAIT_INTERVAL_MS) {
+            send_command(job->sockfd, "file", 0, job->dest_id, job->filename, "WAIT");
+            job->last_wait_ms = now;
+        }
+        timer_schedule(job->wheel, &job->poll, DELTA_POLL_MS);
+        return;
+    }
+
+    mutex_lock(&sigs_lock);
+    for (int i = 0; i < MAX_OUTGOING; ++i)
+        if (delta_jobs[i] == job) delta_jobs[i] = NULL;
+    int cancelled = job->cancelled;
+    mutex_unlock(&sigs_lock);
+
+    if (cancelled) {
+        if (job->delta) fclose(job->delta);
+        delta_sigs_free(job->sigs);
+        free(job);
+        return;
+    }
+    delta_job_finish(job);
+}
+
+static THREAD_FUNC delta_worker(void* arg) {
+    delta_job_run(arg);
+    THREAD_RETURN;
+}
+
+/**
+ * @brief Hands a job to a worker thread, polled from this reactor's wheel.
+ * @return 0 if started, -1 if the caller must encode inline (no wheel, no
+ *         free job slot or no thread).
+ */
+static int delta_job_start(DeltaJob* job) {
+    job->wheel = file_transfer_timers();
+    if (!job->wheel) return -1;
+    job->last_wait_ms = job->wheel->now_ms;
+    timer_init(&job->poll, on_delta_poll, job);
+
+    int slot = -1;
+    mutex_lock(&sigs_lock);
+    for (int i = 0; i < MAX_OUTGOING && slot < 0; ++i)
+        if (!delta_jobs[i]) slot = i;
+    if (slot >= 0) delta_jobs[slot] = job;
+    mutex_unlock(&sigs_lock);
+    if (slot < 0) return -1;
+
+    thread_t worker;
+    if (create_thread(&worker, delta_worker, job) != 0) {
+        mutex_lock(&sigs_lock);
+        delta_jobs[slot] = NULL;
+        mutex_unlock(&sigs_lock);
+        return -1;
+    }
+    detach_thread(worker);
+    timer_schedule(job->wheel, &job->poll, DELTA_POLL_MS);
+    return 0;
+}
+
+void file_delta_on_sigs(const FrameView* view, int connfd) {
+    int dest_id = view->src_id;
+    PendingSigs* p = NULL;
+    PendingSigs* free_slot = NULL;
+    mutex_lock(&sigs_lock);
+    for (int i = 0; i < MAX_OUTGOING && !p; ++i) {
+        if (pending_sigs[i].sockfd == connfd && pending_sigs[i].dest_id == dest_id) p = &pending_sigs[i];
+        else if (pending_sigs[i].sockfd < 0 && !free_slot) free_slot = &pending_sigs[i];
+    }
+    if (!p && free_slot) {
+        p = free_slot;
+        p->sockfd = connfd;
+        p->dest_id = dest_id;
+        p->sigs = NULL;
+        p->filename[0] = '\0';
+    }
+    if (!p) {
+        mutex_unlock(&sigs_lock);
+        log_message(LOG_ERROR, "[FILE] Too many signature sets in progress; ignoring SIGS from client %d", dest_id);
+        return;
+    }
+
+    if (delta_sigs_decode(&p->sigs, FRAME_VIEW_PTR(view, view->payload), view->payload.len) != 0 && p->sigs) {
+        log_message(LOG_WARN, "[FILE] Malformed SIGS from client %d; '%s' will be sent whole", dest_id, p->filename);
+        delta_sigs_free(p->sigs);
+        p->sigs = NULL;
+    }
+    if (p->sigs && !p->filename[0]) snprintf(p->filename, sizeof(p->filename), "%s", p->sigs->filename);
+    if (!view->is_final) {
+        mutex_unlock(&sigs_lock);
+        return;
+    }
+    DeltaSigs* sigs = p->sigs;
+    char filename[sizeof(p->filename)];
+    memcpy(filename, p->filename, sizeof(filename));
+    p->sigs = NULL;
+    p->sockfd = -1;
+    mutex_unlock(&sigs_lock);
+
+    if (!filename[0]) {
+        log_message(LOG_WARN, "[FILE] Signatures from client %d name no file", dest_id);
+        delta_sigs_free(sigs);
+        return;
+    }
+
+    multicast_unicast(dest_id, filename);
+
+    DeltaJob* job = calloc(1, sizeof(*job));
+    if (!job || !sigs || sigs->count != sigs->blocks) {
+        free(job);
+        delta_sigs_free(sigs);
+        send_file_to_client(&connfd, filename, 0, dest_id, view->seq_num);
+        return;
+    }
+    job->sockfd = connfd;
+    job->dest_id = dest_id;
+    job->chunk_size = view->seq_num;  // seq: chunk size asked for
+    job->sigs = sigs;
+    memcpy(job->filename, filename, sizeof(job->filename));
+
+    // Encoding reads the whole file: a worker does it so the reactor keeps serving
+    if (delta_job_start(job) != 0) {
+        delta_job_run(job);
+        delta_job_finish(job);
+    }
+}
@@ -0,0 +1,778 @@
+/**
+ * @file file_batch.c
+ * @brief Manifests of batched transfers: building them from files and
+ *        directories, their BATCH and WANT frame payloads, offering them and
+ *        handing the wanted files to the chunk sender, reading the data
+ *        stream across file boundaries, and unpacking it on the receiver.
+ * @author Oussama Amara
+ * @version 1.3
+ * @date 2026-10-17
+ */
+
+#ifndef _WIN32
+#define _FILE_OFFSET_BITS 64 // fseeko() on large files
+#endif
+
+#include "file_batch.h"
+#include "file_transfer.h"
+#include "file_transfer_internal.h"
+#include "framing.h"
+#include "protocol.h"
+#include "logger.h"
+#include "platform.h"
+#include "platform_thread.h"
+#include "asset_index.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#define fseek64 _fseeki64
+#else
+#include <dirent.h>
+#include <unistd.h>
+#define fseek64 fseeko
+#endif
+
+#define BATCH_COPY_SIZE 65536 ///< Bytes copied per call while unpacking
+
+// ─────────────────────────────────────────────────────────────
+// Paths
+// ─────────────────────────────────────────────────────────────
+
+/**
+ * @brief Accepts relative paths whose components are plain names: no "..",
+ *        no hidden entries (the content store lives in .store), and nothing
+ *        that would break a text frame.
+ */
+static int safe_path(const char* path) {
+    size_t len = strlen(path);
+    if (len == 0 || len >= BATCH_PATH_MAX || strpbrk(path, "\\:|\n")) return 0;
+    for (const char* p = path; *p;) {
+        if (*p == '/' || *p == '.') return 0;  // Empty component, or hidden / ".."
+        const char* slash = strchr(p, '/');
+        if (!slash) break;
+        p = slash + 1;
+    }
+    return path[len - 1] != '/';
+}
+
+static void make_dir(const char* path) {
+#ifdef _WIN32
+    _mkdir(path);
+#else
+    mkdir(path, 0755);
+#endif
+}
+
+/**
+ * @brief Creates the directories above a file of assets/received.
+ */
+static void make_parents(const char* rel) {
+    const char* resolved = resolve_asset_path("received", rel);
+    if (!resolved) return;
+    char full[1024];
+    snprintf(full, sizeof(full), "%s", resolved);
+    size_t base = strlen(full) - strlen(rel);
+    for (char* slash = strchr(full + base, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        make_dir(full);
+        *slash = '/';
+    }
+}
+
+/**
+ * @brief FNV-1a step over a byte range.
+ */
+static unsigned long long fnv_bytes(unsigned long long hash, const void* data, size_t len) {
+    const unsigned char* p = data;
+    for (size_t i = 0; i < len; ++i) hash = (hash ^ p[i]) * 1099511628211ULL;
+    return hash;
+}
+
+// ─────────────────────────────────────────────────────────────
+// SENDER: Build the manifest
+// ─────────────────────────────────────────────────────────────
+
+static FileBatch* batch_new(void) {
+    FileBatch* batch = calloc(1, sizeof(*batch));
+    if (batch) batch->open_index = -1;
+    return batch;
+}
+
+static BatchEntry* batch_append(FileBatch* batch) {
+    if (batch->count == batch->cap) {
+        int cap = batch->cap ? batch->cap * 2 : 64;
+        BatchEntry* grown = realloc(batch->entries, (size_t)cap * sizeof(*grown));
+        if (!grown) return NULL;
+        batch->entries = grown;
+        batch->cap = cap;
+    }
+    BatchEntry* e = &batch->entries[batch->count++];
+    memset(e, 0, sizeof(*e));
+    return e;
+}
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/**
+ * @brief Names in a directory, sorted so the same tree always gives the same
+ *        manifest (and batch ID, which a resumed batch relies on).
+ * @return Number of names (free each and the array), or -1 if unreadable.
+ */
+static int list_dir(const char* dir, char*** names) {
+    int count = 0, cap = 0;
+    *names = NULL;
+#ifdef _WIN32
+    char pattern[1024];
+    snprintf(pattern, sizeof(pattern), "%s/*", dir);
+    struct _finddata_t found;
+    intptr_t h = _findfirst(pattern, &found);
+    if (h == -1) return -1;
+    do {
+        const char* name = found.name;
+#else
+    DIR* d = opendir(dir);
+    if (!d) return -1;
+    struct dirent* de;
+    while ((de = readdir(d)) != NULL) {
+        const char* name = de->d_name;
+#endif
+        if (name[0] == '.') continue;  // ".", "..", and hidden entries
+        if (count == cap) {
+            cap = cap ? cap * 2 : 32;
+            char** grown = realloc(*names, (size_t)cap * sizeof(*grown));
+            if (!grown) break;
+            *names = grown;
+        }
+        char* copy = strdup(name);
+        if (copy) (*names)[count++] = copy;
+#ifdef _WIN32
+    } while (_findnext(h, &found) == 0);
+    _findclose(h);
+#else
+    }
+    closedir(d);
+#endif
+    if (count > 1) qsort(*names, (size_t)count, sizeof(**names), compare_names);
+    return count;
+}
+
+/**
+ * @brief Adds a file of assets/to_send, or every file below a directory.
+ */
+static void batch_walk(FileBatch* batch, const char* rel, int depth) {
+    const char* resolved = resolve_asset_path("to_send", rel);
+    if (!resolved || batch->count >= BATCH_MAX_FILES) return;
+    char full[1024];
+    snprintf(full, sizeof(full), "%s", resolved);
+
+    struct stat st;
+    if (stat(full, &st) != 0) {
+        log_message(LOG_WARN, "[FILE] '%s' not found; left out of the batch", rel);
+        return;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        if (depth >= BATCH_MAX_DEPTH) {
+            log_message(LOG_WARN, "[FILE] '%s' is nested too deep; left out of the batch", rel);
+            return;
+        }
+        char** names;
+        int n = list_dir(full, &names);
+        for (int i = 0; i < n; ++i) {
+            char child[BATCH_PATH_MAX * 2];
+            snprintf(child, sizeof(child), "%s/%s", rel, names[i]);
+            if (safe_path(child)) batch_walk(batch, child, depth + 1);
+            free(names[i]);
+        }
+        free(names);
+        return;
+    }
+
+    if (!S_ISREG(st.st_mode) || file_type_blocked(rel)) return;
+    BatchEntry* e = batch_append(batch);
+    if (!e) return;
+    snprintf(e->path, sizeof(e->path), "%s", rel);
+    e->size = (long long)st.st_size;
+    if (asset_index_hash(rel, e->hash) != 0) {
+        log_message(LOG_WARN, "[FILE] Cannot read '%s'; left out of the batch", rel);
+        batch->count--;
+        return;
+    }
+    batch->total_bytes += e->size;
+}
+
+int file_batch_requested(const char* names) {
+    if (strchr(names, ';')) return 1;
+    const char* path = resolve_asset_path("to_send", names);
+    struct stat st;
+    return path && stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+FileBatch* file_batch_build(const char* names) {
+    FileBatch* batch = batch_new();
+    if (!batch) return NULL;
+
+    char list[BATCH_PATH_MAX * 8];
+    snprintf(list, sizeof(list), "%s", names);
+    for (char *name = list, *sep; name; name = sep ? sep + 1 : NULL) {
+        sep = strchr(name, ';');
+        if (sep) *sep = '\0';
+        while (*name == ' ') name++;
+        size_t len = strlen(name);
+        while (len > 0 && (name[len - 1] == ' ' || name[len - 1] == '/')) name[--len] = '\0';
+        if (len == 0) continue;
+        if (!safe_path(name)) {
+            log_message(LOG_WARN, "[FILE] Refusing unsafe batch path '%s'", name);
+            continue;
+        }
+        if (batch->name[0] == '\0') snprintf(batch->name, sizeof(batch->name), "%.*s", (int)sizeof(batch->name) - 1, name);
+        batch_walk(batch, name, 0);
+    }
+
+    if (batch->count == 0) {
+        log_message(LOG_ERROR, "[FILE] Batch '%s' has no file to send", names);
+        file_batch_free(batch);
+        return NULL;
+    }
+
+    // The ID names this exact manifest: a batch asked for again resumes its checkpoint
+    unsigned long long hash = 1469598103934665603ULL;
+    for (int i = 0; i < batch->count; ++i) {
+        const BatchEntry* e = &batch->entries[i];
+        hash = fnv_bytes(hash, e->path, strlen(e->path) + 1);
+        hash = fnv_bytes(hash, e->hash, CONTENT_HASH_LEN);
+        for (int b = 0; b < 8; ++b) hash = (hash ^ (unsigned char)(e->size >> (b * 8))) * 1099511628211ULL;
+    }
+    snprintf(batch->id, sizeof(batch->id), "%016llx", hash);
+    return batch;
+}
+
+// ─────────────────────────────────────────────────────────────
+// Manifest frames
+// ─────────────────────────────────────────────────────────────
+
+size_t file_batch_encode(const FileBatch* batch, int* next, char* out, size_t cap) {
+    size_t len = 0;
+    if (*next == 0)
+        len = (size_t)snprintf(out, cap, "%s,%d,%lld,%s\n", batch->id, batch->count, batch->total_bytes, batch->name);
+    while (*next < batch->count) {
+        const BatchEntry* e = &batch->entries[*next];
+        char line[BATCH_PATH_MAX + 64];
+        size_t n = (size_t)snprintf(line, sizeof(line), "%lld,%s,%s\n", e->size, e->hash, e->path);
+        if (len + n >= cap) break;
+        memcpy(out + len, line, n);
+        len += n;
+        (*next)++;
+    }
+    return len;
+}
+
+int file_batch_decode(FileBatch** batch, const char* data, size_t len, int seq) {
+    const char* end = data + len;
+    char line[BATCH_PATH_MAX + 64];
+
+    if (seq == 0) {
+        file_batch_free(*batch);
+        *batch = batch_new();
+        if (!*batch) return -1;
+
+        const char* nl = memchr(data, '\n', len);
+        size_t n = nl ? (size_t)(nl - data) : 0;
+        if (!nl || n >= sizeof(line)) return -1;
+        memcpy(line, data, n);
+        line[n] = '\0';
+        int name_at = 0;
+        if (sscanf(line, "%16[0-9a-f],%d,%lld,%n", (*batch)->id, &(*batch)->expected, &(*batch)->total_bytes,
+                   &name_at) != 3 || name_at == 0 || strlen((*batch)->id) != TRANSFER_ID_LEN ||
+            (*batch)->expected <= 0 || (*batch)->expected > BATCH_MAX_FILES)
+            return -1;
+        snprintf((*batch)->name, sizeof((*batch)->name), "%s", line + name_at);
+        data = nl + 1;
+    }
+
+    FileBatch* b = *batch;
+    if (!b || seq != b->count) return -1;  // Frames arrive in order on one stream
+    while (data < end) {
+        const char* nl = memchr(data, '\n', (size_t)(end - data));
+        size_t n = nl ? (size_t)(nl - data) : 0;
+        if (!nl || n >= sizeof(line) || b->count >= b->expected) return -1;
+        memcpy(line, data, n);
+        line[n] = '\0';
+        data = nl + 1;
+
+        BatchEntry* e = batch_append(b);
+        int path_at = 0;
+        if (!e || sscanf(line, "%lld,%24[0-9a-f],%n", &e->size, e->hash, &path_at) != 2 || path_at == 0 ||
+            e->size < 0 || strlen(e->hash) != CONTENT_HASH_LEN || !safe_path(line + path_at)) {
+            log_message(LOG_ERROR, "[FILE] Rejected batch entry '%s'", line);
+            return -1;
+        }
+        snprintf(e->path, sizeof(e->path), "%s", line + path_at);
+    }
+    return 0;
+}
+
+int file_batch_select(FileBatch* batch) {
+    int wanted = 0;
+    for (int i = 0; i < batch->count; ++i) {
+        BatchEntry* e = &batch->entries[i];
+        make_parents(e->path);
+        e->wanted = content_store_materialize(e->hash, e->path) != 0;
+        wanted += e->wanted;
+    }
+    return wanted;
+}
+
+// ─────────────────────────────────────────────────────────────
+// Wanted set
+// ─────────────────────────────────────────────────────────────
+
+size_t file_batch_encode_want(const FileBatch* batch, int* next, char* out, size_t cap) {
+    size_t len = (size_t)snprintf(out, cap, "%d,", *next);
+    while (*next < batch->count && len + 1 < cap) {
+        int nibble = 0;
+        for (int b = 0; b < 4; ++b) {
+            int i = *next + b;
+            if (i < batch->count && batch->entries[i].wanted) nibble |= 8 >> b;
+        }
+        out[len++] = "0123456789abcdef"[nibble];
+        *next = *next + 4 < batch->count ? *next + 4 : batch->count;
+    }
+    out[len] = '\0';
+    return len;
+}
+
+int file_batch_decode_want(FileBatch* batch, const char* data, size_t len) {
+    char prefix[16];
+    size_t n = 0;
+    while (n < len && n < sizeof(prefix) - 1 && data[n] != ',') {
+        prefix[n] = data[n];
+        n++;
+    }
+    if (n == len || data[n] != ',') return -1;
+    prefix[n] = '\0';
+    int first = atoi(prefix);
+    if (first < 0 || first > batch->count) return -1;
+
+    for (size_t i = n + 1; i < len; ++i) {
+        char c = data[i];
+        int nibble = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+        if (nibble < 0) return -1;
+        for (int b = 0; b < 4; ++b) {
+            int entry = first + (int)(i - n - 1) * 4 + b;
+            if (entry < batch->count) batch->entries[entry].wanted = (nibble & (8 >> b)) != 0;
+        }
+    }
+    return 0;
+}
+
+int file_batch_layout(FileBatch* batch) {
+    free(batch->stream);
+    batch->stream = malloc((size_t)batch->count * sizeof(*batch->stream));
+    if (!batch->stream) return -1;
+
+    unsigned long long hash = fnv_bytes(1469598103934665603ULL, batch->id, TRANSFER_ID_LEN);
+    batch->wanted = 0;
+    batch->stream_bytes = 0;
+    for (int i = 0; i < batch->count; ++i) {
+        BatchEntry* e = &batch->entries[i];
+        if (!e->wanted) continue;
+        e->offset = batch->stream_bytes;
+        batch->stream_bytes += e->size;
+        batch->stream[batch->wanted++] = i;
+        unsigned char index[4] = { (unsigned char)i, (unsigned char)(i >> 8), (unsigned char)(i >> 16), (unsigned char)(i >> 24) };
+        hash = fnv_bytes(hash, index, sizeof(index));
+    }
+    snprintf(batch->transfer_id, sizeof(batch->transfer_id), "%016llx", hash);
+    return 0;
+}
+
+// ─────────────────────────────────────────────────────────────
+// SENDER: Read the data stream
+// ─────────────────────────────────────────────────────────────
+
+size_t file_batch_read(FileBatch* batch, void* data, size_t len, long long offset) {
+    size_t done = 0;
+    while (done < len) {
+        long long pos = offset + (long long)done;
+
+        // Last wanted file starting at or before pos; empty files share the
+        // offset of the next one and are skipped this way
+        int lo = 0, hi = batch->wanted - 1, k = -1;
+        while (lo <= hi) {
+            int mid = (lo + hi) / 2;
+            if (batch->entries[batch->stream[mid]].offset <= pos) {
+                k = mid;
+                lo = mid + 1;
+            } else {
+                hi = mid - 1;
+            }
+        }
+        if (k < 0) break;
+        int index = batch->stream[k];
+        const BatchEntry* e = &batch->entries[index];
+        long long within = pos - e->offset;
+        if (within >= e->size) break;
+
+        if (batch->open_index != index) {
+            if (batch->fp) fclose(batch->fp);
+            const char* path = resolve_asset_path("to_send", e->path);
+            batch->fp = path ? fopen(path, "rb") : NULL;
+            batch->open_index = batch->fp ? index : -1;
+            batch->fp_pos = 0;
+            if (!batch->fp) break;
+        }
+        if (batch->fp_pos != within) {
+            if (fseek64(batch->fp, within, SEEK_SET) != 0) break;
+            batch->fp_pos = within;
+        }
+
+        size_t want = len - done;
+        if ((long long)want > e->size - within) want = (size_t)(e->size - within);
+        size_t n = fread((char*)data + done, 1, want, batch->fp);
+        batch->fp_pos += (long long)n;
+        done += n;
+        if (n < want) break;
+    }
+    return done;
+}
+
+// ─────────────────────────────────────────────────────────────
+// SENDER: Offer the manifest and stream what is wanted
+// ─────────────────────────────────────────────────────────────
+
+#define BATCH_ANSWER_TIMEOUT 30 ///< seconds a receiver may take to answer a manifest
+#define BATCH_DRAIN_POLL_MS 10  ///< How often a manifest held back by a congested receiver tries again
+
+/**
+ * @brief One encoded BATCH frame payload inside a manifest buffer.
+ */
+typedef struct {
+    size_t off;
+    size_t len;
+    int first;  ///< Index of the first file it lists
+    int final;
+} ManifestFrame;
+
+/**
+ * @brief A manifest offered to a receiver, waiting for its WANT.
+ *        While its frames are still going out (manifest set) only the reactor
+ *        sending them (wheel) may free it; other threads mark it dropped.
+ */
+typedef struct {
+    int sockfd;             ///< Receiver socket (-1 = free slot)
+    int dest_id;            ///< Receiver ID
+    FileBatch* batch;       ///< Manifest; handed to the chunk sender once answered
+    long long offered_ms;   ///< When the manifest was parked, then when its last frame went out
+    char* manifest;         ///< Encoded BATCH payloads, NULL once every frame is out
+    ManifestFrame* frames;  ///< Frames of manifest
+    int frame_count;        ///< Entries of frames
+    int next_frame;         ///< First frame not sent yet
+    int dropped;            ///< Dropped elsewhere while its frames were going out
+    TimerWheel* wheel;      ///< Wheel of the reactor sending the frames, NULL off a reactor
+    Timer drain;            ///< Sends the next frames once the receiver's queue drains
+} PendingBatch;
+
+static PendingBatch pending_batches[MAX_OUTGOING];
+static mutex_t batches_lock;
+
+void file_batch_init(void) {
+    mutex_init(&batches_lock);
+    for (int i = 0; i < MAX_OUTGOING; ++i) pending_batches[i].sockfd = -1;
+}
+
+/**
+ * @brief Empties a pending slot, or marks it dropped when another reactor is
+ *        still sending its frames. Caller holds batches_lock.
+ */
+static void pending_free(PendingBatch* p) {
+    if (p->manifest) {
+        if (p->wheel != file_transfer_timers()) {
+            p->dropped = 1;  // Freed by its own reactor at the next drain
+            return;
+        }
+        if (p->wheel) timer_cancel(p->wheel, &p->drain);
+        free(p->manifest);
+        free(p->frames);
+        p->manifest = NULL;
+        p->frames = NULL;
+    }
+    file_batch_free(p->batch);
+    p->batch = NULL;
+    p->dropped = 0;
+    p->sockfd = -1;
+}
+
+void file_batch_drop_pending(int sockfd, int dest_id) {
+    mutex_lock(&batches_lock);
+    for (int i = 0; i < MAX_OUTGOING; ++i) {
+        PendingBatch* p = &pending_batches[i];
+        if (p->sockfd == sockfd && (dest_id < 0 || p->dest_id == dest_id)) pending_free(p);
+    }
+    mutex_unlock(&batches_lock);
+}
+
+size_t file_batch_frame_cap(int fd) {
+    return (frame_wire(fd) & WIRE_BINARY) ? BATCH_FRAME_BYTES : MAX_MESSAGE_LENGTH - 1;
+}
+
+/**
+ * @brief Encodes the whole manifest into frame payloads of at most cap bytes.
+ * @return Number of frames (*out and *frames malloc'd), -1 on failure.
+ */
+static int encode_manifest(FileBatch* batch, size_t cap, char** out, ManifestFrame** frames) {
+    size_t room = cap, used = 0;
+    int count = 0, slots = 4, next = 0;
+    char* buf = malloc(room);
+    ManifestFrame* list = malloc(slots * sizeof(*list));
+    while (buf && list && next < batch->count) {
+        if (room - used < cap) {
+            char* grown = realloc(buf, room * 2);
+            if (!grown) break;
+            buf = grown;
+            room *= 2;
+        }
+        if (count == slots) {
+            ManifestFrame* grown = realloc(list, 2 * slots * sizeof(*list));
+            if (!grown) break;
+            list = grown;
+            slots *= 2;
+        }
+        int first = next;
+        size_t len = file_batch_encode(batch, &next, buf + used, cap);
+        if (next == first) break;
+        list[count++] = (ManifestFrame){ .off = used, .len = len, .first = first, .final = next == batch->count };
+        used += len;
+    }
+    if (!buf || !list || next < batch->count) {
+        free(buf);
+        free(list);
+        return -1;
+    }
+    *out = buf;
+    *frames = list;
+    return count;
+}
+
+/**
+ * @brief Queues manifest frames while the receiver's queue is below the high
+ *        watermark. On a reactor the rest waits on the drain timer, like a
+ *        held-back chunk sender, so a slow receiver never stalls the reactor;
+ *        elsewhere frame_wait_drain() waits for room.
+ *        Frames are sent without batches_lock: nobody else touches them.
+ */
+static void manifest_pump(PendingBatch* p) {
+    mutex_lock(&batches_lock);
+    if (p->dropped) {
+        pending_free(p);
+        mutex_unlock(&batches_lock);
+        return;
+    }
+    mutex_unlock(&batches_lock);
+
+    int rc = 0;
+    while (rc == 0 && p->next_frame < p->frame_count) {
+        if (p->wheel && frame_pending(p->sockfd) >= OUTQ_HIGH_WATERMARK) {
+            timer_schedule(p->wheel, &p->drain, BATCH_DRAIN_POLL_MS);
+            return;
+        }
+        const ManifestFrame* f = &p->frames[p->next_frame];
+        rc = send_chunk(p->sockfd, "file", 0, p->dest_id, p->manifest + f->off, f->len, "BATCH", f->first, f->final);
+        if (rc == 0) p->next_frame++;
+        if (rc == 0 && !p->wheel && !f->final) rc = frame_wait_drain(p->sockfd);
+    }
+
+    mutex_lock(&batches_lock);
+    int dropped = p->dropped;
+    free(p->manifest);
+    free(p->frames);
+    p->manifest = NULL;  // Complete: a WANT may take it from here
+    p->frames = NULL;
+    p->offered_ms = monotonic_ms();
+    if (rc != 0) {
+        log_message(LOG_ERROR, "[FILE] Could not send the batch manifest of '%s' to client %d", p->batch->name, p->dest_id);
+    } else if (!dropped) {
+        log_message(LOG_INFO, "[FILE] Offered batch '%s' to client %d: %d file(s), %lld bytes", p->batch->name,
+                    p->dest_id, p->batch->count, p->batch->total_bytes);
+    }
+    if (rc != 0 || dropped) pending_free(p);
+    mutex_unlock(&batches_lock);
+}
+
+static void on_manifest_drain(void* arg) {
+    manifest_pump(arg);
+}
+
+int file_batch_offer(int connfd, const char* names, int dest_id) {
+    FileBatch* batch = file_batch_build(names);
+    if (!batch) return -1;
+
+    // Encoded while the batch is still ours: once parked, a WANT or a newer offer may take it
+    char* manifest;
+    ManifestFrame* frames;
+    int frame_count = encode_manifest(batch, file_batch_frame_cap(connfd), &manifest, &frames);
+    if (frame_count < 0) {
+        file_batch_free(batch);
+        return -1;
+    }
+
+    long long now = monotonic_ms();
+    PendingBatch* slot = NULL;
+    mutex_lock(&batches_lock);
+    for (int i = 0; i < MAX_OUTGOING; ++i) {
+        PendingBatch* p = &pending_batches[i];
+        // A new batch for the same receiver replaces its unanswered one
+        if (p->sockfd >= 0 && ((p->sockfd == connfd && p->dest_id == dest_id) ||
+                               now - p->offered_ms >= BATCH_ANSWER_TIMEOUT * 1000LL))
+            pending_free(p);
+        if (p->sockfd < 0 && !slot) slot = p;
+    }
+    if (!slot) {
+        mutex_unlock(&batches_lock);
+        log_message(LOG_ERROR, "[FILE] Too many batches waiting for an answer; refusing '%s'", names);
+        file_batch_free(batch);
+        free(manifest);
+        free(frames);
+        return -1;
+    }
+    // Parked before the first frame goes out, so the WANT answering the last one finds it
+    slot->sockfd = connfd;
+    slot->dest_id = dest_id;
+    slot->batch = batch;
+    slot->offered_ms = now;
+    slot->manifest = manifest;
+    slot->frames = frames;
+    slot->frame_count = frame_count;
+    slot->next_frame = 0;
+    slot->dropped = 0;
+    slot->wheel = file_transfer_timers();
+    timer_init(&slot->drain, on_manifest_drain, slot);
+    mutex_unlock(&batches_lock);
+
+    manifest_pump(slot);
+    return 0;
+}
+
+void file_batch_on_want(const FrameView* view, int connfd) {
+    PendingBatch* p = NULL;
+    mutex_lock(&batches_lock);
+    for (int i = 0; i < MAX_OUTGOING && !p; ++i) {
+        PendingBatch* q = &pending_batches[i];
+        if (q->sockfd == connfd && q->dest_id == view->src_id && !q->manifest && !q->dropped) p = q;
+    }
+    if (!p) {
+        mutex_unlock(&batches_lock);
+        log_message(LOG_WARN, "[FILE] WANT from client %d matches no batch", view->src_id);
+        return;
+    }
+    if (file_batch_decode_want(p->batch, FRAME_VIEW_PTR(view, view->payload), view->payload.len) != 0) {
+        log_message(LOG_WARN, "[FILE] Malformed WANT from client %d; batch '%s' dropped", view->src_id, p->batch->name);
+        pending_free(p);
+        mutex_unlock(&batches_lock);
+        return;
+    }
+    if (!view->is_final) {
+        mutex_unlock(&batches_lock);
+        return;
+    }
+    FileBatch* batch = p->batch;
+    p->batch = NULL;
+    pending_free(p);
+    mutex_unlock(&batches_lock);
+
+    if (file_batch_layout(batch) != 0 || batch->wanted == 0) {
+        if (batch->wanted == 0)
+            log_message(LOG_INFO, "[FILE] Client %d already stores all %d file(s) of batch '%s'",
+                        view->src_id, batch->count, batch->name);
+        file_batch_free(batch);
+        return;
+    }
+
+    log_message(LOG_INFO, "[FILE] Sending batch '%s' to client %d: %d of %d file(s), %lld bytes as one stream",
+                batch->name, view->src_id, batch->wanted, batch->count, batch->stream_bytes);
+    char staged[TRANSFER_ID_LEN + 8];
+    snprintf(staged, sizeof(staged), "%s.batch", batch->transfer_id);
+    // seq: chunk size asked for; batches always go chunked, across file boundaries
+    file_start_chunked(connfd, NULL, NULL, batch, NULL, batch->stream_bytes, staged, 0, view->src_id, view->seq_num,
+                  NULL, 0, 0);
+}
+
+// ─────────────────────────────────────────────────────────────
+// RECEIVER: Unpack the staging file
+// ─────────────────────────────────────────────────────────────
+
+int file_batch_unpack(FileBatch* batch, const char* staged) {
+    const char* resolved = resolve_asset_path("received", staged);
+    if (!resolved) return -1;
+    char staged_path[1024];
+    snprintf(staged_path, sizeof(staged_path), "%s", resolved);
+
+    FILE* in = fopen(staged_path, "rb");
+    unsigned char* block = malloc(BATCH_COPY_SIZE);
+    if (!in || !block) {
+        if (in) fclose(in);
+        free(block);
+        return -1;
+    }
+
+    // Files follow each other in the stream, so the staging file is read once, in order
+    int failures = 0;
+    for (int k = 0; k < batch->wanted; ++k) {
+        const BatchEntry* e = &batch->entries[batch->stream[k]];
+        resolved = resolve_asset_path("received", e->path);
+        char path[1024];
+        snprintf(path, sizeof(path), "%s", resolved ? resolved : "");
+
+        remove(path);  // May be a link to a stored blob, which must not be overwritten
+        FILE* out = resolved ? fopen(path, "wb") : NULL;
+        ContentHasher h;
+        content_hash_begin(&h);
+        long long left = e->size;
+        int ok = out != NULL;
+        while (left > 0) {
+            size_t want = left < BATCH_COPY_SIZE ? (size_t)left : BATCH_COPY_SIZE;
+            size_t n = fread(block, 1, want, in);
+            if (n == 0) break;
+            content_hash_update(&h, block, n);
+            if (ok) ok = fwrite(block, 1, n, out) == n;
+            left -= (long long)n;
+        }
+        if (out) ok = fclose(out) == 0 && ok;
+
+        char hash[CONTENT_HASH_LEN + 1];
+        content_hash_end(&h, hash);
+        if (ok && left == 0 && strcmp(hash, e->hash) == 0) {
+            content_store_add_hashed(e->path, e->hash);
+            continue;
+        }
+        log_message(LOG_ERROR, "[FILE] Batched file '%s' %s", e->path,
+                    left != 0 ? "is truncated" : !ok ? "could not be written" : "does not match its hash");
+        remove(path);
+        failures++;
+        if (left != 0) {
+            // The staging file is short: every following file is missing too
+            failures += batch->wanted - k - 1;
+            break;
+        }
+    }
+
+    fclose(in);
+    free(block);
+    remove(staged_path);
+    return failures;
+}
+
+void file_batch_free(FileBatch* batch) {
+    if (!batch) return;
+    if (batch->fp) fclose(batch->fp);
+    free(batch->entries);
+    free(batch->stream);
+    free(batch);
+}
@@ -0,0 +1,500 @@
+/**
+ * @file file_multicast.c
+ * @brief One file to many recipients. The server opens a group when a client
+ *        asks for a multicast and announces the file to every recipient; each
+ *        one that answers READY or RESUME gets a chunk sender of its own
+ *        (file_transfer.c) fed from the group's cache of encoded chunks, so
+ *        every chunk is read and encoded once and the same shared frame is
+ *        queued to every recipient.
+ * @author Oussama Amara
+ * @version 1.1
+ * @date 2026-10-17
+ */
+
+#include "file_transfer.h"
+#include "file_transfer_internal.h"
+#include "framing.h"
+#include "logger.h"
+#include "platform.h"
+#include "platform_thread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MULTICAST_MAX 16                        ///< Multicasts in progress at once
+#define MULTICAST_CACHE_BYTES (8 * 1024 * 1024) ///< Smallest chunk cache of a group, in bytes
+#define MULTICAST_CACHE_MAX_BYTES (64 * 1024 * 1024) ///< Largest chunk cache of a group, in bytes
+#define MULTICAST_ANSWER_TIMEOUT 30             ///< seconds a recipient may take to answer INCOMING
+#define MULTICAST_VARIANTS 4                    ///< Binary encodings: CRC32C or not, LZ4 or not
+#define MULTICAST_LAG_MS 1000                   ///< A recipient sent no new chunk for this long stops holding the rest
+#define MULTICAST_JOIN_WINDOW_MS 500            ///< Longest the first recipient to answer waits for the rest
+
+/**
+ * @brief One recipient of a multicast.
+ */
+typedef struct {
+    int id;                   ///< Client ID
+    int state;                ///< MC_*
+    int next;                 ///< Next new chunk its sender queues
+    long long moved_ms;       ///< When it joined or was last sent a new chunk
+    OutgoingFile* parked;     ///< Its sender while the group holds it back (NULL = not parked)
+    int parked_seq;           ///< Chunk the parked sender waits to send, -1 = its START
+} McRecipient;
+
+/**
+ * @brief Encoded frames of one chunk, one per binary wire variant (NULL until a
+ *        recipient with that variant needs it).
+ */
+typedef struct {
+    int seq;                  ///< Chunk held here (-1 = none)
+    uint64_t digest;          ///< Digest of the chunk's bytes, set when they are read
+    SharedFrame* frames[MULTICAST_VARIANTS];
+} McChunk;
+
+/**
+ * @brief One file on its way to many recipients. Each recipient has an
+ *        OutgoingFile of its own (window, SACKs, retransmits) on its reactor;
+ *        they meet in the chunk cache, so a chunk is read and encoded once and
+ *        every queue references the same frame. Recipients start together (the
+ *        join window) and the cache holds a window per recipient. A cached chunk
+ *        stays until every recipient still moving was sent it, so the fastest
+ *        recipient runs at most the cache ahead of the slowest and co-paced
+ *        recipients share every chunk. A recipient sent nothing new for
+ *        MULTICAST_LAG_MS stops holding the rest back and re-reads its chunks.
+ */
+struct MulticastGroup {
+    int active;               ///< Slot in use
+    int src_id;               ///< Client that asked for the multicast
+    char filename[128];       ///< Name of the file
+    FILE* fp;                 ///< Source file, shared by every recipient
+    long long file_size;      ///< File size in bytes
+    char transfer_id[TRANSFER_ID_LEN + 1]; ///< ID of this version of the file
+    int chunk_size;           ///< Fixed by the first recipient to answer (0 until then)
+    int total_chunks;         ///< Chunks in the file
+    McRecipient* recipients;  ///< Everyone the file was announced to
+    int recipient_count;
+    int unsettled;            ///< Recipients still invited or sending
+    int parked;               ///< Recipients whose sender is parked
+    McChunk* cache;           ///< Ring of encoded chunks indexed by seq % cache_slots
+    int cache_slots;
+    unsigned char* chunk;     ///< Read buffer of chunk_size bytes
+    long long reads;          ///< Chunks read from disk and encoded
+    long long shares;         ///< Chunks queued straight from the cache
+    long long started_ms;     ///< When the multicast was requested
+    long long first_join_ms;  ///< When the first recipient answered (0 = none yet)
+    mutex_t lock;             ///< Guards recipients, cache and counters
+};
+
+static MulticastGroup groups[MULTICAST_MAX];
+static mutex_t groups_lock;   ///< Guards claiming and freeing groups; taken before a group's lock
+static THREAD_LOCAL Timer sweep_timer; ///< Answer deadline of the groups opened on this thread
+
+void multicast_init(void) {
+    mutex_init(&groups_lock);
+    for (int i = 0; i < MULTICAST_MAX; ++i) mutex_init(&groups[i].lock);
+}
+
+static McRecipient* recipient_of(MulticastGroup* g, int id) {
+    for (int i = 0; i < g->recipient_count; ++i)
+        if (g->recipients[i].id == id) return &g->recipients[i];
+    return NULL;
+}
+
+/**
+ * @brief Logs the outcome and frees a group's resources (groups_lock and g->lock held).
+ */
+static void multicast_free(MulticastGroup* g) {
+    int count[MC_FAILED + 1] = {0};
+    for (int i = 0; i < g->recipient_count; ++i) count[g->recipients[i].state]++;
+    log_message(LOG_INFO, "[FILE] Multicast of '%s' ended in %lld ms: %d delivered, %d skipped, %d sent separately, "
+                "%d failed; %lld chunk(s) read, %lld served from cache", g->filename, monotonic_ms() - g->started_ms,
+                count[MC_DELIVERED], count[MC_SKIPPED], count[MC_UNICAST], count[MC_FAILED], g->reads, g->shares);
+
+    for (int i = 0; g->cache && i < g->cache_slots; ++i)
+        for (int v = 0; v < MULTICAST_VARIANTS; ++v) frame_share_release(g->cache[i].frames[v]);
+    free(g->cache);
+    free(g->recipients);
+    free(g->chunk);
+    if (g->fp) fclose(g->fp);
+    g->cache = NULL;
+    g->recipients = NULL;
+    g->chunk = NULL;
+    g->fp = NULL;
+    g->active = 0;
+}
+
+static void unpark(MulticastGroup* g, McRecipient* r) {
+    if (!r->parked) return;
+    r->parked = NULL;
+    g->parked--;
+}
+
+static int invited_count(MulticastGroup* g) {
+    int invited = 0;
+    for (int i = 0; i < g->recipient_count; ++i) invited += g->recipients[i].state == MC_INVITED;
+    return invited;
+}
+
+/**
+ * @brief When no other recipient still needs the chunk seq of a slot: 0 once
+ *        none does, else when the last one that was not sent it yet stops
+ *        counting, MULTICAST_LAG_MS after its last new chunk (g->lock held).
+ */
+static long long slot_pinned(MulticastGroup* g, int seq, const McRecipient* self, long long now) {
+    long long until = 0;
+    for (int i = 0; seq >= 0 && i < g->recipient_count; ++i) {
+        const McRecipient* r = &g->recipients[i];
+        long long lapse = r->moved_ms + MULTICAST_LAG_MS;
+        if (r != self && r->state == MC_SENDING && r->next <= seq && now < lapse && lapse > until) until = lapse;
+    }
+    return until;
+}
+
+/**
+ * @brief When new chunk seq for r stops evicting a chunk another recipient
+ *        needs, 0 if it does not (g->lock held).
+ */
+static long long ahead_until(MulticastGroup* g, const McRecipient* r, int seq, long long now) {
+    McChunk* slot = g->cache ? &g->cache[seq % g->cache_slots] : NULL;
+    return slot && slot->seq < seq ? slot_pinned(g, slot->seq, r, now) : 0;
+}
+
+/**
+ * @brief Wakes the parked senders the group no longer holds back: every
+ *        recipient answered, or the slot a sender waits for is free (g->lock held).
+ */
+static void wake_parked(MulticastGroup* g, long long now) {
+    if (g->parked == 0) return;
+    int invited = invited_count(g);
+    for (int i = 0; i < g->recipient_count; ++i) {
+        McRecipient* r = &g->recipients[i];
+        if (!r->parked || (r->parked_seq < 0 ? invited > 0 : ahead_until(g, r, r->parked_seq, now) > 0)) continue;
+        file_transfer_wake(r->parked);
+        unpark(g, r);
+    }
+}
+
+/**
+ * @brief Moves an invited or sending recipient to its final state and frees
+ *        the group after the last one (groups_lock and g->lock held). Senders
+ *        it held back are woken.
+ */
+static void settle_locked(MulticastGroup* g, McRecipient* r, int state) {
+    if (!r || (r->state != MC_INVITED && r->state != MC_SENDING)) return;
+    r->state = state;
+    unpark(g, r);
+    wake_parked(g, monotonic_ms());
+    if (--g->unsettled == 0) multicast_free(g);
+}
+
+void multicast_settle(MulticastGroup* g, int recipient_id, int state) {
+    mutex_lock(&groups_lock);
+    mutex_lock(&g->lock);
+    if (g->active) settle_locked(g, recipient_of(g, recipient_id), state);
+    mutex_unlock(&g->lock);
+    mutex_unlock(&groups_lock);
+}
+
+/**
+ * @brief Gives up on recipients that never answered INCOMING (groups_lock held).
+ * @return Next answer deadline of a group still waiting for answers, 0 if none.
+ */
+static long long multicast_sweep(long long now) {
+    long long next = 0;
+    for (int i = 0; i < MULTICAST_MAX; ++i) {
+        MulticastGroup* g = &groups[i];
+        mutex_lock(&g->lock);
+        long long deadline = g->started_ms + MULTICAST_ANSWER_TIMEOUT * 1000LL;
+        if (g->active && now >= deadline) {
+            for (int k = 0; g->active && k < g->recipient_count; ++k) {
+                if (g->recipients[k].state != MC_INVITED) continue;
+                log_message(LOG_WARN, "[FILE] Client %d never answered the multicast of '%s'", g->recipients[k].id, g->filename);
+                settle_locked(g, &g->recipients[k], MC_FAILED);
+            }
+        } else if (g->active && invited_count(g) > 0 && (next == 0 || deadline < next)) {
+            next = deadline;
+        }
+        mutex_unlock(&g->lock);
+    }
+    return next;
+}
+
+/**
+ * @brief Answer deadline timer: sweeps, then waits for the next deadline while
+ *        a group still waits for answers.
+ */
+static void on_multicast_sweep(void* arg) {
+    (void)arg;
+    long long now = monotonic_ms();
+    mutex_lock(&groups_lock);
+    long long next = multicast_sweep(now);
+    mutex_unlock(&groups_lock);
+    TimerWheel* wheel = file_transfer_timers();
+    if (next > 0 && wheel) timer_schedule(wheel, &sweep_timer, next - now);
+}
+
+/**
+ * @brief Finds the group that announced filename to recipient_id and still waits
+ *        for its answer. Returns with groups_lock and the group's lock held, or NULL
+ *        with neither held.
+ */
+static MulticastGroup* multicast_find_invited(int recipient_id, const char* filename, McRecipient** recipient) {
+    mutex_lock(&groups_lock);
+    multicast_sweep(monotonic_ms());
+    for (int i = 0; i < MULTICAST_MAX; ++i) {
+        MulticastGroup* g = &groups[i];
+        mutex_lock(&g->lock);
+        McRecipient* r = g->active && strcmp(g->filename, filename) == 0 ? recipient_of(g, recipient_id) : NULL;
+        if (r && r->state == MC_INVITED) {
+            *recipient = r;
+            return g;
+        }
+        mutex_unlock(&g->lock);
+    }
+    mutex_unlock(&groups_lock);
+    return NULL;
+}
+
+int file_multicast_open(const char* filename, int src_id, const int* recipients, int count) {
+    if (!filename || !recipients || count <= 0) return -1;
+    AssetInfo info;
+    FILE* fp = file_open_outgoing(filename, 1, &info);
+    if (!fp) return -1;
+    long long file_size = info.size;
+    char transfer_id[TRANSFER_ID_LEN + 1];
+    file_transfer_id_of(filename, &info, transfer_id);
+
+    McRecipient* list = malloc((size_t)count * sizeof(*list));
+    if (!list) {
+        fclose(fp);
+        return -1;
+    }
+
+    mutex_lock(&groups_lock);
+    long long now = monotonic_ms();
+    multicast_sweep(now);
+    MulticastGroup* g = NULL;
+    for (int i = 0; i < MULTICAST_MAX && !g; ++i)
+        if (!groups[i].active) g = &groups[i];
+    if (!g) {
+        mutex_unlock(&groups_lock);
+        log_message(LOG_ERROR, "[FILE] Too many multicasts in progress; refusing '%s'", filename);
+        free(list);
+        fclose(fp);
+        return -1;
+    }
+
+    mutex_lock(&g->lock);
+    g->active = 1;
+    g->src_id = src_id;
+    snprintf(g->filename, sizeof(g->filename), "%s", filename);
+    g->fp = fp;
+    g->file_size = file_size;
+    memcpy(g->transfer_id, transfer_id, sizeof(transfer_id));
+    g->chunk_size = 0;
+    g->total_chunks = 0;
+    g->recipients = list;
+    g->recipient_count = 0;
+    for (int i = 0; i < count; ++i) {
+        if (recipient_of(g, recipients[i])) continue;  // Named twice
+        list[g->recipient_count].id = recipients[i];
+        list[g->recipient_count].state = MC_INVITED;
+        list[g->recipient_count].next = 0;
+        list[g->recipient_count].moved_ms = 0;
+        list[g->recipient_count].parked = NULL;
+        list[g->recipient_count].parked_seq = -1;
+        g->recipient_count++;
+    }
+    g->unsettled = g->recipient_count;
+    g->parked = 0;
+    g->cache = NULL;
+    g->cache_slots = 0;
+    g->chunk = NULL;
+    g->reads = g->shares = 0;
+    g->started_ms = now;
+    g->first_join_ms = 0;
+    log_message(LOG_INFO, "[FILE] Multicasting '%s' (%lld bytes) from client %d to %d recipient(s)",
+                filename, file_size, src_id, g->recipient_count);
+    mutex_unlock(&g->lock);
+    mutex_unlock(&groups_lock);
+
+    // Unanswered recipients are given up at the deadline, not only when the next group opens
+    TimerWheel* wheel = file_transfer_timers();
+    if (wheel && !timer_pending(&sweep_timer)) {
+        timer_init(&sweep_timer, on_multicast_sweep, NULL);
+        timer_schedule(wheel, &sweep_timer, MULTICAST_ANSWER_TIMEOUT * 1000LL);
+    }
+    return 0;
+}
+
+int multicast_join(int connfd, const char* filename, int dest_id, int chunk_size,
+                   const char* resume_id, int first, int end) {
+    McRecipient* r;
+    MulticastGroup* g = multicast_find_invited(dest_id, filename, &r);
+    if (!g) return -1;
+
+    // A shared chunk fits only recipients on binary frames that take the group's chunk size
+    int binary = (frame_wire(connfd) & WIRE_BINARY) != 0 &&
+                 (g->chunk_size == 0 || file_chunk_grant(connfd, chunk_size, 0) == g->chunk_size);
+    long long now = monotonic_ms();
+    if (binary) {
+        // Holds the cache from its first chunk on, even before its START goes out
+        r->state = MC_SENDING;
+        r->next = first > 0 ? first : 0;
+        r->moved_ms = now;
+        wake_parked(g, now);
+    } else {
+        settle_locked(g, r, MC_UNICAST);
+    }
+    if (g->first_join_ms == 0) g->first_join_ms = now;
+    long long file_size = g->file_size;
+    mutex_unlock(&g->lock);
+    mutex_unlock(&groups_lock);
+    if (!binary) return -1;
+
+    if (file_start_chunked(connfd, NULL, g, NULL, NULL, file_size, filename, 0, dest_id, chunk_size, resume_id, first, end) != 0)
+        multicast_settle(g, dest_id, MC_FAILED);
+    return 0;
+}
+
+long long multicast_gather_wait(MulticastGroup* g, int recipient_id, OutgoingFile* sender, long long now) {
+    mutex_lock(&g->lock);
+    long long close = g->first_join_ms + MULTICAST_JOIN_WINDOW_MS;
+    long long wait = g->active && invited_count(g) > 0 && now < close ? close - now : 0;
+    McRecipient* r = recipient_of(g, recipient_id);
+    if (r && wait > 0) {
+        g->parked += !r->parked;
+        r->parked = sender;
+        r->parked_seq = -1;
+    } else if (r) {
+        unpark(g, r);
+    }
+    mutex_unlock(&g->lock);
+    return wait;
+}
+
+int multicast_chunk_size(MulticastGroup* g, int connfd, int requested) {
+    mutex_lock(&g->lock);
+    if (g->chunk_size == 0) {
+        g->chunk_size = file_chunk_grant(connfd, requested, 0);
+        g->total_chunks = (int)((g->file_size + g->chunk_size - 1) / g->chunk_size);
+        int window = OUTQ_HARD_LIMIT / 2 / g->chunk_size;
+        if (window > file_transfer_window()) window = file_transfer_window();
+        long long slots = (long long)g->recipient_count * (window < 1 ? 1 : window);
+        if (slots < MULTICAST_CACHE_BYTES / g->chunk_size) slots = MULTICAST_CACHE_BYTES / g->chunk_size;
+        if (slots > MULTICAST_CACHE_MAX_BYTES / g->chunk_size) slots = MULTICAST_CACHE_MAX_BYTES / g->chunk_size;
+        g->cache_slots = (int)slots;
+        g->cache = calloc((size_t)g->cache_slots, sizeof(*g->cache));
+        g->chunk = malloc((size_t)g->chunk_size);
+        for (int i = 0; g->cache && i < g->cache_slots; ++i) g->cache[i].seq = -1;
+    }
+    int size = g->chunk_size;
+    mutex_unlock(&g->lock);
+    return size;
+}
+
+void multicast_transfer_id(MulticastGroup* g, char* out) {
+    memcpy(out, g->transfer_id, TRANSFER_ID_LEN + 1);
+}
+
+long long multicast_ahead(MulticastGroup* g, int recipient_id, int seq, OutgoingFile* sender, long long now) {
+    mutex_lock(&g->lock);
+    McRecipient* r = recipient_of(g, recipient_id);
+    long long until = ahead_until(g, r, seq, now);
+    if (r && until > 0) {
+        g->parked += !r->parked;
+        r->parked = sender;
+        r->parked_seq = seq;
+    } else if (r) {
+        unpark(g, r);
+    }
+    mutex_unlock(&g->lock);
+    return until > 0 ? until - now : 0;
+}
+
+int multicast_send(MulticastGroup* g, int sockfd, int recipient_id, int seq, uint64_t* digest) {
+    unsigned wire = frame_wire(sockfd);
+    int variant = ((wire & WIRE_CRC32C) ? 1 : 0) | ((wire & WIRE_LZ4) ? 2 : 0);
+    long long now = monotonic_ms();
+
+    SharedFrame* frame = NULL;
+    mutex_lock(&g->lock);
+    McRecipient* r = recipient_of(g, recipient_id);
+    if (g->cache && g->chunk) {
+        McChunk* slot = &g->cache[seq % g->cache_slots];
+        int cached = slot->seq == seq || (slot->seq < seq && !slot_pinned(g, slot->seq, r, now));
+        if (cached && slot->seq != seq) {
+            for (int v = 0; v < MULTICAST_VARIANTS; ++v) {
+                frame_share_release(slot->frames[v]);
+                slot->frames[v] = NULL;
+            }
+            slot->seq = seq;
+        }
+        frame = cached ? slot->frames[variant] : NULL;
+        if (frame) {
+            g->shares++;
+            frame_share_retain(frame);
+            *digest = slot->digest;
+        } else {
+            long long offset = (long long)seq * g->chunk_size;
+            size_t want = seq == g->total_chunks - 1 ? (size_t)(g->file_size - offset) : (size_t)g->chunk_size;
+            if (file_read_at(g->fp, g->chunk, want, offset) == want) {
+                // Every recipient gets the same bytes, so the frame is addressed to no one in particular
+                frame = frame_share_chunk(wire, "file", 0, 0, g->chunk, want, "CHUNK", seq, seq == g->total_chunks - 1);
+                *digest = file_chunk_digest(g->chunk, want, seq);
+                g->reads++;
+            }
+            if (frame && cached) {
+                slot->frames[variant] = frame;
+                slot->digest = *digest;
+                frame_share_retain(frame);
+            }
+        }
+        if (frame && r && seq >= r->next) {
+            r->next = seq + 1;
+            r->moved_ms = now;
+            wake_parked(g, now);
+        }
+    }
+    mutex_unlock(&g->lock);
+
+    if (!frame) {
+        log_message(LOG_ERROR, "[FILE] Read of chunk #%d of '%s' failed", seq, g->filename);
+        return -1;
+    }
+    int rc = frame_send_shared(sockfd, frame);
+    frame_share_release(frame);
+    return rc;
+}
+
+int file_multicast_have(int recipient_id, const char* filename) {
+    McRecipient* r;
+    MulticastGroup* g = multicast_find_invited(recipient_id, filename, &r);
+    if (!g) return -1;
+    settle_locked(g, r, MC_SKIPPED);
+    mutex_unlock(&g->lock);
+    mutex_unlock(&groups_lock);
+    return 0;
+}
+
+void multicast_unicast(int recipient_id, const char* filename) {
+    McRecipient* r;
+    MulticastGroup* g = multicast_find_invited(recipient_id, filename, &r);
+    if (!g) return;
+    settle_locked(g, r, MC_UNICAST);
+    mutex_unlock(&g->lock);
+    mutex_unlock(&groups_lock);
+}
+
+void file_multicast_drop_client(int client_id) {
+    mutex_lock(&groups_lock);
+    for (int i = 0; i < MULTICAST_MAX; ++i) {
+        MulticastGroup* g = &groups[i];
+        mutex_lock(&g->lock);
+        McRecipient* r = g->active ? recipient_of(g, client_id) : NULL;
+        if (r && r->state == MC_INVITED) settle_locked(g, r, MC_FAILED);  // Senders are released with the socket
+        mutex_unlock(&g->lock);
+    }
+    mutex_unlock(&groups_lock);
+}
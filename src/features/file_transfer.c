@@ -4,29 +4,895 @@
  *        Handles sending, receiving, chunk framing, reassembly, delivery confirmation,
  *        retry logic, timeout detection, and progress tracking.
  *        Used by dispatcher and client listener threads.
+ *        Raw data phases move unframed file bodies when negotiated, hashed as they pass.
+ *        Chunked transfers are windowed: the receiver returns cumulative ACKs with a
+ *        SACK bitmap and the sender retransmits only the chunks reported missing.
+ *        Receivers resume from checkpoints and answer HAVE for content they already store.
+ *        A client relaying its own file runs the same chunk sender on its socket;
+ *        the server forwards the chunks, converting base64 and bytes between hops.
+ *        A multicast (file_multicast.c) reads and encodes each chunk once for all
+ *        of its recipients and queues the same shared frame to every one of them.
+ *        A batch sends many files as one chunked stream after a single
+ *        manifest exchange (file_batch.h).
+ *        A receiver holding an older copy signs it, and only a delta of block
+ *        references and literals is sent (delta_sync.h).
+ *        Chunked senders are admitted and paced by the transfer scheduler
+ *        (transfer_scheduler.h); waiting ones keep their receiver alive with WAIT.
+ *        Files to send are opened through the asset index (asset_index.h), and
+ *        popular ones are sent from ready-made chunk frames (hot_cache.h).
+ *        DONE carries an end-to-end digest of the range sent, summed from chunk
+ *        hashes as they are read; the receiver sums the same hashes as it writes
+ *        and re-fetches only the segments that disagree.
  * @author Oussama Amara
- * @version 1.6
- * @date 2025-10-19
+ * @version 3.8
+ * @date 2026-10-17
  */
 
 #include "file_transfer.h"
+#include "file_transfer_internal.h"
 #include "protocol.h"
+#include "framing.h"
 #include "logger.h"
 #include "platform.h"
+#include "platform_thread.h"
+#include "content_store.h"
+#include "file_batch.h"
+#include "delta_sync.h"
+#include "transfer_scheduler.h"
+#include "timer_wheel.h"
+#include "asset_index.h"
+#include "hot_cache.h"
+#include "crc.h"
+#include "client_registry.h"
 
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include <time.h>
+#include <errno.h>
+#include <stdint.h>
 
-#define MAX_RETRIES 5
-#define RETRY_INTERVAL 3 // seconds
+#ifdef _WIN32
+#include <winsock2.h>
+#include <io.h>
+#else
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#include <fcntl.h>
+#include <sys/stat.h>
 
-FileBuffer buffers[MAX_CLIENTS]; ///< Client-side reassembly buffers
+// ─────────────────────────────────────────────────────────────
+// SERVER-SIDE: Send file as a raw data phase
+// ─────────────────────────────────────────────────────────────
+
+/**
+ * @brief Raw data phase in flight; owned by the socket's queue until it ends.
+ */
+typedef struct {
+    FILE* fp;
+    int connfd;
+    int src_id;
+    int dest_id;
+    long long size;
+    long long started_ms;
+    char filename[128];
+} RawSend;
+
+/**
+ * @brief Ends a raw data phase: on success DONE ("<size>,<digest>,<filename>")
+ *        follows the last byte. Runs under the socket's queue lock, so DONE is
+ *        encoded, not sent.
+ */
+static size_t raw_sent(void* arg, int ok, uint64_t digest, char* trailer, size_t cap) {
+    RawSend* rs = arg;
+    size_t len = 0;
+    if (ok) {
+        long long elapsed = monotonic_ms() - rs->started_ms;
+        char done[MAX_MESSAGE_LENGTH];
+        snprintf(done, sizeof(done), "%lld,%016llx,%s", rs->size, (unsigned long long)digest, rs->filename);
+        len = frame_encode_command(rs->connfd, "file", rs->src_id, rs->dest_id, done, "DONE", trailer, cap);
+        log_message(LOG_INFO, "[FILE] Transfer complete: '%s' sent raw in %lld ms (%.2f MB/s)", rs->filename,
+                    elapsed, elapsed > 0 ? rs->size / 1048.576 / elapsed : 0.0);
+    } else {
+        log_message(LOG_ERROR, "[FILE] Raw transfer of '%s' to client %d failed", rs->filename, rs->dest_id);
+    }
+    fclose(rs->fp);
+    free(rs);
+    return len;
+}
+
+/**
+ * @brief Announces the body with a RAW header frame, then queues the file so the
+ *        reactor sends it whenever the socket has room (frame_queue_file()); the
+ *        calling thread never waits.
+ *        Takes ownership of fp.
+ */
+static void send_file_raw(int connfd, FILE* fp, long long file_size, const char* filename, int src_id, int dest_id) {
+    char header[MAX_COMMAND_LENGTH];
+    snprintf(header, sizeof(header), "%lld,%s", file_size, filename);
+
+    RawSend* rs = malloc(sizeof(*rs));
+    if (!rs || send_command(connfd, "file", src_id, dest_id, header, "RAW") < 0) {
+        log_message(LOG_ERROR, "[FILE] Raw transfer of '%s' to client %d failed", filename, dest_id);
+        free(rs);
+        fclose(fp);
+        return;
+    }
+    *rs = (RawSend){ .fp = fp, .connfd = connfd, .src_id = src_id, .dest_id = dest_id,
+                     .size = file_size, .started_ms = monotonic_ms() };
+    snprintf(rs->filename, sizeof(rs->filename), "%s", filename);
+
+    log_message(LOG_INFO, "[FILE] Sending '%s' (%lld bytes) to client %d as a raw data phase", filename, file_size, dest_id);
+    frame_queue_file(connfd, fileno(fp), 0, file_size, raw_sent, rs);
+}
+
+// ─────────────────────────────────────────────────────────────
+// Helpers: 64-bit file sizes, positioned writes, base64 for text frames
+// ─────────────────────────────────────────────────────────────
+
+/**
+ * @brief Size of an open file; ftell() is 32-bit on some platforms.
+ */
+static long long file_length(FILE* fp) {
+#ifdef _WIN32
+    if (_fseeki64(fp, 0, SEEK_END) != 0) return -1;
+    long long size = _ftelli64(fp);
+#else
+    if (fseeko(fp, 0, SEEK_END) != 0) return -1;
+    long long size = (long long)ftello(fp);
+#endif
+    rewind(fp);
+    return size;
+}
+
+static const char b64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/// Value of each base64 character, -1 for anything else
+static const signed char b64_map[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+    -1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+/**
+ * @brief Encodes len bytes as base64 (no '|' or NUL, so it fits a text frame).
+ * @return Encoded length; out must hold 4 * ((len + 2) / 3) + 1 bytes.
+ */
+static size_t base64_encode(const unsigned char* in, size_t len, char* out) {
+    size_t o = 0;
+    for (size_t i = 0; i < len; i += 3) {
+        unsigned v = (unsigned)in[i] << 16;
+        if (i + 1 < len) v |= (unsigned)in[i + 1] << 8;
+        if (i + 2 < len) v |= in[i + 2];
+        out[o++] = b64_alphabet[(v >> 18) & 63];
+        out[o++] = b64_alphabet[(v >> 12) & 63];
+        out[o++] = i + 1 < len ? b64_alphabet[(v >> 6) & 63] : '=';
+        out[o++] = i + 2 < len ? b64_alphabet[v & 63] : '=';
+    }
+    out[o] = '\0';
+    return o;
+}
+
+/**
+ * @brief Decodes base64 produced by base64_encode().
+ * @return Decoded length, or -1 on a malformed input.
+ */
+static long base64_decode(const char* in, size_t len, unsigned char* out) {
+    if (len % 4 != 0) return -1;
+
+    long o = 0;
+    for (size_t i = 0; i < len; i += 4) {
+        int pad = (in[i + 3] == '=') + (in[i + 2] == '=');
+        if (pad && i + 4 != len) return -1;
+        int a = b64_map[(unsigned char)in[i]], b = b64_map[(unsigned char)in[i + 1]];
+        int c = pad >= 2 ? 0 : b64_map[(unsigned char)in[i + 2]];
+        int d = pad >= 1 ? 0 : b64_map[(unsigned char)in[i + 3]];
+        if ((a | b | c | d) < 0) return -1;
+        unsigned v = ((unsigned)a << 18) | ((unsigned)b << 12) | ((unsigned)c << 6) | (unsigned)d;
+        out[o++] = (unsigned char)(v >> 16);
+        if (pad < 2) out[o++] = (unsigned char)(v >> 8);
+        if (pad < 1) out[o++] = (unsigned char)v;
+    }
+    return o;
+}
+
+// ─────────────────────────────────────────────────────────────
+// Windowed chunk sender (the server, or a client relaying its own file)
+// ─────────────────────────────────────────────────────────────
+
+#define FILE_WINDOW_DEFAULT 32 ///< Chunks in flight when not configured
+#define MULTICAST_WAIT_POLL_MS 10 ///< How often a recipient parked on its group checks again where no waker reaches it
+
+/**
+ * @brief Sender state of one chunked transfer.
+ *        Lives between READY and the receiver's last cumulative ACK. Only the
+ *        reactor thread that owns the receiver's socket touches a claimed slot;
+ *        other threads only queue it on its waker.
+ */
+struct OutgoingFile {
+    int sockfd;               ///< Receiver socket (-1 = free slot)
+    FILE* fp;                 ///< Source file (NULL for a multicast recipient or a batch)
+    MulticastGroup* group;    ///< Multicast this recipient belongs to, NULL for one receiver
+    FileBatch* batch;         ///< Files sent back-to-back as this stream, NULL for one file
+    int src_id;               ///< Sender ID carried in the frames
+    int dest_id;              ///< Receiver ID
+    char filename[128];       ///< Name of the file being sent
+    long long file_size;      ///< File size in bytes
+    int chunk_size;           ///< Bytes per chunk
+    int total_chunks;         ///< Chunks in the file
+    char transfer_id[TRANSFER_ID_LEN + 1]; ///< ID of this version of the file
+    int first;                ///< First chunk of this stream's range
+    int end;                  ///< One past the last chunk of this stream's range
+    int window;               ///< Chunks allowed in flight
+    int base;                 ///< Cumulative ACK: every chunk below is confirmed
+    int next;                 ///< Next chunk never sent
+    int text;                 ///< 1 to base64 chunks for text frames
+    int progress;             ///< Last logged progress, in tenths
+    int retransmits;          ///< Chunks sent again
+    int cached;               ///< Chunks sent from the hot cache
+    unsigned char* chunk;     ///< Read buffer of chunk_size bytes (unused in a multicast)
+    unsigned char* resent;    ///< Bitmap of chunks retransmitted since the last RETRY
+    uint64_t* digests;        ///< Chunk digests of [first, first + digest_span), for DONE
+    unsigned char* digested;  ///< Bitmap of the digests known
+    int digest_span;          ///< Chunks digests has room for
+    long long started_ms;     ///< When the transfer began
+    TimerWheel* wheel;        ///< Wheel of the thread driving the transfer; NULL = not scheduled
+    SchedFlow flow;           ///< Admission and pacing state
+    SchedClass cls;           ///< Scheduling class
+    Timer pace;               ///< Retries admission, or resumes sending once tokens refill
+    TimerWheel* group_wheel;  ///< Wheel of a multicast recipient waiting on its group (NULL = not waiting)
+    FileWaker* waker;         ///< Waker of the thread driving the transfer, NULL if none
+    OutgoingFile* wake_next;  ///< Next sender woken on the same waker
+    int woken;                ///< Queued on its waker
+    long long last_sent_ms;   ///< Last chunk or WAIT sent
+};
+
+/**
+ * @brief Senders woken by other threads, resumed by the thread that owns them.
+ */
+struct FileWaker {
+    mutex_t lock;             ///< Guards woken and the wake links of its senders
+    OutgoingFile* woken;      ///< Senders to resume, linked by wake_next
+    void (*notify)(void* ctx); ///< Makes the owner call file_waker_run()
+    void* ctx;
+};
+
+static OutgoingFile** outgoing;             ///< Slots, allocated as needed and never moved (timers point into them)
+static int outgoing_count;                 ///< Entries of outgoing
+static mutex_t outgoing_lock;              ///< Guards claiming and releasing slots, and growing the table
+static int file_window = FILE_WINDOW_DEFAULT;
+static THREAD_LOCAL TimerWheel* file_timers; ///< Listener's wheel on a client, reactor's wheel on the server
+static THREAD_LOCAL FileWaker* file_waker;   ///< Reactor's waker on the server, NULL on a client
+
+
+int file_transfer_window(void) {
+    return file_window;
+}
+
+void file_transfer_init(int window) {
+    mutex_init(&outgoing_lock);
+    if (window > 0) file_window = window;
+    multicast_init();
+    file_batch_init();
+    file_delta_init();
+}
+
+/**
+ * @brief Transfer to dest_id running on sockfd (dest_id -1 = any).
+ *        A client relaying files sends to several receivers over one socket.
+ */
+static OutgoingFile* outgoing_find(int sockfd, int dest_id) {
+    OutgoingFile* found = NULL;
+    mutex_lock(&outgoing_lock);
+    for (int i = 0; i < outgoing_count && !found; ++i)
+        if (outgoing[i]->sockfd == sockfd && (dest_id < 0 || outgoing[i]->dest_id == dest_id)) found = outgoing[i];
+    mutex_unlock(&outgoing_lock);
+    return found;
+}
+
+/**
+ * @brief Takes a released sender off its waker; its group no longer wakes it.
+ */
+static void waker_forget(OutgoingFile* out) {
+    FileWaker* w = out->waker;
+    if (!w) return;
+    mutex_lock(&w->lock);
+    for (OutgoingFile** link = &w->woken; out->woken && *link; link = &(*link)->wake_next) {
+        if (*link == out) {
+            *link = out->wake_next;
+            out->woken = 0;
+            break;
+        }
+    }
+    mutex_unlock(&w->lock);
+}
+
+static void outgoing_release(OutgoingFile* out) {
+    sched_release(&out->flow);
+    if (out->wheel) timer_cancel(out->wheel, &out->pace);
+    if (out->group_wheel) timer_cancel(out->group_wheel, &out->pace);
+    if (out->group) multicast_settle(out->group, out->dest_id, MC_FAILED);
+    waker_forget(out);
+    if (out->fp) fclose(out->fp);
+    file_batch_free(out->batch);
+    free(out->chunk);
+    free(out->resent);
+    free(out->digests);
+    free(out->digested);
+    mutex_lock(&outgoing_lock);
+    memset(out, 0, sizeof(*out));
+    out->sockfd = -1;
+    mutex_unlock(&outgoing_lock);
+}
+
+/**
+ * @brief Claims a slot for sockfd; a transfer to the same receiver already
+ *        running on it is replaced. The table grows with the number of
+ *        transfers, so every recipient of a multicast gets a sender.
+ * @return The slot, NULL when out of memory.
+ */
+static OutgoingFile* outgoing_claim(int sockfd, int dest_id) {
+    OutgoingFile* previous = outgoing_find(sockfd, dest_id);
+    if (previous) {
+        log_message(LOG_WARN, "[FILE] New request replaces '%s' still in flight", previous->filename);
+        outgoing_release(previous);
+    }
+
+    OutgoingFile* out = NULL;
+    mutex_lock(&outgoing_lock);
+    for (int i = 0; i < outgoing_count && !out; ++i)
+        if (outgoing[i]->sockfd < 0) out = outgoing[i];
+    if (!out) {
+        int count = outgoing_count ? outgoing_count * 2 : 16;
+        OutgoingFile** grown = realloc(outgoing, (size_t)count * sizeof(*grown));
+        if (grown) {
+            outgoing = grown;
+            for (; outgoing_count < count; ++outgoing_count) {
+                OutgoingFile* slot = calloc(1, sizeof(*slot));
+                if (!slot) break;
+                slot->sockfd = -1;
+                outgoing[outgoing_count] = slot;
+            }
+        }
+        for (int i = 0; i < outgoing_count && !out; ++i)
+            if (outgoing[i]->sockfd < 0) out = outgoing[i];
+    }
+    if (out) {
+        out->sockfd = sockfd;
+        out->dest_id = dest_id;
+    }
+    mutex_unlock(&outgoing_lock);
+    return out;
+}
+
+
+void file_transfer_release(int sockfd, int dest_id) {
+    file_batch_drop_pending(sockfd, dest_id);
+    file_delta_drop_pending(sockfd, dest_id);
+    OutgoingFile* out;
+    while ((out = outgoing_find(sockfd, dest_id)) != NULL) {
+        log_message(LOG_WARN, "[FILE] Receiver left; abandoning '%s' at chunk %d/%d", out->filename, out->base, out->total_chunks);
+        outgoing_release(out);
+    }
+}
+
+size_t file_read_at(FILE* fp, void* data, size_t len, long long offset) {
+#ifdef _WIN32
+    if (_fseeki64(fp, offset, SEEK_SET) != 0) return 0;
+    return fread(data, 1, len, fp);
+#else
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fileno(fp), (char*)data + done, len - done, (off_t)offset + (off_t)done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+    return done;
+#endif
+}
+
+static void multicast_wait(OutgoingFile* out, TimerCallback callback, long long wait_ms);
+static void on_multicast_lag(void* arg);
+
+/**
+ * @brief Bytes chunk seq puts on the wire (payload only).
+ */
+static size_t chunk_bytes(const OutgoingFile* out, int seq) {
+    long long offset = (long long)seq * out->chunk_size;
+    return seq == out->total_chunks - 1 ? (size_t)(out->file_size - offset) : (size_t)out->chunk_size;
+}
+
+// ─────────────────────────────────────────────────────────────
+// End-to-end digests
+// ─────────────────────────────────────────────────────────────
+
+uint64_t file_chunk_digest(const void* data, size_t len, int seq) {
+    return xxh64(data, len, (uint64_t)seq);
+}
+
+/**
+ * @brief Number of segment digests DONE carries for [first, end).
+ */
+static int digest_segments(int first, int end) {
+    return end - first < DIGEST_SEGMENTS ? end - first : DIGEST_SEGMENTS;
+}
+
+/**
+ * @brief First chunk of segment k of [first, end).
+ */
+static int segment_start(int first, int end, int segments, int k) {
+    return first + (int)((long long)(end - first) * k / segments);
+}
+
+/**
+ * @brief Records the digest of a chunk the first time it is read for this transfer.
+ */
+static void outgoing_digest(OutgoingFile* out, int seq, uint64_t digest) {
+    int i = seq - out->first;
+    if (i < 0 || i >= out->digest_span || (out->digested[i >> 3] & (1u << (i & 7)))) return;
+    out->digested[i >> 3] |= (unsigned char)(1u << (i & 7));
+    out->digests[i] = digest;
+}
+
+/**
+ * @brief Formats DONE: "<first>,<end>,<digest>,<segment digests>,<filename>",
+ *        16 hex digits each. A digest covering a chunk never read here (the
+ *        receiver already held it) is sent as 'x's and left unchecked.
+ */
+static void format_done(const OutgoingFile* out, char* msg, size_t cap) {
+    int segments = digest_segments(out->first, out->end);
+    char hex[DIGEST_SEGMENTS * 16 + 1];
+    uint64_t total = 0;
+    int complete = 1;
+    for (int k = 0; k < segments; ++k) {
+        uint64_t sum = 0;
+        int known = 1;
+        for (int seq = segment_start(out->first, out->end, segments, k);
+             seq < segment_start(out->first, out->end, segments, k + 1); ++seq) {
+            int i = seq - out->first;
+            if (i >= out->digest_span || !(out->digested[i >> 3] & (1u << (i & 7)))) known = 0;
+            else sum += out->digests[i];
+        }
+        if (known) snprintf(hex + k * 16, 17, "%016llx", (unsigned long long)sum);
+        else memset(hex + k * 16, 'x', 16);
+        total += sum;
+        complete = complete && known;
+    }
+    hex[segments * 16] = '\0';
+
+    char whole[17];
+    if (complete) snprintf(whole, sizeof(whole), "%016llx", (unsigned long long)total);
+    else snprintf(whole, sizeof(whole), "%s", "xxxxxxxxxxxxxxxx");
+    snprintf(msg, cap, "%d,%d,%s,%s,%s", out->first, out->end, whole, hex, out->filename);
+}
+
+/**
+ * @brief Reads chunk seq from the file (or the batch's files) and queues it for the receiver.
+ *        Chunks of a hot file go out as cached frames; a cached file's chunk
+ *        that is not encoded yet is encoded once and kept.
+ */
+static int outgoing_send(OutgoingFile* out, int seq) {
+    uint64_t digest;
+    if (out->group) {
+        int rc = multicast_send(out->group, out->sockfd, out->dest_id, seq, &digest);
+        if (rc == 0) outgoing_digest(out, seq, digest);
+        return rc;
+    }
+
+    unsigned wire = 0;
+    int cacheable = 0;
+    if (!out->text && !out->batch) {
+        wire = frame_wire(out->sockfd);
+        SharedFrame* frame = hot_cache_get(out->transfer_id, out->chunk_size, seq, wire, &cacheable, &digest);
+        if (frame) {
+            int rc = frame_send_shared(out->sockfd, frame);
+            frame_share_release(frame);
+            outgoing_digest(out, seq, digest);
+            out->cached++;
+            return rc;
+        }
+    }
+
+    long long offset = (long long)seq * out->chunk_size;
+    size_t want = chunk_bytes(out, seq);
+    size_t got = out->batch ? file_batch_read(out->batch, out->chunk, want, offset) : file_read_at(out->fp, out->chunk, want, offset);
+    if (got != want) {
+        log_message(LOG_ERROR, "[FILE] Read of chunk #%d of '%s' failed", seq, out->filename);
+        return -1;
+    }
+    digest = file_chunk_digest(out->chunk, want, seq);
+    outgoing_digest(out, seq, digest);
+
+    int is_final = seq == out->total_chunks - 1;
+    if (cacheable) {
+        // Addressed to no one in particular, like a multicast frame, so any receiver can reuse it
+        SharedFrame* frame = frame_share_chunk(wire, "file", 0, 0, out->chunk, want, "CHUNK", seq, is_final);
+        if (frame) {
+            hot_cache_put(out->transfer_id, out->chunk_size, seq, wire, frame, digest);
+            int rc = frame_send_shared(out->sockfd, frame);
+            frame_share_release(frame);
+            return rc;
+        }
+    }
+    if (!out->text)
+        return send_chunk(out->sockfd, "file", out->src_id, out->dest_id, out->chunk, want, "CHUNK", seq, is_final);
+
+    char encoded[MAX_MESSAGE_LENGTH];
+    size_t len = base64_encode(out->chunk, want, encoded);
+    return send_chunk(out->sockfd, "file", out->src_id, out->dest_id, encoded, len, "CHUNK", seq, is_final);
+}
+
+/**
+ * @brief Holds a scheduled sender back for wait_ms. A receiver that has heard
+ *        nothing for FILE_WAIT_INTERVAL_MS gets a WAIT, so its deadline and
+ *        retry timers do not give up on a transfer that is only throttled.
+ */
+static void outgoing_hold(OutgoingFile* out, long long wait_ms) {
+    long long now = out->wheel->now_ms;
+    if (now - out->last_sent_ms >= FILE_WAIT_INTERVAL_MS) {
+        send_command(out->sockfd, "file", out->src_id, out->dest_id, out->filename, "WAIT");
+        out->last_sent_ms = now;
+    }
+    if (wait_ms > FILE_WAIT_INTERVAL_MS) wait_ms = FILE_WAIT_INTERVAL_MS;
+    timer_schedule(out->wheel, &out->pace, wait_ms);
+}
+
+/**
+ * @brief Sends new chunks until the window is full, or the scheduler or the
+ *        multicast cache holds the transfer back (the pace timer then resumes it).
+ *        Frames are queued on the reactor socket, so this never blocks.
+ */
+static int outgoing_pump(OutgoingFile* out) {
+    while (out->next < out->end && out->next < out->base + out->window) {
+        long long held = out->group && file_timers ?
+                         multicast_ahead(out->group, out->dest_id, out->next, out, file_timers->now_ms) : 0;
+        if (held > 0) {
+            multicast_wait(out, on_multicast_lag, held);
+            return 0;
+        }
+        if (out->wheel) {
+            long long wait = sched_grant(&out->flow, chunk_bytes(out, out->next), out->wheel->now_ms);
+            if (wait > 0) {
+                outgoing_hold(out, wait);
+                return 0;
+            }
+            out->last_sent_ms = out->wheel->now_ms;
+        }
+        if (outgoing_send(out, out->next) != 0) {
+            log_message(LOG_ERROR, "[FILE] Failed to send chunk #%d", out->next);
+            return -1;
+        }
+        out->next++;
+    }
+    return 0;
+}
+
+/**
+ * @brief Ends a transfer: DONE with the range's digests once every chunk is
+ *        acknowledged, then frees the slot.
+ */
+static void outgoing_finish(OutgoingFile* out) {
+    if (out->base >= out->end) {
+        long long elapsed = monotonic_ms() - out->started_ms;
+        char done[MAX_MESSAGE_LENGTH];
+        format_done(out, done, sizeof(done));
+        send_command(out->sockfd, "file", out->src_id, out->dest_id, done, "DONE");
+        log_message(LOG_INFO, "[FILE] Transfer complete: '%s' chunks [%d,%d) of %d sent, %d retransmitted, %lld ms",
+                    out->filename, out->first, out->end, out->total_chunks, out->retransmits, elapsed);
+        if (out->cached) {
+            HotCacheStats hc;
+            hot_cache_stats(&hc);
+            log_message(LOG_INFO, "[FILE] %d chunk(s) of '%s' came from the hot cache (%lld hits, %lld misses, "
+                        "%lld evictions, %lld file(s), %lld/%lld bytes)", out->cached, out->filename, hc.hits, hc.misses,
+                        hc.evictions, hc.files, hc.bytes, hc.capacity);
+        }
+        if (out->group) multicast_settle(out->group, out->dest_id, MC_DELIVERED);
+        out->group = NULL;  // Settling the last recipient frees the group
+    } else {
+        log_message(LOG_ERROR, "[FILE] Transfer of '%s' aborted at chunk %d/%d", out->filename, out->base, out->end);
+    }
+    outgoing_release(out);
+}
+
+void file_transfer_on_sack(const FrameView* view, int sockfd, int resend_all) {
+    OutgoingFile* out = outgoing_find(sockfd, view->src_id);  // src_id: the receiver reporting
+    if (!out || out->flow.state == FLOW_QUEUED) return;  // Not started yet
+
+    // The receiver may confirm chunks never sent here: a resumed file already
+    // holds them, or a parallel stream delivered them
+    int cum = view->seq_num;
+    if (cum < out->base || cum > out->end) return;  // Stale or bogus
+    if (cum > out->base) out->base = cum;
+    if (out->next < cum) out->next = cum;
+
+    // SACK bitmap: bit i set = chunk cum + 1 + i is stored; below the highest
+    // set bit, clear bits are holes. cum itself is always missing.
+    char sack[SACK_BITS / 4 + 1];
+    frame_view_copy(view, view->payload, sack, sizeof(sack));
+    int highest = -1;
+    unsigned char bits[SACK_BITS / 8] = {0};
+    for (int i = 0; sack[i] && i < SACK_BITS / 4; ++i) {
+        int nibble = sack[i] <= '9' ? sack[i] - '0' : (sack[i] | 0x20) - 'a' + 10;
+        if (nibble < 0 || nibble > 15) return;
+        for (int b = 0; b < 4; ++b) {
+            if (nibble & (8 >> b)) {
+                bits[(i * 4 + b) / 8] |= (unsigned char)(1u << ((i * 4 + b) % 8));
+                highest = i * 4 + b;
+            }
+        }
+    }
+
+    if (cum < out->end && (highest >= 0 || resend_all)) {
+        int last = resend_all ? out->next - 1 : cum + 1 + highest;
+        for (int seq = cum; seq <= last && seq < out->next && seq < out->end; ++seq) {
+            int i = seq - cum - 1;
+            if (seq > cum && i < SACK_BITS && (bits[i / 8] & (1u << (i % 8)))) continue;
+            if (!resend_all && (out->resent[seq >> 3] & (1u << (seq & 7)))) continue;
+            if (out->wheel) sched_charge(&out->flow, chunk_bytes(out, seq), out->wheel->now_ms);
+            if (outgoing_send(out, seq) != 0) {
+                outgoing_finish(out);
+                return;
+            }
+            out->resent[seq >> 3] |= (unsigned char)(1u << (seq & 7));
+            out->retransmits++;
+        }
+    }
+
+    int span = out->end - out->first;
+    int progress = (int)((out->base - out->first) * 10LL / (span ? span : 1));
+    if (progress > out->progress) {
+        out->progress = progress;
+        log_message(LOG_INFO, "[FILE] Sent '%s': %d%% acknowledged (%d/%d)", out->filename, progress * 10, out->base, out->end);
+    }
+
+    if (out->base >= out->end || outgoing_pump(out) != 0) outgoing_finish(out);
+}
 
 // ─────────────────────────────────────────────────────────────
 // SERVER-SIDE: Send file in chunked frames with progress
 // ─────────────────────────────────────────────────────────────
 
+int file_chunk_grant(int connfd, int requested, int relayed) {
+    if (!(frame_wire(connfd) & WIRE_BINARY))
+        return relayed && requested > 0 && requested < FILE_TEXT_CHUNK_SIZE ? requested : FILE_TEXT_CHUNK_SIZE;
+    if (requested <= 0) return FILE_CHUNK_DEFAULT;
+    if (requested < FILE_CHUNK_MIN && !relayed) return FILE_CHUNK_MIN;
+    return requested > FILE_CHUNK_MAX ? FILE_CHUNK_MAX : requested;
+}
+
+void file_transfer_id_of(const char* filename, const AssetInfo* info, char* out) {
+    unsigned long long hash = 1469598103934665603ULL;
+    for (const char* p = filename; *p; ++p) hash = (hash ^ (unsigned char)*p) * 1099511628211ULL;
+    for (int i = 0; i < 8; ++i) hash = (hash ^ (unsigned char)(info->size >> (i * 8))) * 1099511628211ULL;
+    for (int i = 0; i < 8; ++i) hash = (hash ^ (unsigned char)(info->mtime >> (i * 8))) * 1099511628211ULL;
+    snprintf(out, TRANSFER_ID_LEN + 1, "%016llx", hash);
+}
+
+int file_type_blocked(const char* filename) {
+    const char* ext = strrchr(filename, '.');
+    return ext && (strcmp(ext, ".exe") == 0 || strcmp(ext, ".bat") == 0 || strcmp(ext, ".cmd") == 0);
+}
+
+FILE* file_open_outgoing(const char* filename, int positional, AssetInfo* info) {
+    if (file_type_blocked(filename)) {
+        log_message(LOG_ERROR, "[FILE] Blocked file type '%s' for security reasons.", strrchr(filename, '.'));
+        return NULL;
+    }
+
+    FILE* fp = asset_index_open(filename, positional, info);
+    if (fp) return fp;
+
+    const char* path = resolve_asset_path("to_send", filename);
+    if (!path) return NULL;
+
+    fp = fopen(path, "rb");
+    if (!fp) {
+        log_message(LOG_ERROR, "File not found: %s", path);
+        return NULL;
+    }
+
+    struct stat st;
+    info->size = file_length(fp);
+    info->mtime = fstat(fileno(fp), &st) == 0 ? (long long)st.st_mtime : 0;
+    if (info->size < 0) {
+        log_message(LOG_ERROR, "[FILE] Cannot size '%s'", path);
+        fclose(fp);
+        return NULL;
+    }
+    return fp;
+}
+
+/**
+ * @brief Announces an admitted transfer with START and sends its first window.
+ */
+static void outgoing_begin(OutgoingFile* out) {
+    log_message(LOG_INFO, "[FILE] Preparing to send '%s' (%lld bytes) to client %d%s%s", out->filename, out->file_size,
+                out->dest_id, out->group ? " as part of a multicast" : "",
+                out->wheel && out->cls == SCHED_BACKGROUND ? " in the background" : "");
+    log_message(LOG_INFO, "[FILE] Sending chunks [%d,%d) of %d, %d bytes each, window %d%s", out->first, out->end,
+                out->total_chunks, out->chunk_size, out->window, out->text ? " (base64 text frames)" : "");
+
+    char header[MAX_COMMAND_LENGTH];
+    snprintf(header, sizeof(header), "%lld,%d,%s,%d,%d,%s", out->file_size, out->chunk_size, out->transfer_id,
+             out->first, out->end, out->filename);
+    send_chunk(out->sockfd, "file", out->src_id, out->dest_id, header, strlen(header), "START", out->window, 1);
+    if (out->wheel) out->last_sent_ms = out->wheel->now_ms;
+
+    if (outgoing_pump(out) != 0 || out->base >= out->end) outgoing_finish(out);
+}
+
+/**
+ * @brief Pace timer: a queued transfer asks for admission again, a throttled
+ *        one sends what its tokens allow.
+ */
+static void on_outgoing_pace(void* arg) {
+    OutgoingFile* out = arg;
+    if (out->flow.state != FLOW_ACTIVE) {
+        if (sched_admit(&out->flow, out->cls, out->wheel->now_ms)) outgoing_begin(out);
+        else outgoing_hold(out, SCHED_POLL_MS);
+        return;
+    }
+    if (outgoing_pump(out) != 0) outgoing_finish(out);
+}
+
+/**
+ * @brief Asks the scheduler to admit a transfer, then begins it or queues it
+ *        on the pace timer.
+ */
+static void outgoing_admit(OutgoingFile* out) {
+    if (out->wheel && !sched_admit(&out->flow, out->cls, out->wheel->now_ms)) {
+        int active, queued;
+        sched_counts(&active, &queued);
+        log_message(LOG_INFO, "[FILE] '%s' for client %d queued%s: %d transfer(s) sending, %d waiting", out->filename,
+                    out->dest_id, out->cls == SCHED_BACKGROUND ? " in the background class" : "", active, queued);
+        out->last_sent_ms = out->wheel->now_ms - FILE_WAIT_INTERVAL_MS;  // WAIT at once
+        outgoing_hold(out, SCHED_POLL_MS);
+        return;
+    }
+    outgoing_begin(out);
+}
+
+/**
+ * @brief Parks a multicast recipient the group holds back on its pace timer
+ *        (file_timers must be set). callback runs when the group wakes it, or
+ *        after wait_ms, when the group would let it go on by itself. Without a
+ *        waker it checks every MULTICAST_WAIT_POLL_MS.
+ */
+static void multicast_wait(OutgoingFile* out, TimerCallback callback, long long wait_ms) {
+    timer_cancel(file_timers, &out->pace);  // A SACK may pump while a hold is pending
+    out->group_wheel = file_timers;
+    timer_init(&out->pace, callback, out);
+    if (!out->waker && wait_ms > MULTICAST_WAIT_POLL_MS) wait_ms = MULTICAST_WAIT_POLL_MS;
+    timer_schedule(file_timers, &out->pace, wait_ms);
+}
+
+static void multicast_go_on(OutgoingFile* out) {
+    out->group_wheel = NULL;
+    timer_init(&out->pace, on_outgoing_pace, out);
+}
+
+/**
+ * @brief Join timer of a multicast recipient: START goes out once the whole
+ *        group answered or the join window closed, so recipients begin together
+ *        and read each chunk from the group's cache instead of from disk.
+ */
+static void on_multicast_gather(void* arg) {
+    OutgoingFile* out = arg;
+    long long held = multicast_gather_wait(out->group, out->dest_id, out, out->group_wheel->now_ms);
+    if (held > 0) {
+        multicast_wait(out, on_multicast_gather, held);
+        return;
+    }
+    multicast_go_on(out);
+    outgoing_admit(out);
+}
+
+/**
+ * @brief Lag timer of a multicast recipient that ran a whole cache ahead of
+ *        another: sends again once the slot it needs is free.
+ */
+static void on_multicast_lag(void* arg) {
+    OutgoingFile* out = arg;
+    multicast_go_on(out);
+    if (outgoing_pump(out) != 0 || out->base >= out->end) outgoing_finish(out);
+}
+
+int file_start_chunked(int connfd, FILE* fp, MulticastGroup* group, FileBatch* batch, const char* file_id,
+                       long long file_size, const char* filename, int src_id, int dest_id, int chunk_size,
+                       const char* resume_id, int first, int end) {
+    // src_id 0 is the server's own file; a client relaying its file keeps the
+    // size the server granted for the far receiver
+    int requested = chunk_size;
+    chunk_size = group ? multicast_chunk_size(group, connfd, chunk_size) : file_chunk_grant(connfd, chunk_size, src_id != 0);
+    long long total_chunks = (file_size + chunk_size - 1) / chunk_size;
+    if (total_chunks > INT32_MAX) {
+        log_message(LOG_ERROR, "[FILE] '%s' needs more than %d chunks of %d bytes", filename, INT32_MAX, chunk_size);
+        send_command(connfd, "file", src_id, dest_id, filename, "ERR");
+        if (fp) fclose(fp);
+        file_batch_free(batch);
+        return -1;
+    }
+
+    char transfer_id[TRANSFER_ID_LEN + 1];
+    if (group) multicast_transfer_id(group, transfer_id);
+    else if (batch) memcpy(transfer_id, batch->transfer_id, sizeof(transfer_id));
+    else snprintf(transfer_id, sizeof(transfer_id), "%s", file_id);
+    if (resume_id && (strcmp(resume_id, transfer_id) != 0 || requested != chunk_size)) {
+        log_message(LOG_INFO, "[FILE] '%s' changed since client %d's checkpoint; sending it again", filename, dest_id);
+        first = end = 0;
+    }
+    if (end <= 0 || end > total_chunks) end = (int)total_chunks;
+    if (first < 0 || first > end) first = 0;
+
+    OutgoingFile* out = outgoing_claim(connfd, dest_id);
+    if (!out) {
+        log_message(LOG_ERROR, "[FILE] Out of memory; refusing '%s' for client %d", filename, dest_id);
+        send_command(connfd, "file", src_id, dest_id, filename, "ERR");
+        if (fp) fclose(fp);
+        file_batch_free(batch);
+        return -1;
+    }
+    out->fp = fp;
+    out->group = group;
+    out->batch = batch;
+    out->src_id = src_id;
+    out->dest_id = dest_id;
+    snprintf(out->filename, sizeof(out->filename), "%s", filename);
+    memcpy(out->transfer_id, transfer_id, sizeof(transfer_id));
+    out->file_size = file_size;
+    out->chunk_size = chunk_size;
+    out->total_chunks = (int)total_chunks;
+    out->first = out->base = out->next = first;
+    out->end = end;
+    out->text = !(frame_wire(connfd) & WIRE_BINARY);
+    out->started_ms = monotonic_ms();
+
+    // Whole window must fit the outbound queue even if nothing has drained yet
+    int cap = OUTQ_HARD_LIMIT / 2 / (out->text ? MAX_MESSAGE_LENGTH : chunk_size);
+    out->window = file_window < cap ? file_window : cap;
+    if (out->window < 1) out->window = 1;
+
+    out->chunk = group ? NULL : malloc((size_t)chunk_size);
+    out->resent = calloc((size_t)total_chunks / 8 + 1, 1);
+    out->digest_span = end - first;
+    out->digests = calloc((size_t)out->digest_span + 1, sizeof(*out->digests));
+    out->digested = calloc((size_t)out->digest_span / 8 + 1, 1);
+    if ((!out->chunk && !group) || !out->resent || !out->digests || !out->digested) {
+        log_message(LOG_ERROR, "[FILE] Out of memory starting '%s' for client %d", filename, dest_id);
+        send_command(connfd, "file", src_id, dest_id, filename, "ERR");
+        out->group = NULL;  // The caller settles the recipient, as for the failures above
+        outgoing_release(out);
+        return -1;
+    }
+
+    out->wheel = file_timers && sched_enabled() ? file_timers : NULL;
+    out->waker = file_waker;  // Set before the group can park it
+    out->cls = sched_class_of(file_size);
+    timer_init(&out->pace, on_outgoing_pace, out);
+    long long held = group && file_timers ? multicast_gather_wait(group, dest_id, out, file_timers->now_ms) : 0;
+    if (held > 0) {
+        multicast_wait(out, on_multicast_gather, held);
+        return 0;
+    }
+    outgoing_admit(out);
+    return 0;
+}
+
 /**
  * @brief Sends a file to a client in chunked frames with progress logging.
  *        Validates file type, resolves path, and confirms delivery.
@@ -34,180 +900,1007 @@ FileBuffer buffers[MAX_CLIENTS]; ///< Client-side reassembly buffers
  * @param filename Name of the file to send.
  * @param src_id Sender client ID.
  * @param dest_id Receiver client ID.
+ * @param chunk_size Receiver's preferred chunk size (0 = FILE_CHUNK_DEFAULT).
  */
-void send_file_to_client(int* connfd, const char* filename, int src_id, int dest_id) {
+void send_file_to_client(int* connfd, const char* filename, int src_id, int dest_id, int chunk_size) {
     if (!connfd || !filename || src_id < 0 || dest_id < 0) {
         log_message(LOG_ERROR, "Invalid file transfer parameters.");
         return;
     }
 
-    const char* ext = strrchr(filename, '.');
-    if (ext && (strcmp(ext, ".exe") == 0 || strcmp(ext, ".bat") == 0 || strcmp(ext, ".cmd") == 0)) {
-        log_message(LOG_ERROR, "[FILE] Blocked file type '%s' for security reasons.", ext);
+    // A recipient of a multicast is fed from the group's shared chunks
+    if (src_id == 0 && multicast_join(*connfd, filename, dest_id, chunk_size, NULL, 0, 0) == 0) return;
+
+    AssetInfo info;
+    FILE* fp = file_open_outgoing(filename, 1, &info);
+    if (!fp) return;
+
+    // Relayed files (sent by a client) go chunked: the server forwards frames, not raw phases.
+    // So do scheduled ones: a raw phase cannot be paced
+    if (src_id == 0 && (frame_wire(*connfd) & WIRE_RAW) && !sched_enabled()) {
+        send_file_raw(*connfd, fp, info.size, filename, src_id, dest_id);
         return;
     }
+    char file_id[TRANSFER_ID_LEN + 1];
+    file_transfer_id_of(filename, &info, file_id);
+    if (src_id == 0) hot_cache_admit(file_id, info.size);
+    file_start_chunked(*connfd, fp, NULL, NULL, file_id, info.size, filename, src_id, dest_id, chunk_size, NULL, 0, 0);
+}
 
-    print_working_directory();
-    const char* path = resolve_asset_path("to_send", filename);
-    if (!path) return;
+void resume_file_to_client(int connfd, const char* filename, int src_id, int dest_id, int chunk_size,
+                           const char* transfer_id, int first, int end) {
+    if (!filename || src_id < 0 || dest_id < 0) {
+        log_message(LOG_ERROR, "Invalid file transfer parameters.");
+        return;
+    }
 
-    FILE* fp = fopen(path, "rb");
-    if (!fp) {
-        log_message(LOG_ERROR, "File not found: %s", path);
+    // A receiver splitting the transfer narrows the range already in flight
+    OutgoingFile* out = outgoing_find(connfd, dest_id);
+    if (out && strcmp(out->transfer_id, transfer_id) == 0 && strcmp(out->filename, filename) == 0 && first == out->first) {
+        if (end <= 0 || end > out->total_chunks) end = out->total_chunks;
+        out->end = end < out->base ? out->base : end;
+        if (out->next > out->end) out->next = out->end;
+        log_message(LOG_INFO, "[FILE] Client %d narrowed '%s' to chunks [%d,%d)", dest_id, filename, out->first, out->end);
+        if (out->base >= out->end) outgoing_finish(out);
         return;
     }
 
-    fseek(fp, 0, SEEK_END);
-    long file_size = ftell(fp);
-    rewind(fp);
-    int total_chunks = (file_size + MAX_CHUNK_SIZE - 1) / MAX_CHUNK_SIZE;
+    if (src_id == 0 && multicast_join(connfd, filename, dest_id, chunk_size, transfer_id, first, end) == 0) return;
 
-    log_message(LOG_INFO, "[FILE] Preparing to send '%s' (%ld bytes) to client %d", filename, file_size, dest_id);
-    log_message(LOG_INFO, "[FILE] Total chunks to send: %d", total_chunks);
+    AssetInfo info;
+    FILE* fp = file_open_outgoing(filename, 1, &info);
+    if (!fp) return;
 
-    char chunk[MAX_CHUNK_SIZE + 1];
-    int seq = 0;
-    size_t bytes;
+    // Raw bodies cannot start mid-file, so resumed ranges always go chunked
+    log_message(LOG_INFO, "[FILE] Client %d resumes '%s' from chunk %d", dest_id, filename, first);
+    char file_id[TRANSFER_ID_LEN + 1];
+    file_transfer_id_of(filename, &info, file_id);
+    if (src_id == 0) hot_cache_admit(file_id, info.size);
+    file_start_chunked(connfd, fp, NULL, NULL, file_id, info.size, filename, src_id, dest_id, chunk_size, transfer_id, first, end);
+}
 
-    while ((bytes = fread(chunk, 1, MAX_CHUNK_SIZE, fp)) > 0) {
-        chunk[bytes] = '\0';
+const char* file_parse_resume(const char* request, char* transfer_id, int* first, int* end) {
+    char id[TRANSFER_ID_LEN + 2];
+    int name_at = 0;
+    if (sscanf(request, "%17[0-9a-f],%d,%d,%n", id, first, end, &name_at) != 3 || name_at == 0 ||
+        strlen(id) != TRANSFER_ID_LEN || request[name_at] == '\0')
+        return NULL;
+    memcpy(transfer_id, id, TRANSFER_ID_LEN + 1);
+    return request + name_at;
+}
 
-        char frame[MAX_COMMAND_LENGTH];
-        build_frame("file", src_id, dest_id, chunk, "CHUNK", frame);
+// ─────────────────────────────────────────────────────────────
+// SERVER-SIDE: Relay chunks between clients
+// ─────────────────────────────────────────────────────────────
 
-        char extended[MAX_COMMAND_LENGTH];
-        snprintf(extended, sizeof(extended), "%s|%d|%d", frame, seq, feof(fp));
+int file_relay_chunk(const FrameView* view, int dest_fd) {
+    const char* data = FRAME_VIEW_PTR(view, view->payload);
+    size_t len = view->payload.len;
+    int to_binary = (frame_wire(dest_fd) & WIRE_BINARY) != 0;
 
-        if (send(*connfd, extended, strlen(extended), 0) < 0) {
-            log_message(LOG_ERROR, "[FILE] Failed to send chunk #%d", seq);
-            break;
-        }
+    // Same frame format on both hops: the payload goes through untouched
+    if (view->binary == to_binary)
+        return send_chunk(dest_fd, "file", view->src_id, view->dest_id, data, len, "CHUNK", view->seq_num, view->is_final);
 
-        float percent = (100.0 * (seq + 1)) / total_chunks;
-        log_message(LOG_INFO, "[FILE] Sent chunk #%d (%.2f%%)", seq, percent);
-        seq++;
+    if (to_binary) {
+        unsigned char decoded[FILE_TEXT_CHUNK_SIZE + 3];
+        long n = len <= 4 * sizeof(decoded) / 3 ? base64_decode(data, len, decoded) : -1;
+        if (n < 0) return -1;
+        return send_chunk(dest_fd, "file", view->src_id, view->dest_id, decoded, (size_t)n, "CHUNK", view->seq_num, view->is_final);
     }
 
-    fclose(fp);
+    // Text receivers are granted chunks whose base64 fits a frame
+    if (len > FILE_TEXT_CHUNK_SIZE) return -1;
+    char encoded[MAX_MESSAGE_LENGTH];
+    size_t n = base64_encode((const unsigned char*)data, len, encoded);
+    return send_chunk(dest_fd, "file", view->src_id, view->dest_id, encoded, n, "CHUNK", view->seq_num, view->is_final);
+}
 
-    char done[MAX_COMMAND_LENGTH];
-    build_frame("file", src_id, dest_id, filename, "DONE", done);
-    send(*connfd, done, strlen(done), 0);
+// ─────────────────────────────────────────────────────────────
+// CLIENT-SIDE: Retry and deadline timers
+// ─────────────────────────────────────────────────────────────
+
+// Each listener thread (the main connection and every extra stream) has its own
+// wheel and buffers; streams of one file meet in the shared PartialFile.
+// Buffers are indexed by the sender's registry slot (0 = the server) and never
+// move once allocated, since their timers sit on the wheel.
+static THREAD_LOCAL FileBuffer** buffers;    ///< Receive state per sender slot
+static THREAD_LOCAL int buffer_count;        ///< Entries of buffers
+
+static int file_streams = 1;                 ///< Connections a large file is split across
+static FileStreamOpener stream_opener;       ///< Opens the extra connections
+
+#define STREAM_MIN_CHUNKS 16 ///< Fewest chunks worth a connection of their own
+
+static void end_transfer(FileBuffer* buf);
+
+/**
+ * @brief Receive state of the transfer from src_id (0 = the server, else a
+ *        client relaying its file), found by the registry slot in the ID.
+ *        A transfer left by an earlier client of the same slot is ended.
+ * @param claim 1 to take the sender's buffer when no transfer from src_id is active.
+ * @return The buffer, or NULL (none active, or out of memory).
+ */
+static FileBuffer* buffer_of(int src_id, int claim) {
+    int slot = src_id & REGISTRY_SLOT_MASK;
+    if (slot < buffer_count && buffers[slot]) {
+        FileBuffer* buf = buffers[slot];
+        if (buf->active && buf->src_id == src_id) return buf;
+        if (!claim) return NULL;
+        if (buf->active) end_transfer(buf);
+        return buf;
+    }
+    if (!claim) return NULL;
+
+    if (slot >= buffer_count) {
+        int count = buffer_count ? buffer_count : 16;
+        while (count <= slot) count *= 2;
+        FileBuffer** grown = realloc(buffers, (size_t)count * sizeof(*grown));
+        if (!grown) return NULL;
+        memset(grown + buffer_count, 0, (size_t)(count - buffer_count) * sizeof(*grown));
+        buffers = grown;
+        buffer_count = count;
+    }
+    buffers[slot] = calloc(1, sizeof(FileBuffer));
+    return buffers[slot];
+}
+
+void file_transfer_set_timers(TimerWheel* wheel) {
+    file_timers = wheel;
+}
+
+TimerWheel* file_transfer_timers(void) {
+    return file_timers;
+}
+
+FileWaker* file_waker_create(void (*notify)(void* ctx), void* ctx) {
+    FileWaker* w = calloc(1, sizeof(*w));
+    if (!w) return NULL;
+    mutex_init(&w->lock);
+    w->notify = notify;
+    w->ctx = ctx;
+    return w;
+}
+
+void file_waker_destroy(FileWaker* waker) {
+    if (!waker) return;
+    mutex_destroy(&waker->lock);
+    free(waker);
+}
+
+void file_transfer_set_waker(FileWaker* waker) {
+    file_waker = waker;
+}
+
+void file_transfer_wake(OutgoingFile* sender) {
+    FileWaker* w = sender->waker;
+    if (!w) return;
+    mutex_lock(&w->lock);
+    int first = w->woken == NULL;
+    if (!sender->woken) {
+        sender->woken = 1;
+        sender->wake_next = w->woken;
+        w->woken = sender;
+    }
+    mutex_unlock(&w->lock);
+    if (first) w->notify(w->ctx);  // Later wakes ride on the pending notification
+}
+
+void file_waker_run(FileWaker* waker) {
+    // Senders stay linked until resumed, so a release meanwhile can unlink them
+    mutex_lock(&waker->lock);
+    while (waker->woken) {
+        OutgoingFile* out = waker->woken;
+        waker->woken = out->wake_next;
+        out->woken = 0;
+        if (out->group_wheel) timer_schedule(out->group_wheel, &out->pace, 0);
+    }
+    mutex_unlock(&waker->lock);
+}
+
+void file_transfer_set_streams(int streams, FileStreamOpener opener) {
+    file_streams = streams > 1 ? streams : 1;
+    stream_opener = opener;
+}
+
+/**
+ * @brief Stops the timers and lets go of the file. An incomplete file keeps its
+ *        checkpoint, so the transfer resumes from here next time it is offered.
+ */
+static void end_transfer(FileBuffer* buf) {
+    if (file_timers) {
+        timer_cancel(file_timers, &buf->deadline);
+        timer_cancel(file_timers, &buf->retry);
+    }
+    if (buf->file) partial_release(buf->file);
+    buf->file = NULL;
+    file_batch_free(buf->batch);
+    buf->batch = NULL;
+    delta_basis_free(buf->delta);
+    buf->delta = NULL;
+    buf->active = 0;
+}
+
+void file_transfer_abandon(void) {
+    for (int i = 0; i < buffer_count; ++i) {
+        if (buffers[i] && buffers[i]->active) end_transfer(buffers[i]);
+        free(buffers[i]);
+    }
+    free(buffers);
+    buffers = NULL;
+    buffer_count = 0;
+}
+
+/**
+ * @brief Transfer deadline. Chunks only stamp last_received_ms, so the timer is
+ *        re-armed here for the remaining time instead of on every chunk.
+ */
+static void on_transfer_deadline(void* arg) {
+    FileBuffer* buf = arg;
+    long long idle = file_timers->now_ms - buf->last_received_ms;
+    if (idle < TRANSFER_TIMEOUT * 1000LL) {
+        timer_schedule(file_timers, &buf->deadline, TRANSFER_TIMEOUT * 1000LL - idle);
+        return;
+    }
+
+    log_message(LOG_WARN, "[FILE] Timeout waiting for chunk from client %d. Aborting transfer of '%s'.", buf->src_id, buf->filename);
+    send_command(buf->sockfd, "system", 0, buf->src_id, buf->filename, "TIMEOUT");
+    end_transfer(buf);
+}
+
+/**
+ * @brief Reports the receiver's state: seq is the cumulative ACK (first missing
+ *        chunk of the stream's range) and the payload is a hex bitmap of the
+ *        SACK_BITS chunks after it.
+ * @param status "ACK" for routine reports, "RETRY" to have every gap resent.
+ */
+static void send_sack(FileBuffer* buf, const char* status) {
+    char sack[SACK_BITS / 4 + 1];
+    for (int i = 0; i < SACK_BITS / 4; ++i) {
+        int nibble = 0;
+        for (int b = 0; b < 4; ++b) {
+            int seq = buf->cum_ack + 1 + i * 4 + b;
+            if (seq < buf->end && partial_has(buf->file, seq)) nibble |= 8 >> b;
+        }
+        sack[i] = "0123456789abcdef"[nibble];
+    }
+    sack[SACK_BITS / 4] = '\0';
+    send_chunk(buf->sockfd, "file", buf->self_id, buf->src_id, sack, SACK_BITS / 4, status, buf->cum_ack, 1);
+    buf->unacked = 0;
+}
+
+/**
+ * @brief Armed while chunks are outstanding. After RETRY_INTERVAL without a
+ *        chunk (a lost tail leaves no gap to report) asks the sender to resend
+ *        everything unconfirmed. Gives up after MAX_RETRIES such rounds in a row.
+ */
+static void on_chunk_retry(void* arg) {
+    FileBuffer* buf = arg;
+    long long idle = file_timers->now_ms - buf->last_received_ms;
 
-    log_message(LOG_INFO, "[FILE] Transfer complete: '%s' sent in %d chunk(s)", filename, seq);
+    if (buf->received_count != buf->retry_mark) {
+        // Progress since the last round: wait for RETRY_INTERVAL of silence
+        buf->retry_mark = buf->received_count;
+        buf->retry_rounds = 0;
+        if (idle < RETRY_INTERVAL * 1000LL) {
+            timer_schedule(file_timers, &buf->retry, RETRY_INTERVAL * 1000LL - idle);
+            return;
+        }
+    }
+    if (++buf->retry_rounds > MAX_RETRIES) {
+        log_message(LOG_ERROR, "[FILE] Missing chunks of '%s' exceeded retry limit. Aborting.", buf->filename);
+        end_transfer(buf);
+        return;
+    }
+
+    log_message(LOG_INFO, "[FILE] Requested retry from chunk #%d (round %d)", buf->cum_ack, buf->retry_rounds);
+    send_sack(buf, "RETRY");
+    timer_schedule(file_timers, &buf->retry, RETRY_INTERVAL * 1000LL);
 }
 
 // ─────────────────────────────────────────────────────────────
-// CLIENT-SIDE: Respond to INCOMING with READY
+// CLIENT-SIDE: Respond to INCOMING with READY or RESUME
 // ─────────────────────────────────────────────────────────────
 
 /**
- * @brief Handles INCOMING file notification and responds with READY.
- * @param cmd Parsed command containing file metadata.
+ * @brief Answers INCOMING with SIGS frames: the signatures of the older copy in
+ *        assets/received. A copy that cannot be read to its end closes them
+ *        early, and the sender then sends the whole file.
+ * @return 0 once the signatures are sent, -1 if there is no copy worth signing.
+ */
+static int send_signatures(FileBuffer* buf, int sockfd, const char* hash, int chunk_size) {
+    DeltaBasis* basis = delta_basis_open(buf->filename, hash);
+    unsigned char* payload = basis ? malloc(DELTA_FRAME_BYTES) : NULL;
+    if (!payload) {
+        delta_basis_free(basis);
+        return -1;
+    }
+    log_message(LOG_INFO, "[FILE] Incoming file '%s' from client %d. Sending signatures of the copy held (%d block(s) of %d bytes)...",
+                buf->filename, buf->src_id, basis->blocks, basis->block_size);
+
+    for (int sent = 0;; sent = 1) {
+        int first = basis->next;
+        size_t len = delta_sign_next(basis, payload, DELTA_FRAME_BYTES);
+        if (len == 0 && !sent) {
+            log_message(LOG_WARN, "[FILE] Could not read the copy of '%s'", buf->filename);
+            free(payload);
+            delta_basis_free(basis);
+            return -1;
+        }
+        int failed = len == 0;
+        if (failed) {
+            // No signatures in the last frame: the sender finds them incomplete
+            log_message(LOG_WARN, "[FILE] Could not read the copy of '%s' to its end; asking for the whole file", buf->filename);
+            len = (size_t)snprintf((char*)payload, DELTA_FRAME_BYTES, "%d\n", first);
+        }
+        int last = failed || basis->next == basis->blocks;
+        send_chunk(sockfd, "file", buf->self_id, buf->src_id, payload, len, "SIGS", chunk_size, last);
+        if (last) break;
+    }
+    free(payload);
+    buf->delta = basis;
+    return 0;
+}
+
+/**
+ * @brief Handles INCOMING file notification ("<content_hash>,<filename>").
+ *        Answers HAVE when the content store already holds the blob (the file
+ *        is materialized locally), else READY, or RESUME
+ *        ("<transfer_id>,<first>,0,<filename>") when a checkpoint of the file
+ *        exists so only the missing chunks are sent, or SIGS when an older copy
+ *        of a server file is held so only a delta is sent. The answer is addressed to
+ *        the offer's sender: 0 for the server's own files, else the client
+ *        whose file the server relays.
+ * @param view Frame view containing file metadata.
  * @param sockfd Socket to send READY frame.
+ * @param chunk_size Preferred chunk size, carried in READY's seq field.
  */
-void handle_file_incoming(const ParsedCommand* cmd, int sockfd) {
-    FileBuffer* buf = &buffers[cmd->src_id];
+void handle_file_incoming(const FrameView* view, int sockfd, int chunk_size) {
+    if (view->src_id < 0) return;
+    FileBuffer* buf = buffer_of(view->src_id, 1);
+    if (!buf) {
+        log_message(LOG_ERROR, "[FILE] Out of memory; ignoring offer from client %d", view->src_id);
+        return;
+    }
+    if (buf->active) end_transfer(buf);  // A new offer replaces any transfer still running
+
+    char offer[MAX_COMMAND_LENGTH], hash[CONTENT_HASH_LEN + 1];
+    frame_view_copy(view, view->payload, offer, sizeof(offer));
+    const char* filename = content_parse_offer(offer, hash);
+    if (hash[0] && content_store_materialize(hash, filename) == 0) {
+        log_message(LOG_INFO, "[FILE] Incoming file '%s' from client %d is already stored (%s). Sending HAVE...",
+                    filename, view->src_id, hash);
+        send_chunk(sockfd, "file", view->dest_id, view->src_id, offer, strlen(offer), "HAVE", 0, 1);
+        return;
+    }
+
     buf->active = 1;
-    buf->src_id = cmd->src_id;
-    strncpy(buf->filename, cmd->message, sizeof(buf->filename));
-    buf->final_seq = -1;
-    memset(buf->received, 0, sizeof(buf->received));
-    memset(buf->retry_count, 0, sizeof(buf->retry_count));
-    memset(buf->last_retry, 0, sizeof(buf->last_retry));
+    buf->src_id = view->src_id;
+    buf->sockfd = sockfd;
+    buf->file = NULL;
+    buf->refetches = 0;
+    snprintf(buf->filename, sizeof(buf->filename), "%s", filename);
 
-    log_message(LOG_INFO, "[FILE] Incoming file '%s' from client %d. Sending READY...", cmd->message, cmd->src_id);
+    timer_init(&buf->deadline, on_transfer_deadline, buf);
+    timer_init(&buf->retry, on_chunk_retry, buf);
+    if (file_timers) {
+        buf->last_received_ms = file_timers->now_ms;
+        timer_schedule(file_timers, &buf->deadline, TRANSFER_TIMEOUT * 1000LL);
+    }
 
-    char ready[MAX_COMMAND_LENGTH];
-    build_frame("file", cmd->dest_id, 0, cmd->message, "READY", ready);
-    send(sockfd, ready, strlen(ready), 0);
+    char transfer_id[TRANSFER_ID_LEN + 1];
+    int saved_chunk, first_missing;
+    if (partial_probe(buf->filename, transfer_id, &saved_chunk, &first_missing) == 0) {
+        char request[MAX_COMMAND_LENGTH];
+        snprintf(request, sizeof(request), "%s,%d,0,%s", transfer_id, first_missing, buf->filename);
+        log_message(LOG_INFO, "[FILE] Incoming file '%s' from client %d. Resuming from chunk %d...",
+                    buf->filename, view->src_id, first_missing);
+        send_chunk(sockfd, "file", view->dest_id, view->src_id, request, strlen(request), "RESUME", saved_chunk, 1);
+        return;
+    }
+
+    // Server files only: a relaying client sends chunks, it cannot encode deltas
+    buf->self_id = view->dest_id;
+    if (view->src_id == 0 && hash[0] && (frame_wire(sockfd) & WIRE_BINARY) &&
+        send_signatures(buf, sockfd, hash, chunk_size) == 0)
+        return;
+
+    log_message(LOG_INFO, "[FILE] Incoming file '%s' from client %d. Sending READY...", buf->filename, view->src_id);
+
+    send_chunk(sockfd, "file", view->dest_id, view->src_id, buf->filename, strlen(buf->filename), "READY", chunk_size, 1);
+}
+
+// ─────────────────────────────────────────────────────────────
+// CLIENT-SIDE: Answer a batch manifest with WANT
+// ─────────────────────────────────────────────────────────────
+
+void handle_file_batch(const FrameView* view, int sockfd, int chunk_size) {
+    if (view->src_id < 0) return;
+    FileBuffer* buf = buffer_of(view->src_id, view->seq_num == 0);
+    if (!buf || (view->seq_num > 0 && !buf->batch)) {
+        log_message(LOG_WARN, "[FILE] Batch manifest from client %d arrived without its start; ignored", view->src_id);
+        return;
+    }
+
+    if (view->seq_num == 0) {
+        if (buf->active) end_transfer(buf);  // A new offer replaces any transfer still running
+        buf->active = 1;
+        buf->src_id = view->src_id;
+        buf->sockfd = sockfd;
+        buf->self_id = view->dest_id;
+        buf->file = NULL;
+        timer_init(&buf->deadline, on_transfer_deadline, buf);
+        timer_init(&buf->retry, on_chunk_retry, buf);
+        if (file_timers) timer_schedule(file_timers, &buf->deadline, TRANSFER_TIMEOUT * 1000LL);
+    }
+    if (file_timers) buf->last_received_ms = file_timers->now_ms;
+
+    if (file_batch_decode(&buf->batch, FRAME_VIEW_PTR(view, view->payload), view->payload.len, view->seq_num) != 0) {
+        log_message(LOG_ERROR, "[FILE] Malformed batch manifest from client %d", view->src_id);
+        send_command(sockfd, "system", buf->self_id, view->src_id, buf->batch ? buf->batch->name : "batch", "ERR");
+        end_transfer(buf);
+        return;
+    }
+    if (!view->is_final) return;
+
+    FileBatch* batch = buf->batch;
+    snprintf(buf->filename, sizeof(buf->filename), "%s", batch->name);
+    if (batch->count != batch->expected) {
+        log_message(LOG_ERROR, "[FILE] Batch '%s' lists %d of %d file(s)", batch->name, batch->count, batch->expected);
+        send_command(sockfd, "system", buf->self_id, view->src_id, batch->name, "ERR");
+        end_transfer(buf);
+        return;
+    }
+
+    // Files whose content is stored are materialized here and left out of the stream
+    int wanted = file_batch_select(batch);
+    if (file_batch_layout(batch) != 0) {
+        end_transfer(buf);
+        return;
+    }
+    log_message(LOG_INFO, "[FILE] Batch '%s' from client %d: %d file(s), %lld bytes; %d already stored, requesting %d (%lld bytes)",
+                batch->name, view->src_id, batch->count, batch->total_bytes, batch->count - wanted, wanted,
+                batch->stream_bytes);
+
+    size_t cap = file_batch_frame_cap(sockfd);
+    char* payload = malloc(cap);
+    if (!payload) {
+        end_transfer(buf);
+        return;
+    }
+    for (int next = 0; next < batch->count;) {
+        size_t len = file_batch_encode_want(batch, &next, payload, cap);
+        send_chunk(sockfd, "file", buf->self_id, view->src_id, payload, len, "WANT", chunk_size, next == batch->count);
+    }
+    free(payload);
+
+    if (wanted == 0) {
+        send_command(sockfd, "system", view->src_id, buf->self_id, batch->name, "ACK");
+        log_message(LOG_INFO, "[FILE] Every file of batch '%s' is already stored; ACK sent to sender %d", batch->name, view->src_id);
+        end_transfer(buf);
+    }
 }
 
 // ─────────────────────────────────────────────────────────────
-// CLIENT-SIDE: Buffer chunks, reassemble, retry, and track progress
+// CLIENT-SIDE: Write chunks at their offset, retry, and track progress
 // ─────────────────────────────────────────────────────────────
 
 /**
- * @brief Handles incoming file chunks, buffers them, triggers retries, and reassembles when complete.
- * @param cmd Parsed command containing chunk data and metadata.
- * @param sockfd Socket to send retry or ACK frames.
+ * @brief Confirms a stored file to the sender, or reports that it could not be saved.
+ *        A batch is unpacked first and confirmed once, as a whole. A delta is
+ *        applied to the copy it was encoded against; if that fails the whole
+ *        file is asked for with READY.
  */
-void handle_file_chunk(const ParsedCommand* cmd, int sockfd) {
-    FileBuffer* buf = &buffers[cmd->src_id];
-    if (!buf->active) {
-        log_message(LOG_WARN, "[FILE] Received chunk from %d but no active transfer.", cmd->src_id);
+static void finish_transfer(FileBuffer* buf, const FrameView* view, int sockfd, int saved) {
+    FileBatch* batch = buf->batch;
+    DeltaBasis* delta = buf->delta;
+    int failed = 0;
+    if (saved && batch) {
+        failed = file_batch_unpack(batch, buf->filename);
+        saved = failed == 0;
+    }
+    if (saved && delta && delta_apply(delta, buf->filename) != 0) {
+        log_message(LOG_WARN, "[FILE] Asking sender %d for the whole of '%s'", view->src_id, delta->filename);
+        send_chunk(sockfd, "file", buf->self_id, view->src_id, delta->filename, strlen(delta->filename), "READY",
+                   buf->chunk_size, 1);
+        end_transfer(buf);
         return;
     }
+    const char* name = batch ? batch->name : delta ? delta->filename : buf->filename;
 
-    strncpy(buf->chunks[cmd->seq_num], cmd->message, MAX_CHUNK_SIZE);
-    buf->chunks[cmd->seq_num][MAX_CHUNK_SIZE] = '\0';
-    buf->received[cmd->seq_num] = 1;
-    buf->last_received = time(NULL);
-    if (cmd->is_final) buf->final_seq = cmd->seq_num;
+    if (saved) {
+        PartialFile* pf = buf->file;
+        long long elapsed = (file_timers ? file_timers->now_ms : monotonic_ms()) - pf->started_ms;
+        if (!batch && !delta) content_store_add(buf->filename);
+        //src_id: 0 — the system/server is the one sending the ACK frame
+        send_command(sockfd, "system", view->src_id, buf->self_id, name, "ACK");
+        if (batch)
+            log_message(LOG_INFO, "[FILE] Batch '%s' (%d file(s), %lld bytes, %d chunk(s), %d resumed) saved in %lld ms and ACK sent to sender %d",
+                        name, batch->wanted, pf->file_size, pf->total_chunks, pf->resumed, elapsed, view->src_id);
+        else if (delta)
+            log_message(LOG_INFO, "[FILE] File '%s' rebuilt from a %lld-byte delta (%d chunk(s), %d resumed) in %lld ms and ACK sent to sender %d",
+                        name, pf->file_size, pf->total_chunks, pf->resumed, elapsed, view->src_id);
+        else
+            log_message(LOG_INFO, "[FILE] File '%s' (%lld bytes, %d chunk(s), %d resumed) saved in %lld ms and ACK sent to sender %d from receiver %d",
+                        buf->filename, pf->file_size, pf->total_chunks, pf->resumed, elapsed, view->src_id, buf->self_id);
+    } else {
+        send_command(sockfd, "system", buf->self_id, view->src_id, name, "ERR");
+        if (failed != 0)
+            log_message(LOG_ERROR, "[FILE] Failed to unpack batch '%s' (%d file(s) lost). ERR sent to sender %d",
+                        name, failed < 0 ? batch->wanted : failed, buf->src_id);
+        else
+            log_message(LOG_ERROR, "[FILE] Failed to save file '%s'. ERR sent to sender %d", name, buf->src_id);
+    }
+    end_transfer(buf);
+}
 
-    int received_chunks = 0;
-    for (int i = 0; i <= buf->final_seq; ++i)
-        if (buf->received[i]) received_chunks++;
+/**
+ * @brief Splits the rest of a stream's range into file_streams stripes. This
+ *        connection keeps the first (narrowed on the sender with RESUME); each
+ *        other stripe is requested on a connection of its own.
+ */
+static void split_transfer(FileBuffer* buf) {
+    int remaining = buf->end - buf->cum_ack;
+    if (file_streams < 2 || !stream_opener || remaining < file_streams * STREAM_MIN_CHUNKS) return;
 
-    float percent = (100.0 * received_chunks) / (buf->final_seq + 1);
-    log_message(LOG_INFO, "[FILE] Receiving '%s': %.2f%% (%d/%d)",
-                buf->filename, percent, received_chunks, buf->final_seq + 1);
+    int stripe = remaining / file_streams;
+    int bounds[file_streams + 1];
+    for (int k = 0; k < file_streams; ++k) bounds[k] = buf->cum_ack + k * stripe;
+    bounds[file_streams] = buf->end;
 
-    // Retry missing chunks
-    time_t now = time(NULL);
-    for (int i = 0; i <= buf->final_seq; ++i) {
-        if (!buf->received[i] && now - buf->last_retry[i] > RETRY_INTERVAL) {
-            if (++buf->retry_count[i] > MAX_RETRIES) {
-                log_message(LOG_ERROR, "[FILE] Chunk #%d exceeded retry limit. Aborting.", i);
-                buf->active = 0;
-                return;
-            }
+    char request[MAX_COMMAND_LENGTH];
+    snprintf(request, sizeof(request), "%s,%d,%d,%s", buf->file->transfer_id, buf->first, bounds[1], buf->filename);
+    send_chunk(buf->sockfd, "file", buf->self_id, buf->src_id, request, strlen(request), "RESUME", buf->chunk_size, 1);
+    buf->end = bounds[1];
 
-            if (buf->retry_count[i] == 1 || buf->retry_count[i] % 5 == 0) {
-                log_message(LOG_INFO, "[FILE] Requested retry for chunk #%d (attempt %d)", i, buf->retry_count[i]);
-            }
+    for (int k = 1; k < file_streams; ++k) {
+        int first = partial_first_missing(buf->file, bounds[k], bounds[k + 1]);
+        if (first == bounds[k + 1]) continue;
+        snprintf(request, sizeof(request), "%s,%d,%d,%s", buf->file->transfer_id, first, bounds[k + 1], buf->filename);
+        if (stream_opener(request, buf->chunk_size, buf->src_id) != 0)
+            log_message(LOG_WARN, "[FILE] Could not open stream for chunks [%d,%d) of '%s'", first, bounds[k + 1], buf->filename);
+    }
+    log_message(LOG_INFO, "[FILE] Split '%s' across %d streams of ~%d chunk(s)", buf->filename, file_streams, stripe);
+}
+
+void handle_file_start(const FrameView* view, int sockfd, int may_split) {
+    if (view->src_id < 0) return;
+    FileBuffer* buf = buffer_of(view->src_id, 1);
+    if (!buf) {
+        log_message(LOG_ERROR, "[FILE] Out of memory; ignoring START from client %d", view->src_id);
+        return;
+    }
+
+    char header[MAX_COMMAND_LENGTH];
+    frame_view_copy(view, view->payload, header, sizeof(header));
+    long long size;
+    int chunk_size, first, end, name_at = 0;
+    char transfer_id[TRANSFER_ID_LEN + 2];
+    if (sscanf(header, "%lld,%d,%17[0-9a-f],%d,%d,%n", &size, &chunk_size, transfer_id, &first, &end, &name_at) != 5 ||
+        name_at == 0 || size < 0 || chunk_size <= 0 || strlen(transfer_id) != TRANSFER_ID_LEN ||
+        header[name_at] == '\0' || (size + chunk_size - 1) / chunk_size > INT32_MAX) {
+        log_message(LOG_ERROR, "[FILE] Malformed transfer header '%s'", header);
+        return;
+    }
 
-            char retry[MAX_COMMAND_LENGTH];
-            snprintf(retry, sizeof(retry), "RETRY|%d", i);
-            build_frame("file", 0, buf->src_id, retry, "RETRY", retry);
-            send(sockfd, retry, strlen(retry), 0);
-            buf->last_retry[i] = now;
+    if (!buf->active || buf->file) {
+        // START without INCOMING (or a second START): begin from a clean state
+        if (buf->active) end_transfer(buf);
+        buf->active = 1;
+        buf->src_id = view->src_id;
+        timer_init(&buf->deadline, on_transfer_deadline, buf);
+        timer_init(&buf->retry, on_chunk_retry, buf);
+    }
+    buf->sockfd = sockfd;
+    if (buf->delta) {
+        // Signatures were sent, but the sender chose the whole file over a delta
+        char staged[sizeof(buf->filename) + 8];
+        snprintf(staged, sizeof(staged), "%s.delta", buf->delta->filename);
+        if (strcmp(staged, header + name_at) != 0) {
+            delta_basis_free(buf->delta);
+            buf->delta = NULL;
         }
     }
+    snprintf(buf->filename, sizeof(buf->filename), "%s", header + name_at);
+    buf->chunk_size = chunk_size;
+    int total_chunks = (int)((size + chunk_size - 1) / chunk_size);
+    if (end <= 0 || end > total_chunks) end = total_chunks;
+    if (first < 0 || first > end) first = 0;
+    buf->first = first;
+    buf->end = end;
+    buf->received_count = 0;
+    buf->progress = 0;
+    buf->self_id = view->dest_id;
+    buf->unacked = 0;
+    buf->ack_every = view->seq_num / 4 > 1 ? view->seq_num / 4 : 1;  // seq: sender's window
+    buf->retry_rounds = 0;
+    buf->retry_mark = 0;
+    buf->awaiting_done = 0;
 
-    // Reassemble if complete
-    if (buf->final_seq >= 0) {
-        for (int i = 0; i <= buf->final_seq; ++i)
-            if (!buf->received[i]) return;
+    buf->file = partial_open(transfer_id, buf->filename, size, chunk_size);
+    if (!buf->file) {
+        finish_transfer(buf, view, sockfd, 0);
+        return;
+    }
+    if (buf->file->complete) {
+        // Zero-length file, or every chunk was already stored
+        buf->cum_ack = end;
+        send_sack(buf, "ACK");
+        finish_transfer(buf, view, sockfd, 1);
+        return;
+    }
+    buf->cum_ack = partial_first_missing(buf->file, first, end);
 
-        log_message(LOG_INFO, "[FILE] All chunks received. Reassembling '%s'...", buf->filename);
+    if (file_timers && !timer_pending(&buf->deadline)) {
+        buf->last_received_ms = file_timers->now_ms;
+        timer_schedule(file_timers, &buf->deadline, TRANSFER_TIMEOUT * 1000LL);
+    }
+    if (file_timers) timer_schedule(file_timers, &buf->retry, RETRY_INTERVAL * 1000LL);
 
-        char full[MAX_MESSAGE_SIZE] = "";
-        for (int i = 0; i <= buf->final_seq; ++i)
-            strncat(full, buf->chunks[i], sizeof(full) - strlen(full) - 1);
+    log_message(LOG_INFO, "[FILE] Receiving '%s' (%lld bytes): chunks [%d,%d) of %d, %d bytes each",
+                buf->filename, size, first, end, total_chunks, chunk_size);
 
-        /*const char* path = resolve_asset_path("received", buf->filename);*/
-        const char* path = resolve_asset_path("received", buf->filename);
-        if (!path) return;
+    // A batch's or a delta's stream exists only on the sender that built it: extra streams cannot ask for it
+    if (may_split && !buf->batch && !buf->delta) split_transfer(buf);
+    // Tell the sender what this range already holds (from a checkpoint or another stream)
+    if (buf->cum_ack > first) send_sack(buf, "ACK");
+    if (buf->cum_ack >= buf->end) end_transfer(buf);
+}
+
+/**
+ * @brief Handles incoming file chunks, writes them at their offset with their
+ *        digests, arms retries for gaps, and waits for the sender's DONE once
+ *        every chunk of the range is stored.
+ * @param view Frame view containing chunk data and metadata.
+ * @param sockfd Socket to send retry or ACK frames.
+ */
+void handle_file_chunk(const FrameView* view, int sockfd) {
+    FileBuffer* buf = buffer_of(view->src_id, 0);
+    if (!buf || !buf->file) {
+        log_message(LOG_WARN, "[FILE] Received chunk from %d but no active transfer.", view->src_id);
+        return;
+    }
 
-        FILE* fp = fopen(path, "wb");
-        if (fp) {
-            fwrite(full, 1, strlen(full), fp);
-            fclose(fp);
+    PartialFile* pf = buf->file;
+    int seq = view->seq_num;
+    if (seq < 0 || seq >= pf->total_chunks) return;
 
-            char ack[MAX_COMMAND_LENGTH];
-            //src_id: 0 — the system/server is the one sending the ACK frame
-            build_frame("system",cmd->src_id, cmd->dest_id , buf->filename, "ACK", ack);
-            send(sockfd, ack, strlen(ack), 0);
-            log_message(LOG_INFO, "[FILE] File '%s' saved and ACK sent to sender %d from receiver %d",
-            buf->filename, cmd->src_id, cmd->dest_id);
-        } else {
-            char err[MAX_COMMAND_LENGTH];
-            build_frame("system", cmd->dest_id, cmd->src_id, buf->filename, "ERR", err);
-            send(sockfd, err, strlen(err), 0);
-            log_message(LOG_ERROR, "[FILE] Failed to save file '%s'. ERR sent to sender %d", buf->filename, buf->src_id);
+    // Binary frames carry the bytes verbatim; text frames carry base64
+    const unsigned char* data = (const unsigned char*)FRAME_VIEW_PTR(view, view->payload);
+    long len = view->payload.len;
+    unsigned char decoded[FILE_TEXT_CHUNK_SIZE + 3];
+    if (!view->binary) {
+        len = view->payload.len <= 4 * sizeof(decoded) / 3 ? base64_decode((const char*)data, view->payload.len, decoded) : -1;
+        data = decoded;
+    }
+
+    long long offset = (long long)seq * pf->chunk_size;
+    long expected = seq == pf->total_chunks - 1 ? (long)(pf->file_size - offset) : pf->chunk_size;
+    if (len != expected) {
+        log_message(LOG_WARN, "[FILE] Chunk #%d of '%s' has %ld bytes, expected %ld; dropped", seq, buf->filename, len, expected);
+        return;
+    }
+
+    int stored = partial_store(pf, seq, data, (size_t)len, file_chunk_digest(data, (size_t)len, seq));
+    if (stored < 0) {
+        log_message(LOG_ERROR, "[FILE] Write of chunk #%d to '%s' failed", seq, buf->filename);
+        finish_transfer(buf, view, sockfd, 0);
+        return;
+    }
+    int previous_ack = buf->cum_ack;
+    if (stored > 0) buf->received_count++;
+    while (buf->cum_ack < buf->end && partial_has(pf, buf->cum_ack)) buf->cum_ack++;
+    buf->unacked++;
+
+    if (file_timers) {
+        buf->last_received_ms = file_timers->now_ms;
+        if (!timer_pending(&buf->retry) && !buf->awaiting_done) timer_schedule(file_timers, &buf->retry, RETRY_INTERVAL * 1000LL);
+    }
+
+    int span = buf->end - buf->first;
+    int progress = (int)((buf->cum_ack - buf->first) * 10LL / (span ? span : 1));
+    if (progress > buf->progress) {
+        buf->progress = progress;
+        log_message(LOG_INFO, "[FILE] Receiving '%s' [%d,%d): %d%% (%d/%d stored)",
+                    buf->filename, buf->first, buf->end, progress * 10, pf->received_count, pf->total_chunks);
+    }
+
+    // Acknowledge every ack_every chunks, and at once when a chunk is out of order
+    // (a gap opened, or a repair closed one) so the sender reacts without waiting
+    if (buf->cum_ack != previous_ack + 1 || buf->unacked >= buf->ack_every || buf->cum_ack == buf->end)
+        send_sack(buf, "ACK");
+
+    if (buf->cum_ack == buf->end && !buf->awaiting_done) {
+        // Nothing left to retry; the deadline stays armed for DONE
+        buf->awaiting_done = 1;
+        if (file_timers) timer_cancel(file_timers, &buf->retry);
+        log_message(LOG_DEBUG, "[FILE] Chunks [%d,%d) of '%s' stored; waiting for the sender's digest",
+                    buf->first, buf->end, buf->filename);
+    }
+}
+
+// ─────────────────────────────────────────────────────────────
+// CLIENT-SIDE: Verify the end-to-end digest
+// ─────────────────────────────────────────────────────────────
+
+/**
+ * @brief Checks DONE's digests against the chunks stored. Segments holding a
+ *        chunk not stored here, or sent as 'x's, are skipped.
+ * @param[out] bad_first First chunk of the first segment that differs.
+ * @param[out] bad_end End of the last segment that differs.
+ * @return 1 if digests were checked and agree, 0 if there were none to check,
+ *         -1 on a mismatch.
+ */
+static int verify_digest(FileBuffer* buf, const char* done, int* bad_first, int* bad_end) {
+    PartialFile* pf = buf->file;
+    int first, end, segs_at = 0;
+    char whole[17];
+    if (sscanf(done, "%d,%d,%16[0-9a-fx],%n", &first, &end, whole, &segs_at) != 3 || segs_at == 0 ||
+        strlen(whole) != 16 || first < 0 || first > end || end > pf->total_chunks)
+        return 0;
+    int segments = digest_segments(first, end);
+    const char* segs = done + segs_at;
+    if (strlen(segs) <= (size_t)segments * 16 || segs[segments * 16] != ',') return 0;
+
+    uint64_t sum;
+    if (whole[0] != 'x' && partial_digest(pf, first, end, &sum) == 0 && sum == strtoull(whole, NULL, 16)) return 1;
+
+    // The whole range disagrees or cannot be checked: narrow it down by segment
+    int checked = 0;
+    *bad_first = end;
+    *bad_end = first;
+    for (int k = 0; k < segments; ++k) {
+        char hex[17];
+        memcpy(hex, segs + k * 16, 16);
+        hex[16] = '\0';
+        int a = segment_start(first, end, segments, k), b = segment_start(first, end, segments, k + 1);
+        if (hex[0] == 'x' || strspn(hex, "0123456789abcdef") != 16 || partial_digest(pf, a, b, &sum) != 0) continue;
+        checked++;
+        if (sum == strtoull(hex, NULL, 16)) continue;
+        if (a < *bad_first) *bad_first = a;
+        *bad_end = b;
+    }
+    if (*bad_first < *bad_end) return -1;
+    return checked > 0;
+}
+
+/**
+ * @brief Forgets chunks that failed verification and asks the sender for them
+ *        again with RESUME. Batches and deltas exist only on the sender that
+ *        built them, so they cannot be re-fetched in part: a delta falls back
+ *        to the whole file and a batch fails.
+ * @return 1 if the range was asked for, 0 if the transfer ended.
+ */
+static int refetch_range(FileBuffer* buf, const FrameView* view, int sockfd, int first, int end) {
+    partial_forget(buf->file, first, end);
+    if (buf->delta) {
+        log_message(LOG_WARN, "[FILE] Delta of '%s' failed verification; asking sender %d for the whole file",
+                    buf->delta->filename, view->src_id);
+        send_chunk(sockfd, "file", buf->self_id, view->src_id, buf->delta->filename, strlen(buf->delta->filename),
+                   "READY", buf->chunk_size, 1);
+        end_transfer(buf);
+        return 0;
+    }
+    if (buf->batch || ++buf->refetches > DIGEST_MAX_REFETCH) {
+        log_message(LOG_ERROR, "[FILE] '%s' failed verification in chunks [%d,%d)%s", buf->filename, first, end,
+                    buf->batch ? "" : " too many times");
+        finish_transfer(buf, view, sockfd, 0);
+        return 0;
+    }
+
+    log_message(LOG_WARN, "[FILE] Digest mismatch in chunks [%d,%d) of '%s'; fetching them again (%d/%d)",
+                first, end, buf->filename, buf->refetches, DIGEST_MAX_REFETCH);
+    char request[MAX_COMMAND_LENGTH];
+    snprintf(request, sizeof(request), "%s,%d,%d,%s", buf->file->transfer_id, first, end, buf->filename);
+    send_chunk(sockfd, "file", buf->self_id, buf->src_id, request, strlen(request), "RESUME", buf->chunk_size, 1);
+    buf->awaiting_done = 0;  // START of the range begins the stream again
+    return 1;
+}
+
+static void place_raw(RawReceive* rx, const FrameView* view);
+
+int handle_file_done(const FrameView* view, int sockfd, RawReceive* rx) {
+    if (rx->awaiting_done && rx->src_id == view->src_id) {
+        place_raw(rx, view);
+        return 0;
+    }
+
+    FileBuffer* buf = buffer_of(view->src_id, 0);
+    if (!buf || !buf->file || !buf->awaiting_done) return 0;  // Raw phase, or a range that held nothing new
+
+    char done[MAX_COMMAND_LENGTH];
+    frame_view_copy(view, view->payload, done, sizeof(done));
+    int bad_first = 0, bad_end = 0;
+    int verified = verify_digest(buf, done, &bad_first, &bad_end);
+    if (verified < 0) return refetch_range(buf, view, sockfd, bad_first, bad_end);
+    if (verified)
+        log_message(LOG_INFO, "[FILE] Digest of chunks [%d,%d) of '%s' verified", buf->first, buf->end, buf->filename);
+    else
+        log_message(LOG_DEBUG, "[FILE] DONE for '%s' carried no digest to check", buf->filename);
+
+    buf->awaiting_done = 0;
+    int placed = partial_finish(buf->file);
+    if (placed == 0) {
+        log_message(LOG_INFO, "[FILE] Chunks [%d,%d) of '%s' stored; other streams still running", buf->first, buf->end, buf->filename);
+        end_transfer(buf);
+        return 0;
+    }
+    finish_transfer(buf, view, sockfd, placed > 0);
+    return 0;
+}
+
+void handle_file_error(const FrameView* view) {
+    // A refused request of our own comes back as ERR too: only the file in flight ends
+    char filename[MAX_MESSAGE_LENGTH];
+    frame_view_copy(view, view->payload, filename, sizeof(filename));
+    FileBuffer* buf = buffer_of(view->src_id, 0);
+    if (!buf || strcmp(buf->filename, filename) != 0) return;
+    log_message(LOG_ERROR, "[FILE] Sender %d could not send '%s'", view->src_id, buf->filename);
+    end_transfer(buf);
+}
+
+void handle_file_wait(const FrameView* view) {
+    FileBuffer* buf = buffer_of(view->src_id, 0);
+    if (!buf || !file_timers) return;
+    log_message(LOG_DEBUG, "[FILE] Sender %d holds '%s' back (scheduled)", view->src_id, buf->filename);
+    buf->last_received_ms = file_timers->now_ms;
+    if (timer_pending(&buf->retry)) timer_schedule(file_timers, &buf->retry, RETRY_INTERVAL * 1000LL);
+}
+
+// ─────────────────────────────────────────────────────────────
+// CLIENT-SIDE: Receive a raw data phase
+// ─────────────────────────────────────────────────────────────
+
+#define RAW_BOUNCE_SIZE 65536 ///< Largest read per call on the recv() fallback
+
+/**
+ * @brief Reports a raw phase that could not be stored and drops its partial file.
+ */
+static void fail_raw(RawReceive* rx) {
+    char part[1024];
+    if (partial_path(rx->filename, ".part", part, sizeof(part)) == 0) remove(part);
+    send_command(rx->sockfd, "system", rx->dest_id, rx->src_id, rx->filename, "ERR");
+    log_message(LOG_ERROR, "[FILE] Failed to save file '%s'. ERR sent to sender %d", rx->filename, rx->src_id);
+}
+
+/**
+ * @brief Adds body bytes to the phase's digest as they are stored. A
+ *        FILE_DIGEST_CHUNK arriving over several reads is hashed piece by piece,
+ *        and its hash is summed once the chunk (or the body) is complete.
+ */
+static void raw_hash(RawReceive* rx, const unsigned char* data, size_t len) {
+    while (len > 0) {
+        size_t at = (size_t)(rx->hashed % FILE_DIGEST_CHUNK);
+        if (at == 0) xxh64_reset(&rx->chunk_hash, (uint64_t)(rx->hashed / FILE_DIGEST_CHUNK));
+        size_t n = FILE_DIGEST_CHUNK - at < len ? FILE_DIGEST_CHUNK - at : len;
+        xxh64_update(&rx->chunk_hash, data, n);
+        rx->hashed += (long long)n;
+        data += n;
+        len -= n;
+        if (rx->hashed % FILE_DIGEST_CHUNK == 0 || rx->hashed == rx->total) rx->digest += xxh64_digest(&rx->chunk_hash);
+    }
+}
+
+/**
+ * @brief Closes the destination once the last body byte is stored; the file
+ *        keeps its ".part" name until DONE confirms the phase ended.
+ */
+static void finish_raw(RawReceive* rx) {
+    int saved = rx->fp && fclose(rx->fp) == 0;
+    rx->fp = NULL;
+
+    if (saved) rx->awaiting_done = 1;
+    else fail_raw(rx);
+}
+
+/**
+ * @brief Ends a raw phase on its DONE ("<size>,<digest>,<filename>"): a body
+ *        stored whole whose digest matches the sender's takes its final name and
+ *        is confirmed the same way the chunk path does. A body that differs is
+ *        asked for again with READY, up to DIGEST_MAX_REFETCH times.
+ */
+static void place_raw(RawReceive* rx, const FrameView* view) {
+    rx->awaiting_done = 0;
+    char done[MAX_COMMAND_LENGTH], hex[17];
+    frame_view_copy(view, view->payload, done, sizeof(done));
+    long long size;
+    int name_at = 0;
+    if (sscanf(done, "%lld,%16[0-9a-f],%n", &size, hex, &name_at) != 2 || name_at == 0 || strlen(hex) != 16) {
+        log_message(LOG_DEBUG, "[FILE] DONE for '%s' carried no digest to check", rx->filename);
+    } else if (size != rx->total || strtoull(hex, NULL, 16) != rx->digest) {
+        char part[1024];
+        if (partial_path(rx->filename, ".part", part, sizeof(part)) == 0) remove(part);
+        if (++rx->refetches > DIGEST_MAX_REFETCH) {
+            log_message(LOG_ERROR, "[FILE] '%s' failed verification too many times", rx->filename);
+            fail_raw(rx);
+            return;
         }
+        log_message(LOG_WARN, "[FILE] Digest mismatch in raw body of '%s'; fetching it again (%d/%d)",
+                    rx->filename, rx->refetches, DIGEST_MAX_REFETCH);
+        send_chunk(rx->sockfd, "file", rx->dest_id, rx->src_id, rx->filename, strlen(rx->filename), "READY", 0, 1);
+        return;
+    } else {
+        log_message(LOG_INFO, "[FILE] Digest of raw body of '%s' verified", rx->filename);
+    }
 
-        buf->active = 0;
+    if (rx->written != rx->total || partial_place(rx->filename) != 0) {
+        fail_raw(rx);
+        return;
     }
-}
\ No newline at end of file
+
+    long long elapsed = monotonic_ms() - rx->started_ms;
+    content_store_add(rx->filename);
+    send_command(rx->sockfd, "system", rx->src_id, rx->dest_id, rx->filename, "ACK");
+    log_message(LOG_INFO, "[FILE] File '%s' (%lld bytes) saved in %lld ms and ACK sent to sender %d",
+                rx->filename, rx->total, elapsed, rx->src_id);
+}
+
+int handle_file_raw(const FrameView* view, int sockfd, RawReceive* rx) {
+    char header[MAX_COMMAND_LENGTH];
+    frame_view_copy(view, view->payload, header, sizeof(header));
+
+    char* name = strchr(header, ',');
+    char* end;
+    long long size = strtoll(header, &end, 10);
+    if (!name || end != name || size < 0 || name[1] == '\0') {
+        log_message(LOG_ERROR, "[FILE] Malformed raw header '%s'", header);
+        return -1;
+    }
+
+    if (rx->awaiting_done) {
+        log_message(LOG_WARN, "[FILE] Raw body of '%s' never got its DONE; dropping it", rx->filename);
+        fail_raw(rx);
+    }
+    // A body fetched again after a digest mismatch keeps counting its attempts
+    int refetches = rx->src_id == view->src_id && strcmp(rx->filename, name + 1) == 0 ? rx->refetches : 0;
+    memset(rx, 0, sizeof(*rx));
+    rx->refetches = refetches;
+    rx->src_id = view->src_id;
+    rx->dest_id = view->dest_id;
+    rx->sockfd = sockfd;
+    rx->total = rx->remaining = size;
+    rx->started_ms = monotonic_ms();
+    snprintf(rx->filename, sizeof(rx->filename), "%s", name + 1);
+
+    // The raw phase replaces the chunked reassembly for this sender
+    FileBuffer* chunked = buffer_of(view->src_id, 0);
+    if (chunked) end_transfer(chunked);
+
+    // A checkpoint left by an earlier chunked attempt no longer describes the .part
+    char part[1024], ckpt[1024];
+    if (partial_path(rx->filename, ".ckpt", ckpt, sizeof(ckpt)) == 0) remove(ckpt);
+    rx->fp = partial_path(rx->filename, ".part", part, sizeof(part)) == 0 ? fopen(part, "wb+") : NULL;
+    if (!rx->fp) {
+        // Still consume the body so the stream stays framed after it
+        log_message(LOG_ERROR, "[FILE] Cannot open '%s' for writing; discarding %lld bytes", rx->filename, size);
+    }
+
+    log_message(LOG_INFO, "[FILE] Receiving '%s' (%lld bytes) from client %d as a raw data phase",
+                rx->filename, size, rx->src_id);
+
+    if (size == 0) finish_raw(rx);
+    return 0;
+}
+
+void file_raw_write(RawReceive* rx, const void* data, size_t len) {
+    if (len > (size_t)rx->remaining) len = (size_t)rx->remaining;
+    if (rx->fp && fwrite(data, 1, len, rx->fp) != len) {
+        log_message(LOG_ERROR, "[FILE] Write to '%s' failed; discarding the rest", rx->filename);
+        fclose(rx->fp);
+        rx->fp = NULL;
+    } else if (rx->fp) {
+        rx->written += (long long)len;
+        raw_hash(rx, data, len);
+    }
+    rx->remaining -= len;
+    if (rx->remaining == 0) finish_raw(rx);
+}
+
+long file_raw_from_socket(RawReceive* rx) {
+    char bounce[RAW_BOUNCE_SIZE];
+    size_t want = rx->remaining < RAW_BOUNCE_SIZE ? (size_t)rx->remaining : RAW_BOUNCE_SIZE;
+    int n = recv(rx->sockfd, bounce, (int)want, 0);
+    if (n <= 0) return n;
+    file_raw_write(rx, bounce, (size_t)n);
+    return n;
+}
@@ -0,0 +1,230 @@
+/**
+ * @file hot_cache.c
+ * @brief Hot-file cache: files hashed by transfer ID into buckets and kept on
+ *        an LRU list, each with a table of shared frames per chunk and variant.
+ *        One lock guards it all; frames leave it with their own reference, so
+ *        evicting a file never frees a frame still queued on a socket. Each
+ *        chunk's digest is kept beside its frames for DONE.
+ * @author Oussama Amara
+ * @version 1.1
+ * @date 2026-10-17
+ */
+
+#include "hot_cache.h"
+#include "partial_file.h"
+#include "platform_thread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief One cached file.
+ */
+typedef struct HotFile {
+    struct HotFile* next;             ///< Next in the same bucket
+    struct HotFile* newer;            ///< LRU neighbours
+    struct HotFile* older;
+    char file_id[TRANSFER_ID_LEN + 1];
+    long long file_size;
+    int chunk_size;                   ///< Set by the first lookup, 0 before
+    int total_chunks;
+    SharedFrame** frames;             ///< total_chunks * HOT_CACHE_VARIANTS, NULL = not encoded yet
+    uint64_t* digests;                ///< Chunk digests, set with a chunk's first frame
+    long long bytes;                  ///< Held by this file: entry, table and frames
+} HotFile;
+
+static struct {
+    int enabled;
+    mutex_t lock;
+    long long capacity;
+    HotFile* buckets[HOT_CACHE_BUCKETS];
+    HotFile* newest;
+    HotFile* oldest;
+    HotCacheStats stats;
+} hot;
+
+static unsigned id_bucket(const char* file_id) {
+    unsigned long long hash = 1469598103934665603ULL;
+    for (const char* p = file_id; *p; ++p) hash = (hash ^ (unsigned char)*p) * 1099511628211ULL;
+    return (unsigned)(hash % HOT_CACHE_BUCKETS);
+}
+
+static int variant_of(unsigned wire) {
+    return ((wire & WIRE_CRC32C) ? 1 : 0) | ((wire & WIRE_LZ4) ? 2 : 0);
+}
+
+// ─────────────────────────────────────────────────────────────
+// Entries and LRU list (lock held)
+// ─────────────────────────────────────────────────────────────
+
+static HotFile* file_find(const char* file_id) {
+    for (HotFile* f = hot.buckets[id_bucket(file_id)]; f; f = f->next)
+        if (strcmp(f->file_id, file_id) == 0) return f;
+    return NULL;
+}
+
+static void lru_unlink(HotFile* f) {
+    if (f->newer) f->newer->older = f->older;
+    else hot.newest = f->older;
+    if (f->older) f->older->newer = f->newer;
+    else hot.oldest = f->newer;
+    f->newer = f->older = NULL;
+}
+
+static void lru_push(HotFile* f) {
+    f->older = hot.newest;
+    f->newer = NULL;
+    if (hot.newest) hot.newest->newer = f;
+    else hot.oldest = f;
+    hot.newest = f;
+}
+
+static void lru_touch(HotFile* f) {
+    if (hot.newest == f) return;
+    lru_unlink(f);
+    lru_push(f);
+}
+
+static void file_evict(HotFile* f) {
+    for (HotFile** link = &hot.buckets[id_bucket(f->file_id)]; *link; link = &(*link)->next) {
+        if (*link != f) continue;
+        *link = f->next;
+        break;
+    }
+    lru_unlink(f);
+    if (f->frames) {
+        for (long long i = 0; i < (long long)f->total_chunks * HOT_CACHE_VARIANTS; ++i) frame_share_release(f->frames[i]);
+        free(f->frames);
+    }
+    free(f->digests);
+    hot.stats.bytes -= f->bytes;
+    hot.stats.files--;
+    hot.stats.evictions++;
+    free(f);
+}
+
+/**
+ * @brief Evicts the least recently used files, never keep, until the cache fits.
+ * @return 1 if it fits.
+ */
+static int make_room(const HotFile* keep) {
+    while (hot.stats.bytes > hot.capacity && hot.oldest && hot.oldest != keep) file_evict(hot.oldest);
+    return hot.stats.bytes <= hot.capacity;
+}
+
+/**
+ * @brief The file's chunk frame slot for a transfer, laying out its table on first use.
+ * @return The slot, or NULL if the file is cached for another chunk size.
+ */
+static SharedFrame** frame_slot(HotFile* f, int chunk_size, int seq, unsigned wire) {
+    if (f->chunk_size == 0) {
+        long long total = (f->file_size + chunk_size - 1) / chunk_size;
+        size_t table = (size_t)total * (HOT_CACHE_VARIANTS * sizeof(*f->frames) + sizeof(*f->digests));
+        f->frames = calloc((size_t)total * HOT_CACHE_VARIANTS + 1, sizeof(*f->frames));
+        f->digests = calloc((size_t)total + 1, sizeof(*f->digests));
+        if (!f->frames || !f->digests) {
+            free(f->frames);
+            free(f->digests);
+            f->frames = NULL;
+            f->digests = NULL;
+            return NULL;
+        }
+        f->chunk_size = chunk_size;
+        f->total_chunks = (int)total;
+        f->bytes += (long long)table;
+        hot.stats.bytes += (long long)table;
+    }
+    if (f->chunk_size != chunk_size || seq < 0 || seq >= f->total_chunks) return NULL;
+    return &f->frames[(size_t)seq * HOT_CACHE_VARIANTS + (size_t)variant_of(wire)];
+}
+
+// ─────────────────────────────────────────────────────────────
+// API
+// ─────────────────────────────────────────────────────────────
+
+void hot_cache_init(long long max_bytes) {
+    mutex_init(&hot.lock);
+    hot.capacity = max_bytes > 0 ? max_bytes : 0;
+    hot.stats.capacity = hot.capacity;
+    hot.enabled = hot.capacity > 0;
+}
+
+void hot_cache_admit(const char* file_id, long long file_size) {
+    if (!hot.enabled || file_size <= 0 || file_size > hot.capacity / HOT_CACHE_FILE_SHARE) return;
+
+    mutex_lock(&hot.lock);
+    HotFile* f = file_find(file_id);
+    if (f) {
+        lru_touch(f);
+    } else if ((f = calloc(1, sizeof(*f))) != NULL) {
+        snprintf(f->file_id, sizeof(f->file_id), "%s", file_id);
+        f->file_size = file_size;
+        f->bytes = (long long)sizeof(*f);
+        unsigned b = id_bucket(file_id);
+        f->next = hot.buckets[b];
+        hot.buckets[b] = f;
+        lru_push(f);
+        hot.stats.bytes += f->bytes;
+        hot.stats.files++;
+        make_room(f);
+    }
+    mutex_unlock(&hot.lock);
+}
+
+SharedFrame* hot_cache_get(const char* file_id, int chunk_size, int seq, unsigned wire, int* cacheable,
+                           uint64_t* digest) {
+    *cacheable = 0;
+    if (!hot.enabled || !(wire & WIRE_BINARY)) return NULL;
+
+    SharedFrame* frame = NULL;
+    mutex_lock(&hot.lock);
+    HotFile* f = file_find(file_id);
+    SharedFrame** slot = f ? frame_slot(f, chunk_size, seq, wire) : NULL;
+    if (slot && *slot) {
+        frame = *slot;
+        *digest = f->digests[seq];
+        frame_share_retain(frame);
+        lru_touch(f);
+        hot.stats.hits++;
+    } else if (slot) {
+        *cacheable = 1;
+        hot.stats.misses++;
+    }
+    mutex_unlock(&hot.lock);
+    return frame;
+}
+
+void hot_cache_put(const char* file_id, int chunk_size, int seq, unsigned wire, SharedFrame* frame, uint64_t digest) {
+    if (!hot.enabled || !frame) return;
+
+    mutex_lock(&hot.lock);
+    HotFile* f = file_find(file_id);
+    SharedFrame** slot = f ? frame_slot(f, chunk_size, seq, wire) : NULL;
+    if (slot && !*slot) {
+        long long size = (long long)frame_shared_size(frame);
+        frame_share_retain(frame);
+        *slot = frame;
+        f->digests[seq] = digest;
+        f->bytes += size;
+        hot.stats.bytes += size;
+        if (!make_room(f)) {
+            // Only this file is left and it still does not fit: keep it without the new frame
+            *slot = NULL;
+            f->bytes -= size;
+            hot.stats.bytes -= size;
+            frame_share_release(frame);
+        }
+    }
+    mutex_unlock(&hot.lock);
+}
+
+void hot_cache_stats(HotCacheStats* stats) {
+    if (!hot.enabled) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    mutex_lock(&hot.lock);
+    *stats = hot.stats;
+    mutex_unlock(&hot.lock);
+}
@@ -0,0 +1,399 @@
+/**
+ * @file partial_file.c
+ * @brief Partial files and receive checkpoints for resumable transfers.
+ *        A checkpoint is a one-line header ("TRANSFER <id> <size> <chunk_size> <chunks>")
+ *        followed by the bitmap of stored chunks and their 64-bit digests. It is
+ *        written to a temporary file and renamed over the old one after the chunk
+ *        data is synced, so it never claims a chunk that is not on disk.
+ * @author Oussama Amara
+ * @version 1.2
+ * @date 2026-10-17
+ */
+
+#include "partial_file.h"
+#include "logger.h"
+#include "platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#define MAX_PARTIALS 16 ///< Transfers receiving at once
+
+static PartialFile* open_files[MAX_PARTIALS];
+static mutex_t open_files_lock; ///< Guards open_files and refs
+
+#define CHUNK_BIT(bits, seq) ((bits)[(seq) >> 3] & (1u << ((seq) & 7)))
+
+void partial_init(void) {
+    mutex_init(&open_files_lock);
+}
+
+// ─────────────────────────────────────────────────────────────
+// Paths and file helpers
+// ─────────────────────────────────────────────────────────────
+
+int partial_path(const char* filename, const char* suffix, char* out, size_t cap) {
+    const char* base = resolve_asset_path("received", filename);
+    if (!base) return -1;
+    return (size_t)snprintf(out, cap, "%s%s", base, suffix) < cap ? 0 : -1;
+}
+
+static int sync_fd(int fd) {
+#ifdef _WIN32
+    return _commit(fd);
+#else
+    return fsync(fd);
+#endif
+}
+
+/**
+ * @brief rename() that replaces an existing destination on every platform.
+ */
+static int replace_file(const char* from, const char* to) {
+#ifdef _WIN32
+    remove(to);
+#endif
+    return rename(from, to);
+}
+
+/**
+ * @brief Writes len bytes at offset without moving a shared file position.
+ */
+static int write_at(int fd, const void* data, size_t len, long long offset) {
+    const char* p = data;
+    while (len > 0) {
+#ifdef _WIN32
+        if (_lseeki64(fd, offset, SEEK_SET) < 0) return -1;
+        int n = _write(fd, p, (unsigned)len);
+#else
+        ssize_t n = pwrite(fd, p, len, (off_t)offset);
+        if (n < 0 && errno == EINTR) continue;
+#endif
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+// ─────────────────────────────────────────────────────────────
+// Checkpoints
+// ─────────────────────────────────────────────────────────────
+
+/**
+ * @brief Loads a checkpoint. The bitmap (and the digests, if asked for) are
+ *        malloc()ed for the caller.
+ */
+static unsigned char* load_checkpoint(const char* filename, char* transfer_id, long long* file_size,
+                                      int* chunk_size, int* total_chunks, uint64_t** digests) {
+    char path[1024];
+    if (partial_path(filename, ".ckpt", path, sizeof(path)) != 0) return NULL;
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return NULL;
+
+    unsigned char* bits = NULL;
+    char id[TRANSFER_ID_LEN + 2];
+    if (fscanf(fp, "TRANSFER %17s %lld %d %d", id, file_size, chunk_size, total_chunks) == 4 &&
+        fgetc(fp) == '\n' && strlen(id) == TRANSFER_ID_LEN && *chunk_size > 0 && *total_chunks >= 0 &&
+        *total_chunks == (*file_size + *chunk_size - 1) / *chunk_size) {
+        size_t bytes = (size_t)*total_chunks / 8 + 1;
+        size_t count = (size_t)*total_chunks;
+        uint64_t* sums = malloc((count ? count : 1) * sizeof(*sums));
+        bits = malloc(bytes);
+        // A checkpoint without digests (an older format) cannot be verified: start over
+        if (bits && (!sums || fread(bits, 1, bytes, fp) != bytes || fread(sums, sizeof(*sums), count, fp) != count)) {
+            free(bits);
+            bits = NULL;
+        }
+        if (bits) memcpy(transfer_id, id, TRANSFER_ID_LEN + 1);
+        if (bits && digests) *digests = sums;
+        else free(sums);
+    }
+    fclose(fp);
+
+    // Without the partial data the bitmap means nothing
+    char part[1024];
+    if (bits && (partial_path(filename, ".part", part, sizeof(part)) != 0 || (fp = fopen(part, "rb")) == NULL)) {
+        free(bits);
+        if (digests) free(*digests);
+        return NULL;
+    }
+    if (bits) fclose(fp);
+    return bits;
+}
+
+/**
+ * @brief Saves the checkpoint (pf->lock held). Chunk data is synced first.
+ */
+static void save_checkpoint(PartialFile* pf) {
+    char path[1024], tmp[1040];
+    if (partial_path(pf->filename, ".ckpt", path, sizeof(path)) != 0) return;
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    if (pf->fd >= 0 && sync_fd(pf->fd) != 0) return;
+
+    FILE* fp = fopen(tmp, "wb");
+    if (!fp) return;
+    size_t bytes = (size_t)pf->total_chunks / 8 + 1;
+    size_t count = (size_t)pf->total_chunks;
+    int ok = fprintf(fp, "TRANSFER %s %lld %d %d\n", pf->transfer_id, pf->file_size, pf->chunk_size, pf->total_chunks) > 0 &&
+             fwrite(pf->received, 1, bytes, fp) == bytes && fwrite(pf->digests, sizeof(*pf->digests), count, fp) == count;
+    ok = (fclose(fp) == 0) && ok;
+    if (ok && replace_file(tmp, path) == 0) {
+        pf->checkpoint_ms = monotonic_ms();
+    } else {
+        remove(tmp);
+        log_message(LOG_WARN, "[FILE] Could not save checkpoint of '%s'", pf->filename);
+    }
+}
+
+/**
+ * @brief Renames the finished file into place and drops its checkpoint (pf->lock held).
+ */
+static int finalize(PartialFile* pf) {
+    char part[1024], ckpt[1024];
+    int ok = partial_path(pf->filename, ".part", part, sizeof(part)) == 0 &&
+             partial_path(pf->filename, ".ckpt", ckpt, sizeof(ckpt)) == 0;
+    ok = (close(pf->fd) == 0) && ok;
+    pf->fd = -1;
+    pf->complete = 1;
+
+    if (!ok || partial_place(pf->filename) != 0) return -1;
+    remove(ckpt);
+    return 0;
+}
+
+int partial_place(const char* filename) {
+    char part[1024];
+    const char* final_path = partial_path(filename, ".part", part, sizeof(part)) == 0
+                                 ? resolve_asset_path("received", filename) : NULL;
+    if (!final_path || replace_file(part, final_path) != 0) {
+        log_message(LOG_ERROR, "[FILE] Could not move '%s' into place", filename);
+        return -1;
+    }
+    return 0;
+}
+
+int partial_probe(const char* filename, char* transfer_id, int* chunk_size, int* first_missing) {
+    long long size;
+    int total;
+    unsigned char* bits = load_checkpoint(filename, transfer_id, &size, chunk_size, &total, NULL);
+    if (!bits) return -1;
+
+    int seq = 0;
+    while (seq < total && CHUNK_BIT(bits, seq)) seq++;
+    free(bits);
+    *first_missing = seq;
+    return 0;
+}
+
+// ─────────────────────────────────────────────────────────────
+// Shared partial files
+// ─────────────────────────────────────────────────────────────
+
+/**
+ * @brief Opens "<name>.part": resumed from a matching checkpoint or truncated.
+ */
+static PartialFile* create_partial(const char* transfer_id, const char* filename, long long file_size, int chunk_size) {
+    PartialFile* pf = calloc(1, sizeof(*pf));
+    if (!pf) return NULL;
+    snprintf(pf->transfer_id, sizeof(pf->transfer_id), "%s", transfer_id);
+    snprintf(pf->filename, sizeof(pf->filename), "%s", filename);
+    pf->file_size = file_size;
+    pf->chunk_size = chunk_size;
+    pf->total_chunks = (int)((file_size + chunk_size - 1) / chunk_size);
+    pf->started_ms = pf->checkpoint_ms = monotonic_ms();
+
+    char saved_id[TRANSFER_ID_LEN + 1];
+    long long saved_size;
+    int saved_chunk, saved_total;
+    uint64_t* sums = NULL;
+    unsigned char* bits = load_checkpoint(filename, saved_id, &saved_size, &saved_chunk, &saved_total, &sums);
+    int resume = bits && strcmp(saved_id, transfer_id) == 0 && saved_size == file_size && saved_chunk == chunk_size;
+    if (bits && !resume) {
+        log_message(LOG_INFO, "[FILE] Discarding checkpoint of an older '%s'", filename);
+        free(bits);
+        free(sums);
+        bits = NULL;
+        sums = NULL;
+    }
+
+    char part[1024];
+    if (partial_path(filename, ".part", part, sizeof(part)) != 0) {
+        free(bits);
+        free(sums);
+        free(pf);
+        return NULL;
+    }
+#ifdef _WIN32
+    pf->fd = _open(part, _O_WRONLY | _O_CREAT | _O_BINARY | (resume ? 0 : _O_TRUNC), 0644);
+#else
+    pf->fd = open(part, O_WRONLY | O_CREAT | (resume ? 0 : O_TRUNC), 0644);
+#endif
+    pf->received = bits ? bits : calloc((size_t)pf->total_chunks / 8 + 1, 1);
+    pf->digests = sums ? sums : calloc((size_t)pf->total_chunks + 1, sizeof(*pf->digests));
+    if (pf->fd < 0 || !pf->received || !pf->digests) {
+        log_message(LOG_ERROR, "[FILE] Cannot open '%s' for writing", part);
+        if (pf->fd >= 0) close(pf->fd);
+        free(pf->received);
+        free(pf->digests);
+        free(pf);
+        return NULL;
+    }
+
+    for (int seq = 0; seq < pf->total_chunks; ++seq)
+        if (CHUNK_BIT(pf->received, seq)) pf->received_count++;
+    pf->resumed = pf->received_count;
+    if (resume) log_message(LOG_INFO, "[FILE] Resuming '%s': %d/%d chunk(s) already stored", filename, pf->received_count, pf->total_chunks);
+
+    mutex_init(&pf->lock);
+    if (pf->received_count == pf->total_chunks) finalize(pf);
+    return pf;
+}
+
+PartialFile* partial_open(const char* transfer_id, const char* filename, long long file_size, int chunk_size) {
+    mutex_lock(&open_files_lock);
+    PartialFile* pf = NULL;
+    int free_slot = -1;
+    for (int i = 0; i < MAX_PARTIALS && !pf; ++i) {
+        PartialFile* f = open_files[i];
+        if (!f) {
+            if (free_slot < 0) free_slot = i;
+        } else if (strcmp(f->transfer_id, transfer_id) == 0 && strcmp(f->filename, filename) == 0 &&
+                   f->chunk_size == chunk_size) {
+            pf = f;
+        }
+    }
+
+    if (pf) {
+        pf->refs++;
+    } else if (free_slot >= 0 && (pf = create_partial(transfer_id, filename, file_size, chunk_size)) != NULL) {
+        pf->refs = 1;
+        open_files[free_slot] = pf;
+    }
+    mutex_unlock(&open_files_lock);
+    return pf;
+}
+
+int partial_has(PartialFile* pf, int seq) {
+    mutex_lock(&pf->lock);
+    int has = pf->complete || (seq >= 0 && seq < pf->total_chunks && CHUNK_BIT(pf->received, seq));
+    mutex_unlock(&pf->lock);
+    return has;
+}
+
+int partial_first_missing(PartialFile* pf, int from, int end) {
+    mutex_lock(&pf->lock);
+    if (pf->complete) from = end;
+    while (from < end && CHUNK_BIT(pf->received, from)) from++;
+    mutex_unlock(&pf->lock);
+    return from;
+}
+
+int partial_store(PartialFile* pf, int seq, const void* data, size_t len, uint64_t digest) {
+    if (seq < 0 || seq >= pf->total_chunks) return -1;
+
+    mutex_lock(&pf->lock);
+    if (pf->complete || CHUNK_BIT(pf->received, seq)) {
+        mutex_unlock(&pf->lock);
+        return 0;
+    }
+    pf->writers++;
+    int fd = pf->fd;
+    mutex_unlock(&pf->lock);
+
+    // Writes run unlocked at disjoint offsets (overlapping streams write the
+    // same bytes); the file is closed only once no write is in progress
+    int written = write_at(fd, data, len, (long long)seq * pf->chunk_size) == 0;
+
+    int rc = 0;
+    mutex_lock(&pf->lock);
+    pf->writers--;
+    if (!written) {
+        rc = -1;
+    } else if (!CHUNK_BIT(pf->received, seq)) {
+        pf->received[seq >> 3] |= (unsigned char)(1u << (seq & 7));
+        pf->digests[seq] = digest;
+        pf->received_count++;
+        rc = pf->received_count == pf->total_chunks ? 2 : 1;
+        if (rc == 1 && monotonic_ms() - pf->checkpoint_ms >= CHECKPOINT_INTERVAL_MS)
+            save_checkpoint(pf);
+    }
+    mutex_unlock(&pf->lock);
+    return rc;
+}
+
+int partial_digest(PartialFile* pf, int first, int end, uint64_t* digest) {
+    int missing = 0;
+    uint64_t sum = 0;
+    mutex_lock(&pf->lock);
+    for (int seq = first < 0 ? 0 : first; seq < end && seq < pf->total_chunks; ++seq) {
+        if (CHUNK_BIT(pf->received, seq)) sum += pf->digests[seq];
+        else missing++;
+    }
+    if (end > pf->total_chunks) missing += end - pf->total_chunks;
+    mutex_unlock(&pf->lock);
+    *digest = sum;
+    return missing;
+}
+
+void partial_forget(PartialFile* pf, int first, int end) {
+    mutex_lock(&pf->lock);
+    if (!pf->complete) {
+        for (int seq = first < 0 ? 0 : first; seq < end && seq < pf->total_chunks; ++seq) {
+            if (!CHUNK_BIT(pf->received, seq)) continue;
+            pf->received[seq >> 3] &= (unsigned char)~(1u << (seq & 7));
+            pf->received_count--;
+        }
+        save_checkpoint(pf);
+    }
+    mutex_unlock(&pf->lock);
+}
+
+int partial_finish(PartialFile* pf) {
+    // Streams hold a reference until their range is verified, so the last one
+    // left moves the file, and no other write can be in progress
+    mutex_lock(&open_files_lock);
+    int last = pf->refs == 1;
+    mutex_unlock(&open_files_lock);
+
+    mutex_lock(&pf->lock);
+    int rc = pf->complete ? 1 : 0;
+    if (!pf->complete && last && pf->received_count == pf->total_chunks && pf->writers == 0)
+        rc = finalize(pf) == 0 ? 1 : -1;
+    mutex_unlock(&pf->lock);
+    return rc;
+}
+
+void partial_release(PartialFile* pf) {
+    mutex_lock(&open_files_lock);
+    int last = --pf->refs == 0;
+    if (last) {
+        for (int i = 0; i < MAX_PARTIALS; ++i)
+            if (open_files[i] == pf) open_files[i] = NULL;
+    }
+    mutex_unlock(&open_files_lock);
+    if (!last) return;
+
+    mutex_lock(&pf->lock);
+    if (!pf->complete) {
+        save_checkpoint(pf);
+        close(pf->fd);
+        log_message(LOG_INFO, "[FILE] Checkpointed '%s' at %d/%d chunk(s)", pf->filename, pf->received_count, pf->total_chunks);
+    }
+    mutex_unlock(&pf->lock);
+    mutex_destroy(&pf->lock);
+    free(pf->received);
+    free(pf->digests);
+    free(pf);
+}
@@ -0,0 +1,194 @@
+/**
+ * @file transfer_scheduler.c
+ * @brief Admission queue and token buckets shared by every outgoing chunked transfer.
+ *        The shared bucket and the wait queues are guarded by one lock; a
+ *        transfer's own bucket is only touched by the thread driving it.
+ * @author Oussama Amara
+ * @version 1.0
+ * @date 2026-10-17
+ */
+
+#include "transfer_scheduler.h"
+#include "platform.h"
+#include "platform_thread.h"
+
+/**
+ * @brief Limits and shared state. Nothing is locked while no limit is set.
+ */
+static struct {
+    int enabled;                 ///< 1 if any limit is set
+    mutex_t lock;
+    int max_transfers;           ///< 0 = unlimited
+    long long transfer_rate;     ///< Bytes per second per transfer, 0 = unlimited
+    long long total_rate;        ///< Bytes per second for all transfers, 0 = unlimited
+    long long background_size;   ///< Smallest background transfer, 0 = no background class
+    int active;                  ///< Admitted transfers
+    int queued;                  ///< Transfers waiting for a slot
+    SchedFlow* head[2];          ///< Wait queue per class (oldest first)
+    SchedFlow* tail[2];
+    double tokens;               ///< Shared bucket (bytes; negative = debt)
+    long long stamp_ms;          ///< Last refill of the shared bucket
+    long long interactive_ms;    ///< Last chat frame
+    long long foreground_ms;     ///< Last foreground chunk
+} sched;
+
+/**
+ * @brief Bytes a bucket holds at most: SCHED_BURST_MS worth of its rate.
+ */
+static double bucket_depth(long long rate) {
+    double depth = (double)rate * SCHED_BURST_MS / 1000.0;
+    return depth < 1.0 ? 1.0 : depth;
+}
+
+static void bucket_refill(double* tokens, long long* stamp_ms, long long rate, long long now_ms) {
+    if (now_ms > *stamp_ms) {
+        *tokens += (double)(now_ms - *stamp_ms) * (double)rate / 1000.0;
+        double depth = bucket_depth(rate);
+        if (*tokens > depth) *tokens = depth;
+    }
+    *stamp_ms = now_ms;
+}
+
+/**
+ * @brief Milliseconds until a bucket holds at least level tokens.
+ */
+static long long bucket_wait(double tokens, double level, long long rate) {
+    if (tokens >= level) return 0;
+    return (long long)((level - tokens) * 1000.0 / (double)rate) + 1;
+}
+
+void sched_init(int max_transfers, long long transfer_rate, long long total_rate, long long background_size) {
+    mutex_init(&sched.lock);
+    sched.max_transfers = max_transfers > 0 ? max_transfers : 0;
+    sched.transfer_rate = transfer_rate > 0 ? transfer_rate : 0;
+    sched.total_rate = total_rate > 0 ? total_rate : 0;
+    sched.background_size = background_size > 0 ? background_size : 0;
+    sched.stamp_ms = monotonic_ms();
+    sched.tokens = sched.total_rate ? bucket_depth(sched.total_rate) : 0;
+    sched.enabled = sched.max_transfers || sched.transfer_rate || sched.total_rate || sched.background_size;
+}
+
+int sched_enabled(void) {
+    return sched.enabled;
+}
+
+SchedClass sched_class_of(long long bytes) {
+    return sched.background_size && bytes >= sched.background_size ? SCHED_BACKGROUND : SCHED_FOREGROUND;
+}
+
+static void queue_remove(SchedFlow* flow) {
+    if (flow->prev) flow->prev->next = flow->next;
+    else sched.head[flow->cls] = flow->next;
+    if (flow->next) flow->next->prev = flow->prev;
+    else sched.tail[flow->cls] = flow->prev;
+    flow->prev = flow->next = NULL;
+}
+
+int sched_admit(SchedFlow* flow, SchedClass cls, long long now_ms) {
+    if (!sched.enabled || flow->state == FLOW_ACTIVE) return 1;
+
+    mutex_lock(&sched.lock);
+    if (flow->state == FLOW_IDLE) {
+        flow->cls = cls;
+        flow->next = NULL;
+        flow->prev = sched.tail[cls];
+        if (sched.tail[cls]) sched.tail[cls]->next = flow;
+        else sched.head[cls] = flow;
+        sched.tail[cls] = flow;
+        flow->state = FLOW_QUEUED;
+        sched.queued++;
+    }
+
+    // Oldest of its class; the background class goes only when no foreground transfer waits
+    int turn = sched.head[flow->cls] == flow && (flow->cls == SCHED_FOREGROUND || !sched.head[SCHED_FOREGROUND]);
+    int admitted = turn && (!sched.max_transfers || sched.active < sched.max_transfers);
+    if (admitted) {
+        queue_remove(flow);
+        flow->state = FLOW_ACTIVE;
+        sched.queued--;
+        sched.active++;
+        flow->tokens = sched.transfer_rate ? bucket_depth(sched.transfer_rate) : 0;
+        flow->stamp_ms = now_ms;
+    }
+    mutex_unlock(&sched.lock);
+    return admitted;
+}
+
+long long sched_grant(SchedFlow* flow, size_t bytes, long long now_ms) {
+    if (!sched.enabled) return 0;
+
+    long long wait = 0;
+    if (sched.transfer_rate) {
+        bucket_refill(&flow->tokens, &flow->stamp_ms, sched.transfer_rate, now_ms);
+        wait = bucket_wait(flow->tokens, 0, sched.transfer_rate);
+    }
+
+    mutex_lock(&sched.lock);
+    double floor = 0;
+    if (sched.total_rate) {
+        bucket_refill(&sched.tokens, &sched.stamp_ms, sched.total_rate, now_ms);
+        // Background traffic keeps half the bucket for the foreground to draw on
+        if (flow->cls == SCHED_BACKGROUND) floor = bucket_depth(sched.total_rate) / 2;
+        long long shared = bucket_wait(sched.tokens, floor, sched.total_rate);
+        if (shared > wait) wait = shared;
+    }
+    if (flow->cls == SCHED_BACKGROUND) {
+        // Uncapped link: idle means no chat and no foreground chunk for a while
+        long long busy = sched.interactive_ms;
+        if (!sched.total_rate && sched.foreground_ms > busy) busy = sched.foreground_ms;
+        long long quiet = busy ? busy + SCHED_IDLE_MS - now_ms : 0;
+        if (quiet > wait) wait = quiet;
+    }
+    if (wait == 0) {
+        if (sched.total_rate) sched.tokens -= (double)bytes;
+        if (flow->cls == SCHED_FOREGROUND) sched.foreground_ms = now_ms;
+    }
+    mutex_unlock(&sched.lock);
+
+    if (wait == 0 && sched.transfer_rate) flow->tokens -= (double)bytes;
+    return wait;
+}
+
+void sched_charge(SchedFlow* flow, size_t bytes, long long now_ms) {
+    if (!sched.enabled) return;
+    if (sched.transfer_rate) {
+        bucket_refill(&flow->tokens, &flow->stamp_ms, sched.transfer_rate, now_ms);
+        flow->tokens -= (double)bytes;
+    }
+    if (!sched.total_rate) return;
+    mutex_lock(&sched.lock);
+    bucket_refill(&sched.tokens, &sched.stamp_ms, sched.total_rate, now_ms);
+    sched.tokens -= (double)bytes;
+    mutex_unlock(&sched.lock);
+}
+
+void sched_release(SchedFlow* flow) {
+    if (!sched.enabled || flow->state == FLOW_IDLE) return;
+    mutex_lock(&sched.lock);
+    if (flow->state == FLOW_ACTIVE) {
+        sched.active--;
+    } else {
+        queue_remove(flow);
+        sched.queued--;
+    }
+    flow->state = FLOW_IDLE;
+    mutex_unlock(&sched.lock);
+}
+
+void sched_note_interactive(long long now_ms) {
+    if (!sched.enabled) return;
+    mutex_lock(&sched.lock);
+    sched.interactive_ms = now_ms;
+    mutex_unlock(&sched.lock);
+}
+
+void sched_counts(int* active, int* queued) {
+    if (!sched.enabled) {
+        *active = *queued = 0;
+        return;
+    }
+    mutex_lock(&sched.lock);
+    *active = sched.active;
+    *queued = sched.queued;
+    mutex_unlock(&sched.lock);
+}
@@ -0,0 +1,168 @@
+/**
+ * @file frame_v2.c
+ * @brief Encodes and decodes binary protocol v2 frames.
+ *        A fixed 28-byte big-endian header replaces the text fields, so a frame is
+ *        built and parsed with a handful of loads and stores instead of
+ *        snprintf/strtok/atoi, and its payload may contain '|' or NUL bytes.
+ *        Decoding yields a FrameView whose payload points into the frame.
+ *        Negotiated LZ4 compression is applied per frame: chat payloads use a
+ *        built-in dictionary of common words, everything else a plain block.
+ * @author Oussama Amara
+ * @version 1.2
+ * @date 2026-10-17
+ */
+
+#include "protocol.h"
+#include "crc.h"
+#include "logger.h"
+#include "lz4.h"
+#include "framing.h"
+#include "platform_thread.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Dictionary both peers prime chat compression with. Changing it breaks
+ *        compatibility with peers built with the old one.
+ */
+static const char chat_dictionary[] =
+    " I you the and to a is it that of in what have for not be this are with your my on me "
+    "just do we can so but was know like all about get if he they will at how there would "
+    "one when out think from now good going really want right here yes okay thanks thank you "
+    "please sorry hello hey hi see you later tomorrow today tonight meeting time where are you "
+    "what's up how are you doing I'm don't can't it's that's let me know sounds good no problem "
+    "the file send sending sent received message game play ready wait done ";
+
+static THREAD_LOCAL unsigned char* inflated;  ///< Decompressed payload of the last frame
+static THREAD_LOCAL size_t inflated_cap;
+
+static void put_u16(unsigned char* p, uint16_t v) {
+    p[0] = (unsigned char)(v >> 8);
+    p[1] = (unsigned char)v;
+}
+
+static void put_u32(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static uint16_t get_u16(const unsigned char* p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t get_u32(const unsigned char* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+/**
+ * @brief Checksum stored at offset 24: CRC32C over the rest of the header and the
+ *        payload when FRAME_FLAG_CRC32C is set, the legacy payload checksum otherwise.
+ */
+static uint32_t frame_v2_checksum(const unsigned char* header, const void* payload,
+                                  size_t payload_len, uint16_t flags) {
+    if (flags & FRAME_FLAG_CRC32C)
+        return crc32c(crc32c(0, header, FRAME_V2_HEADER_SIZE - 4), payload, payload_len);
+    return checksum32(payload, payload_len);
+}
+
+size_t encode_frame_v2(FrameHeaderV2* hdr, const void* payload, size_t payload_len, unsigned char* out) {
+    hdr->payload_len = (uint32_t)payload_len;
+
+    out[0] = FRAME_V2_MAGIC;
+    out[1] = FRAME_V2_VERSION;
+    out[2] = hdr->channel;
+    out[3] = hdr->status;
+    put_u32(out + 4, (uint32_t)hdr->src_id);
+    put_u32(out + 8, (uint32_t)hdr->dest_id);
+    put_u32(out + 12, (uint32_t)hdr->seq);
+    put_u16(out + 16, hdr->flags);
+    put_u16(out + 18, 0);
+    put_u32(out + 20, hdr->payload_len);
+    if (payload_len && payload != out + FRAME_V2_HEADER_SIZE) memcpy(out + FRAME_V2_HEADER_SIZE, payload, payload_len);
+
+    hdr->checksum = frame_v2_checksum(out, payload, payload_len, hdr->flags);
+    put_u32(out + 24, hdr->checksum);
+
+    return FRAME_V2_HEADER_SIZE + payload_len;
+}
+
+int decode_frame_v2_view(const unsigned char* frame, size_t len, FrameView* view) {
+    if (!frame || !view || len < FRAME_V2_HEADER_SIZE) return -1;
+    if (frame[0] != FRAME_V2_MAGIC || frame[1] != FRAME_V2_VERSION) return -1;
+
+    uint32_t payload_len = get_u32(frame + 20);
+    if (payload_len != len - FRAME_V2_HEADER_SIZE) return -1;
+    uint16_t flags = get_u16(frame + 16);
+    if (frame_v2_checksum(frame, frame + FRAME_V2_HEADER_SIZE, payload_len, flags) != get_u32(frame + 24))
+        return -1;
+
+    view->base = (const char*)frame;
+    view->binary = 1;
+    view->channel = frame[2] < CH_COUNT ? frame[2] : CH_UNKNOWN;
+    view->status = frame[3] < ST_COUNT ? frame[3] : ST_UNKNOWN;
+    view->src_id = (int32_t)get_u32(frame + 4);
+    view->dest_id = (int32_t)get_u32(frame + 8);
+    view->seq_num = (int32_t)get_u32(frame + 12);
+    view->is_final = (flags & FRAME_FLAG_FINAL) != 0;
+    view->crc.off = view->crc.len = 0;  // Integrity already verified from the header
+    view->payload.off = FRAME_V2_HEADER_SIZE;
+    view->payload.len = payload_len;
+
+    if (flags & FRAME_FLAG_LZ4) {
+        // Original length, then the block; the view moves to the inflated copy
+        if (payload_len < 4) return -1;
+        const unsigned char* block = frame + FRAME_V2_HEADER_SIZE;
+        uint32_t original = get_u32(block);
+        if (original > FRAME_MAX_SIZE) return -1;
+        if (original > inflated_cap) {
+            unsigned char* grown = realloc(inflated, original);
+            if (!grown) return -1;
+            inflated = grown;
+            inflated_cap = original;
+        }
+        long n = (flags & FRAME_FLAG_DICT)
+                     ? lz4_decompress_dict(chat_dictionary, sizeof(chat_dictionary) - 1, block + 4, payload_len - 4, inflated, original)
+                     : lz4_decompress(block + 4, payload_len - 4, inflated, original);
+        if (n != (long)original) return -1;
+        view->base = (const char*)inflated;
+        view->payload.off = 0;
+        view->payload.len = original;
+    }
+    return 0;
+}
+
+size_t frame_v2_compress(int channel, const void* payload, size_t len, unsigned char* out, uint16_t* flags) {
+    int chat = channel == CH_CHAT;
+    if (len < (chat ? FRAME_COMPRESS_MIN_CHAT : FRAME_COMPRESS_MIN)) return 0;
+
+    // Must beat the payload by at least one byte, counting the length prefix
+    size_t n = chat ? lz4_compress_dict(chat_dictionary, sizeof(chat_dictionary) - 1, payload, len, out + 4, len - 5)
+                    : lz4_compress(payload, len, out + 4, len - 5);
+    if (n == 0) return 0;
+
+    put_u32(out, (uint32_t)len);
+    *flags |= FRAME_FLAG_LZ4 | (chat ? FRAME_FLAG_DICT : 0);
+    return n + 4;
+}
+
+void frame_v2_release(void) {
+    free(inflated);
+    inflated = NULL;
+    inflated_cap = 0;
+}
+
+int decode_frame_v2(const unsigned char* frame, size_t len, ParsedCommand* cmd) {
+    if (!cmd) return -1;
+
+    FrameView view;
+    if (decode_frame_v2_view(frame, len, &view) != 0) return -1;
+    if (view.payload.len >= sizeof(cmd->message)) {
+        log_message(LOG_WARN, "Binary payload of %u bytes exceeds message limit.", view.payload.len);
+        return -1;
+    }
+    frame_view_to_command(&view, cmd);
+    return 0;
+}
@@ -0,0 +1,933 @@
+/**
+ * @file framing.c
+ * @brief Length-prefixed stream framing and per-connection receive buffers.
+ *        Wire format: <LEN:4 bytes, big-endian><BODY:LEN bytes>.
+ *        A single read can yield many frames; partial frames stay buffered
+ *        until the rest arrives. Binary v2 frames are self-delimiting and are
+ *        sent as-is; the per-socket wire table decides which format to emit.
+ *        Reactor-owned sockets send through an outbound queue of coalesced blocks
+ *        drained with writev(); everything else is written synchronously.
+ *        Raw data phases are queue blocks too: the file body is read a slice at a
+ *        time, hashed for its end-to-end digest while the slice is in cache, and
+ *        sent from it until the socket would block, resuming from the saved offset.
+ *        Binary payloads are LZ4-compressed on sockets that negotiated it.
+ * @author Oussama Amara
+ * @version 1.7
+ * @date 2026-10-17
+ */
+
+#include "framing.h"
+#include "protocol.h"
+#include "logger.h"
+#include "platform_thread.h"
+#include "platform.h"
+#include "crc.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <io.h>
+#else
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief How long send_frame() waits for a full socket buffer to drain.
+ */
+#define SEND_STALL_TIMEOUT_MS 5000
+
+/**
+ * @brief Bytes of a raw data phase read, hashed and sent at a time; a whole
+ *        number of FILE_DIGEST_CHUNKs, so each slice starts a digest chunk.
+ */
+#define RAW_SLICE_SIZE (4 * FILE_DIGEST_CHUNK)
+
+int recvbuf_init(RecvBuffer* rb, size_t capacity) {
+    rb->data = malloc(capacity);
+    rb->capacity = rb->data ? capacity : 0;
+    rb->head = 0;
+    rb->tail = 0;
+    return rb->data ? 0 : -1;
+}
+
+void recvbuf_free(RecvBuffer* rb) {
+    free(rb->data);
+    rb->data = NULL;
+    rb->capacity = rb->head = rb->tail = 0;
+}
+
+/**
+ * @brief Makes room for at least `need` more bytes after tail.
+ *        Moves the unread remainder to the front first, then grows if still short.
+ */
+static int recvbuf_reserve(RecvBuffer* rb, size_t need) {
+    if (rb->capacity - rb->tail >= need) return 0;
+
+    if (rb->head > 0) {
+        size_t unread = rb->tail - rb->head;
+        memmove(rb->data, rb->data + rb->head, unread);
+        rb->head = 0;
+        rb->tail = unread;
+        if (rb->capacity - rb->tail >= need) return 0;
+    }
+
+    size_t wanted = rb->tail + need;
+    if (wanted > FRAME_MAX_SIZE + FRAME_PREFIX_SIZE) return -1;
+    size_t cap = rb->capacity ? rb->capacity : RECVBUF_INITIAL_SIZE;
+    while (cap < wanted) cap *= 2;
+    if (cap > FRAME_MAX_SIZE + FRAME_PREFIX_SIZE) cap = FRAME_MAX_SIZE + FRAME_PREFIX_SIZE;
+
+    char* grown = realloc(rb->data, cap);
+    if (!grown) return -1;
+    rb->data = grown;
+    rb->capacity = cap;
+    return 0;
+}
+
+int recvbuf_fill(RecvBuffer* rb, int fd) {
+    if (recvbuf_reserve(rb, 1) != 0) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    while (1) {
+        int received = recv(fd, rb->data + rb->tail, (int)(rb->capacity - rb->tail), 0);
+        if (received > 0) rb->tail += received;
+        if (received < 0 && errno == EINTR) continue;
+        return received;
+    }
+}
+
+/**
+ * @brief Extracts a binary v2 frame; the whole frame (header included) is returned.
+ */
+static int recvbuf_next_binary(RecvBuffer* rb, const char** frame, size_t* len) {
+    size_t available = rb->tail - rb->head;
+    if (available < FRAME_V2_HEADER_SIZE) {
+        if (recvbuf_reserve(rb, FRAME_V2_HEADER_SIZE - available) != 0) return -1;
+        return 0;
+    }
+
+    const unsigned char* p = (const unsigned char*)rb->data + rb->head;
+    size_t total = FRAME_V2_HEADER_SIZE +
+                   (((size_t)p[20] << 24) | ((size_t)p[21] << 16) | ((size_t)p[22] << 8) | (size_t)p[23]);
+    if (total > FRAME_MAX_SIZE) {
+        log_message(LOG_WARN, "Binary frame of %zu bytes exceeds limit of %d.", total, FRAME_MAX_SIZE);
+        return -1;
+    }
+
+    if (available < total) {
+        if (recvbuf_reserve(rb, total - available) != 0) return -1;
+        return 0;
+    }
+
+    *frame = rb->data + rb->head;
+    *len = total;
+    rb->head += total;
+    if (rb->head == rb->tail) rb->head = rb->tail = 0;
+    return 1;
+}
+
+int recvbuf_next_frame(RecvBuffer* rb, const char** frame, size_t* len) {
+    size_t available = rb->tail - rb->head;
+    if (available == 0) return 0;
+
+    const unsigned char* p = (const unsigned char*)rb->data + rb->head;
+    if (p[0] == FRAME_V2_MAGIC) return recvbuf_next_binary(rb, frame, len);
+    if (available < FRAME_PREFIX_SIZE) return 0;
+
+    size_t body = ((size_t)p[0] << 24) | ((size_t)p[1] << 16) | ((size_t)p[2] << 8) | (size_t)p[3];
+    if (body > FRAME_MAX_SIZE) {
+        log_message(LOG_WARN, "Frame of %zu bytes exceeds limit of %d.", body, FRAME_MAX_SIZE);
+        return -1;
+    }
+
+    if (available < FRAME_PREFIX_SIZE + body) {
+        // Make sure the rest of this frame will fit on the next fill
+        if (recvbuf_reserve(rb, FRAME_PREFIX_SIZE + body - available) != 0) return -1;
+        return 0;
+    }
+
+    *frame = rb->data + rb->head + FRAME_PREFIX_SIZE;
+    *len = body;
+    rb->head += FRAME_PREFIX_SIZE + body;
+    if (rb->head == rb->tail) rb->head = rb->tail = 0;
+    return 1;
+}
+
+size_t recvbuf_take(RecvBuffer* rb, size_t max, const char** data) {
+    size_t n = rb->tail - rb->head;
+    if (n > max) n = max;
+    *data = rb->data + rb->head;
+    rb->head += n;
+    if (rb->head == rb->tail) rb->head = rb->tail = 0;
+    return n;
+}
+
+/**
+ * @brief Blocks until the socket is writable or the timeout expires.
+ * @return 1 if writable, 0 otherwise.
+ */
+static int wait_writable(int fd, int timeout_ms) {
+#ifdef _WIN32
+    fd_set wfds;
+    FD_ZERO(&wfds);
+    FD_SET(fd, &wfds);
+    struct timeval tv = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+    return select(fd + 1, NULL, &wfds, NULL, &tv) > 0;
+#else
+    struct pollfd pfd = { .fd = fd, .events = POLLOUT, .revents = 0 };
+    return poll(&pfd, 1, timeout_ms) > 0 && (pfd.revents & POLLOUT);
+#endif
+}
+
+/**
+ * @brief Shuts down a socket whose stream cannot continue; its reactor reaps it.
+ */
+static void shutdown_socket(int fd) {
+#ifdef _WIN32
+    shutdown(fd, SD_BOTH);
+#else
+    shutdown(fd, SHUT_RDWR);
+#endif
+}
+
+/**
+ * @brief Shuts down a socket whose peer stopped reading.
+ */
+static void drop_stalled_peer(int fd) {
+    log_message(LOG_WARN, "Peer on socket %d stopped reading; dropping connection.", fd);
+    shutdown_socket(fd);
+}
+
+/**
+ * @brief Sends the whole buffer, waiting out EAGAIN on non-blocking sockets.
+ */
+static int send_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        int sent = send(fd, data, (int)len, 0);
+        if (sent > 0) {
+            data += sent;
+            len -= sent;
+            continue;
+        }
+#ifdef _WIN32
+        if (sent < 0 && WSAGetLastError() == WSAEWOULDBLOCK) {
+#else
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+#endif
+            if (wait_writable(fd, SEND_STALL_TIMEOUT_MS)) continue;
+            drop_stalled_peer(fd);
+        }
+        return -1;
+    }
+    return 0;
+}
+
+// ─────────────────────────────────────────────────────────────
+// Outbound queues
+// ─────────────────────────────────────────────────────────────
+
+#define OUTQ_BLOCK_SIZE 16384  ///< Small frames are coalesced into blocks of this size
+#define OUTQ_IOV_MAX 64        ///< Blocks handed to one writev()
+#define OUTQ_DIRTY_MAX 64      ///< Sockets remembered per cork section
+
+/**
+ * @brief Encoded frame referenced by several queues; freed with its last reference.
+ */
+struct SharedFrame {
+    int refs;
+    size_t len;
+    char data[];
+};
+
+/**
+ * @brief File body of a raw data phase; [pos, end) of the file is still unsent.
+ */
+typedef struct {
+    int fd;
+    long long start;
+    long long pos;
+    long long end;
+    long long hashed;  ///< Bytes before this are read and in digest
+    uint64_t digest;   ///< Sum of the FILE_DIGEST_CHUNK digests so far
+    unsigned char* slice;  ///< Bytes [hashed - slice_len, hashed) of the file
+    size_t slice_len;
+    FileSentFn done;
+    void* arg;
+} OutFile;
+
+/**
+ * @brief One contiguous run of queued bytes; [off, len) of bytes is still unsent.
+ *        bytes is the block's own data, or part of a SharedFrame it references.
+ *        A file block carries no bytes; it stands for the file range it names.
+ */
+typedef struct OutBlock {
+    struct OutBlock* next;
+    SharedFrame* shared;  ///< Referenced frame (NULL = bytes are data)
+    OutFile* file;        ///< Raw data phase (NULL = bytes)
+    char* bytes;
+    size_t off;
+    size_t len;
+    size_t cap;
+    char data[];
+} OutBlock;
+
+/**
+ * @brief Outbound queue of one socket. Producers on any thread append under
+ *        the lock; pending is also readable without it.
+ */
+typedef struct {
+    mutex_t lock;
+    int active;       ///< Set between frame_queue_open() and frame_queue_close()
+    OutBlock* head;
+    OutBlock* tail;
+    size_t pending;   ///< Unsent bytes across all byte blocks
+    long long file_left;  ///< Unsent bytes of queued file bodies (not in pending)
+} OutQueue;
+
+/**
+ * @brief Queues live in fd-indexed pages like the wire table. Pages are never
+ *        freed, so a producer racing with a close still locks valid memory.
+ */
+#define OUTQ_PAGE_BITS 10
+#define OUTQ_PAGE_SIZE (1 << OUTQ_PAGE_BITS)
+#define OUTQ_PAGE_COUNT 4096
+
+static OutQueue* outq_pages[OUTQ_PAGE_COUNT];
+
+static THREAD_LOCAL int cork_depth;
+static THREAD_LOCAL int dirty_fds[OUTQ_DIRTY_MAX];
+static THREAD_LOCAL int dirty_count;
+
+/**
+ * @brief Returns the queue slot for fd, creating its page if `create` is set.
+ */
+static OutQueue* outq_slot(int fd, int create) {
+    if (fd < 0 || (fd >> OUTQ_PAGE_BITS) >= OUTQ_PAGE_COUNT) return NULL;
+    OutQueue** slot = &outq_pages[fd >> OUTQ_PAGE_BITS];
+
+    OutQueue* page = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (!page) {
+        if (!create) return NULL;
+        OutQueue* fresh = calloc(OUTQ_PAGE_SIZE, sizeof(OutQueue));
+        if (!fresh) return NULL;
+        for (int i = 0; i < OUTQ_PAGE_SIZE; ++i) mutex_init(&fresh[i].lock);
+        if (__atomic_compare_exchange_n(slot, &page, fresh, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            page = fresh;
+        } else {
+            for (int i = 0; i < OUTQ_PAGE_SIZE; ++i) mutex_destroy(&fresh[i].lock);
+            free(fresh);
+        }
+    }
+    return &page[fd & (OUTQ_PAGE_SIZE - 1)];
+}
+
+/**
+ * @brief Appends bytes to the queue, filling the tail block before adding one.
+ *        Bytes of a shared frame (data points into it) are referenced, not copied.
+ */
+static int outq_append(OutQueue* q, const char* data, size_t len, SharedFrame* shared) {
+    OutBlock* tail = q->tail;
+    if (!shared && tail && !tail->shared && !tail->file && tail->cap - tail->len >= len) {
+        memcpy(tail->data + tail->len, data, len);
+        tail->len += len;
+    } else {
+        size_t cap = shared ? 0 : (len > OUTQ_BLOCK_SIZE ? len : OUTQ_BLOCK_SIZE);
+        OutBlock* b = malloc(sizeof(*b) + cap);
+        if (!b) return -1;
+        b->next = NULL;
+        b->shared = shared;
+        b->file = NULL;
+        b->off = 0;
+        b->len = len;
+        b->cap = cap;
+        if (shared) {
+            frame_share_retain(shared);
+            b->bytes = (char*)data;
+        } else {
+            b->bytes = b->data;
+            memcpy(b->data, data, len);
+        }
+        if (tail) tail->next = b;
+        else q->head = b;
+        q->tail = b;
+    }
+    __atomic_store_n(&q->pending, q->pending + len, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static void outb_free(OutBlock* b) {
+    if (b->shared) frame_share_release(b->shared);
+    if (b->file) free(b->file->slice);
+    free(b->file);
+    free(b);
+}
+
+/**
+ * @brief Ends the file block at the head of the queue (caller holds q->lock).
+ *        Its callback may hand back a trailing frame, which takes the block's
+ *        place so it goes out right after the last file byte.
+ */
+static void outq_end_file(OutQueue* q, int ok) {
+    OutBlock* b = q->head;
+    OutFile* f = b->file;
+    __atomic_store_n(&q->file_left, q->file_left - (f->end - f->pos), __ATOMIC_RELAXED);
+
+    char trailer[MAX_COMMAND_LENGTH + FRAME_PREFIX_SIZE];
+    size_t len = f->done(f->arg, ok, f->digest, trailer, sizeof(trailer));
+    q->head = b->next;
+    if (!q->head) q->tail = NULL;
+    outb_free(b);
+    if (!ok || len == 0) return;
+
+    OutBlock* t = malloc(sizeof(*t) + len);
+    if (!t) return;
+    t->shared = NULL;
+    t->file = NULL;
+    t->bytes = t->data;
+    t->off = 0;
+    t->len = t->cap = len;
+    memcpy(t->data, trailer, len);
+    t->next = q->head;
+    q->head = t;
+    if (!q->tail) q->tail = t;
+    __atomic_store_n(&q->pending, q->pending + len, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Releases `sent` bytes from the front of the queue.
+ */
+static void outq_consume(OutQueue* q, size_t sent) {
+    __atomic_store_n(&q->pending, q->pending - sent, __ATOMIC_RELAXED);
+    while (sent > 0) {
+        OutBlock* b = q->head;
+        size_t left = b->len - b->off;
+        if (sent < left) {
+            b->off += sent;
+            return;
+        }
+        sent -= left;
+        q->head = b->next;
+        if (!q->head) q->tail = NULL;
+        outb_free(b);
+    }
+}
+
+static void outq_clear(OutQueue* q) {
+    while (q->head) {
+        if (q->head->file) {
+            outq_end_file(q, 0);
+            continue;
+        }
+        OutBlock* b = q->head;
+        q->head = b->next;
+        outb_free(b);
+    }
+    q->tail = NULL;
+    __atomic_store_n(&q->pending, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&q->file_left, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Reads len bytes at offset without moving a shared file position.
+ */
+static int read_at(int fd, void* out, size_t len, long long offset) {
+    char* p = out;
+    while (len > 0) {
+#ifdef _WIN32
+        int got = _lseeki64(fd, offset, SEEK_SET) < 0 ? -1 : _read(fd, p, (unsigned)len);
+#else
+        ssize_t got = pread(fd, p, len, (off_t)offset);
+        if (got < 0 && errno == EINTR) continue;
+#endif
+        if (got <= 0) return -1;
+        p += got;
+        len -= (size_t)got;
+        offset += got;
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads the next slice of the body and adds it to the digest while it is
+ *        in cache. The slice is then sent from the same buffer, so every byte
+ *        of the file is read once.
+ * @return 0 on success, -1 if the file could not be read (or shrank).
+ */
+static int outfile_read(OutFile* f) {
+    if (!f->slice && !(f->slice = malloc(RAW_SLICE_SIZE))) return -1;
+    long long left = f->end - f->hashed;
+    size_t n = left > RAW_SLICE_SIZE ? RAW_SLICE_SIZE : (size_t)left;
+    if (read_at(f->fd, f->slice, n, f->hashed) != 0) return -1;
+    for (size_t off = 0; off < n; off += FILE_DIGEST_CHUNK) {
+        size_t piece = n - off < FILE_DIGEST_CHUNK ? n - off : FILE_DIGEST_CHUNK;
+        f->digest += xxh64(f->slice + off, piece, (uint64_t)((f->hashed + (long long)off - f->start) / FILE_DIGEST_CHUNK));
+    }
+    f->hashed += (long long)n;
+    f->slice_len = n;
+    return 0;
+}
+
+/**
+ * @brief Writes the file block at the head of the queue until the socket would
+ *        block, keeping its position for the next flush (caller holds q->lock).
+ * @return 1 once the body is written, 0 if the socket would block, -1 on error.
+ */
+static int outq_send_file(OutQueue* q, int fd) {
+    OutFile* f = q->head->file;
+    while (f->pos < f->end) {
+        if (f->pos == f->hashed && outfile_read(f) != 0) {
+            // The file shrank or failed to read: the receiver can never be told where the body ends
+            log_message(LOG_ERROR, "File ended %lld bytes short of the announced length; dropping socket %d.",
+                        f->end - f->pos, fd);
+            outq_end_file(q, 0);
+            shutdown_socket(fd);
+            return -1;
+        }
+        size_t want = (size_t)(f->hashed - f->pos);
+        const char* from = (const char*)f->slice + f->slice_len - want;
+#ifdef _WIN32
+        int sent = send(fd, from, (int)want, 0);
+        if (sent < 0) return WSAGetLastError() == WSAEWOULDBLOCK ? 0 : -1;
+#else
+        ssize_t sent = send(fd, from, want, 0);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+#endif
+        f->pos += sent;
+        __atomic_store_n(&q->file_left, q->file_left - sent, __ATOMIC_RELAXED);
+    }
+    outq_end_file(q, 1);
+    return 1;
+}
+
+/**
+ * @brief Writes queued blocks until the socket would block (caller holds q->lock).
+ * @return 0 if the socket is still usable, -1 on error.
+ */
+static int outq_drain(OutQueue* q, int fd) {
+    while (q->head) {
+        if (q->head->file) {
+            int rc = outq_send_file(q, fd);
+            if (rc <= 0) return rc;
+            continue;
+        }
+#ifdef _WIN32
+        OutBlock* b = q->head;
+        int sent = send(fd, b->bytes + b->off, (int)(b->len - b->off), 0);
+        if (sent < 0) return WSAGetLastError() == WSAEWOULDBLOCK ? 0 : -1;
+#else
+        struct iovec iov[OUTQ_IOV_MAX];
+        int n = 0;
+        for (OutBlock* b = q->head; b && !b->file && n < OUTQ_IOV_MAX; b = b->next, ++n) {
+            iov[n].iov_base = b->bytes + b->off;
+            iov[n].iov_len = b->len - b->off;
+        }
+        ssize_t sent = writev(fd, iov, n);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+#endif
+        outq_consume(q, (size_t)sent);
+    }
+    return 0;
+}
+
+/**
+ * @brief Remembers a socket to flush at frame_uncork().
+ * @return 0 if remembered, -1 if the list is full and the caller must flush now.
+ */
+static int cork_mark(int fd) {
+    for (int i = 0; i < dirty_count; ++i)
+        if (dirty_fds[i] == fd) return 0;
+    if (dirty_count == OUTQ_DIRTY_MAX) return -1;
+    dirty_fds[dirty_count++] = fd;
+    return 0;
+}
+
+/**
+ * @brief Hands an encoded frame to the socket: through its queue if it has one,
+ *        synchronously otherwise. A shared frame that cannot be written at once
+ *        is queued by reference.
+ */
+static int transmit(int fd, const char* data, size_t len, SharedFrame* shared) {
+    OutQueue* q = outq_slot(fd, 0);
+    if (!q) return send_all(fd, data, len);
+
+    mutex_lock(&q->lock);
+    if (!q->active) {
+        mutex_unlock(&q->lock);
+        return send_all(fd, data, len);
+    }
+
+    int rc = 0;
+    if (!q->head && cork_depth == 0) {
+        // Idle socket: try the kernel directly and queue only what it refuses
+        while (len > 0) {
+            int sent = send(fd, data, (int)len, 0);
+            if (sent > 0) {
+                data += sent;
+                len -= sent;
+                continue;
+            }
+#ifdef _WIN32
+            if (sent < 0 && WSAGetLastError() != WSAEWOULDBLOCK) rc = -1;
+#else
+            if (sent < 0 && errno == EINTR) continue;
+            if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) rc = -1;
+#endif
+            break;
+        }
+        if (rc == 0 && len > 0) rc = outq_append(q, data, len, shared);
+    } else {
+        rc = outq_append(q, data, len, shared);
+        if (rc == 0 && (cork_depth == 0 || cork_mark(fd) != 0)) rc = outq_drain(q, fd);
+    }
+
+    if (rc == 0 && q->pending > OUTQ_HARD_LIMIT) {
+        log_message(LOG_WARN, "Socket %d has %zu bytes queued (limit %d).", fd, q->pending, OUTQ_HARD_LIMIT);
+        outq_clear(q);
+        drop_stalled_peer(fd);
+        rc = -1;
+    }
+    mutex_unlock(&q->lock);
+    return rc;
+}
+
+int frame_queue_open(int fd) {
+    OutQueue* q = outq_slot(fd, 1);
+    if (!q) return -1;
+    mutex_lock(&q->lock);
+    outq_clear(q);
+    q->active = 1;
+    mutex_unlock(&q->lock);
+    return 0;
+}
+
+void frame_queue_close(int fd) {
+    OutQueue* q = outq_slot(fd, 0);
+    if (!q) return;
+    mutex_lock(&q->lock);
+    outq_clear(q);
+    q->active = 0;
+    mutex_unlock(&q->lock);
+}
+
+long frame_flush(int fd) {
+    OutQueue* q = outq_slot(fd, 0);
+    if (!q) return 0;
+    mutex_lock(&q->lock);
+    long rc = 0;
+    if (q->active) rc = outq_drain(q, fd) == 0 ? (long)q->pending + (long)q->file_left : -1;
+    mutex_unlock(&q->lock);
+    return rc;
+}
+
+size_t frame_pending(int fd) {
+    OutQueue* q = outq_slot(fd, 0);
+    if (!q) return 0;
+    return __atomic_load_n(&q->pending, __ATOMIC_RELAXED) + (size_t)__atomic_load_n(&q->file_left, __ATOMIC_RELAXED);
+}
+
+int frame_wait_drain(int fd) {
+    if (frame_pending(fd) <= OUTQ_HIGH_WATERMARK) return 0;
+
+    while (1) {
+        long left = frame_flush(fd);
+        if (left < 0) return -1;
+        if (left <= OUTQ_LOW_WATERMARK) return 0;
+        if (!wait_writable(fd, SEND_STALL_TIMEOUT_MS)) {
+            frame_queue_close(fd);
+            drop_stalled_peer(fd);
+            return -1;
+        }
+    }
+}
+
+void frame_cork(void) {
+    cork_depth++;
+}
+
+void frame_uncork(void) {
+    if (cork_depth == 0 || --cork_depth > 0) return;
+    for (int i = 0; i < dirty_count; ++i) frame_flush(dirty_fds[i]);
+    dirty_count = 0;
+}
+
+/**
+ * @brief Writes a file body to a socket that has no queue, a slice at a time,
+ *        waiting out EAGAIN like send_all().
+ * @return 0 on success, -1 on failure.
+ */
+static int send_file_sync(int fd, OutFile* f) {
+    while (f->pos < f->end) {
+        if (outfile_read(f) != 0) {
+            log_message(LOG_ERROR, "File ended %lld bytes short of the announced length.", f->end - f->pos);
+            return -1;
+        }
+        if (send_all(fd, (const char*)f->slice, f->slice_len) != 0) return -1;
+        f->pos = f->hashed;
+    }
+    return 0;
+}
+
+int frame_queue_file(int fd, int file_fd, long long offset, long long len, FileSentFn done, void* arg) {
+    OutQueue* q = outq_slot(fd, 0);
+    if (q) {
+        mutex_lock(&q->lock);
+        if (q->active) {
+            OutBlock* b = malloc(sizeof(*b));
+            OutFile* f = malloc(sizeof(*f));
+            if (!b || !f) {
+                mutex_unlock(&q->lock);
+                free(b);
+                free(f);
+                done(arg, 0, 0, NULL, 0);
+                return -1;
+            }
+            *f = (OutFile){ .fd = file_fd, .start = offset, .pos = offset, .end = offset + len, .hashed = offset,
+                            .done = done, .arg = arg };
+            *b = (OutBlock){ .next = NULL, .shared = NULL, .file = f, .bytes = NULL };
+            if (q->tail) q->tail->next = b;
+            else q->head = b;
+            q->tail = b;
+            __atomic_store_n(&q->file_left, q->file_left + len, __ATOMIC_RELAXED);
+
+            int rc = 0;
+            if (cork_depth == 0 || cork_mark(fd) != 0) rc = outq_drain(q, fd);
+            mutex_unlock(&q->lock);
+            return rc;
+        }
+        mutex_unlock(&q->lock);
+    }
+
+    char trailer[MAX_COMMAND_LENGTH + FRAME_PREFIX_SIZE];
+    OutFile f = { .fd = file_fd, .start = offset, .pos = offset, .end = offset + len, .hashed = offset };
+    int ok = send_file_sync(fd, &f) == 0;
+    free(f.slice);
+    size_t n = done(arg, ok, f.digest, trailer, sizeof(trailer));
+    if (!ok) return -1;
+    return n > 0 ? send_all(fd, trailer, n) : 0;
+}
+
+int send_frame(int fd, const char* frame, size_t len) {
+    if (len > FRAME_MAX_SIZE) {
+        log_message(LOG_ERROR, "Refusing to send %zu-byte frame (limit %d).", len, FRAME_MAX_SIZE);
+        return -1;
+    }
+
+    char stack[FRAME_PREFIX_SIZE + 2048];
+    char* out = len + FRAME_PREFIX_SIZE <= sizeof(stack) ? stack : malloc(len + FRAME_PREFIX_SIZE);
+    if (!out) return -1;
+
+    out[0] = (char)((len >> 24) & 0xFF);
+    out[1] = (char)((len >> 16) & 0xFF);
+    out[2] = (char)((len >> 8) & 0xFF);
+    out[3] = (char)(len & 0xFF);
+    memcpy(out + FRAME_PREFIX_SIZE, frame, len);
+
+    int rc = transmit(fd, out, len + FRAME_PREFIX_SIZE, NULL);
+    if (out != stack) free(out);
+    return rc;
+}
+
+// ─────────────────────────────────────────────────────────────
+// Per-socket wire options
+// ─────────────────────────────────────────────────────────────
+
+/**
+ * @brief Two-level table indexed by fd. Pages are allocated on first write and
+ *        never freed, so readers need no lock: they load the page pointer and the
+ *        flag byte atomically.
+ */
+#define WIRE_PAGE_BITS 12
+#define WIRE_PAGE_SIZE (1 << WIRE_PAGE_BITS)
+#define WIRE_PAGE_COUNT 1024
+
+static unsigned char* wire_pages[WIRE_PAGE_COUNT];
+
+void frame_set_wire(int fd, unsigned flags) {
+    if (fd < 0 || (fd >> WIRE_PAGE_BITS) >= WIRE_PAGE_COUNT) return;
+    unsigned char** slot = &wire_pages[fd >> WIRE_PAGE_BITS];
+
+    unsigned char* page = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (!page) {
+        if (!flags) return;
+        unsigned char* fresh = calloc(WIRE_PAGE_SIZE, 1);
+        if (!fresh) return;
+        if (__atomic_compare_exchange_n(slot, &page, fresh, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            page = fresh;
+        } else {
+            free(fresh);
+        }
+    }
+    __atomic_store_n(&page[fd & (WIRE_PAGE_SIZE - 1)], (unsigned char)flags, __ATOMIC_RELEASE);
+}
+
+unsigned frame_wire(int fd) {
+    if (fd < 0 || (fd >> WIRE_PAGE_BITS) >= WIRE_PAGE_COUNT) return 0;
+    unsigned char* page = __atomic_load_n(&wire_pages[fd >> WIRE_PAGE_BITS], __ATOMIC_ACQUIRE);
+    return page ? __atomic_load_n(&page[fd & (WIRE_PAGE_SIZE - 1)], __ATOMIC_ACQUIRE) : 0;
+}
+
+// ─────────────────────────────────────────────────────────────
+// Format-aware senders
+// ─────────────────────────────────────────────────────────────
+
+/**
+ * @brief Encodes one binary v2 frame into out (len + FRAME_V2_HEADER_SIZE bytes).
+ * @return Encoded size.
+ */
+static size_t encode_binary(unsigned wire, const char* channel, int src_id, int dest_id, const void* data,
+                            size_t len, const char* status, int seq, int is_final, unsigned char* out) {
+    FrameHeaderV2 hdr = {
+        .channel = (uint8_t)channel_code(channel),
+        .status = (uint8_t)status_code(status),
+        .flags = (is_final ? FRAME_FLAG_FINAL : 0) | ((wire & WIRE_CRC32C) ? FRAME_FLAG_CRC32C : 0),
+        .src_id = src_id,
+        .dest_id = dest_id,
+        .seq = seq,
+    };
+
+    // Compressed in place after the header; payloads that do not shrink go as they are
+    if (wire & WIRE_LZ4) {
+        size_t packed = frame_v2_compress(hdr.channel, data, len, out + FRAME_V2_HEADER_SIZE, &hdr.flags);
+        if (packed) {
+            data = out + FRAME_V2_HEADER_SIZE;
+            len = packed;
+        }
+    }
+    return encode_frame_v2(&hdr, data, len, out);
+}
+
+/**
+ * @brief Encodes and sends one binary v2 frame.
+ */
+static int send_binary(int fd, unsigned wire, const char* channel, int src_id, int dest_id,
+                       const void* data, size_t len, const char* status, int seq, int is_final) {
+    if (len > FRAME_MAX_SIZE - FRAME_V2_HEADER_SIZE) {
+        log_message(LOG_ERROR, "Refusing to send %zu-byte payload (limit %d).", len, FRAME_MAX_SIZE);
+        return -1;
+    }
+
+    unsigned char stack[FRAME_V2_HEADER_SIZE + 2048];
+    unsigned char* out = len + FRAME_V2_HEADER_SIZE <= sizeof(stack) ? stack : malloc(len + FRAME_V2_HEADER_SIZE);
+    if (!out) return -1;
+
+    size_t total = encode_binary(wire, channel, src_id, dest_id, data, len, status, seq, is_final, out);
+    int rc = transmit(fd, (const char*)out, total, NULL);
+    if (out != stack) free(out);
+    return rc;
+}
+
+int send_command(int fd, const char* channel, int src_id, int dest_id,
+                 const char* message, const char* status) {
+    unsigned wire = frame_wire(fd);
+    if (wire & WIRE_BINARY)
+        return send_binary(fd, wire, channel, src_id, dest_id, message, strlen(message), status, 0, 1);
+
+    char frame[MAX_COMMAND_LENGTH];
+    size_t len = build_frame_ex(channel, src_id, dest_id, message, status, -1, 1,
+                                (wire & WIRE_CRC32C) != 0, frame);
+    return send_frame(fd, frame, len);
+}
+
+size_t frame_encode_command(int fd, const char* channel, int src_id, int dest_id,
+                            const char* message, const char* status, char* out, size_t cap) {
+    unsigned wire = frame_wire(fd);
+    size_t len = strlen(message);
+    if (wire & WIRE_BINARY) {
+        if (len > MAX_MESSAGE_LENGTH || len + FRAME_V2_HEADER_SIZE > cap) return 0;
+        return encode_binary(wire, channel, src_id, dest_id, message, len, status, 0, 1, (unsigned char*)out);
+    }
+
+    char frame[MAX_COMMAND_LENGTH];
+    size_t body = build_frame_ex(channel, src_id, dest_id, message, status, -1, 1, (wire & WIRE_CRC32C) != 0, frame);
+    if (body + FRAME_PREFIX_SIZE > cap) return 0;
+    out[0] = (char)((body >> 24) & 0xFF);
+    out[1] = (char)((body >> 16) & 0xFF);
+    out[2] = (char)((body >> 8) & 0xFF);
+    out[3] = (char)(body & 0xFF);
+    memcpy(out + FRAME_PREFIX_SIZE, frame, body);
+    return body + FRAME_PREFIX_SIZE;
+}
+
+int send_chunk(int fd, const char* channel, int src_id, int dest_id,
+               const void* data, size_t len, const char* status, int seq, int is_final) {
+    unsigned wire = frame_wire(fd);
+    if (wire & WIRE_BINARY)
+        return send_binary(fd, wire, channel, src_id, dest_id, data, len, status, seq, is_final);
+
+    char text[MAX_MESSAGE_LENGTH];
+    if (len >= sizeof(text)) len = sizeof(text) - 1;
+    memcpy(text, data, len);
+    text[len] = '\0';
+
+    char frame[MAX_COMMAND_LENGTH];
+    size_t frame_len = build_frame_ex(channel, src_id, dest_id, text, status, seq, is_final,
+                                      (wire & WIRE_CRC32C) != 0, frame);
+    return send_frame(fd, frame, frame_len);
+}
+
+// ─────────────────────────────────────────────────────────────
+// Shared frames
+// ─────────────────────────────────────────────────────────────
+
+SharedFrame* frame_share_chunk(unsigned wire, const char* channel, int src_id, int dest_id,
+                               const void* data, size_t len, const char* status, int seq, int is_final) {
+    if (len > FRAME_MAX_SIZE - FRAME_V2_HEADER_SIZE) return NULL;
+
+    SharedFrame* f = malloc(sizeof(*f) + len + FRAME_V2_HEADER_SIZE + FRAME_PREFIX_SIZE);
+    if (!f) return NULL;
+    f->refs = 1;
+    if (wire & WIRE_BINARY) {
+        f->len = encode_binary(wire, channel, src_id, dest_id, data, len, status, seq, is_final, (unsigned char*)f->data);
+        return f;
+    }
+
+    char text[MAX_MESSAGE_LENGTH];
+    if (len >= sizeof(text)) len = sizeof(text) - 1;
+    memcpy(text, data, len);
+    text[len] = '\0';
+    char frame[MAX_COMMAND_LENGTH];
+    size_t body = build_frame_ex(channel, src_id, dest_id, text, status, seq, is_final, (wire & WIRE_CRC32C) != 0, frame);
+    SharedFrame* grown = body + FRAME_PREFIX_SIZE > len + FRAME_V2_HEADER_SIZE + FRAME_PREFIX_SIZE
+                             ? realloc(f, sizeof(*f) + body + FRAME_PREFIX_SIZE) : f;
+    if (!grown) {
+        free(f);
+        return NULL;
+    }
+    f = grown;
+    f->data[0] = (char)((body >> 24) & 0xFF);
+    f->data[1] = (char)((body >> 16) & 0xFF);
+    f->data[2] = (char)((body >> 8) & 0xFF);
+    f->data[3] = (char)(body & 0xFF);
+    memcpy(f->data + FRAME_PREFIX_SIZE, frame, body);
+    f->len = body + FRAME_PREFIX_SIZE;
+    return f;
+}
+
+void frame_share_retain(SharedFrame* frame) {
+    __atomic_add_fetch(&frame->refs, 1, __ATOMIC_RELAXED);
+}
+
+void frame_share_release(SharedFrame* frame) {
+    if (frame && __atomic_sub_fetch(&frame->refs, 1, __ATOMIC_ACQ_REL) == 0) free(frame);
+}
+
+size_t frame_shared_size(const SharedFrame* frame) {
+    return frame->len;
+}
+
+int frame_send_shared(int fd, SharedFrame* frame) {
+    return transmit(fd, frame->data, frame->len, frame);
+}
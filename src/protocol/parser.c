@@ -5,9 +5,11 @@
  *      Format: <CRC>|<OPTION>|<PAYLOAD>|EOC
  *      Logs parsing errors and CRC mismatches.
  *     Future: Extend validation for channels, IDs, message formats.
- *   @date 2025-09-14
+ *     parse_frame_view() validates either wire format in place, without copying.
+ *     Text CRC fields may be legacy XOR (2 digits) or whole-frame CRC32C (8 digits).
+ *   @date 2026-10-17
  *  @author Oussama Amara
- * @version 0.7
+ * @version 0.8
  */
 
 #include "protocol.h"
@@ -16,19 +18,63 @@
 #include <string.h>
 
 int parse_command(const char* input, ParsedCommand* cmd) {
-    if (decode_frame(input, cmd) != 0) {
+    if (parse_frame(input, strlen(input), cmd) != 0) return -1;
+
+    // Future: validate channel, status, and message format
+    log_message(LOG_DEBUG, "Command validated: %s → %s [%s]",
+                cmd->channel, cmd->message, cmd->status);
+    return 0;
+}
+
+/**
+ * @brief Checks a text frame's CRC field: 8 hex digits are a CRC32C of everything
+ *        after the field, anything else is the legacy XOR of MESSAGE.
+ * @return 1 if valid, 0 if mismatch.
+ */
+static int validate_frame_crc(const char* frame, size_t len, const FrameView* view) {
+    if (view->crc.len != FRAME_CRC32C_DIGITS) {
+        return validate_crc_n(FRAME_VIEW_PTR(view, view->crc), view->crc.len,
+                              FRAME_VIEW_PTR(view, view->payload), view->payload.len);
+    }
+
+    uint32_t received = 0;
+    for (int i = 0; i < FRAME_CRC32C_DIGITS; ++i) {
+        char c = frame[i];
+        int digit = (c >= '0' && c <= '9') ? c - '0'
+                  : (c >= 'A' && c <= 'F') ? c - 'A' + 10
+                  : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+        if (digit < 0) return 0;
+        received = (received << 4) | (uint32_t)digit;
+    }
+    size_t skip = FRAME_CRC32C_DIGITS + 1;
+    return crc32c(0, frame + skip, len - skip) == received;
+}
+
+int parse_frame_view(const char* frame, size_t len, FrameView* view) {
+    if (len > 0 && (unsigned char)frame[0] == FRAME_V2_MAGIC) {
+        if (decode_frame_v2_view((const unsigned char*)frame, len, view) != 0) {
+            log_message(LOG_WARN, "Binary frame rejected (malformed or checksum mismatch).");
+            return -1;
+        }
+        return 0;
+    }
+
+    if (decode_frame_view(frame, len, view) != 0) {
         log_message(LOG_WARN, "Frame decoding failed.");
         return -1;
     }
 
-    if (!validate_crc(cmd->crc, cmd->message)) {
+    if (!validate_frame_crc(frame, len, view)) {
         log_message(LOG_WARN, "CRC mismatch.");
         return -1;
     }
+    return 0;
+}
 
-    // Future: validate channel, status, and message format
-    log_message(LOG_DEBUG, "Command validated: %s → %s [%s]",
-                cmd->channel, cmd->message, cmd->status);
+int parse_frame(const char* frame, size_t len, ParsedCommand* cmd) {
+    FrameView view;
+    if (parse_frame_view(frame, len, &view) != 0) return -1;
+    frame_view_to_command(&view, cmd);
     return 0;
 }
 
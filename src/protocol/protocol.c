@@ -4,9 +4,13 @@
  *        Builds and decodes structured protocol frames for chat, file, and game features.
  *        Format: <CRC>|<CHANNEL>|<SRC_ID>|<DEST_ID>|<MESSAGE>|<STATUS>|SEQ|END
  *        Supports chunked delivery and integrity validation.
- * @date 2025-09-28
+ *        Also maps channel and status names to the codes used by binary v2 frames.
+ *        Text frames are decoded in place into FrameViews (field offsets, no copies).
+ *        The CRC field is either the legacy 2-digit XOR of MESSAGE or an 8-digit
+ *        CRC32C of everything that follows it.
+ * @date 2026-10-17
  * @author Oussama Amara
- * @version 0.8
+ * @version 1.6
  */
 
 
@@ -18,39 +22,196 @@
 
 void build_frame(const char* channel, int src_id, int dest_id,
                  const char* message, const char* status, char* out_frame) {
-    char crc[9];
-    generate_crc(message, crc);
-    snprintf(out_frame, MAX_COMMAND_LENGTH, "%s|%s|%d|%d|%s|%s",
-             crc, channel, src_id, dest_id, message, status);
+    build_frame_ex(channel, src_id, dest_id, message, status, -1, 1, 0, out_frame);
+}
+
+size_t build_frame_ex(const char* channel, int src_id, int dest_id, const char* message,
+                      const char* status, int seq, int is_final, int use_crc32c, char* out_frame) {
+    if (!use_crc32c) {
+        char crc[9];
+        generate_crc(message, crc);
+        int n = seq < 0
+            ? snprintf(out_frame, MAX_COMMAND_LENGTH, "%s|%s|%d|%d|%s|%s",
+                       crc, channel, src_id, dest_id, message, status)
+            : snprintf(out_frame, MAX_COMMAND_LENGTH, "%s|%s|%d|%d|%s|%s|%d|%d",
+                       crc, channel, src_id, dest_id, message, status, seq, is_final);
+        return n < MAX_COMMAND_LENGTH ? (size_t)n : MAX_COMMAND_LENGTH - 1;
+    }
+
+    // Fields first, then the CRC32C of everything after the CRC field in front
+    char* body = out_frame + FRAME_CRC32C_DIGITS + 1;
+    size_t cap = MAX_COMMAND_LENGTH - FRAME_CRC32C_DIGITS - 1;
+    int n = seq < 0
+        ? snprintf(body, cap, "%s|%d|%d|%s|%s", channel, src_id, dest_id, message, status)
+        : snprintf(body, cap, "%s|%d|%d|%s|%s|%d|%d", channel, src_id, dest_id, message, status, seq, is_final);
+    size_t len = n < (int)cap ? (size_t)n : cap - 1;
+
+    static const char hex[] = "0123456789ABCDEF";
+    uint32_t crc = crc32c(0, body, len);
+    for (int i = FRAME_CRC32C_DIGITS - 1; i >= 0; --i, crc >>= 4) out_frame[i] = hex[crc & 0xF];
+    out_frame[FRAME_CRC32C_DIGITS] = '|';
+    return FRAME_CRC32C_DIGITS + 1 + len;
 }
 
 //Frame format: <CRC>|<CHANNEL>|<SRC_ID>|<DEST_ID>|<MESSAGE>|<STATUS>|SEQ=X|END=Y
 
-int decode_frame(const char* input, ParsedCommand* cmd) {
-    if (!input || !cmd) return -1;
+/**
+ * @brief Parses a signed decimal field without requiring a terminator.
+ */
+static int32_t parse_int_n(const char* p, size_t len) {
+    size_t i = 0;
+    int neg = 0;
+    if (i < len && (p[i] == '-' || p[i] == '+')) neg = p[i++] == '-';
+    int32_t v = 0;
+    while (i < len && p[i] >= '0' && p[i] <= '9') v = v * 10 + (p[i++] - '0');
+    return neg ? -v : v;
+}
 
-    char temp[MAX_COMMAND_LENGTH];
-    strncpy(temp, input, sizeof(temp));
-    temp[sizeof(temp) - 1] = '\0';
+int decode_frame_view(const char* frame, size_t len, FrameView* view) {
+    if (!frame || !view) return -1;
 
-    char* tokens[8];
+    // Field boundaries: at most 8 fields, the last one runs to the end
+    FrameSpan fields[8];
     int count = 0;
-    char* token = strtok(temp, "|");
-    while (token && count < 8) {
-        tokens[count++] = token;
-        token = strtok(NULL, "|");
+    size_t start = 0;
+    while (count < 8) {
+        const char* bar = count < 7 ? memchr(frame + start, '|', len - start) : NULL;
+        size_t end = bar ? (size_t)(bar - frame) : len;
+        fields[count].off = (uint32_t)start;
+        fields[count].len = (uint32_t)(end - start);
+        count++;
+        if (!bar) break;
+        start = end + 1;
     }
 
     if (count < 6) return -1;
 
-    strncpy(cmd->crc, tokens[0], sizeof(cmd->crc) - 1);
-    strncpy(cmd->channel, tokens[1], sizeof(cmd->channel) - 1);
-    cmd->src_id = atoi(tokens[2]);
-    cmd->dest_id = atoi(tokens[3]);
-    strncpy(cmd->message, tokens[4], sizeof(cmd->message) - 1);
-    strncpy(cmd->status, tokens[5], sizeof(cmd->status) - 1);
-    cmd->seq_num = (count >= 7) ? atoi(tokens[6]) : 0;
-    cmd->is_final = (count == 8) ? atoi(tokens[7]) : 1;
+    view->base = frame;
+    view->binary = 0;
+    view->crc = fields[0];
+    view->channel = (uint8_t)channel_code_n(frame + fields[1].off, fields[1].len);
+    view->src_id = parse_int_n(frame + fields[2].off, fields[2].len);
+    view->dest_id = parse_int_n(frame + fields[3].off, fields[3].len);
+    view->payload = fields[4];
+    view->status = (uint8_t)status_code_n(frame + fields[5].off, fields[5].len);
+    view->seq_num = (count >= 7) ? parse_int_n(frame + fields[6].off, fields[6].len) : 0;
+    view->is_final = (count == 8) ? parse_int_n(frame + fields[7].off, fields[7].len) != 0 : 1;
+
+    return 0;
+}
+
+size_t frame_view_copy(const FrameView* view, FrameSpan span, char* dst, size_t cap) {
+    size_t n = span.len < cap - 1 ? span.len : cap - 1;
+    memcpy(dst, FRAME_VIEW_PTR(view, span), n);
+    dst[n] = '\0';
+    return n;
+}
+
+void frame_view_to_command(const FrameView* view, ParsedCommand* cmd) {
+    frame_view_copy(view, view->crc, cmd->crc, sizeof(cmd->crc));
+    strcpy(cmd->channel, channel_name(view->channel));
+    strcpy(cmd->status, status_name(view->status));
+    cmd->src_id = view->src_id;
+    cmd->dest_id = view->dest_id;
+    cmd->message_len = frame_view_copy(view, view->payload, cmd->message, sizeof(cmd->message));
+    cmd->seq_num = view->seq_num;
+    cmd->is_final = view->is_final;
+}
+
+int decode_frame(const char* input, ParsedCommand* cmd) {
+    if (!input || !cmd) return -1;
 
+    FrameView view;
+    if (decode_frame_view(input, strlen(input), &view) != 0) return -1;
+    frame_view_to_command(&view, cmd);
     return 0;
 }
+
+// ─────────────────────────────────────────────────────────────
+// Channel and status name tables (indexed by ChannelCode / StatusCode)
+// ─────────────────────────────────────────────────────────────
+
+static const char* const channel_names[CH_COUNT] = {
+    [CH_UNKNOWN] = "unknown",
+    [CH_SYSTEM]  = "system",
+    [CH_CHAT]    = "chat",
+    [CH_FILE]    = "file",
+    [CH_GAME]    = "game",
+};
+
+static const char* const status_names[ST_COUNT] = {
+    [ST_UNKNOWN]   = "UNKNOWN",
+    [ST_WAIT]      = "WAIT",
+    [ST_READY]     = "READY",
+    [ST_DONE]      = "DONE",
+    [ST_ACK]       = "ACK",
+    [ST_LIST]      = "LIST",
+    [ST_ID_ASSIGN] = "ID_ASSIGN",
+    [ST_ERR]       = "ERR",
+    [ST_CHUNK]     = "CHUNK",
+    [ST_REQUEST]   = "REQUEST",
+    [ST_INCOMING]  = "INCOMING",
+    [ST_RETRY]     = "RETRY",
+    [ST_TIMEOUT]   = "TIMEOUT",
+    [ST_ALERT]     = "ALERT",
+    [ST_START]     = "START",
+    [ST_CAPS]      = "CAPS",
+    [ST_JOIN]      = "JOIN",
+    [ST_LEAVE]     = "LEAVE",
+    [ST_RAW]       = "RAW",
+    [ST_HAVE] = "HAVE", [ST_RESUME]    = "RESUME",
+    [ST_OFFER]     = "OFFER",
+    [ST_BATCH]     = "BATCH",
+    [ST_WANT]      = "WANT",
+    [ST_SIGS]      = "SIGS",
+};
+
+// ─────────────────────────────────────────────────────────────
+// Perfect hashes for name → code (every known name lands in its own slot;
+// empty slots map to *_UNKNOWN, whose name never matches a real field)
+// ─────────────────────────────────────────────────────────────
+
+#define CHANNEL_HASH(p, n) (((unsigned char)(p)[2] + 3u * (unsigned char)(p)[(n) - 1]) & 3u)
+#define STATUS_HASH(p, n)  (((unsigned char)(p)[2] + 3u * (unsigned char)(p)[(n) - 1] + (unsigned)(n)) & 63u)
+
+static const uint8_t channel_slots[4] = {
+    [0] = CH_GAME, [1] = CH_CHAT, [2] = CH_SYSTEM, [3] = CH_FILE,
+};
+
+static const uint8_t status_slots[64] = {
+    [1]  = ST_OFFER,
+    [2]  = ST_START,    [4]  = ST_SIGS,    [6]  = ST_ALERT,   [9]  = ST_WAIT,      [11] = ST_ERR,
+    [13] = ST_CAPS,     [14] = ST_WANT,    [16] = ST_TIMEOUT,   [17] = ST_READY,
+    [18] = ST_ID_ASSIGN, [19] = ST_LIST,   [20] = ST_REQUEST,   [21] = ST_LEAVE,
+    [31] = ST_RAW,      [32] = ST_INCOMING, [33] = ST_DONE,     [36] = ST_RETRY,
+    [40] = ST_RESUME,   [41] = ST_HAVE,    [47] = ST_ACK,       [49] = ST_BATCH,
+    [55] = ST_JOIN,     [59] = ST_CHUNK,
+};
+
+const char* channel_name(int code) {
+    return (code > CH_UNKNOWN && code < CH_COUNT) ? channel_names[code] : channel_names[CH_UNKNOWN];
+}
+
+int channel_code(const char* name) {
+    return channel_code_n(name, strlen(name));
+}
+
+int channel_code_n(const char* name, size_t len) {
+    if (len < 3 || len > 6) return CH_UNKNOWN;
+    int code = channel_slots[CHANNEL_HASH(name, len)];
+    return (strncmp(name, channel_names[code], len) == 0 && channel_names[code][len] == '\0') ? code : CH_UNKNOWN;
+}
+
+const char* status_name(int code) {
+    return (code > ST_UNKNOWN && code < ST_COUNT) ? status_names[code] : status_names[ST_UNKNOWN];
+}
+
+int status_code(const char* name) {
+    return status_code_n(name, strlen(name));
+}
+
+int status_code_n(const char* name, size_t len) {
+    if (len < 3 || len > 9) return ST_UNKNOWN;
+    int code = status_slots[STATUS_HASH(name, len)];
+    return (strncmp(name, status_names[code], len) == 0 && status_names[code][len] == '\0') ? code : ST_UNKNOWN;
+}
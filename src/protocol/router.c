@@ -0,0 +1,42 @@
+/**
+ * @file router.c
+ * @brief Implements the [channel][status] frame jump table.
+ *        Wildcard registrations are expanded into the table up front, so the
+ *        dispatch path never branches on names or falls back through a chain.
+ * @author Oussama Amara
+ * @version 1.0
+ * @date 2026-10-17
+ */
+
+#include "router.h"
+#include "logger.h"
+
+#include <string.h>
+
+void router_init(FrameRouter* router) {
+    memset(router, 0, sizeof(*router));
+}
+
+int router_register(FrameRouter* router, int channel, int status, FrameHandler handler) {
+    if (channel <= CH_UNKNOWN || channel >= CH_COUNT) return -1;
+
+    if (status == ROUTE_ANY_STATUS) {
+        for (int s = 0; s < ST_COUNT; ++s)
+            if (!router->routes[channel][s]) router->routes[channel][s] = handler;
+        return 0;
+    }
+
+    if (status <= ST_UNKNOWN || status >= ST_COUNT) return -1;
+    router->routes[channel][status] = handler;
+    return 0;
+}
+
+int router_dispatch(const FrameRouter* router, const FrameView* view, void* ctx) {
+    FrameHandler handler = router->routes[view->channel][view->status];
+    if (!handler) {
+        log_message(LOG_DEBUG, "No route for %s/%s", channel_name(view->channel), status_name(view->status));
+        return 0;
+    }
+    handler(view, ctx);
+    return 1;
+}
@@ -1,83 +1,165 @@
 /**
  * @file client_registry.c
  * @brief Implements client registration and activity tracking.
- *     Supports up to MAX_CLIENTS simultaneous clients.
- *    Tracks last activity for timeout handling.
- *  @date 2025-09-14
+ *     Slots live in slabs of REGISTRY_SLAB_SIZE that are allocated on demand and
+ *     never freed, so a reader can always dereference a slot it found. Lookups
+ *     by ID decode the slot from the ID and compare the stored ID (which embeds
+ *     the generation); lookups by socket go through an fd-indexed table.
+ *     Both are lock-free; register/unregister serialize on a mutex.
+ *  @date 2026-10-17
  * @author Oussama Amara
- * @version 0.1
+ * @version 0.3
  */
 
 #include "client_registry.h"
 #include "logger.h"
+#include "platform_thread.h"
 #include <string.h>
-#include <unistd.h>
+#include <stdlib.h>
 
-static ClientInfo clients[MAX_CLIENTS];
+#define REGISTRY_SLAB_COUNT ((REGISTRY_MAX_CLIENTS + REGISTRY_SLAB_SIZE - 1) / REGISTRY_SLAB_SIZE)
+
+/**
+ * @brief fd → client ID table, two levels so it costs nothing for unused fd ranges.
+ */
+#define FD_PAGE_BITS 12
+#define FD_PAGE_SIZE (1 << FD_PAGE_BITS)
+#define FD_PAGE_COUNT 1024
+
+static ClientInfo* slabs[REGISTRY_SLAB_COUNT];   ///< Slot storage, grown one slab at a time
+static int* fd_pages[FD_PAGE_COUNT];             ///< fd → ID
+static int slots_used;                           ///< High-water mark of slots ever handed out
+static int free_head = -1;                       ///< Recycled slots (LIFO)
+static int active_count;                         ///< Registered clients
+static mutex_t registry_lock;                    ///< Serializes writers only
+
+/**
+ * @brief Returns the slot for an index, or NULL if its slab does not exist yet.
+ */
+static ClientInfo* slot_at(int slot) {
+    ClientInfo* slab = __atomic_load_n(&slabs[slot / REGISTRY_SLAB_SIZE], __ATOMIC_ACQUIRE);
+    return slab ? &slab[slot % REGISTRY_SLAB_SIZE] : NULL;
+}
+
+/**
+ * @brief Resolves an ID to its slot if the ID is still current.
+ */
+static ClientInfo* slot_for_id(int id) {
+    if (id <= 0) return NULL;
+    int slot = (id & REGISTRY_SLOT_MASK) - 1;
+    if (slot < 0 || slot >= REGISTRY_MAX_CLIENTS) return NULL;
+    ClientInfo* c = slot_at(slot);
+    if (!c || __atomic_load_n(&c->id, __ATOMIC_ACQUIRE) != id) return NULL;
+    return c;
+}
+
+/**
+ * @brief Stores the ID for an fd (caller holds registry_lock).
+ */
+static void fd_index_set(int fd, int id) {
+    if (fd < 0 || (fd >> FD_PAGE_BITS) >= FD_PAGE_COUNT) return;
+    int* page = fd_pages[fd >> FD_PAGE_BITS];
+    if (!page) {
+        if (!id) return;
+        page = calloc(FD_PAGE_SIZE, sizeof(int));
+        if (!page) return;
+        __atomic_store_n(&fd_pages[fd >> FD_PAGE_BITS], page, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&page[fd & (FD_PAGE_SIZE - 1)], id, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Loads the ID stored for an fd (0 if none).
+ */
+static int fd_index_get(int fd) {
+    if (fd < 0 || (fd >> FD_PAGE_BITS) >= FD_PAGE_COUNT) return 0;
+    int* page = __atomic_load_n(&fd_pages[fd >> FD_PAGE_BITS], __ATOMIC_ACQUIRE);
+    return page ? __atomic_load_n(&page[fd & (FD_PAGE_SIZE - 1)], __ATOMIC_ACQUIRE) : 0;
+}
 
 void init_registry() {
-    memset(clients, 0, sizeof(clients));
-    // init all IDs to -1 (indicating free slots)
-    for (int i = 0; i < MAX_CLIENTS; ++i) clients[i].id = -1;
+    mutex_init(&registry_lock);
 }
 
 int register_client(int socket, struct sockaddr_in addr) {
-    for (int i = 0; i < MAX_CLIENTS; ++i) {
-        if (clients[i].id == -1) {
-            clients[i].id = i + 1;// IDs start from 1 0 is reserved for server
-            clients[i].socket = socket;
-            clients[i].addr = addr;
-            clients[i].last_activity = time(NULL);
-            clients[i].active = 1;
-            snprintf(clients[i].name, sizeof(clients[i].name), "Client%d", clients[i].id);
-            return clients[i].id;
+    mutex_lock(&registry_lock);
+
+    int slot = free_head;
+    if (slot >= 0) {
+        free_head = slot_at(slot)->next_free;
+    } else if (slots_used < REGISTRY_MAX_CLIENTS) {
+        slot = slots_used;
+        int slab = slot / REGISTRY_SLAB_SIZE;
+        if (!slabs[slab]) {
+            ClientInfo* fresh = calloc(REGISTRY_SLAB_SIZE, sizeof(ClientInfo));
+            if (!fresh) {
+                mutex_unlock(&registry_lock);
+                log_message(LOG_ERROR, "Registry: out of memory growing to %d slots.", slot + 1);
+                return -1;
+            }
+            __atomic_store_n(&slabs[slab], fresh, __ATOMIC_RELEASE);
         }
+        __atomic_store_n(&slots_used, slots_used + 1, __ATOMIC_RELEASE);
+    } else {
+        mutex_unlock(&registry_lock);
+        log_message(LOG_WARN, "Registry full (%d clients).", REGISTRY_MAX_CLIENTS);
+        return -1;
     }
-    return -1;
+
+    ClientInfo* c = slot_at(slot);
+    int id = (c->generation << REGISTRY_SLOT_BITS) | (slot + 1);
+
+    __atomic_store_n(&c->socket, socket, __ATOMIC_RELAXED);
+    c->addr = addr;
+    c->next_free = -1;
+    snprintf(c->name, sizeof(c->name), "Client%d", id);
+    __atomic_store_n(&c->id, id, __ATOMIC_RELEASE);  // Publish: readers now match this ID
+    fd_index_set(socket, id);
+    __atomic_add_fetch(&active_count, 1, __ATOMIC_RELAXED);
+
+    mutex_unlock(&registry_lock);
+    return id;
 }
 
 int get_socket_by_id(int id) {
-    for (int i = 0; i < MAX_CLIENTS; ++i)
-        if (clients[i].id == id && clients[i].active)
-            return clients[i].socket;
-    return -1;
+    ClientInfo* c = slot_for_id(id);
+    if (!c) return -1;
+    int socket = __atomic_load_n(&c->socket, __ATOMIC_ACQUIRE);
+    // The slot may have been recycled between the two loads
+    return __atomic_load_n(&c->id, __ATOMIC_ACQUIRE) == id ? socket : -1;
 }
 
 int get_id_by_socket(int socket) {
-    for (int i = 0; i < MAX_CLIENTS; ++i)
-        if (clients[i].socket == socket && clients[i].active)
-            return clients[i].id;
-    return -1;
-}
-
-void update_activity(int id) {
-    for (int i = 0; i < MAX_CLIENTS; ++i)
-        if (clients[i].id == id)
-            clients[i].last_activity = time(NULL);
+    int id = fd_index_get(socket);
+    return (id > 0 && slot_for_id(id)) ? id : -1;
 }
 
 void unregister_client(int id) {
-    for (int i = 0; i < MAX_CLIENTS; ++i)
-        if (clients[i].id == id) {
-            close(clients[i].socket);
-            clients[i].id = -1;
-            clients[i].active = 0;
-        }
-}
-
-void check_timeouts(int timeout_seconds) {
-    time_t now = time(NULL);
-    for (int i = 0; i < MAX_CLIENTS; ++i) {
-        if (clients[i].active && (now - clients[i].last_activity) > timeout_seconds) {
-            log_message(LOG_INFO, "Client %d timed out.", clients[i].id);
-            unregister_client(clients[i].id);
-        }
+    mutex_lock(&registry_lock);
+    ClientInfo* c = slot_for_id(id);
+    if (c) {
+        __atomic_store_n(&c->id, 0, __ATOMIC_RELEASE);
+        c->generation = (c->generation + 1) & REGISTRY_GEN_MASK;  // Stale copies of id never match again
+        if (fd_index_get(c->socket) == id) fd_index_set(c->socket, 0);
+        c->next_free = free_head;
+        free_head = (id & REGISTRY_SLOT_MASK) - 1;
+        __atomic_sub_fetch(&active_count, 1, __ATOMIC_RELAXED);
     }
+    mutex_unlock(&registry_lock);
 }
 
 int has_active_clients() {
-    for (int i = 0; i < MAX_CLIENTS; ++i)
-        if (clients[i].active)
-            return 1;
-    return 0;
+    return __atomic_load_n(&active_count, __ATOMIC_RELAXED);
+}
+
+void registry_foreach(RegistryVisitor visit, void* ctx) {
+    int used = __atomic_load_n(&slots_used, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < used; ++i) {
+        ClientInfo* c = slot_at(i);
+        if (!c) break;
+        int id = __atomic_load_n(&c->id, __ATOMIC_ACQUIRE);
+        if (!id) continue;
+        int socket = get_socket_by_id(id);
+        if (socket >= 0) visit(id, socket, ctx);
+    }
 }
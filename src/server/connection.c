@@ -13,6 +13,10 @@
 #include <winsock2.h>
 #else
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
 #endif
 
 #include <stdio.h>
@@ -47,14 +51,46 @@ void create_socket(int* sockfd) {
 
 void socket_bind(struct sockaddr_in* servaddr, int* sockfd) {
     if (bind(*sockfd, (struct sockaddr*)servaddr, sizeof(*servaddr)) < 0) {
-        log_message(LOG_ERROR, "Socket bind failed.");
+        log_message(LOG_ERROR, "Socket bind failed: %s", strerror(errno));
         exit(1);
     }
     log_message(LOG_INFO, "Socket bound.");
 }
 
+int socket_reuseport(int* sockfd) {
+    int one = 1;
+#ifdef SO_REUSEPORT
+    if (setsockopt(*sockfd, SOL_SOCKET, SO_REUSEPORT, (const char*)&one, sizeof(one)) == 0) return 0;
+#endif
+    log_message(LOG_WARN, "SO_REUSEPORT not supported on this platform.");
+    return -1;
+}
+
+int open_listener(const char* host, int port, int reuseport) {
+    int sockfd;
+    create_socket(&sockfd);
+#ifndef _WIN32
+    int one = 1; // rebind immediately after a restart despite TIME_WAIT peers
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+#endif
+    if (reuseport && socket_reuseport(&sockfd) != 0) {
+        log_message(LOG_ERROR, "Cannot share port %d between reactors.", port);
+        exit(1);
+    }
+
+    struct sockaddr_in servaddr;
+    memset(&servaddr, 0, sizeof(servaddr));
+    servaddr.sin_family = AF_INET;
+    servaddr.sin_addr.s_addr = inet_addr(host);
+    servaddr.sin_port = htons(port);
+
+    socket_bind(&servaddr, &sockfd);
+    socket_listening(&sockfd);
+    return sockfd;
+}
+
 void socket_listening(int* sockfd) {
-    if (listen(*sockfd, 8) != 0) {
+    if (listen(*sockfd, SOMAXCONN) != 0) {
         log_message(LOG_ERROR, "Listen failed.");
         exit(1);
     }
@@ -69,3 +105,30 @@ void socket_accept(int* connfd, int* sockfd, struct sockaddr_in* cli, int* len)
     }
     log_message(LOG_INFO, "Client connected.");
 }
+
+int socket_set_nonblocking(int sockfd) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(sockfd, FIONBIO, &mode) == 0 ? 0 : -1;
+#else
+    int flags = fcntl(sockfd, F_GETFL, 0);
+    if (flags < 0) return -1;
+    return fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
+#endif
+}
+
+int socket_would_block(void) {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+void socket_close(int sockfd) {
+#ifdef _WIN32
+    closesocket(sockfd);
+#else
+    close(sockfd);
+#endif
+}
@@ -4,136 +4,451 @@
  *        Supports chat, file, game, and system logic with delivery confirmation.
  *        Delegates file logic to features/file_transfer.c.
  *        Logs key events including ACK receipt, file size, and chunk count.
- * @date 2025-10-19
+ *        Works on FrameViews so the hot path never copies a whole frame.
+ *        Handlers are registered once in a [channel][status] jump table.
+ *        File frames addressed to a client rather than the server belong to a
+ *        client-to-client relay and are forwarded (relay.c).
+ *        A REQUEST addressed to the server names several recipients and
+ *        starts a multicast; one naming a directory or several files starts a batch.
+ *        SIGS answering an offer turn the transfer into a delta.
+ *        Chat traffic is reported to the transfer scheduler, so background
+ *        transfers leave it the link.
+ *        Offers take their content hash from the asset index.
+ * @date 2026-10-17
  * @author Oussama
- * @version 2.2
+ * @version 3.7
  */
 
 #include "dispatcher.h"
 #include "protocol.h"
 #include "client_registry.h"
 #include "logger.h"
+#include "framing.h"
 #include "chat.h"
 #include "file_transfer.h"
+#include "file_batch.h"
+#include "content_store.h"
+#include "platform.h"
+#include "router.h"
+#include "relay.h"
+#include "transfer_scheduler.h"
+#include "asset_index.h"
 
 #include <string.h>
+#include <stdlib.h>
 #include <unistd.h>
 
+#define MULTICAST_REQUEST_MAX 8192 ///< Bytes of a multicast REQUEST read (recipient list and filename)
+
 /**
- * @brief Dispatches a parsed command to its appropriate handler.
- *        Handles chat, file, game, and system channels.
- *        Logs delivery confirmation and file transfer lifecycle.
- * @param cmd Pointer to parsed command.
- */
-void dispatch_command(const ParsedCommand* cmd) {
-    if (!cmd) return;
-    log_message(LOG_DEBUG, "Dispatching → channel=%s src=%d dest=%d status=%s msg=%s",
-                cmd->channel, cmd->src_id, cmd->dest_id, cmd->status, cmd->message);
-
-    update_activity(cmd->src_id);
-
-    // ─────────────────────────────────────────────
-    // System-level ACK handling
-    // ─────────────────────────────────────────────
-    if (strcmp(cmd->channel, "system") == 0) {
-        if (strcmp(cmd->status, "ACK") == 0) {
-            int sender_fd = get_socket_by_id(cmd->dest_id);
-            if (sender_fd >= 0) {
-                char ack_msg[MAX_COMMAND_LENGTH];
-                build_frame("system", 0, cmd->dest_id, "DELIVERY_CONFIRMED", "ACK", ack_msg);
-                send(sender_fd, ack_msg, strlen(ack_msg), 0);
-                //to do fix routing for ack file
-                if (strcmp(cmd->channel, "file") == 0) {
-                    log_message(LOG_INFO, "[FILE] ACK received from client %d and confirmation sent to client %d",
-                                 cmd->dest_id ,cmd->src_id);   
-                } else {  
-                log_message(LOG_INFO, "[SYSTEM] ACK received from client %d and confirmation sent to client %d",
-                            cmd->src_id, cmd->dest_id);
-                }
-            }
-        }
+ * @brief Routes shared by every reactor; filled once by dispatcher_init().
+ */
+static FrameRouter server_router;
+
+// ─────────────────────────────────────────────
+// System handlers
+// ─────────────────────────────────────────────
+
+/**
+ * @brief Records the capabilities a client accepted from the CAPS offer.
+ */
+static void handle_system_caps(const FrameView* view, void* ctx) {
+    (void)ctx;
+    char caps[MAX_MESSAGE_LENGTH];
+    frame_view_copy(view, view->payload, caps, sizeof(caps));
+    int client_fd = get_socket_by_id(view->src_id);
+    if (client_fd > 0) {
+        unsigned wire = (strstr(caps, CAP_BINARY_V2) ? WIRE_BINARY : 0) |
+                        (strstr(caps, CAP_CRC32C) ? WIRE_CRC32C : 0) |
+                        (strstr(caps, CAP_RAW) ? WIRE_RAW : 0);
+        if ((wire & WIRE_BINARY) && strstr(caps, CAP_LZ4)) wire |= WIRE_LZ4;  // Text frames cannot carry it
+        frame_set_wire(client_fd, wire);
+        log_message(LOG_INFO, "[SYSTEM] Client %d negotiated %s frames with %s checksums%s%s", view->src_id,
+                    (wire & WIRE_BINARY) ? "binary v2" : "text", (wire & WIRE_CRC32C) ? "CRC32C" : "legacy",
+                    (wire & WIRE_RAW) ? ", raw file transfers" : "", (wire & WIRE_LZ4) ? ", LZ4 compression" : "");
+    }
+}
+
+/**
+ * @brief Confirms delivery to the original sender. A relayed file's ACK
+ *        ("from" its sender, to the receiver) ends the relay.
+ */
+static void handle_system_ack(const FrameView* view, void* ctx) {
+    (void)ctx;
+    if (view->src_id != 0) relay_close(view->src_id, view->dest_id);
+    int sender_fd = get_socket_by_id(view->dest_id);
+    if (sender_fd >= 0) {
+        send_command(sender_fd, "system", 0, view->dest_id, "DELIVERY_CONFIRMED", "ACK");
+        log_message(LOG_INFO, "[SYSTEM] ACK received from client %d and confirmation sent to client %d",
+                    view->src_id, view->dest_id);
+    }
+}
+
+// ─────────────────────────────────────────────
+// Chat handlers
+// ─────────────────────────────────────────────
+
+/**
+ * @brief Buffers chat chunks and forwards the message once the final chunk arrives.
+ */
+static void handle_chat(const FrameView* view, void* ctx) {
+    (void)ctx;
+    sched_note_interactive(monotonic_ms());  // Background transfers step aside
+    buffer_chat_chunk(view);
+    if (!view->is_final) return;
+
+    const char* full_msg = assemble_chat_message(view->src_id, view->dest_id);
+    if (!full_msg) {
+        log_message(LOG_WARN, "Incomplete chat message from %d", view->src_id);
         return;
     }
 
-    // ─────────────────────────────────────────────
-    // Chat message routing
-    // ─────────────────────────────────────────────
-    if (strcmp(cmd->channel, "chat") == 0) {
-        buffer_chat_chunk(cmd);
-        if (cmd->is_final) {
-            const char* full_msg = assemble_chat_message(cmd->src_id, cmd->dest_id);
-            if (!full_msg) {
-                log_message(LOG_WARN, "Incomplete chat message from %d", cmd->src_id);
-                return;
-            }
-
-            if (moderate_chat_message(full_msg)) {
-                char alert[MAX_COMMAND_LENGTH];
-                build_frame("system", 0, cmd->src_id, "Inappropriate language detected", "ALERT", alert);
-                send(get_socket_by_id(cmd->src_id), alert, strlen(alert), 0);
-                return;
-            }
-
-            char forward[MAX_COMMAND_LENGTH];
-            build_frame("chat", cmd->src_id, cmd->dest_id, full_msg, "READY", forward);
-            int dest_fd = get_socket_by_id(cmd->dest_id);
-            if (dest_fd <= 0) {
-                log_message(LOG_ERROR, "Invalid destination ID: %d. Cannot route message.", cmd->dest_id);
-                return;
-            }
-
-            log_message(LOG_INFO, "[CHAT] Forwarding from %d to %d: %s", cmd->src_id, cmd->dest_id, full_msg);
-            int sent = send(dest_fd, forward, strlen(forward), 0);
-            if (sent <= 0) {
-                log_message(LOG_ERROR, "Failed to send to client %d", cmd->dest_id);
-            }
-        }
+    if (moderate_chat_message(full_msg)) {
+        send_command(get_socket_by_id(view->src_id), "system", 0, view->src_id, "Inappropriate language detected", "ALERT");
         return;
     }
 
-    // ─────────────────────────────────────────────
-    // File transfer routing
-    // ─────────────────────────────────────────────
-    if (strcmp(cmd->channel, "file") == 0) {
-        int dest_fd = get_socket_by_id(cmd->dest_id);
+    int dest_fd = get_socket_by_id(view->dest_id);
+    if (dest_fd <= 0) {
+        log_message(LOG_ERROR, "Invalid destination ID: %d. Cannot route message.", view->dest_id);
+        return;
+    }
 
-        if (strcmp(cmd->status, "REQUEST") == 0) {
-            if (dest_fd <= 0) {
-                log_message(LOG_ERROR, "[FILE] Target client %d not available", cmd->dest_id);
-                return;
-            }
+    log_message(LOG_INFO, "[CHAT] Forwarding from %d to %d: %s", view->src_id, view->dest_id, full_msg);
+    if (send_command(dest_fd, "chat", view->src_id, view->dest_id, full_msg, "READY") != 0) {
+        log_message(LOG_ERROR, "Failed to send to client %d", view->dest_id);
+    }
+}
 
-            char notify[MAX_COMMAND_LENGTH];
-            build_frame("file", 0, cmd->dest_id, cmd->message, "INCOMING", notify);
-            send(dest_fd, notify, strlen(notify), 0);
-            log_message(LOG_INFO, "[FILE] Notified client %d of incoming file '%s' from client %d",
-                        cmd->dest_id, cmd->message, cmd->src_id);
-        }
+// ─────────────────────────────────────────────
+// File transfer handlers
+// ─────────────────────────────────────────────
 
-        else if (strcmp(cmd->status, "READY") == 0) {
-            int receiver_fd = get_socket_by_id(cmd->src_id);  // src_id is the one who sent READY
-            if (receiver_fd <= 0) {
-                log_message(LOG_ERROR, "[FILE] Destination client %d not available for delivery", cmd->src_id);
-                return;
-            }
+/**
+ * @brief Builds the INCOMING payload of one of the server's files ("<content_hash>,<filename>").
+ */
+static void build_file_offer(const char* filename, char* offer, size_t cap) {
+    char hash[CONTENT_HASH_LEN + 1];
+    if (asset_index_hash(filename, hash) == 0) {
+        snprintf(offer, cap, "%s,%s", hash, filename);
+    } else {
+        snprintf(offer, cap, "%s", filename);  // Unreadable here; the transfer reports it
+    }
+}
 
-            log_message(LOG_INFO, "[FILE] Client %d is ready to receive '%s' from client %d",
-                        cmd->src_id, cmd->message, cmd->dest_id);
-            send_file_to_client(&receiver_fd, cmd->message, cmd->dest_id, cmd->src_id);
-        }
+/**
+ * @brief Collects every registered client but the requester ("*" recipients).
+ */
+typedef struct {
+    int* ids;
+    int count;
+    int cap;
+    int except;
+} RecipientList;
+
+static void collect_recipient(int id, int socket, void* ctx) {
+    (void)socket;
+    RecipientList* list = ctx;
+    if (id != list->except && list->count < list->cap) list->ids[list->count++] = id;
+}
 
-        else if (strcmp(cmd->status, "ACK") == 0) {
-            log_message(LOG_INFO, "[FILE] Received ACK for '%s' from client %d", cmd->message, cmd->src_id);
+/**
+ * @brief Multicast REQUEST ("<id>,<id>,...;<filename>", or "*;<filename>" for
+ *        everyone online): opens the group and announces the file to each recipient.
+ */
+static void handle_file_multicast(const FrameView* view) {
+    char request[MULTICAST_REQUEST_MAX];
+    frame_view_copy(view, view->payload, request, sizeof(request));
+    char* filename = strchr(request, ';');
+    if (!filename || filename[1] == '\0') {
+        log_message(LOG_WARN, "[FILE] Malformed multicast request from client %d", view->src_id);
+        return;
+    }
+    *filename++ = '\0';
+
+    int ids[MULTICAST_REQUEST_MAX / 2];
+    RecipientList list = { ids, 0, (int)(sizeof(ids) / sizeof(ids[0])), view->src_id };
+    if (strcmp(request, "*") == 0) {
+        registry_foreach(collect_recipient, &list);
+    } else {
+        for (char* p = request; *p && list.count < list.cap;) {
+            char* end;
+            long id = strtol(p, &end, 10);
+            if (end == p) break;
+            if (id > 0 && get_socket_by_id((int)id) > 0) ids[list.count++] = (int)id;
+            else log_message(LOG_WARN, "[FILE] Multicast recipient %ld not available", id);
+            p = *end == ',' ? end + 1 : end;
         }
+    }
+    if (list.count == 0 || file_multicast_open(filename, view->src_id, ids, list.count) != 0) {
+        send_command(get_socket_by_id(view->src_id), "file", 0, view->src_id, filename, "ERR");
+        return;
+    }
+
+    char offer[MAX_MESSAGE_LENGTH + CONTENT_HASH_LEN + 1];
+    build_file_offer(filename, offer, sizeof(offer));
+    for (int i = 0; i < list.count; ++i) {
+        int fd = get_socket_by_id(ids[i]);
+        if (fd > 0) send_command(fd, "file", 0, ids[i], offer, "INCOMING");
+    }
+}
+
+/**
+ * @brief Notifies the target client of an incoming file ("<content_hash>,<filename>").
+ *        The hash lets a receiver that already stores the content skip the transfer.
+ *        A request addressed to the server is a multicast.
+ */
+static void handle_file_request(const FrameView* view, void* ctx) {
+    (void)ctx;
+    if (view->dest_id == 0) {
+        handle_file_multicast(view);
+        return;
+    }
+
+    char filename[MAX_MESSAGE_LENGTH];
+    frame_view_copy(view, view->payload, filename, sizeof(filename));
 
+    int dest_fd = get_socket_by_id(view->dest_id);
+    if (dest_fd <= 0) {
+        log_message(LOG_ERROR, "[FILE] Target client %d not available", view->dest_id);
         return;
     }
 
-    // ─────────────────────────────────────────────
-    // Game logic stub
-    // ─────────────────────────────────────────────
-    if (strcmp(cmd->channel, "game") == 0) {
-        log_message(LOG_WARN, "[GAME] Game feature not yet implemented.");
+    // A directory, or "a;b;c": one manifest instead of one offer per file
+    if (file_batch_requested(filename)) {
+        if (file_batch_offer(dest_fd, filename, view->dest_id) != 0)
+            send_command(get_socket_by_id(view->src_id), "file", 0, view->src_id, filename, "ERR");
         return;
     }
+
+    char offer[MAX_MESSAGE_LENGTH + CONTENT_HASH_LEN + 1];
+    build_file_offer(filename, offer, sizeof(offer));
+
+    send_command(dest_fd, "file", 0, view->dest_id, offer, "INCOMING");
+    log_message(LOG_INFO, "[FILE] Notified client %d of incoming file '%s' from client %d",
+                view->dest_id, filename, view->src_id);
+}
+
+/**
+ * @brief A receiver could not store a file. For a relayed file the relay ends.
+ */
+static void handle_system_err(const FrameView* view, void* ctx) {
+    (void)ctx;
+    char filename[MAX_MESSAGE_LENGTH];
+    frame_view_copy(view, view->payload, filename, sizeof(filename));
+    log_message(LOG_WARN, "[SYSTEM] Client %d could not store '%s'", view->src_id, filename);
+    if (view->dest_id != 0) relay_close(view->dest_id, view->src_id);
+}
+
+/**
+ * @brief A client offers its own file ("<content_hash>,<filename>") to another:
+ *        the server relays it instead of sending a copy of its own.
+ */
+static void handle_file_offer(const FrameView* view, void* ctx) {
+    (void)ctx;
+    char offer[MAX_MESSAGE_LENGTH], hash[CONTENT_HASH_LEN + 1];
+    frame_view_copy(view, view->payload, offer, sizeof(offer));
+    const char* filename = content_parse_offer(offer, hash);
+
+    int dest_fd = get_socket_by_id(view->dest_id);
+    if (dest_fd <= 0 || view->dest_id == view->src_id) {
+        log_message(LOG_ERROR, "[FILE] Target client %d not available", view->dest_id);
+        return;
+    }
+    if (relay_open(view->src_id, view->dest_id, filename) != 0) {
+        log_message(LOG_ERROR, "[FILE] Too many relays in progress; refusing '%s' from client %d", filename, view->src_id);
+        send_command(get_socket_by_id(view->src_id), "file", 0, view->src_id, filename, "ERR");
+        return;
+    }
+
+    send_command(dest_fd, "file", view->src_id, view->dest_id, offer, "INCOMING");
+    log_message(LOG_INFO, "[FILE] Relaying '%s' from client %d to client %d", filename, view->src_id, view->dest_id);
+}
+
+/**
+ * @brief Receiver already stores the announced content: nothing is sent.
+ */
+static void handle_file_have(const FrameView* view, void* ctx) {
+    (void)ctx;
+    char offer[MAX_MESSAGE_LENGTH], hash[CONTENT_HASH_LEN + 1];
+    frame_view_copy(view, view->payload, offer, sizeof(offer));
+    const char* filename = content_parse_offer(offer, hash);
+    log_message(LOG_INFO, "[FILE] Client %d already has '%s' (%s); transfer skipped", view->src_id, filename, hash);
+
+    if (view->dest_id != 0) {
+        relay_forward(view, view->seq_num);
+        relay_close(view->dest_id, view->src_id);
+    } else {
+        file_multicast_have(view->src_id, filename);
+    }
+}
+
+/**
+ * @brief Streams the file once the receiver reports READY.
+ *        For a relayed file READY goes on to the sending client, with the chunk
+ *        size granted for the receiver's wire format in seq.
+ */
+static void handle_file_ready(const FrameView* view, void* ctx) {
+    (void)ctx;
+    char filename[MAX_MESSAGE_LENGTH];
+    frame_view_copy(view, view->payload, filename, sizeof(filename));
+
+    int receiver_fd = get_socket_by_id(view->src_id);  // src_id is the one who sent READY
+    if (receiver_fd <= 0) {
+        log_message(LOG_ERROR, "[FILE] Destination client %d not available for delivery", view->src_id);
+        return;
+    }
+
+    if (view->dest_id != 0) {
+        if (relay_forward(view, file_chunk_grant(receiver_fd, view->seq_num, 0)) != 0)
+            log_message(LOG_WARN, "[FILE] READY from client %d for '%s' matches no relay", view->src_id, filename);
+        return;
+    }
+
+    log_message(LOG_INFO, "[FILE] Client %d is ready to receive '%s' from client %d",
+                view->src_id, filename, view->dest_id);
+    send_file_to_client(&receiver_fd, filename, view->dest_id, view->src_id, view->seq_num);  // seq: chunk size asked for
+}
+
+/**
+ * @brief The receiver of a batch says which of its files it needs.
+ */
+static void handle_file_want(const FrameView* view, void* ctx) {
+    (void)ctx;
+    int receiver_fd = get_socket_by_id(view->src_id);
+    if (receiver_fd > 0) file_batch_on_want(view, receiver_fd);
+}
+
+/**
+ * @brief The receiver holds an older copy of the offered file and sends its
+ *        signatures: only a delta against that copy is sent.
+ */
+static void handle_file_sigs(const FrameView* view, void* ctx) {
+    (void)ctx;
+    int receiver_fd = get_socket_by_id(view->src_id);
+    if (receiver_fd > 0) file_delta_on_sigs(view, receiver_fd);
+}
+
+/**
+ * @brief Resumes or narrows a transfer: "<transfer_id>,<first>,<end>,<filename>".
+ *        For a relayed file it goes on to the sending client; an extra stream of
+ *        the receiver joins the relay here.
+ */
+static void handle_file_resume(const FrameView* view, void* ctx) {
+    (void)ctx;
+    char request[MAX_MESSAGE_LENGTH];
+    frame_view_copy(view, view->payload, request, sizeof(request));
+
+    char transfer_id[TRANSFER_ID_LEN + 1];
+    int first, end;
+    const char* filename = file_parse_resume(request, transfer_id, &first, &end);
+    if (!filename) {
+        log_message(LOG_WARN, "[FILE] Malformed RESUME '%s' from client %d", request, view->src_id);
+        return;
+    }
+
+    if (view->dest_id != 0) {
+        if (relay_join(view->dest_id, view->src_id, filename) != 0 || relay_forward(view, view->seq_num) != 0)
+            log_message(LOG_WARN, "[FILE] RESUME from client %d for '%s' matches no relay", view->src_id, filename);
+        return;
+    }
+
+    int receiver_fd = get_socket_by_id(view->src_id);
+    if (receiver_fd <= 0) {
+        log_message(LOG_ERROR, "[FILE] Destination client %d not available for delivery", view->src_id);
+        return;
+    }
+    resume_file_to_client(receiver_fd, filename, view->dest_id, view->src_id, view->seq_num,  // seq: chunk size
+                          transfer_id, first, end);
+}
+
+/**
+ * @brief Receiver's SACK: slides the sending window and repairs reported gaps.
+ *        SACKs of a relayed file go on to the sending client.
+ */
+static void handle_file_ack(const FrameView* view, void* ctx) {
+    (void)ctx;
+    if (view->dest_id != 0) {
+        relay_forward(view, view->seq_num);
+        return;
+    }
+    int receiver_fd = get_socket_by_id(view->src_id);
+    if (receiver_fd > 0) file_transfer_on_sack(view, receiver_fd, 0);
+}
+
+/**
+ * @brief Receiver's retry timer fired: resends every chunk it has not confirmed.
+ */
+static void handle_file_retry(const FrameView* view, void* ctx) {
+    (void)ctx;
+    if (view->dest_id != 0) {
+        relay_forward(view, view->seq_num);
+        return;
+    }
+    int receiver_fd = get_socket_by_id(view->src_id);
+    if (receiver_fd > 0) file_transfer_on_sack(view, receiver_fd, 1);
+}
+
+/**
+ * @brief START and CHUNK frames of a relayed file: forwarded to the receiver as
+ *        they arrive. DONE is forwarded too; the relay then waits for the
+ *        receiver's verdict on the digest.
+ */
+static void handle_file_relayed(const FrameView* view, void* ctx) {
+    (void)ctx;
+    if (relay_forward(view, view->seq_num) != 0) {
+        log_message(LOG_WARN, "[FILE] %s from client %d to client %d matches no relay", status_name(view->status),
+                    view->src_id, view->dest_id);
+        return;
+    }
+    if (view->status == ST_DONE) relay_done(view->src_id, view->dest_id);
+}
+
+// ─────────────────────────────────────────────
+// Game logic stub
+// ─────────────────────────────────────────────
+
+/**
+ * @brief Placeholder until the game feature exists.
+ */
+static void handle_game(const FrameView* view, void* ctx) {
+    (void)view;
+    (void)ctx;
+    log_message(LOG_WARN, "[GAME] Game feature not yet implemented.");
+}
+
+void dispatcher_init(void) {
+    router_init(&server_router);
+    router_register(&server_router, CH_SYSTEM, ST_CAPS, handle_system_caps);
+    router_register(&server_router, CH_SYSTEM, ST_ACK, handle_system_ack);
+    router_register(&server_router, CH_SYSTEM, ST_ERR, handle_system_err);
+    router_register(&server_router, CH_CHAT, ROUTE_ANY_STATUS, handle_chat);
+    router_register(&server_router, CH_FILE, ST_REQUEST, handle_file_request);
+    router_register(&server_router, CH_FILE, ST_READY, handle_file_ready);
+    router_register(&server_router, CH_FILE, ST_ACK, handle_file_ack);
+    router_register(&server_router, CH_FILE, ST_RETRY, handle_file_retry);
+    router_register(&server_router, CH_FILE, ST_RESUME, handle_file_resume);
+    router_register(&server_router, CH_FILE, ST_HAVE, handle_file_have);
+    router_register(&server_router, CH_FILE, ST_WANT, handle_file_want);
+    router_register(&server_router, CH_FILE, ST_SIGS, handle_file_sigs);
+    router_register(&server_router, CH_FILE, ST_OFFER, handle_file_offer);
+    router_register(&server_router, CH_FILE, ST_START, handle_file_relayed);
+    router_register(&server_router, CH_FILE, ST_CHUNK, handle_file_relayed);
+    router_register(&server_router, CH_FILE, ST_DONE, handle_file_relayed);
+    router_register(&server_router, CH_GAME, ROUTE_ANY_STATUS, handle_game);
+}
+
+/**
+ * @brief Dispatches a decoded frame to its registered handler.
+ *        The view borrows the connection's receive buffer; anything kept past
+ *        this call is copied out.
+ * @param view Pointer to the decoded frame.
+ */
+void dispatch_command(const FrameView* view) {
+    if (!view) return;
+    log_message(LOG_DEBUG, "Dispatching → channel=%s src=%d dest=%d status=%s msg=%.*s",
+                channel_name(view->channel), view->src_id, view->dest_id,
+                status_name(view->status), (int)view->payload.len, FRAME_VIEW_PTR(view, view->payload));
+
+    router_dispatch(&server_router, view, NULL);
 }
@@ -1,11 +1,11 @@
 /**
  * @file server.c
  * @brief Entry point and orchestration logic for the server application.
- *        Loads config, sets up sockets, launches thread-per-client and background sync.
- *        Uses select() for multi-port monitoring and supports chat, file, and game features.
- * @date 2025-09-21
+ *        Loads config, sets up presence and starts the reactor pool.
+ *        Each reactor owns its own listeners and client sockets for chat, file, and game features.
+ * @date 2026-10-17
  * @author Oussama
- * @version 3.1
+ * @version 4.7
  */
 
 #include "server.h"
@@ -15,7 +15,15 @@
 #include "client_registry.h"
 #include "platform.h"
 #include "platform_thread.h"
-#include "thread_logic.h"
+#include "reactor.h"
+#include "dispatcher.h"
+#include "presence.h"
+#include "file_transfer.h"
+#include "content_store.h"
+#include "relay.h"
+#include "transfer_scheduler.h"
+#include "asset_index.h"
+#include "hot_cache.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -23,22 +31,9 @@
 
 #ifdef _WIN32
 #include <winsock2.h>
-#define socklen_t int
-#else
-#include <unistd.h>
-#include <sys/select.h>
 #endif
 #include <signal.h>
 
-/**
- * Time of inactive client after which we kill the client
- */
-#define CLIENT_TIME_OUT 300 // seconds
-
-/**
- * Server idle sleep duration when no clients are connected
- */
-#define SERVER_IDLE_SLEEP_MS 5000 // milliseconds
 /**
  * @brief Global flag to control server running state.
  */
@@ -55,8 +50,9 @@ void handle_sigint(int sig) {
 }
 
 /**
- * @brief Main server entry point. Loads config, sets up sockets, and uses select() to monitor all ports.
- *        Spawns threads for each accepted client and launches background sync thread.
+ * @brief Main server entry point. Loads config, initializes the registry, dispatcher,
+ *        presence, file transfer, scheduler, content store, asset index, hot cache
+ *        and relay subsystems, then runs the reactor pool on all ports until shutdown.
  * @param argc Argument count.
  * @param argv Argument vector.
  * @return 0 on success, non-zero on error.
@@ -75,90 +71,30 @@ int run_server(int argc, char** argv) {
 
     set_log_level(LOG_INFO);
     signal(SIGINT, handle_sigint);
+#ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN); // peers may vanish mid-send; handle EPIPE instead
+#endif
     win_socket_init();
     init_registry();
-
-    // Launch background sync thread
-    thread_t sync_thread;
-    create_thread(&sync_thread, broadcast_client_list, NULL);
-    detach_thread(sync_thread);
-
-    int ports[3] = { cfg.port_chat, cfg.port_file, cfg.port_game };
-    int sockfds[3];
-
-    for (int i = 0; i < 3; ++i) {
-        create_socket(&sockfds[i]);
-
-        struct sockaddr_in servaddr;
-        memset(&servaddr, 0, sizeof(servaddr));
-        servaddr.sin_family = AF_INET;
-        servaddr.sin_addr.s_addr = inet_addr(cfg.host);
-        servaddr.sin_port = htons(ports[i]);
-
-        socket_bind(&servaddr, &sockfds[i]);
-        socket_listening(&sockfds[i]);
-
-        log_message(LOG_INFO, "Listening on %s:%d", cfg.host, ports[i]);
-    }
-
-    while (server_running) {
-        fd_set readfds;
-        FD_ZERO(&readfds);
-        int maxfd = -1;
-
-        for (int i = 0; i < 3; ++i) {
-            FD_SET(sockfds[i], &readfds);
-            if (sockfds[i] > maxfd) maxfd = sockfds[i];
-        }
-
-        struct timeval timeout = { .tv_sec = 1, .tv_usec = 0 };
-        int ready = select(maxfd + 1, &readfds, NULL, NULL, &timeout);
-
-        if (ready > 0) {
-            for (int i = 0; i < 3; ++i) {
-                if (FD_ISSET(sockfds[i], &readfds)) {
-                    struct sockaddr_in cli;
-                    socklen_t len = sizeof(cli);
-                    int connfd = accept(sockfds[i], (struct sockaddr*)&cli, &len);
-                    if (connfd < 0) continue;
-
-                    log_message(LOG_INFO, "Accepted connection on port %d from %s:%d",
-                                ports[i], inet_ntoa(cli.sin_addr), ntohs(cli.sin_port));
-
-                    ClientArgs* args = malloc(sizeof(ClientArgs));
-                    args->connfd = connfd;
-                    args->cli = cli;
-                    args->port = ports[i];
-
-                    thread_t tid;
-                    if (create_thread(&tid, handle_client_thread, args) == 0) {
-                        detach_thread(tid);
-                    } else {
-                        log_message(LOG_ERROR, "Failed to create thread.");
-                        free(args);
-                    }
-                }
-            }
-        }
-        // Periodically check for client timeouts and clean up
-        check_timeouts(CLIENT_TIME_OUT);
-        if (!has_active_clients()) {
-            log_message(LOG_INFO, "No active clients. Sleeping...");
-            sleep_ms(SERVER_IDLE_SLEEP_MS);
-        }
-    }
-
-    for (int i = 0; i < 3; ++i) {
-#ifdef _WIN32
-        closesocket(sockfds[i]);
-#else
-        close(sockfds[i]);
-#endif
-    }
+    dispatcher_init();
+    presence_init();
+    file_transfer_init(cfg.file_window);
+    sched_init(cfg.max_transfers, cfg.transfer_rate, cfg.total_rate, cfg.background_size);
+    content_store_init();
+    asset_index_init();
+    hot_cache_init(cfg.hot_cache_size);
+    relay_init();
+
+    int rc = reactor_pool_run(&cfg, &server_running);
+
+    HotCacheStats hc;
+    hot_cache_stats(&hc);
+    if (hc.hits || hc.misses)
+        log_message(LOG_INFO, "[FILE] Hot cache: %lld hits, %lld misses, %lld evictions", hc.hits, hc.misses, hc.evictions);
 
     win_socket_cleanup();
     log_message(LOG_INFO, "Server shutdown complete.");
-    return 0;
+    return rc == 0 ? 0 : 1;
 }
 
 /**
@@ -0,0 +1,158 @@
+/**
+ * @file presence.c
+ * @brief Versioned membership set with join/leave deltas.
+ *        Members are kept in a dense array for iteration, with a slot-indexed
+ *        position table for O(1) removal. One lock serializes membership changes
+ *        so every client sees the deltas in version order; the frames themselves
+ *        only go to outbound queues, so holding it never waits on a slow peer.
+ * @author Oussama Amara
+ * @version 1.0
+ * @date 2026-10-17
+ */
+
+#include "presence.h"
+#include "client_registry.h"
+#include "protocol.h"
+#include "framing.h"
+#include "logger.h"
+#include "platform_thread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static mutex_t presence_lock;
+static int* members;        ///< Member IDs, dense
+static int member_count;
+static int member_cap;
+static int* member_pos;     ///< Registry slot → index in members + 1 (0 = absent)
+static int pos_cap;
+static int version;         ///< Bumped on every join and leave
+
+static int slot_of(int id) {
+    return (id & REGISTRY_SLOT_MASK) - 1;
+}
+
+/**
+ * @brief Grows `*arr` to hold at least `need` ints, zero-filling the new tail.
+ */
+static int grow(int** arr, int* cap, int need) {
+    if (need <= *cap) return 0;
+    int n = *cap ? *cap : 64;
+    while (n < need) n *= 2;
+    int* grown = realloc(*arr, (size_t)n * sizeof(int));
+    if (!grown) return -1;
+    memset(grown + *cap, 0, (size_t)(n - *cap) * sizeof(int));
+    *arr = grown;
+    *cap = n;
+    return 0;
+}
+
+/**
+ * @brief Sends one presence frame stamped with the current version.
+ */
+static void send_presence(int id, const char* message, size_t len, const char* status, int is_final) {
+    int socket = get_socket_by_id(id);
+    if (socket < 0) return;
+    send_chunk(socket, "system", 0, id, message, len, status, version, is_final);
+}
+
+/**
+ * @brief Sends START or WAIT depending on how many members are online.
+ */
+static void send_readiness(int id) {
+    int socket = get_socket_by_id(id);
+    if (socket < 0) return;
+    if (member_count >= 2) {
+        send_command(socket, "system", 0, id, "You may begin", "START");
+    } else {
+        send_command(socket, "system", 0, id, "Waiting for another client...", "WAIT");
+    }
+}
+
+/**
+ * @brief Sends the joiner every other member as "id,name" entries separated by ';',
+ *        split over as many LIST frames as needed; the last one is marked final.
+ */
+static void send_snapshot(int id) {
+    char list_msg[MAX_MESSAGE_LENGTH];
+    size_t len = 0;
+    int others = member_count - 1;
+
+    for (int i = 0; i < member_count; ++i) {
+        if (members[i] == id) continue;
+        char entry[32];
+        int n = snprintf(entry, sizeof(entry), "%s%d,%s", len ? ";" : "", members[i], "Client");
+        if (len + (size_t)n >= sizeof(list_msg)) {
+            send_presence(id, list_msg, len, "LIST", 0);
+            len = 0;
+            n = snprintf(entry, sizeof(entry), "%d,%s", members[i], "Client");
+        }
+        memcpy(list_msg + len, entry, (size_t)n);
+        len += (size_t)n;
+    }
+    if (others > 0) send_presence(id, list_msg, len, "LIST", 1);
+}
+
+void presence_init(void) {
+    mutex_init(&presence_lock);
+}
+
+void presence_join(int id) {
+    int slot = slot_of(id);
+    mutex_lock(&presence_lock);
+    if (grow(&member_pos, &pos_cap, slot + 1) != 0 || grow(&members, &member_cap, member_count + 1) != 0) {
+        mutex_unlock(&presence_lock);
+        log_message(LOG_ERROR, "Presence: out of memory adding client %d.", id);
+        return;
+    }
+    if (member_pos[slot]) {
+        mutex_unlock(&presence_lock);
+        return;
+    }
+
+    members[member_count++] = id;
+    member_pos[slot] = member_count;
+    version++;
+
+    frame_cork();
+    char entry[32];
+    int n = snprintf(entry, sizeof(entry), "%d,%s", id, "Client");
+    for (int i = 0; i < member_count - 1; ++i) {
+        send_presence(members[i], entry, (size_t)n, "JOIN", 1);
+        if (member_count == 2) send_readiness(members[i]);
+    }
+    send_snapshot(id);
+    send_readiness(id);
+    frame_uncork();
+
+    mutex_unlock(&presence_lock);
+}
+
+void presence_leave(int id) {
+    int slot = slot_of(id);
+    mutex_lock(&presence_lock);
+    if (slot < 0 || slot >= pos_cap || !member_pos[slot] || members[member_pos[slot] - 1] != id) {
+        mutex_unlock(&presence_lock);
+        return;
+    }
+
+    // Move the last member into the hole
+    int index = member_pos[slot] - 1;
+    int last = members[--member_count];
+    members[index] = last;
+    member_pos[slot_of(last)] = index + 1;
+    member_pos[slot] = 0;
+    version++;
+
+    frame_cork();
+    char entry[16];
+    int n = snprintf(entry, sizeof(entry), "%d", id);
+    for (int i = 0; i < member_count; ++i) {
+        send_presence(members[i], entry, (size_t)n, "LEAVE", 1);
+        if (member_count == 1) send_readiness(members[i]);
+    }
+    frame_uncork();
+
+    mutex_unlock(&presence_lock);
+}
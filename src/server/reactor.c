@@ -0,0 +1,605 @@
+/**
+ * @file reactor.c
+ * @brief Event loop driving accept, receive, parse and dispatch from readiness events.
+ *        Listening and client sockets share one poller: edge-triggered epoll on Linux,
+ *        level-triggered poll()/WSAPoll elsewhere. Handlers drain sockets until they
+ *        would block, so both backends behave the same. A pool of reactors shards
+ *        accepts through per-thread SO_REUSEPORT listeners. Outbound frames are
+ *        queued per connection and flushed on writability; frames produced while
+ *        handling one read are corked into a single write per destination. Idle
+ *        clients are dropped by per-connection timers on the reactor's timer wheel,
+ *        which also paces the file transfers the reactor drives. A wake descriptor
+ *        (eventfd, or a pipe) lets other threads resume the senders it parked.
+ * @author Oussama Amara
+ * @version 1.9
+ * @date 2026-10-17
+ */
+
+#include "reactor.h"
+#include "connection.h"
+#include "client_registry.h"
+#include "protocol.h"
+#include "framing.h"
+#include "dispatcher.h"
+#include "presence.h"
+#include "file_transfer.h"
+#include "relay.h"
+#include "logger.h"
+#include "platform.h"
+#include "platform_thread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#define socklen_t int
+#define poll WSAPoll
+#else
+#include <unistd.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#endif
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#elif !defined(_WIN32)
+#include <poll.h>
+#endif
+
+#define PE_READ  0x1 ///< Interested in / reported readable
+#define PE_WRITE 0x2 ///< Interested in / reported writable
+#define PE_ERROR 0x4 ///< Error or hang-up reported
+
+/**
+ * @brief Readiness event returned by the poller backend.
+ */
+typedef struct {
+    void* data;  ///< Listener or Connection registered with the descriptor
+    int events;  ///< PE_READ / PE_WRITE / PE_ERROR
+} PollEvent;
+
+// ─────────────────────────────────────────────────────────────
+// Poller backend: edge-triggered epoll
+// ─────────────────────────────────────────────────────────────
+#ifdef __linux__
+
+struct Poller {
+    int epfd;
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+};
+
+static Poller* poller_create(void) {
+    Poller* p = calloc(1, sizeof(*p));
+    if (!p) return NULL;
+    p->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (p->epfd < 0) {
+        free(p);
+        return NULL;
+    }
+    return p;
+}
+
+static int poller_ctl(Poller* p, int op, int fd, int events, void* data) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLET | EPOLLRDHUP;
+    if (events & PE_READ) ev.events |= EPOLLIN;
+    if (events & PE_WRITE) ev.events |= EPOLLOUT;
+    ev.data.ptr = data;
+    return epoll_ctl(p->epfd, op, fd, &ev);
+}
+
+static int poller_add(Poller* p, int fd, int events, void* data) {
+    return poller_ctl(p, EPOLL_CTL_ADD, fd, events, data);
+}
+
+static void poller_del(Poller* p, int fd) {
+    epoll_ctl(p->epfd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+static int poller_wait(Poller* p, PollEvent* out, int max, int timeout_ms) {
+    int n = epoll_wait(p->epfd, p->events, max, timeout_ms);
+    for (int i = 0; i < n; ++i) {
+        uint32_t e = p->events[i].events;
+        out[i].data = p->events[i].data.ptr;
+        out[i].events = 0;
+        if (e & (EPOLLIN | EPOLLRDHUP)) out[i].events |= PE_READ;
+        if (e & EPOLLOUT) out[i].events |= PE_WRITE;
+        if (e & (EPOLLERR | EPOLLHUP)) out[i].events |= PE_ERROR;
+    }
+    return n;
+}
+
+static void poller_destroy(Poller* p) {
+    close(p->epfd);
+    free(p);
+}
+
+// ─────────────────────────────────────────────────────────────
+// Poller backend: portable poll() / WSAPoll
+// ─────────────────────────────────────────────────────────────
+#else
+
+struct Poller {
+    struct pollfd* fds;
+    void** data;
+    int count;
+    int capacity;
+};
+
+static Poller* poller_create(void) {
+    return calloc(1, sizeof(Poller));
+}
+
+static int poller_add(Poller* p, int fd, int events, void* data) {
+    if (p->count == p->capacity) {
+        int cap = p->capacity ? p->capacity * 2 : 64;
+        struct pollfd* fds = realloc(p->fds, cap * sizeof(*fds));
+        if (!fds) return -1;
+        p->fds = fds;
+        void** d = realloc(p->data, cap * sizeof(*d));
+        if (!d) return -1;
+        p->data = d;
+        p->capacity = cap;
+    }
+    p->fds[p->count].fd = fd;
+    p->fds[p->count].events = (short)(((events & PE_READ) ? POLLIN : 0) | ((events & PE_WRITE) ? POLLOUT : 0));
+    p->fds[p->count].revents = 0;
+    p->data[p->count] = data;
+    p->count++;
+    return 0;
+}
+
+static void poller_del(Poller* p, int fd) {
+    for (int i = 0; i < p->count; ++i) {
+        if (p->fds[i].fd == fd) {
+            p->fds[i] = p->fds[p->count - 1];
+            p->data[i] = p->data[p->count - 1];
+            p->count--;
+            return;
+        }
+    }
+}
+
+static int poller_wait(Poller* p, PollEvent* out, int max, int timeout_ms) {
+    // Level-triggered: ask for writability only while something is queued
+    for (int i = 0; i < p->count; ++i) {
+        if (frame_pending(p->fds[i].fd) > 0) p->fds[i].events |= POLLOUT;
+        else p->fds[i].events &= ~POLLOUT;
+    }
+    int ready = poll(p->fds, p->count, timeout_ms);
+    int n = 0;
+    for (int i = 0; ready > 0 && i < p->count && n < max; ++i) {
+        short e = p->fds[i].revents;
+        if (!e) continue;
+        out[n].data = p->data[i];
+        out[n].events = 0;
+        if (e & POLLIN) out[n].events |= PE_READ;
+        if (e & POLLOUT) out[n].events |= PE_WRITE;
+        if (e & (POLLERR | POLLHUP | POLLNVAL)) out[n].events |= PE_ERROR;
+        n++;
+    }
+    return ready < 0 ? -1 : n;
+}
+
+static void poller_destroy(Poller* p) {
+    free(p->fds);
+    free(p->data);
+    free(p);
+}
+
+#endif
+
+// ─────────────────────────────────────────────────────────────
+// Connection lifecycle
+// ─────────────────────────────────────────────────────────────
+
+/**
+ * @brief Unregisters the client, removes it from the poller and releases it.
+ */
+static void reactor_close(Reactor* r, Connection* c) {
+    timer_cancel(&r->timers, &c->idle_timer);
+    poller_del(r->poller, c->fd);
+    if (c->client_id >= 0) {
+        presence_leave(c->client_id);
+        file_transfer_release(c->fd, -1);
+        file_multicast_drop_client(c->client_id);
+        relay_drop_client(c->client_id);
+        unregister_client(c->client_id);
+        log_message(LOG_INFO, "Client %d disconnected.", c->client_id);
+    }
+    frame_flush(c->fd);        // Best effort for anything still queued
+    frame_queue_close(c->fd);
+    frame_set_wire(c->fd, 0);  // The next socket reusing this fd starts in text mode
+    socket_close(c->fd);
+
+    if (c->prev) c->prev->next = c->next;
+    else r->connections = c->next;
+    if (c->next) c->next->prev = c->prev;
+    r->connection_count--;
+    recvbuf_free(&c->rbuf);
+    free(c);
+}
+
+/**
+ * @brief Inactivity timer. Reads only stamp last_read_ms, so the timer is re-armed
+ *        here for the remaining time instead of on every read. An idle socket is
+ *        shut down rather than closed: events already collected for it may still
+ *        be pending, and its hang-up is reaped as a read event.
+ */
+static void reactor_idle_expired(void* arg) {
+    Connection* c = arg;
+    Reactor* r = c->owner;
+    long long idle = r->timers.now_ms - c->last_read_ms;
+    if (idle < CLIENT_TIME_OUT * 1000LL) {
+        timer_schedule(&r->timers, &c->idle_timer, CLIENT_TIME_OUT * 1000LL - idle);
+        return;
+    }
+    log_message(LOG_INFO, "Client %d timed out.", c->client_id);
+#ifdef _WIN32
+    shutdown(c->fd, SD_BOTH);
+#else
+    shutdown(c->fd, SHUT_RDWR);
+#endif
+}
+
+/**
+ * @brief Registers a freshly accepted socket and performs the ID_ASSIGN handshake.
+ */
+static void reactor_open(Reactor* r, int connfd, struct sockaddr_in cli, int port) {
+    socket_set_nonblocking(connfd);
+    int one = 1;
+    setsockopt(connfd, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+
+    int client_id = register_client(connfd, cli);
+    if (client_id < 0) {
+        log_message(LOG_ERROR, "Max clients reached.");
+        socket_close(connfd);
+        return;
+    }
+
+    Connection* c = calloc(1, sizeof(*c));
+    if (c && recvbuf_init(&c->rbuf, RECVBUF_INITIAL_SIZE) != 0) {
+        free(c);
+        c = NULL;
+    }
+    if (c && frame_queue_open(connfd) != 0) {
+        recvbuf_free(&c->rbuf);
+        free(c);
+        c = NULL;
+    }
+    if (!c) {
+        log_message(LOG_ERROR, "Out of memory for connection state.");
+        unregister_client(client_id);
+        socket_close(connfd);
+        return;
+    }
+    c->kind = EV_CONNECTION;
+    c->fd = connfd;
+    c->port = port;
+    c->client_id = client_id;
+    c->addr = cli;
+    c->owner = r;
+    c->last_read_ms = r->timers.now_ms;
+    timer_init(&c->idle_timer, reactor_idle_expired, c);
+
+    // Edge-triggered epoll reports writability only after the socket was full
+    if (poller_add(r->poller, connfd, PE_READ | PE_WRITE, c) != 0) {
+        log_message(LOG_ERROR, "Failed to watch client socket.");
+        frame_queue_close(connfd);
+        unregister_client(client_id);
+        socket_close(connfd);
+        recvbuf_free(&c->rbuf);
+        free(c);
+        return;
+    }
+
+    c->next = r->connections;
+    if (r->connections) r->connections->prev = c;
+    r->connections = c;
+    r->connection_count++;
+    timer_schedule(&r->timers, &c->idle_timer, CLIENT_TIME_OUT * 1000LL);
+
+    send_command(connfd, "system", 0, client_id, "ID_ASSIGN", "READY");
+    log_message(LOG_INFO, "Sent ID_ASSIGN to client %d", client_id);
+
+    // Offer binary v2, CRC32C and raw file transfers; the client opts in by echoing the capabilities it wants
+    send_command(connfd, "system", 0, client_id, CAP_BINARY_V2 "," CAP_CRC32C "," CAP_RAW "," CAP_LZ4, "CAPS");
+
+    presence_join(client_id);
+}
+
+/**
+ * @brief Accepts every pending connection on a listener.
+ */
+static void reactor_accept(Reactor* r, Listener* l) {
+    while (1) {
+        struct sockaddr_in cli;
+        socklen_t len = sizeof(cli);
+        int connfd = accept(l->fd, (struct sockaddr*)&cli, &len);
+        if (connfd < 0) {
+            if (errno == EINTR) continue;
+            if (!socket_would_block()) log_message(LOG_WARN, "Accept failed on port %d.", l->port);
+            return;
+        }
+
+        log_message(LOG_INFO, "Reactor %d accepted connection on port %d from %s:%d",
+                    r->index, l->port, inet_ntoa(cli.sin_addr), ntohs(cli.sin_port));
+        reactor_open(r, connfd, cli, l->port);
+    }
+}
+
+/**
+ * @brief Parses and dispatches one frame body.
+ */
+static void reactor_handle_frame(Connection* c, const char* frame, size_t len) {
+    FrameView view;
+    if (parse_frame_view(frame, len, &view) == 0) {
+        dispatch_command(&view);
+    } else {
+        log_message(LOG_WARN, "Failed to parse frame from client %d", c->client_id);
+    }
+}
+
+/**
+ * @brief Reads until the socket would block, dispatching every complete frame.
+ *        Partial frames stay in the connection's receive buffer.
+ * @return 0 if the connection is still open, -1 if it was closed.
+ */
+static int reactor_read(Reactor* r, Connection* c) {
+    while (1) {
+        int received = recvbuf_fill(&c->rbuf, c->fd);
+        if (received > 0) {
+            c->last_read_ms = r->timers.now_ms;
+            const char* frame;
+            size_t len;
+            int rc;
+            frame_cork();
+            while ((rc = recvbuf_next_frame(&c->rbuf, &frame, &len)) == 1) {
+                reactor_handle_frame(c, frame, len);
+            }
+            frame_uncork();
+            if (rc == 0) continue;
+            log_message(LOG_WARN, "Framing error from client %d; closing.", c->client_id);
+        } else if (received < 0 && socket_would_block()) {
+            return 0;
+        }
+
+        reactor_close(r, c);
+        return -1;
+    }
+}
+
+// ─────────────────────────────────────────────────────────────
+// Cross-thread wakeups
+// ─────────────────────────────────────────────────────────────
+
+/**
+ * @brief Opens the wake descriptor: an eventfd on Linux, a pipe on other POSIX
+ *        systems. Windows has neither for WSAPoll; its parked senders poll.
+ */
+static int reactor_wake_open(Reactor* r) {
+#ifdef __linux__
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) return -1;
+    r->wake_fds[0] = r->wake_fds[1] = fd;
+    return 0;
+#elif !defined(_WIN32)
+    if (pipe(r->wake_fds) != 0) return -1;
+    socket_set_nonblocking(r->wake_fds[0]);
+    socket_set_nonblocking(r->wake_fds[1]);
+    return 0;
+#else
+    (void)r;
+    return -1;
+#endif
+}
+
+static void reactor_wake_close(Reactor* r) {
+#ifndef _WIN32
+    if (r->wake_fds[0] >= 0) close(r->wake_fds[0]);
+    if (r->wake_fds[1] >= 0 && r->wake_fds[1] != r->wake_fds[0]) close(r->wake_fds[1]);
+#endif
+    r->wake_fds[0] = r->wake_fds[1] = -1;
+}
+
+/**
+ * @brief Waker notification, from any thread: makes the reactor's wait return.
+ */
+static void reactor_notify(void* ctx) {
+#ifndef _WIN32
+    Reactor* r = ctx;
+    uint64_t one = 1;
+    ssize_t n = write(r->wake_fds[1], &one, sizeof(one));
+    (void)n;  // A full pipe already wakes the reactor
+#else
+    (void)ctx;
+#endif
+}
+
+/**
+ * @brief Drains the wake descriptor and resumes the woken senders.
+ */
+static void reactor_wake(Reactor* r) {
+#ifndef _WIN32
+    uint64_t buf[16];
+    while (read(r->wake_fds[0], buf, sizeof(buf)) > 0) {}
+#endif
+    file_waker_run(r->waker);
+}
+
+// ─────────────────────────────────────────────────────────────
+// Public API
+// ─────────────────────────────────────────────────────────────
+
+int reactor_init(Reactor* r) {
+    memset(r, 0, sizeof(*r));
+    timer_wheel_init(&r->timers, monotonic_ms());
+    r->wake_fds[0] = r->wake_fds[1] = -1;
+    r->poller = poller_create();
+    if (!r->poller) {
+        log_message(LOG_ERROR, "Failed to create event poller.");
+        return -1;
+    }
+    // Without a wake descriptor, multicast senders held back by their group poll instead
+    r->wake_kind = EV_WAKE;
+    if (reactor_wake_open(r) == 0 && poller_add(r->poller, r->wake_fds[0], PE_READ, &r->wake_kind) == 0)
+        r->waker = file_waker_create(reactor_notify, r);
+    if (!r->waker) reactor_wake_close(r);
+    return 0;
+}
+
+int reactor_add_listener(Reactor* r, int fd, int port) {
+    if (r->listener_count >= REACTOR_MAX_LISTENERS) return -1;
+
+    Listener* l = &r->listeners[r->listener_count];
+    l->kind = EV_LISTENER;
+    l->fd = fd;
+    l->port = port;
+    socket_set_nonblocking(fd);
+    if (poller_add(r->poller, fd, PE_READ, l) != 0) {
+        log_message(LOG_ERROR, "Failed to watch listener on port %d.", port);
+        return -1;
+    }
+    r->listener_count++;
+    return 0;
+}
+
+void reactor_run(Reactor* r, volatile sig_atomic_t* running) {
+    PollEvent events[REACTOR_MAX_EVENTS];
+    file_transfer_set_timers(&r->timers);  // Paces the chunked senders this reactor drives
+    file_transfer_set_waker(r->waker);
+
+    while (*running) {
+        int timeout = timer_wheel_timeout(&r->timers);
+        if (timeout < 0 || timeout > REACTOR_MAX_WAIT_MS) timeout = REACTOR_MAX_WAIT_MS;
+
+        int n = poller_wait(r->poller, events, REACTOR_MAX_EVENTS, timeout);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            log_message(LOG_ERROR, "Event wait failed.");
+            break;
+        }
+        // One clock read per wakeup; handlers use the cached value
+        timer_wheel_advance(&r->timers, monotonic_ms());
+
+        for (int i = 0; i < n; ++i) {
+            EventKind kind = *(EventKind*)events[i].data;
+            if (kind == EV_LISTENER) {
+                reactor_accept(r, (Listener*)events[i].data);
+                continue;
+            }
+            if (kind == EV_WAKE) {
+                reactor_wake(r);
+                continue;
+            }
+
+            Connection* c = (Connection*)events[i].data;
+            if (events[i].events & PE_WRITE) {
+                frame_flush(c->fd);
+            }
+            if (events[i].events & (PE_READ | PE_ERROR)) {
+                reactor_read(r, c);
+            }
+        }
+    }
+}
+
+void reactor_destroy(Reactor* r) {
+    while (r->connections) reactor_close(r, r->connections);
+    for (int i = 0; i < r->listener_count; ++i) socket_close(r->listeners[i].fd);
+    r->listener_count = 0;
+    // Connections are closed, so no sender is left to wake
+    file_waker_destroy(r->waker);
+    r->waker = NULL;
+    reactor_wake_close(r);
+    if (r->poller) poller_destroy(r->poller);
+    r->poller = NULL;
+}
+
+// ─────────────────────────────────────────────────────────────
+// Reactor pool
+// ─────────────────────────────────────────────────────────────
+
+/**
+ * @brief One event-loop thread and the reactor it owns.
+ */
+typedef struct {
+    Reactor reactor;
+    const Config* cfg;
+    volatile sig_atomic_t* running;
+    thread_t thread;
+} ReactorWorker;
+
+static THREAD_FUNC reactor_worker_main(void* arg) {
+    ReactorWorker* w = (ReactorWorker*)arg;
+    Reactor* r = &w->reactor;
+
+    if (w->cfg->pin_cpus) {
+        int cpu = r->index % cpu_count();
+        if (pin_current_thread(cpu) == 0) {
+            log_message(LOG_INFO, "Reactor %d pinned to CPU %d", r->index, cpu);
+        } else {
+            log_message(LOG_WARN, "Reactor %d could not be pinned to CPU %d", r->index, cpu);
+        }
+    }
+
+    reactor_run(r, w->running);
+    THREAD_RETURN;
+}
+
+int reactor_pool_run(const Config* cfg, volatile sig_atomic_t* running) {
+    int count = cfg->reactors > 0 ? cfg->reactors : cpu_count();
+    if (count > REACTOR_MAX_THREADS) count = REACTOR_MAX_THREADS;
+#ifndef SO_REUSEPORT
+    if (count > 1) {
+        log_message(LOG_WARN, "SO_REUSEPORT unavailable; running a single reactor.");
+        count = 1;
+    }
+#endif
+
+    ReactorWorker* workers = calloc(count, sizeof(*workers));
+    if (!workers) return -1;
+
+    int ports[3] = { cfg->port_chat, cfg->port_file, cfg->port_game };
+    for (int i = 0; i < count; ++i) {
+        Reactor* r = &workers[i].reactor;
+        if (reactor_init(r) != 0) {
+            for (int j = 0; j < i; ++j) reactor_destroy(&workers[j].reactor);
+            free(workers);
+            return -1;
+        }
+        r->index = i;
+        workers[i].cfg = cfg;
+        workers[i].running = running;
+
+        for (int p = 0; p < 3; ++p) {
+            int fd = open_listener(cfg->host, ports[p], count > 1);
+            reactor_add_listener(r, fd, ports[p]);
+        }
+    }
+    log_message(LOG_INFO, "Listening on %s:%d/%d/%d with %d reactor(s)",
+                cfg->host, ports[0], ports[1], ports[2], count);
+
+    int started = 1;
+    for (int i = 1; i < count; ++i, ++started) {
+        if (create_thread(&workers[i].thread, reactor_worker_main, &workers[i]) != 0) {
+            log_message(LOG_ERROR, "Failed to start reactor %d; running %d.", i, started);
+            // Unserved listeners would still be handed connections by the kernel
+            for (int j = i; j < count; ++j) reactor_destroy(&workers[j].reactor);
+            break;
+        }
+    }
+
+    reactor_worker_main(&workers[0]);
+
+    for (int i = 1; i < started; ++i) join_thread(workers[i].thread);
+    for (int i = 0; i < count; ++i) reactor_destroy(&workers[i].reactor);
+    free(workers);
+    return 0;
+}
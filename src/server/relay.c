@@ -0,0 +1,169 @@
+/**
+ * @file relay.c
+ * @brief Relay table and frame forwarding for client-to-client file transfers.
+ *        The table is small and fixed, like the sender table of file_transfer.c;
+ *        one lock guards it because the two ends of a relay may be served by
+ *        different reactors. Frames are forwarded with the lock released, into
+ *        the destination's outbound queue, so a slow receiver never blocks the
+ *        sender's reactor. A relay outlives the sender's DONE until the receiver
+ *        confirms or refuses the file, so a RESUME after a failed digest still
+ *        reaches the sender; relays left without a verdict expire as the table
+ *        is searched.
+ * @author Oussama Amara
+ * @version 1.1
+ * @date 2026-10-17
+ */
+
+#include "relay.h"
+#include "client_registry.h"
+#include "file_transfer.h"
+#include "framing.h"
+#include "logger.h"
+#include "platform.h"
+#include "platform_thread.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define RELAY_MAX 64 ///< Relays in progress at once
+#define RELAY_LINGER_MS (TRANSFER_TIMEOUT * 1000LL) ///< How long a relay past DONE waits for the receiver's verdict
+
+/**
+ * @brief One file on its way from sender_id to receiver_id.
+ */
+typedef struct {
+    int sender_id;            ///< Client that owns the file (0 = free slot)
+    int receiver_id;          ///< Receiving client
+    char filename[128];       ///< Name of the file
+    long long bytes;          ///< Chunk payload bytes forwarded so far
+    int chunks;               ///< Chunks forwarded so far (retransmissions included)
+    long long started_ms;     ///< When the offer went through
+    long long done_ms;        ///< When the sender's DONE went through (0 = still sending)
+} Relay;
+
+static Relay relays[RELAY_MAX];
+static mutex_t relay_lock;
+
+void relay_init(void) {
+    mutex_init(&relay_lock);
+}
+
+/**
+ * @brief Frees a relay whose receiver gave no verdict within RELAY_LINGER_MS of
+ *        DONE. Call with relay_lock held.
+ * @return 1 if the slot is (now) free.
+ */
+static int relay_expire(Relay* r, long long now) {
+    if (r->sender_id == 0) return 1;
+    if (r->done_ms == 0 || now - r->done_ms < RELAY_LINGER_MS) return 0;
+    log_message(LOG_WARN, "[FILE] Relay of '%s' from client %d to client %d ended without a verdict from the receiver",
+                r->filename, r->sender_id, r->receiver_id);
+    memset(r, 0, sizeof(*r));
+    return 1;
+}
+
+/**
+ * @brief Relay between two clients (0, 0 = a free slot). Call with relay_lock held.
+ */
+static Relay* relay_find(int sender_id, int receiver_id) {
+    long long now = monotonic_ms();
+    for (int i = 0; i < RELAY_MAX; ++i) {
+        if (relay_expire(&relays[i], now) && sender_id != 0) continue;
+        if (relays[i].sender_id == sender_id && relays[i].receiver_id == receiver_id) return &relays[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Takes the relay between two clients, or a free slot. Call with relay_lock held.
+ */
+static Relay* relay_claim(int sender_id, int receiver_id, const char* filename) {
+    Relay* r = relay_find(sender_id, receiver_id);
+    if (!r) r = relay_find(0, 0);
+    if (!r) return NULL;
+    r->sender_id = sender_id;
+    r->receiver_id = receiver_id;
+    snprintf(r->filename, sizeof(r->filename), "%s", filename);
+    r->bytes = 0;
+    r->chunks = 0;
+    r->started_ms = monotonic_ms();
+    r->done_ms = 0;
+    return r;
+}
+
+int relay_open(int sender_id, int receiver_id, const char* filename) {
+    mutex_lock(&relay_lock);
+    Relay* r = relay_claim(sender_id, receiver_id, filename);
+    mutex_unlock(&relay_lock);
+    return r ? 0 : -1;
+}
+
+int relay_join(int sender_id, int receiver_id, const char* filename) {
+    mutex_lock(&relay_lock);
+    Relay* r = NULL;
+    long long now = monotonic_ms();
+    for (int i = 0; i < RELAY_MAX && !r; ++i)
+        if (!relay_expire(&relays[i], now) && relays[i].sender_id == sender_id && strcmp(relays[i].filename, filename) == 0)
+            r = &relays[i];
+    if (r && r->receiver_id != receiver_id) r = relay_claim(sender_id, receiver_id, filename);
+    else if (r) r->done_ms = 0;  // Re-fetch after a failed digest: the sender streams again
+    mutex_unlock(&relay_lock);
+    return r ? 0 : -1;
+}
+
+int relay_forward(const FrameView* view, int seq) {
+    mutex_lock(&relay_lock);
+    Relay* r = relay_find(view->src_id, view->dest_id);  // Sender → receiver
+    int to_receiver = r != NULL;
+    if (!r) r = relay_find(view->dest_id, view->src_id); // Receiver → sender
+    if (r && to_receiver && view->status == ST_CHUNK) {
+        r->bytes += view->payload.len;
+        r->chunks++;
+    }
+    mutex_unlock(&relay_lock);
+    if (!r) return -1;
+
+    int dest_fd = get_socket_by_id(view->dest_id);
+    if (dest_fd <= 0) return -1;
+
+    if (to_receiver && view->status == ST_CHUNK) return file_relay_chunk(view, dest_fd);
+    return send_chunk(dest_fd, channel_name(view->channel), view->src_id, view->dest_id,
+                      FRAME_VIEW_PTR(view, view->payload), view->payload.len, status_name(view->status),
+                      seq, view->is_final);
+}
+
+void relay_done(int sender_id, int receiver_id) {
+    mutex_lock(&relay_lock);
+    Relay* r = relay_find(sender_id, receiver_id);
+    if (r) r->done_ms = monotonic_ms();
+    mutex_unlock(&relay_lock);
+}
+
+void relay_close(int sender_id, int receiver_id) {
+    mutex_lock(&relay_lock);
+    Relay* r = relay_find(sender_id, receiver_id);
+    if (r) {
+        long long elapsed = monotonic_ms() - r->started_ms;
+        log_message(LOG_INFO, "[FILE] Relay of '%s' from client %d to client %d ended: %d chunk(s), %lld bytes in %lld ms",
+                    r->filename, sender_id, receiver_id, r->chunks, r->bytes, elapsed);
+        memset(r, 0, sizeof(*r));
+    }
+    mutex_unlock(&relay_lock);
+}
+
+void relay_drop_client(int client_id) {
+    mutex_lock(&relay_lock);
+    for (int i = 0; i < RELAY_MAX; ++i) {
+        Relay* r = &relays[i];
+        if (r->sender_id == 0 || (r->sender_id != client_id && r->receiver_id != client_id)) continue;
+        // An extra stream closes once its range is stored, with no verdict of its own
+        if (r->done_ms && client_id == r->receiver_id)
+            log_message(LOG_INFO, "[FILE] Relay of '%s' from client %d to client %d ended as the receiver left",
+                        r->filename, r->sender_id, r->receiver_id);
+        else
+            log_message(LOG_WARN, "[FILE] Client %d left; relay of '%s' from client %d to client %d dropped",
+                        client_id, r->filename, r->sender_id, r->receiver_id);
+        memset(r, 0, sizeof(*r));
+    }
+    mutex_unlock(&relay_lock);
+}
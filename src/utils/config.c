@@ -4,8 +4,8 @@
  *        Applies default values, then overrides from file and environment variables.
  *        Used by both server and client to configure host and ports.
  * @author Oussama Amara
- * @version 0.9
- * @date 2025-09-07
+ * @version 1.7
+ * @date 2026-10-17
  */
 /**
  * To do list:
@@ -30,6 +30,21 @@ int load_config(const char* path, Config* cfg) {
     cfg->port_chat = 8081;   // Default server ports
     cfg->port_file = 8082;
     cfg->port_game = 8083;
+    cfg->reactors = 1;       // Single event loop unless configured
+    cfg->pin_cpus = 0;
+    cfg->binary_protocol = 1; // Opt into binary v2 frames when the server offers them
+    cfg->crc32c = 1;          // Opt into CRC32C checksums when the server offers them
+    cfg->raw_transfer = 1;    // Opt into raw file data phases when the server offers them
+    cfg->compression = 1;     // Opt into LZ4 payload compression when the server offers it
+    cfg->chunk_size = 65536;  // File chunk size asked for in READY
+    cfg->file_window = 32;    // File chunks in flight before the sender waits for a SACK
+    cfg->max_transfers = 0;   // Transfer scheduler: no limits unless configured
+    cfg->transfer_rate = 0;
+    cfg->total_rate = 0;
+    cfg->background_size = 0;
+    cfg->hot_cache_size = 64LL * 1024 * 1024;
+    cfg->streams = 1;         // One connection per file unless configured
+    cfg->relay = 0;           // File requests name the server's copy unless relaying our own
     /**
      *  ovveride default values with config file if it exists
      */
@@ -55,6 +70,36 @@ int load_config(const char* path, Config* cfg) {
                 cfg->port_file = atoi(value);
             } else if (strcmp(key, "port_game") == 0) {
                 cfg->port_game = atoi(value);
+            } else if (strcmp(key, "reactors") == 0) {
+                cfg->reactors = atoi(value);
+            } else if (strcmp(key, "pin_cpus") == 0) {
+                cfg->pin_cpus = atoi(value);
+            } else if (strcmp(key, "protocol") == 0) {
+                cfg->binary_protocol = strcmp(value, "text") != 0;
+            } else if (strcmp(key, "checksum") == 0) {
+                cfg->crc32c = strcmp(value, "xor") != 0;
+            } else if (strcmp(key, "transfer") == 0) {
+                cfg->raw_transfer = strcmp(value, "chunked") != 0;
+            } else if (strcmp(key, "compression") == 0) {
+                cfg->compression = strcmp(value, "none") != 0;
+            } else if (strcmp(key, "chunk_size") == 0) {
+                cfg->chunk_size = atoi(value);
+            } else if (strcmp(key, "file_window") == 0) {
+                cfg->file_window = atoi(value);
+            } else if (strcmp(key, "max_transfers") == 0) {
+                cfg->max_transfers = atoi(value);
+            } else if (strcmp(key, "transfer_rate") == 0) {
+                cfg->transfer_rate = atoll(value);
+            } else if (strcmp(key, "total_rate") == 0) {
+                cfg->total_rate = atoll(value);
+            } else if (strcmp(key, "background_size") == 0) {
+                cfg->background_size = atoll(value);
+            } else if (strcmp(key, "hot_cache_size") == 0) {
+                cfg->hot_cache_size = atoll(value);
+            } else if (strcmp(key, "streams") == 0) {
+                cfg->streams = atoi(value);
+            } else if (strcmp(key, "relay") == 0) {
+                cfg->relay = strcmp(value, "on") == 0;
             }
         }
     }
@@ -92,6 +137,90 @@ int load_config(const char* path, Config* cfg) {
         log_message(LOG_INFO, "Overriding game port from environment: %s", env_game);
     }
 
+    const char* env_reactors = getenv("CONFIG_REACTORS");
+    if (env_reactors) {
+        cfg->reactors = atoi(env_reactors);
+        log_message(LOG_INFO, "Overriding reactor count from environment: %s", env_reactors);
+    }
+
+    const char* env_protocol = getenv("CONFIG_PROTOCOL");
+    if (env_protocol) {
+        cfg->binary_protocol = strcmp(env_protocol, "text") != 0;
+        log_message(LOG_INFO, "Overriding protocol from environment: %s", env_protocol);
+    }
+
+    const char* env_checksum = getenv("CONFIG_CHECKSUM");
+    if (env_checksum) {
+        cfg->crc32c = strcmp(env_checksum, "xor") != 0;
+        log_message(LOG_INFO, "Overriding checksum from environment: %s", env_checksum);
+    }
+
+    const char* env_transfer = getenv("CONFIG_TRANSFER");
+    if (env_transfer) {
+        cfg->raw_transfer = strcmp(env_transfer, "chunked") != 0;
+        log_message(LOG_INFO, "Overriding file transfer mode from environment: %s", env_transfer);
+    }
+
+    const char* env_compression = getenv("CONFIG_COMPRESSION");
+    if (env_compression) {
+        cfg->compression = strcmp(env_compression, "none") != 0;
+        log_message(LOG_INFO, "Overriding compression from environment: %s", env_compression);
+    }
+
+    const char* env_chunk = getenv("CONFIG_CHUNK_SIZE");
+    if (env_chunk) {
+        cfg->chunk_size = atoi(env_chunk);
+        log_message(LOG_INFO, "Overriding file chunk size from environment: %s", env_chunk);
+    }
+
+    const char* env_window = getenv("CONFIG_FILE_WINDOW");
+    if (env_window) {
+        cfg->file_window = atoi(env_window);
+        log_message(LOG_INFO, "Overriding file window from environment: %s", env_window);
+    }
+
+    const char* env_max_transfers = getenv("CONFIG_MAX_TRANSFERS");
+    if (env_max_transfers) {
+        cfg->max_transfers = atoi(env_max_transfers);
+        log_message(LOG_INFO, "Overriding concurrent transfers from environment: %s", env_max_transfers);
+    }
+
+    const char* env_transfer_rate = getenv("CONFIG_TRANSFER_RATE");
+    if (env_transfer_rate) {
+        cfg->transfer_rate = atoll(env_transfer_rate);
+        log_message(LOG_INFO, "Overriding per-transfer rate from environment: %s", env_transfer_rate);
+    }
+
+    const char* env_total_rate = getenv("CONFIG_TOTAL_RATE");
+    if (env_total_rate) {
+        cfg->total_rate = atoll(env_total_rate);
+        log_message(LOG_INFO, "Overriding total transfer rate from environment: %s", env_total_rate);
+    }
+
+    const char* env_background = getenv("CONFIG_BACKGROUND_SIZE");
+    if (env_background) {
+        cfg->background_size = atoll(env_background);
+        log_message(LOG_INFO, "Overriding background transfer size from environment: %s", env_background);
+    }
+
+    const char* env_hot_cache = getenv("CONFIG_HOT_CACHE_SIZE");
+    if (env_hot_cache) {
+        cfg->hot_cache_size = atoll(env_hot_cache);
+        log_message(LOG_INFO, "Overriding hot file cache size from environment: %s", env_hot_cache);
+    }
+
+    const char* env_streams = getenv("CONFIG_STREAMS");
+    if (env_streams) {
+        cfg->streams = atoi(env_streams);
+        log_message(LOG_INFO, "Overriding file streams from environment: %s", env_streams);
+    }
+
+    const char* env_relay = getenv("CONFIG_RELAY");
+    if (env_relay) {
+        cfg->relay = strcmp(env_relay, "on") == 0;
+        log_message(LOG_INFO, "Overriding file relay from environment: %s", env_relay);
+    }
+
     log_message(LOG_INFO, "Config loaded: host=%s, port=%d (chat=%d, file=%d, game=%d)",
                 cfg->host, cfg->port, cfg->port_chat, cfg->port_file, cfg->port_game);
 
@@ -1,18 +1,27 @@
 /**
  * @file crc.c
  * @brief Implements CRC generation and validation for protocol integrity.
+ *        CRC32C (Castagnoli) uses the SSE4.2 crc32 instruction when the CPU has it
+ *        and falls back to table-driven slicing-by-8 otherwise. XXH64 hashes
+ *        file chunks for end-to-end digests, in one call or as the bytes arrive.
  * @author Oussama Amara
- * @version 1.0
- * @date 2025-08-15
+ * @version 1.3
+ * @date 2026-10-17
  */
 
 #include "crc.h"
 #include <stdio.h>
 #include <string.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32C_HAVE_SSE42 1
+#include <nmmintrin.h>
+#endif
+
 void generate_crc(const char* input, char* out_crc) {
     unsigned char crc = 0;
-    for (size_t i = 0; i < strlen(input); ++i) {
+    size_t len = strlen(input);
+    for (size_t i = 0; i < len; ++i) {
         crc ^= input[i];
     }
     snprintf(out_crc, 8, "%02X", crc);
@@ -23,3 +32,279 @@ int validate_crc(const char* received_crc, const char* payload) {
     generate_crc(payload, expected);
     return strcmp(received_crc, expected) == 0;
 }
+
+int validate_crc_n(const char* received_crc, size_t crc_len, const char* payload, size_t len) {
+    unsigned char crc = 0;
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= payload[i];
+    }
+    static const char hex[] = "0123456789ABCDEF";
+    return crc_len == 2 && received_crc[0] == hex[crc >> 4] && received_crc[1] == hex[crc & 0xF];
+}
+
+uint32_t checksum32(const void* data, size_t len) {
+    const unsigned char* p = data;
+    uint32_t sum = 0;
+    for (size_t i = 0; i < len; ++i) {
+        sum = ((sum << 5) | (sum >> 27)) ^ p[i];
+    }
+    return sum;
+}
+
+// ─────────────────────────────────────────────────────────────
+// CRC32C
+// ─────────────────────────────────────────────────────────────
+
+#define CRC32C_POLY 0x82F63B78u  // Reflected Castagnoli polynomial
+
+static uint32_t crc32c_table[8][256];
+static int crc32c_ready;
+
+/**
+ * @brief Builds the slicing-by-8 tables. Concurrent callers write identical
+ *        values, so the first use needs no lock.
+ */
+static void crc32c_init_tables(void) {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) c = (c >> 1) ^ (CRC32C_POLY & (0u - (c & 1)));
+        crc32c_table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = crc32c_table[0][i];
+        for (int t = 1; t < 8; ++t) {
+            c = crc32c_table[0][c & 0xFF] ^ (c >> 8);
+            crc32c_table[t][i] = c;
+        }
+    }
+    __atomic_store_n(&crc32c_ready, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Portable CRC32C: eight bytes per step through eight lookup tables.
+ */
+static uint32_t crc32c_sw(uint32_t c, const unsigned char* p, size_t len) {
+    if (!__atomic_load_n(&crc32c_ready, __ATOMIC_ACQUIRE)) crc32c_init_tables();
+
+    while (len && ((uintptr_t)p & 7)) {
+        c = crc32c_table[0][(c ^ *p++) & 0xFF] ^ (c >> 8);
+        len--;
+    }
+    while (len >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        lo = __builtin_bswap32(lo);
+        hi = __builtin_bswap32(hi);
+#endif
+        lo ^= c;
+        c = crc32c_table[7][lo & 0xFF] ^ crc32c_table[6][(lo >> 8) & 0xFF] ^
+            crc32c_table[5][(lo >> 16) & 0xFF] ^ crc32c_table[4][lo >> 24] ^
+            crc32c_table[3][hi & 0xFF] ^ crc32c_table[2][(hi >> 8) & 0xFF] ^
+            crc32c_table[1][(hi >> 16) & 0xFF] ^ crc32c_table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) c = crc32c_table[0][(c ^ *p++) & 0xFF] ^ (c >> 8);
+    return c;
+}
+
+#ifdef CRC32C_HAVE_SSE42
+/**
+ * @brief CRC32C with the SSE4.2 crc32 instruction, eight bytes at a time.
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t c, const unsigned char* p, size_t len) {
+    while (len && ((uintptr_t)p & 7)) {
+        c = _mm_crc32_u8(c, *p++);
+        len--;
+    }
+#ifdef __x86_64__
+    uint64_t c64 = c;
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c64 = _mm_crc32_u64(c64, v);
+        p += 8;
+        len -= 8;
+    }
+    c = (uint32_t)c64;
+#endif
+    while (len >= 4) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        c = _mm_crc32_u32(c, v);
+        p += 4;
+        len -= 4;
+    }
+    while (len--) c = _mm_crc32_u8(c, *p++);
+    return c;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t len) {
+    const unsigned char* p = data;
+    uint32_t c = ~crc;
+#ifdef CRC32C_HAVE_SSE42
+    static int use_hw = -1;
+    int hw = __atomic_load_n(&use_hw, __ATOMIC_RELAXED);
+    if (hw < 0) {
+        __builtin_cpu_init();
+        hw = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+        __atomic_store_n(&use_hw, hw, __ATOMIC_RELAXED);
+    }
+    if (hw) return ~crc32c_hw(c, p, len);
+#endif
+    return ~crc32c_sw(c, p, len);
+}
+
+// ─────────────────────────────────────────────────────────────
+// XXH64
+// ─────────────────────────────────────────────────────────────
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+static uint64_t xxh_rotl(uint64_t v, int r) {
+    return (v << r) | (v >> (64 - r));
+}
+
+static uint64_t xxh_read64(const unsigned char* p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static uint32_t xxh_read32(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+static uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME64_2;
+    return xxh_rotl(acc, 31) * XXH_PRIME64_1;
+}
+
+static uint64_t xxh_merge(uint64_t acc, uint64_t lane) {
+    acc ^= xxh_round(0, lane);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+/**
+ * @brief Folds the four lanes into one state once 32 bytes or more were hashed.
+ */
+static uint64_t xxh_converge(const uint64_t v[4]) {
+    uint64_t h = xxh_rotl(v[0], 1) + xxh_rotl(v[1], 7) + xxh_rotl(v[2], 12) + xxh_rotl(v[3], 18);
+    for (int i = 0; i < 4; ++i) h = xxh_merge(h, v[i]);
+    return h;
+}
+
+/**
+ * @brief Mixes in the last (fewer than 32) bytes and avalanches the state.
+ */
+static uint64_t xxh_finish(uint64_t h, const unsigned char* p, const unsigned char* end) {
+    while (p + 8 <= end) {
+        h ^= xxh_round(0, xxh_read64(p));
+        h = xxh_rotl(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t)xxh_read32(p) * XXH_PRIME64_1;
+        h = xxh_rotl(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p++) * XXH_PRIME64_5;
+        h = xxh_rotl(h, 11) * XXH_PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t xxh64(const void* data, size_t len, uint64_t seed) {
+    const unsigned char* p = data;
+    const unsigned char* end = p + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        // Four independent lanes keep the multipliers busy in parallel
+        uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = seed + XXH_PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME64_1;
+        const unsigned char* limit = end - 32;
+        do {
+            v1 = xxh_round(v1, xxh_read64(p));
+            v2 = xxh_round(v2, xxh_read64(p + 8));
+            v3 = xxh_round(v3, xxh_read64(p + 16));
+            v4 = xxh_round(v4, xxh_read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = xxh_converge((const uint64_t[4]){ v1, v2, v3, v4 });
+    } else {
+        h = seed + XXH_PRIME64_5;
+    }
+    h += (uint64_t)len;
+    return xxh_finish(h, p, end);
+}
+
+void xxh64_reset(Xxh64State* s, uint64_t seed) {
+    s->v[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+    s->v[1] = seed + XXH_PRIME64_2;
+    s->v[2] = seed;
+    s->v[3] = seed - XXH_PRIME64_1;
+    s->seed = seed;
+    s->total = 0;
+    s->mem_len = 0;
+}
+
+/**
+ * @brief Runs one 32-byte stripe through the four lanes.
+ */
+static void xxh_stripe(uint64_t v[4], const unsigned char* p) {
+    for (int i = 0; i < 4; ++i) v[i] = xxh_round(v[i], xxh_read64(p + 8 * i));
+}
+
+void xxh64_update(Xxh64State* s, const void* data, size_t len) {
+    const unsigned char* p = data;
+    const unsigned char* end = p + len;
+    s->total += len;
+
+    if (s->mem_len + len < 32) {
+        memcpy(s->mem + s->mem_len, p, len);
+        s->mem_len += len;
+        return;
+    }
+    if (s->mem_len > 0) {
+        size_t fill = 32 - s->mem_len;
+        memcpy(s->mem + s->mem_len, p, fill);
+        xxh_stripe(s->v, s->mem);
+        p += fill;
+        s->mem_len = 0;
+    }
+    for (; p + 32 <= end; p += 32) xxh_stripe(s->v, p);
+    s->mem_len = (size_t)(end - p);
+    memcpy(s->mem, p, s->mem_len);
+}
+
+uint64_t xxh64_digest(const Xxh64State* s) {
+    uint64_t h = s->total >= 32 ? xxh_converge(s->v) : s->seed + XXH_PRIME64_5;
+    h += s->total;
+    return xxh_finish(h, s->mem, s->mem + s->mem_len);
+}
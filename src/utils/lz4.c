@@ -0,0 +1,207 @@
+/**
+ * @file lz4.c
+ * @brief LZ4 block compressor and decompressor.
+ *        Greedy matching through a 4096-entry hash table of 4-byte sequences,
+ *        with the usual skip acceleration: each miss in a row advances further,
+ *        so incompressible input costs little before it is given up on.
+ *        A dictionary is handled as history placed before the input.
+ * @author Oussama Amara
+ * @version 1.0
+ * @date 2026-10-17
+ */
+
+#include "lz4.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_MATCH 4
+#define LAST_LITERALS 5       ///< The block ends with at least this many literals
+#define MF_LIMIT 12           ///< No match may start in the last MF_LIMIT bytes
+#define MAX_OFFSET 65535
+#define HASH_BITS 12
+#define SKIP_TRIGGER 6        ///< Misses before the search step grows
+
+static uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t hash4(uint32_t v) {
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/**
+ * @brief Writes a length that does not fit the token nibble (the 15 is already in the token).
+ */
+static uint8_t* put_length(uint8_t* op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+/**
+ * @brief Compresses buf[start, end); buf[0, start) is history matches may refer to.
+ */
+static size_t compress_block(const uint8_t* buf, size_t start, size_t end, uint8_t* dst, size_t cap) {
+    uint32_t table[1 << HASH_BITS];
+    memset(table, 0, sizeof(table));
+    for (size_t p = start > MAX_OFFSET ? start - MAX_OFFSET : 0; p + MIN_MATCH <= start; ++p)
+        table[hash4(read32(buf + p))] = (uint32_t)p;
+
+    uint8_t* op = dst;
+    uint8_t* oend = dst + cap;
+    size_t anchor = start;
+    size_t ip = start;
+
+    if (end - start >= MF_LIMIT + 1) {
+        size_t mflimit = end - MF_LIMIT;
+        size_t matchlimit = end - LAST_LITERALS;
+        unsigned misses = 1u << SKIP_TRIGGER;
+
+        while (ip < mflimit) {
+            uint32_t seq = read32(buf + ip);
+            uint32_t h = hash4(seq);
+            size_t ref = table[h];
+            table[h] = (uint32_t)ip;
+            if (ref >= ip || ip - ref > MAX_OFFSET || read32(buf + ref) != seq) {
+                ip += misses++ >> SKIP_TRIGGER;
+                continue;
+            }
+
+            // Extend backwards over pending literals, then forwards
+            while (ip > anchor && ref > 0 && buf[ip - 1] == buf[ref - 1]) {
+                ip--;
+                ref--;
+            }
+            size_t len = MIN_MATCH;
+            while (ip + len < matchlimit && buf[ref + len] == buf[ip + len]) len++;
+
+            size_t literals = ip - anchor;
+            size_t match = len - MIN_MATCH;
+            if ((size_t)(oend - op) < 1 + literals / 255 + 1 + literals + 2 + match / 255 + 1) return 0;
+
+            uint8_t* token = op++;
+            *token = (uint8_t)((literals >= 15 ? 15 : literals) << 4);
+            if (literals >= 15) op = put_length(op, literals - 15);
+            memcpy(op, buf + anchor, literals);
+            op += literals;
+
+            size_t offset = ip - ref;
+            *op++ = (uint8_t)offset;
+            *op++ = (uint8_t)(offset >> 8);
+            *token |= (uint8_t)(match >= 15 ? 15 : match);
+            if (match >= 15) op = put_length(op, match - 15);
+
+            ip += len;
+            anchor = ip;
+            misses = 1u << SKIP_TRIGGER;
+            if (ip < mflimit) table[hash4(read32(buf + ip - 2))] = (uint32_t)(ip - 2);
+        }
+    }
+
+    size_t literals = end - anchor;
+    if ((size_t)(oend - op) < 1 + literals / 255 + 1 + literals) return 0;
+    uint8_t* token = op++;
+    *token = (uint8_t)((literals >= 15 ? 15 : literals) << 4);
+    if (literals >= 15) op = put_length(op, literals - 15);
+    memcpy(op, buf + anchor, literals);
+    op += literals;
+    return (size_t)(op - dst);
+}
+
+/**
+ * @brief Decodes into out[start, cap); out[0, start) is history offsets may reach.
+ */
+static long decompress_block(const uint8_t* src, size_t len, uint8_t* out, size_t start, size_t cap) {
+    const uint8_t* ip = src;
+    const uint8_t* iend = src + len;
+    size_t op = start;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        size_t literals = token >> 4;
+        if (literals == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                literals += b;
+            } while (b == 255);
+        }
+        if (literals > (size_t)(iend - ip) || literals > cap - op) return -1;
+        memcpy(out + op, ip, literals);
+        ip += literals;
+        op += literals;
+        if (ip == iend) break;  // The last sequence has no match
+
+        if (iend - ip < 2) return -1;
+        size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) return -1;
+
+        size_t match = token & 15;
+        if (match == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                match += b;
+            } while (b == 255);
+        }
+        match += MIN_MATCH;
+        if (match > cap - op) return -1;
+
+        const uint8_t* from = out + op - offset;
+        if (offset >= match) {
+            memcpy(out + op, from, match);
+        } else {
+            for (size_t i = 0; i < match; ++i) out[op + i] = from[i];  // Overlapping run
+        }
+        op += match;
+    }
+    return (long)(op - start);
+}
+
+size_t lz4_compress(const void* src, size_t len, void* dst, size_t cap) {
+    return compress_block(src, 0, len, dst, cap);
+}
+
+size_t lz4_compress_dict(const void* dict, size_t dict_len, const void* src, size_t len, void* dst, size_t cap) {
+    if (dict_len > MAX_OFFSET) {
+        dict = (const uint8_t*)dict + dict_len - MAX_OFFSET;
+        dict_len = MAX_OFFSET;
+    }
+    uint8_t stack[2048];
+    uint8_t* buf = dict_len + len <= sizeof(stack) ? stack : malloc(dict_len + len);
+    if (!buf) return 0;
+    memcpy(buf, dict, dict_len);
+    memcpy(buf + dict_len, src, len);
+    size_t n = compress_block(buf, dict_len, dict_len + len, dst, cap);
+    if (buf != stack) free(buf);
+    return n;
+}
+
+long lz4_decompress(const void* src, size_t len, void* dst, size_t cap) {
+    return decompress_block(src, len, dst, 0, cap);
+}
+
+long lz4_decompress_dict(const void* dict, size_t dict_len, const void* src, size_t len, void* dst, size_t cap) {
+    if (dict_len > MAX_OFFSET) {
+        dict = (const uint8_t*)dict + dict_len - MAX_OFFSET;
+        dict_len = MAX_OFFSET;
+    }
+    uint8_t stack[2048];
+    uint8_t* buf = dict_len + cap <= sizeof(stack) ? stack : malloc(dict_len + cap);
+    if (!buf) return -1;
+    memcpy(buf, dict, dict_len);
+    long n = decompress_block(src, len, buf, dict_len, dict_len + cap);
+    if (n > 0) memcpy(dst, buf + dict_len, (size_t)n);
+    if (buf != stack) free(buf);
+    return n;
+}
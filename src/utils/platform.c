@@ -3,12 +3,13 @@
  * @brief Cross-platform compatibility utilities.
  *       Provides functions for sleep and temporary directory retrieval.
  * @author Oussama Amara
- * @version 1.1
- * @date 2025-08-15
+ * @version 1.3
+ * @date 2026-10-17
  */
 
 #include "platform.h"
 #include "logger.h"
+#include "platform_thread.h"
 #ifdef _WIN32
 #include <windows.h>
 #include <direct.h>
@@ -20,6 +21,7 @@
 #include <stdlib.h>
 #include <limits.h>
 #include <sys/stat.h>
+#include <time.h>
 
 void sleep_ms(int milliseconds) {
 #ifdef _WIN32
@@ -28,6 +30,16 @@ void sleep_ms(int milliseconds) {
     usleep(milliseconds * 1000);
 #endif
 }
+long long monotonic_ms(void) {
+#ifdef _WIN32
+    return (long long)GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
 const char* get_temp_dir() {
 #ifdef _WIN32
     return getenv("TEMP") ? getenv("TEMP") : "C:\\Temp";
@@ -72,10 +84,16 @@ const char* get_working_directory_path() {
     }
 }
 
-const char* resolve_asset_path(const char* subfolder, const char* filename) {
-    static char full_path[PATH_MAX];
-    char cwd[PATH_MAX];
+/**
+ * @brief Walks up from the working directory to the first one holding assets/.
+ *        The result is kept, so later calls cost nothing; asset_index_init()
+ *        makes the first call before other threads start.
+ */
+const char* resolve_assets_root(void) {
+    static char root[PATH_MAX];
+    if (root[0]) return root;
 
+    char cwd[PATH_MAX];
     if (!getcwd(cwd, sizeof(cwd))) {
         log_message(LOG_ERROR, "[PATH] Failed to get current working directory.");
         return NULL;
@@ -87,8 +105,8 @@ const char* resolve_asset_path(const char* subfolder, const char* filename) {
 
         struct stat st;
         if (stat(test_path, &st) == 0 && S_ISDIR(st.st_mode)) {
-            snprintf(full_path, sizeof(full_path), "%s/assets/%s/%s", cwd, subfolder, filename);
-            return full_path;
+            snprintf(root, sizeof(root), "%s", test_path);
+            return root;
         }
 
         // Move up one directory
@@ -105,3 +123,11 @@ const char* resolve_asset_path(const char* subfolder, const char* filename) {
     return NULL;
 }
 
+const char* resolve_asset_path(const char* subfolder, const char* filename) {
+    static THREAD_LOCAL char full_path[PATH_MAX];  // Listener threads of parallel streams resolve concurrently
+    const char* root = resolve_assets_root();
+    if (!root) return NULL;
+
+    snprintf(full_path, sizeof(full_path), "%s/%s/%s", root, subfolder, filename);
+    return full_path;
+}
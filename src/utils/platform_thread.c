@@ -2,11 +2,15 @@
  * @file platform_thread.c
  * @brief Cross-platform thread abstraction for client handling.
  *        Uses pthreads on Linux/macOS and CreateThread on Windows.
+ *        Also provides mutexes, joining and CPU affinity for event-loop workers.
  * @author Oussama Amara
- * @version 1.0
- * @date 2025-08-15
+ * @version 1.1
+ * @date 2026-10-17
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // pthread_setaffinity_np
+#endif
 #include "platform_thread.h"
 
 #ifdef _WIN32
@@ -22,8 +26,33 @@ void detach_thread(thread_t thread) {
     CloseHandle(thread);
 }
 
+void join_thread(thread_t thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+int pin_current_thread(int cpu) {
+    if (cpu < 0 || cpu >= (int)(sizeof(DWORD_PTR) * 8)) return -1;
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) ? 0 : -1;
+}
+
+int cpu_count(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+void mutex_init(mutex_t* m) { InitializeCriticalSection(m); }
+void mutex_lock(mutex_t* m) { EnterCriticalSection(m); }
+void mutex_unlock(mutex_t* m) { LeaveCriticalSection(m); }
+void mutex_destroy(mutex_t* m) { DeleteCriticalSection(m); }
+
 #else
+#ifdef __linux__
+#include <sched.h>
+#endif
 #include <pthread.h>
+#include <unistd.h>
 
 int create_thread(thread_t* thread, THREAD_FUNC (*func)(void*), void* arg) {
     return pthread_create(thread, NULL, func, arg);
@@ -32,4 +61,30 @@ int create_thread(thread_t* thread, THREAD_FUNC (*func)(void*), void* arg) {
 void detach_thread(thread_t thread) {
     pthread_detach(thread);
 }
+void join_thread(thread_t thread) {
+    pthread_join(thread, NULL);
+}
+
+int pin_current_thread(int cpu) {
+#ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE) return -1;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 0 : -1;
+#else
+    (void)cpu;
+    return -1;
+#endif
+}
+
+int cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+void mutex_init(mutex_t* m) { pthread_mutex_init(m, NULL); }
+void mutex_lock(mutex_t* m) { pthread_mutex_lock(m); }
+void mutex_unlock(mutex_t* m) { pthread_mutex_unlock(m); }
+void mutex_destroy(mutex_t* m) { pthread_mutex_destroy(m); }
 #endif
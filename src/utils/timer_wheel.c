@@ -0,0 +1,155 @@
+/**
+ * @file timer_wheel.c
+ * @brief Hierarchical timer wheel.
+ *        Level L slot s holds timers due within 64^(L+1) ticks whose tick bits
+ *        [6L, 6L+6) equal s. Whenever level 0 wraps, the next slot of level 1 is
+ *        redistributed (and level 2 when level 1 wraps, and so on). Empty level-0
+ *        ticks are skipped with the occupancy bitmap.
+ * @author Oussama Amara
+ * @version 1.0
+ * @date 2026-10-17
+ */
+
+#include "timer_wheel.h"
+
+#include <string.h>
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+/**
+ * @brief Links a timer into the slot matching its expiry.
+ */
+static void wheel_place(TimerWheel* w, Timer* t) {
+    uint64_t delta = t->expires > w->tick ? t->expires - w->tick : 0;
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1ull << (TIMER_WHEEL_BITS * (level + 1)))) level++;
+
+    // Beyond the last level: park in the farthest slot, it cascades again later
+    uint64_t span = 1ull << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS);
+    uint64_t when = delta >= span ? w->tick + span - 1 : t->expires;
+    int slot = (int)((when >> (TIMER_WHEEL_BITS * level)) & SLOT_MASK);
+
+    Timer** head = &w->slots[level][slot];
+    t->next = *head;
+    if (*head) (*head)->pprev = &t->next;
+    *head = t;
+    t->pprev = head;
+    t->level = (uint8_t)level;
+    t->slot = (uint8_t)slot;
+    w->occupied[level] |= 1ull << slot;
+}
+
+static void wheel_unlink(TimerWheel* w, Timer* t) {
+    *t->pprev = t->next;
+    if (t->next) t->next->pprev = t->pprev;
+    if (!w->slots[t->level][t->slot]) w->occupied[t->level] &= ~(1ull << t->slot);
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+/**
+ * @brief Redistributes one slot of an upper level into the levels below.
+ * @return The slot index that was cascaded.
+ */
+static int wheel_cascade(TimerWheel* w, int level) {
+    int slot = (int)((w->tick >> (TIMER_WHEEL_BITS * level)) & SLOT_MASK);
+    Timer* t = w->slots[level][slot];
+    w->slots[level][slot] = NULL;
+    w->occupied[level] &= ~(1ull << slot);
+    while (t) {
+        Timer* next = t->next;
+        wheel_place(w, t);
+        t = next;
+    }
+    return slot;
+}
+
+void timer_wheel_init(TimerWheel* w, long long now_ms) {
+    memset(w, 0, sizeof(*w));
+    w->origin_ms = now_ms;
+    w->now_ms = now_ms;
+}
+
+void timer_init(Timer* t, TimerCallback callback, void* arg) {
+    memset(t, 0, sizeof(*t));
+    t->callback = callback;
+    t->arg = arg;
+}
+
+void timer_schedule(TimerWheel* w, Timer* t, long long delay_ms) {
+    if (t->pprev) wheel_unlink(w, t);
+    else w->count++;
+
+    if (delay_ms < 0) delay_ms = 0;
+    long long due = w->now_ms - w->origin_ms + delay_ms;
+    uint64_t expires = (uint64_t)((due + TIMER_WHEEL_TICK_MS - 1) / TIMER_WHEEL_TICK_MS);
+    t->expires = expires > w->tick ? expires : w->tick;
+    wheel_place(w, t);
+}
+
+void timer_cancel(TimerWheel* w, Timer* t) {
+    if (!t->pprev) return;
+    wheel_unlink(w, t);
+    w->count--;
+}
+
+int timer_pending(const Timer* t) {
+    return t->pprev != NULL;
+}
+
+void timer_wheel_advance(TimerWheel* w, long long now_ms) {
+    if (now_ms > w->now_ms) w->now_ms = now_ms;
+    uint64_t target = (uint64_t)((w->now_ms - w->origin_ms) / TIMER_WHEEL_TICK_MS);
+
+    while (w->tick <= target) {
+        if (w->count == 0) {
+            w->tick = target + 1;
+            break;
+        }
+
+        int index = (int)(w->tick & SLOT_MASK);
+        if (index == 0) {
+            for (int level = 1; level < TIMER_WHEEL_LEVELS && wheel_cascade(w, level) == 0; ++level) {
+            }
+        }
+
+        // Detach the slot first: callbacks may re-arm into it or free their owners
+        Timer* expired = w->slots[0][index];
+        w->slots[0][index] = NULL;
+        w->occupied[0] &= ~(1ull << index);
+        w->tick++;
+
+        while (expired) {
+            Timer* t = expired;
+            expired = t->next;
+            if (expired) expired->pprev = &expired;
+            t->next = NULL;
+            t->pprev = NULL;
+            w->count--;
+            t->callback(t->arg);
+        }
+
+        // Skip empty level-0 ticks up to the next wrap
+        unsigned pos = (unsigned)(w->tick & SLOT_MASK);
+        if (pos != 0) {
+            uint64_t ahead = w->occupied[0] >> pos;
+            uint64_t skip = ahead ? (uint64_t)__builtin_ctzll(ahead) : (uint64_t)(TIMER_WHEEL_SLOTS - pos);
+            w->tick = (w->tick + skip <= target + 1) ? w->tick + skip : target + 1;
+        }
+    }
+}
+
+int timer_wheel_timeout(const TimerWheel* w) {
+    if (w->count == 0) return -1;
+
+    // At a wrap the next tick cascades, so it may fire timers from upper levels
+    unsigned pos = (unsigned)(w->tick & SLOT_MASK);
+    uint64_t ahead = w->occupied[0] >> pos;
+    uint64_t next = pos == 0 ? w->tick
+                  : ahead ? w->tick + (uint64_t)__builtin_ctzll(ahead)
+                          : w->tick + (uint64_t)(TIMER_WHEEL_SLOTS - pos);
+
+    long long due = w->origin_ms + (long long)next * TIMER_WHEEL_TICK_MS - w->now_ms;
+    if (due < 0) return 0;
+    return due > 0x7FFFFFFF ? 0x7FFFFFFF : (int)due;
+}